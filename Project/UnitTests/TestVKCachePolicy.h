@@ -0,0 +1,13 @@
+//
+//  TestVKCachePolicy.h
+//  Project
+//
+//  Created by AndrewShmig on 10/16/13.
+//  Copyright (c) 2013 AndrewShmig. All rights reserved.
+//
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@interface TestVKCachePolicy : SenTestCase
+
+@end
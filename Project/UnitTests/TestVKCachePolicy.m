@@ -0,0 +1,127 @@
+//
+//  TestVKCachePolicy.m
+//  Project
+//
+//  Created by AndrewShmig on 10/16/13.
+//  Copyright (c) 2013 AndrewShmig. All rights reserved.
+//
+
+#import "TestVKCachePolicy.h"
+#import "VKCachePolicy.h"
+#import "VKUser.h"
+#import "VKStorage.h"
+#import "VKStorageItem.h"
+#import "VKAccessToken.h"
+
+
+@implementation TestVKCachePolicy
+
+- (void)testDefaultTable
+{
+    VKCachePolicyTable *table = [VKCachePolicyTable defaultTable];
+
+    STAssertTrue([table policyForMethod:@"users.get"].liveTime == VKCachedDataLiveTimeOneDay, @"Profiles should be cached for a day");
+    STAssertTrue([table policyForMethod:@"friends.getOnline"].liveTime == VKCachedDataLiveTimeOneMinute, @"Online status should be cached for a minute");
+    STAssertTrue([table policyForMethod:@"FRIENDS.GETONLINE"].liveTime == VKCachedDataLiveTimeOneMinute, @"Method names should be case insensitive");
+    STAssertFalse([table policyForMethod:@"photos.getUploadServer"].isCacheable, @"Upload servers should not be cached");
+    STAssertTrue([table policyForMethod:@"unknown.getItems"] == table.defaultPolicy, @"Unknown read methods should use the default policy");
+}
+
+- (void)testDefaultTableDoesNotServeStaleVolatileData
+{
+    VKCachePolicyTable *table = [VKCachePolicyTable defaultTable];
+
+    for (NSString *methodName in @[@"messages.get", @"messages.getDialogs", @"messages.getHistory",
+                                   @"friends.getOnline", @"account.getCounters", @"notifications.get"]) {
+        STAssertTrue([table policyForMethod:methodName].isCacheable, @"%@ should be cached", methodName);
+        STAssertTrue([table policyForMethod:methodName].staleGraceTime == 0, @"Stale %@ response should not be served", methodName);
+    }
+}
+
+- (void)testDefaultTableDoesNotCacheMutatingMethods
+{
+    VKCachePolicyTable *table = [VKCachePolicyTable defaultTable];
+
+    for (NSString *methodName in @[@"messages.send", @"messages.delete", @"likes.add", @"status.set",
+                                   @"wall.post", @"unknown.method"])
+        STAssertFalse([table policyForMethod:methodName].isCacheable, @"%@ should not be cached", methodName);
+
+//    явно установленная политика важнее
+    [table setPolicy:[VKCachePolicy policyWithLiveTime:VKCachedDataLiveTimeOneMinute]
+           forMethod:@"status.set"];
+
+    STAssertTrue([table policyForMethod:@"status.set"].isCacheable, @"Explicit policy should override mutating method policy");
+    STAssertTrue([[[VKCachePolicyTable alloc] init] policyForMethod:@"messages.send"].isCacheable, @"Empty table should use the default policy");
+}
+
+- (void)testPolicyOverrideIsAppliedToRequest
+{
+    VKCachePolicyTable *table = [VKCachePolicyTable defaultTable];
+    VKCachePolicy *policy = [[VKCachePolicy alloc]
+                                            initWithLiveTime:VKCachedDataLiveTimeOneWeek
+                                              staleGraceTime:60
+                                              useSharedCache:YES
+                                                    priority:VKRequestPriorityLow];
+
+    [table setPolicy:policy forMethod:@"users.get"];
+
+    VKRequest *request = [[VKRequest alloc] initWithMethod:@"users.get"
+                                                   options:@{@"uids" : @"1"}];
+
+    [[table policyForMethod:@"users.get"] applyToRequest:request];
+
+    STAssertTrue(request.cacheLiveTime == VKCachedDataLiveTimeOneWeek, @"Wrong cacheLiveTime");
+    STAssertTrue(request.staleGraceTime == 60, @"Wrong staleGraceTime");
+    STAssertTrue(request.useSharedCache, @"Request should use shared cache");
+    STAssertTrue(request.priority == VKRequestPriorityLow, @"Wrong priority");
+
+    [table removePolicyForMethod:@"users.get"];
+
+    STAssertTrue([table policyForMethod:@"users.get"] == table.defaultPolicy, @"Removed policy is still used");
+}
+
+- (void)testUserRequestsTakeCachePolicyFromTable
+{
+    VKAccessToken *token = [[VKAccessToken alloc]
+                                           initWithUserID:1
+                                              accessToken:@"1"
+                                           expirationTime:0
+                                              permissions:@[@"offline"]];
+    VKStorageItem *item = [[VKStorage sharedStorage]
+                                      createStorageItemForAccessToken:token];
+    [[VKStorage sharedStorage] addItem:item];
+    [VKUser activateUserWithID:1];
+
+    VKUser *user = [VKUser currentUser];
+    user.startAllRequestsImmediately = NO;
+
+    VKRequest *request = [user wallPostWithCustomOptions:@{@"message" : @"1"}];
+
+    STAssertTrue(request.cacheLiveTime == VKCachedDataLiveTimeNever, @"Mutating method should not be cached by default");
+    STAssertFalse(request.isIdempotent, @"Mutating method should not be idempotent");
+
+//    таблица - единственный источник кэшируемости, явная политика важнее
+    [user.cachePolicyTable setPolicy:[VKCachePolicy policyWithLiveTime:VKCachedDataLiveTimeOneMinute]
+                           forMethod:@"wall.post"];
+
+    request = [user wallPostWithCustomOptions:@{@"message" : @"1"}];
+
+    STAssertTrue(request.cacheLiveTime == VKCachedDataLiveTimeOneMinute, @"Explicit table policy should be applied");
+    STAssertFalse(request.isIdempotent, @"Table policy should not change idempotency");
+
+    request = [user infoWithCustomOptions:@{@"uids" : @"1"}];
+
+    STAssertTrue(request.cacheLiveTime == VKCachedDataLiveTimeOneDay, @"Profiles should be cached for a day");
+    STAssertTrue(request.isIdempotent, @"users.get should be idempotent");
+//    общий кэш также определяется только таблицей
+    STAssertTrue(request.useSharedCache, @"Profiles requested without token should use shared cache");
+
+    [user.cachePolicyTable setPolicy:[VKCachePolicy policyWithLiveTime:VKCachedDataLiveTimeOneDay]
+                           forMethod:@"users.get"];
+
+    STAssertFalse([user infoWithCustomOptions:@{@"uids" : @"1"}].useSharedCache, @"Table policy should disable shared cache");
+
+    [[VKStorage sharedStorage] clean];
+}
+
+@end
@@ -6,13 +6,94 @@
 //  Copyright (c) 2013 AndrewShmig. All rights reserved.
 //
 
+#import <spawn.h>
+#import <sys/wait.h>
 #import "TestVKCachedData.h"
 #import "VKCachedData.h"
+#import "VKCachedDataRecord.h"
+#import "VKCacheIndex.h"
+#import "VKCacheKey.h"
+#import "VKCachedDataSegmentStore.h"
+#import "VKCachedDataFileStore.h"
+#import "VKCacheDirectoryLock.h"
+#import "VKCachePack.h"
+#import "VKCacheTagRules.h"
 #import "NSString+toBase64.h"
+#import "NSData+compression.h"
+
+
+// переменные окружения дочерних процессов testMultiProcessCachesShareDirectoryAcrossProcesses
+static NSString *const kTestVKCachedDataChildPathVariable = @"VK_CACHED_DATA_TEST_PATH";
+static NSString *const kTestVKCachedDataChildWriterVariable = @"VK_CACHED_DATA_TEST_WRITER";
+static NSUInteger const kTestVKCachedDataChildKeysCount = 50;
 
 
 @implementation TestVKCachedData
 
+#pragma mark - helpers
+
+- (BOOL)writePayload:(NSData *)payload
+             toStore:(id <VKCachedDataStore>)store
+              forKey:(NSString *)key
+{
+    VKCachedDataRecordHeader header;
+
+    [VKCachedDataRecord fillHeader:&header
+                       withPayload:payload
+                          liveTime:VKCachedDataLiveTimeOneHour
+                 creationTimestamp:1000];
+
+    return [store writeRecordWithHeader:&header
+                                payload:payload
+                                 forKey:key];
+}
+
+// запускает тестовый метод в отдельном процессе тестовой программы
+- (pid_t)spawnTestMethod:(NSString *)testName
+             environment:(NSDictionary *)variables
+{
+    NSMutableArray *arguments = [[[NSProcessInfo processInfo] arguments] mutableCopy];
+    NSString *test = [NSString stringWithFormat:@"%@/%@", NSStringFromClass([self class]), testName];
+    NSUInteger testOptionIndex = [arguments indexOfObject:@"-SenTest"];
+
+    if (NSNotFound == testOptionIndex || testOptionIndex + 1 >= [arguments count])
+        [arguments insertObjects:@[@"-SenTest", test]
+                       atIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(1, 2)]];
+    else
+        arguments[testOptionIndex + 1] = test;
+
+    NSMutableDictionary *environment = [[[NSProcessInfo processInfo] environment] mutableCopy];
+    [environment addEntriesFromDictionary:variables];
+
+    char **argv = calloc([arguments count] + 1, sizeof(char *));
+    char **envp = calloc([environment count] + 1, sizeof(char *));
+    NSUInteger i = 0;
+
+    for (NSString *argument in arguments)
+        argv[i++] = strdup([argument UTF8String]);
+
+    i = 0;
+
+    for (NSString *name in environment)
+        envp[i++] = strdup([[NSString stringWithFormat:@"%@=%@", name, environment[name]] UTF8String]);
+
+    pid_t pid = -1;
+
+    if (0 != posix_spawn(&pid, [[[NSBundle mainBundle] executablePath] fileSystemRepresentation], NULL, NULL, argv, envp))
+        pid = -1;
+
+    for (i = 0; NULL != argv[i]; i++)
+        free(argv[i]);
+
+    for (i = 0; NULL != envp[i]; i++)
+        free(envp[i]);
+
+    free(argv);
+    free(envp);
+
+    return pid;
+}
+
 #pragma mark - initWithCacheDirectory: tests
 
 - (void)testInitialization
@@ -142,4 +223,1166 @@
     STAssertTrue(YES, @"Always true");
 }
 
+#pragma mark - memory cache tests
+
+- (void)testCachedDataIsAvailableRightAfterAdding
+{
+    NSString *path = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) lastObject];
+    NSString *myCachePath = [path stringByAppendingFormat:@"/Vkontakte-iOS-SDK-v2.0/Caches/58789857/"];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:myCachePath];
+
+    NSURL *url = [NSURL URLWithString:@"https://api.vk.com/method/users.get?uids=1"];
+    NSData *data = [@"{\"response\":[]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    [cachedData addCachedData:data forURL:url];
+
+//    данные должны быть получены из оперативной памяти, не дожидаясь записи на диск
+    STAssertEqualObjects([cachedData cachedDataForURL:url], data, @"Cached data should be returned from memory");
+
+    [cachedData removeCachedDataForURL:url];
+    STAssertNil([cachedData cachedDataForURL:url], @"Cached data should be removed from memory");
+}
+
+- (void)testStaleCachedDataWithinGraceTime
+{
+    NSString *path = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) lastObject];
+    NSString *myCachePath = [path stringByAppendingFormat:@"/Vkontakte-iOS-SDK-v2.0/Caches/58789857/"];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:myCachePath];
+
+    NSURL *url = [NSURL URLWithString:@"https://api.vk.com/method/users.get?uids=2"];
+    NSData *data = [@"{\"response\":[]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    [cachedData addCachedData:data
+                       forURL:url
+                     liveTime:VKCachedDataLiveTimeNever];
+
+//    ждём истечения срока жизни
+    [NSThread sleepForTimeInterval:2.0];
+
+    BOOL isStale = NO;
+    NSData *staleData = [cachedData cachedDataForURL:url
+                                         offlineMode:NO
+                                      staleGraceTime:VKCachedDataLiveTimeOneMinute
+                                             isStale:&isStale];
+
+    STAssertEqualObjects(staleData, data, @"Stale data should be returned within grace time");
+    STAssertTrue(isStale, @"Data should be marked as stale");
+
+    STAssertNil([cachedData cachedDataForURL:url], @"Stale data should not be returned without grace time");
+}
+
+- (void)testDisabledMemoryCache
+{
+    NSString *path = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) lastObject];
+    NSString *myCachePath = [path stringByAppendingFormat:@"/Vkontakte-iOS-SDK-v2.0/Caches/58789857/"];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:myCachePath];
+    cachedData.memoryCacheSize = 0;
+
+    STAssertTrue(cachedData.memoryCacheSize == 0, @"memoryCacheSize != 0");
+}
+
+#pragma mark - binary record tests
+
+- (void)testRecordWriteAndRead
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"VKCachedDataRecordTest"];
+    NSData *payload = [@"{\"response\":[1,2,3]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    BOOL written = [VKCachedDataRecord writeRecordWithPayload:payload
+                                                     liveTime:VKCachedDataLiveTimeOneDay
+                                            creationTimestamp:1372500000
+                                                       toFile:path];
+    STAssertTrue(written, @"Record was not written");
+
+    VKCachedDataRecord *record = [VKCachedDataRecord recordWithContentsOfFile:path];
+
+    STAssertNotNil(record, @"Record was not read");
+    STAssertEqualObjects(record.payload, payload, @"Wrong record payload");
+    STAssertTrue(record.liveTime == VKCachedDataLiveTimeOneDay, @"Wrong record live time");
+    STAssertTrue(record.creationTimestamp == 1372500000, @"Wrong record creation timestamp");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testCorruptedRecordIsRejected
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"VKCachedDataRecordTest"];
+    NSData *payload = [@"{\"response\":[1,2,3]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    [VKCachedDataRecord writeRecordWithPayload:payload
+                                      liveTime:VKCachedDataLiveTimeOneDay
+                             creationTimestamp:1372500000
+                                        toFile:path];
+
+//    портим последний байт данных
+    NSMutableData *corrupted = [NSMutableData dataWithContentsOfFile:path];
+    ((uint8_t *) [corrupted mutableBytes])[[corrupted length] - 1] ^= 0xFF;
+    [corrupted writeToFile:path atomically:YES];
+
+    STAssertNil([VKCachedDataRecord recordWithContentsOfFile:path], @"Corrupted record should be rejected");
+
+//    файлы в старом формате (plist) так же не должны читаться
+    [@{@"data" : payload} writeToFile:path atomically:YES];
+    STAssertNil([VKCachedDataRecord recordWithContentsOfFile:path], @"Plist record should be rejected");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+#pragma mark - compression tests
+
+- (void)testCompressionRoundtrip
+{
+    NSMutableString *json = [NSMutableString stringWithString:@"{\"response\":["];
+
+    for (NSUInteger i = 0; i < 500; i++)
+        [json appendFormat:@"{\"uid\":%u,\"first_name\":\"Ivan\",\"last_name\":\"Petrov\"},", i];
+
+    NSData *data = [json dataUsingEncoding:NSUTF8StringEncoding];
+
+    NSData *lz4Data = [data LZ4CompressedData];
+    STAssertTrue([lz4Data length] < [data length], @"LZ4 did not compress data");
+    STAssertEqualObjects([lz4Data LZ4DecompressedDataWithLength:[data length]], data, @"Wrong LZ4 roundtrip");
+    STAssertNil([lz4Data LZ4DecompressedDataWithLength:[data length] + 1], @"Wrong length should be rejected");
+
+    NSData *zlibData = [data zlibCompressedData];
+    STAssertTrue([zlibData length] < [data length], @"zlib did not compress data");
+    STAssertEqualObjects([zlibData zlibDecompressedDataWithLength:[data length]], data, @"Wrong zlib roundtrip");
+}
+
+- (void)testCompressedRecordWriteAndRead
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"VKCachedDataRecordTest"];
+    NSMutableData *payload = [NSMutableData dataWithLength:64 * 1024];
+    memset([payload mutableBytes], 'a', 1024);
+
+    VKCachedDataRecordHeader header;
+    NSData *storedPayload = [VKCachedDataRecord fillHeader:&header
+                                               withPayload:payload
+                                                  liveTime:VKCachedDataLiveTimeOneDay
+                                         creationTimestamp:1372500000
+                                               compression:VKCachedDataCompressionLZ4];
+
+    STAssertTrue(header.flags & kVKCachedDataRecordFlagCompressionLZ4, @"Record should be compressed");
+    STAssertTrue(header.logicalLength == [payload length], @"Wrong logical length");
+    STAssertTrue(header.length == [storedPayload length] && header.length < header.logicalLength, @"Wrong stored length");
+
+    [VKCachedDataRecord writeRecordWithHeader:&header
+                                      payload:storedPayload
+                                       toFile:path];
+
+    VKCachedDataRecord *record = [VKCachedDataRecord recordWithContentsOfFile:path];
+
+    STAssertEqualObjects(record.payload, payload, @"Wrong decompressed payload");
+    STAssertTrue(record.storedLength == [storedPayload length], @"Wrong record stored length");
+
+//    несжимаемые данные хранятся как есть
+    uint8_t randomBytes[256];
+    arc4random_buf(randomBytes, sizeof(randomBytes));
+    NSData *randomPayload = [NSData dataWithBytes:randomBytes length:sizeof(randomBytes)];
+
+    storedPayload = [VKCachedDataRecord fillHeader:&header
+                                       withPayload:randomPayload
+                                          liveTime:VKCachedDataLiveTimeOneDay
+                                 creationTimestamp:1372500000
+                                       compression:VKCachedDataCompressionZlib];
+
+    STAssertTrue(0 == header.flags, @"Incompressible record should be stored as is");
+    STAssertEqualObjects(storedPayload, randomPayload, @"Wrong stored payload");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testDecompressedPayloadIsKeptInMemory
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingString:@"VKCachedDataCompressionTest/"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    NSString *key = [VKCacheKey keyForData:[@"friends.get?uid=1" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSMutableString *json = [NSMutableString stringWithString:@"{\"response\":["];
+
+    for (NSUInteger i = 0; i < 512; i++)
+        [json appendFormat:@"{\"uid\":%lu,\"online\":0},", (unsigned long) i];
+
+    [json appendString:@"{}]}"];
+
+    NSData *payload = [json dataUsingEncoding:NSUTF8StringEncoding];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:path];
+
+    STAssertTrue([payload length] >= cachedData.compressionThreshold, @"Typical response should be compressed by default");
+
+    [cachedData addCachedData:payload forKey:key liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData flush];
+
+    STAssertTrue(cachedData.size < cachedData.logicalSize, @"Payload was not compressed");
+
+//    первое чтение распаковывает запись с диска, последующие берут данные из памяти
+    VKCachedData *reopenedCachedData = [[VKCachedData alloc]
+                                                      initWithCacheDirectory:path];
+    NSData *firstRead = [reopenedCachedData cachedDataForKey:key offlineMode:NO staleGraceTime:0 isStale:NULL];
+    NSData *secondRead = [reopenedCachedData cachedDataForKey:key offlineMode:NO staleGraceTime:0 isStale:NULL];
+
+    STAssertEqualObjects(firstRead, payload, @"Wrong decompressed payload");
+    STAssertTrue(firstRead == secondRead, @"Payload was decompressed again");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+#pragma mark - index tests
+
+- (void)testIndexSaveAndLoad
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"VKCacheIndexTest"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    VKCacheIndex *index = [[VKCacheIndex alloc] initWithContentsOfFile:path];
+    STAssertFalse(index.isLoaded, @"Index file should not exist");
+
+    VKCacheIndexEntry *entry = [[VKCacheIndexEntry alloc] init];
+    entry.key = @"0123456789abcdef0123456789abcdef";
+    entry.size = 1024;
+    entry.creationTimestamp = 1372500000;
+    entry.liveTime = VKCachedDataLiveTimeOneHour;
+    entry.lastAccessTimestamp = 1372500100;
+    entry.accessCount = 3;
+
+    [index setEntry:entry];
+    [index saveIfNeeded];
+
+    VKCacheIndex *loadedIndex = [[VKCacheIndex alloc] initWithContentsOfFile:path];
+    VKCacheIndexEntry *loadedEntry = [loadedIndex entryForKey:entry.key];
+
+    STAssertTrue(loadedIndex.isLoaded, @"Index was not loaded");
+    STAssertTrue(loadedIndex.count == 1, @"count != 1");
+    STAssertTrue(loadedIndex.totalSize == 1024, @"totalSize != 1024");
+    STAssertTrue(loadedEntry.size == entry.size, @"Wrong entry size");
+    STAssertTrue(loadedEntry.creationTimestamp == entry.creationTimestamp, @"Wrong entry creation timestamp");
+    STAssertTrue(loadedEntry.liveTime == entry.liveTime, @"Wrong entry live time");
+    STAssertTrue(loadedEntry.lastAccessTimestamp == entry.lastAccessTimestamp, @"Wrong entry last access timestamp");
+    STAssertTrue(loadedEntry.accessCount == entry.accessCount, @"Wrong entry access count");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testIndexAccessStatisticsAreSavedOnFlush
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"VKCacheIndexTest"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    VKCacheIndex *index = [[VKCacheIndex alloc] initWithContentsOfFile:path];
+
+    VKCacheIndexEntry *entry = [[VKCacheIndexEntry alloc] init];
+    entry.key = @"0123456789abcdef0123456789abcdef";
+    entry.size = 1024;
+    entry.lastAccessTimestamp = 1372500000;
+
+    [index setEntry:entry];
+    [index saveIfNeeded];
+
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil];
+
+//    обращения к записям хранятся в памяти и сами по себе индекс не сохраняют
+    [index touchEntryForKey:entry.key atTimestamp:1372500100];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    [index saveIfNeeded];
+
+    STAssertNotNil(attributes, @"Index was not saved");
+    STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path], @"Access should not save the index");
+
+    [index flush];
+
+    VKCacheIndexEntry *loadedEntry = [[[VKCacheIndex alloc] initWithContentsOfFile:path] entryForKey:entry.key];
+
+    STAssertTrue(loadedEntry.lastAccessTimestamp == 1372500100, @"Access statistics were not saved on flush");
+    STAssertTrue(loadedEntry.accessCount == 1, @"Wrong entry access count");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testIndexGenerationChangesOnlyWithEntries
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"VKCacheIndexTest"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    NSLock *lock = [[NSLock alloc] init];
+    VKCacheIndex *index = [[VKCacheIndex alloc] initWithContentsOfFile:path lock:lock];
+    VKCacheIndex *otherIndex = [[VKCacheIndex alloc] initWithContentsOfFile:path lock:lock];
+
+    VKCacheIndexEntry *entry = [[VKCacheIndexEntry alloc] init];
+    entry.key = @"0123456789abcdef0123456789abcdef";
+    entry.size = 1024;
+
+    [index setEntry:entry];
+    [index synchronize];
+    [otherIndex synchronize];
+
+    STAssertFalse([otherIndex isChangedOnDisk], @"Index should be synchronized");
+
+//    статистика обращений сохраняется без смены поколения
+    [index touchEntryForKey:entry.key atTimestamp:1372500100];
+    [index flush];
+
+    STAssertFalse([otherIndex isChangedOnDisk], @"Access statistics should not change the generation");
+    STAssertTrue([[[VKCacheIndex alloc] initWithContentsOfFile:path] entryForKey:entry.key].accessCount == 1, @"Access statistics were not saved");
+
+    [index removeEntryForKey:entry.key];
+    [index synchronize];
+
+    STAssertTrue([otherIndex isChangedOnDisk], @"Removed entry should change the generation");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testIndexEntryExpiration
+{
+    VKCacheIndexEntry *entry = [[VKCacheIndexEntry alloc] init];
+    entry.creationTimestamp = 1000;
+    entry.liveTime = VKCachedDataLiveTimeOneMinute;
+
+    STAssertFalse([entry isExpiredAtTimestamp:1060], @"Entry should not be expired");
+    STAssertTrue([entry isExpiredAtTimestamp:1061], @"Entry should be expired");
+}
+
+- (void)testEvictionOrder
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"VKCacheIndexTest"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    VKCacheIndex *index = [[VKCacheIndex alloc] initWithContentsOfFile:path];
+
+    VKCacheIndexEntry *frequentEntry = [[VKCacheIndexEntry alloc] init];
+    frequentEntry.key = @"00000000000000000000000000000001";
+    frequentEntry.lastAccessTimestamp = 1000;
+    frequentEntry.accessCount = 10;
+
+    VKCacheIndexEntry *recentEntry = [[VKCacheIndexEntry alloc] init];
+    recentEntry.key = @"00000000000000000000000000000002";
+    recentEntry.lastAccessTimestamp = 2000;
+    recentEntry.accessCount = 1;
+
+    [index setEntry:frequentEntry];
+    [index setEntry:recentEntry];
+
+//    LRU: первой вытесняется давно использованная запись
+    NSArray *lruEntries = [index entriesSortedForEvictionPolicy:VKCachedDataEvictionPolicyLRU];
+    STAssertEqualObjects([lruEntries[0] key], frequentEntry.key, @"Least recently used entry should be evicted first");
+
+//    LFU: первой вытесняется редко использованная запись
+    NSArray *lfuEntries = [index entriesSortedForEvictionPolicy:VKCachedDataEvictionPolicyLFU];
+    STAssertEqualObjects([lfuEntries[0] key], recentEntry.key, @"Least frequently used entry should be evicted first");
+
+    [index touchEntryForKey:recentEntry.key atTimestamp:3000];
+    STAssertTrue([index entryForKey:recentEntry.key].accessCount == 2, @"Access count was not incremented");
+    STAssertTrue([index entryForKey:recentEntry.key].lastAccessTimestamp == 3000, @"Last access timestamp was not updated");
+}
+
+- (void)testExpiredEntriesAreReturnedInBatches
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"VKCacheIndexTest"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    VKCacheIndex *index = [[VKCacheIndex alloc] initWithContentsOfFile:path];
+
+    for (NSUInteger i = 0; i < 5; i++) {
+        VKCacheIndexEntry *entry = [[VKCacheIndexEntry alloc] init];
+        entry.key = [NSString stringWithFormat:@"0000000000000000000000000000000%lu", (unsigned long) i];
+        entry.creationTimestamp = 1000;
+        entry.liveTime = (i < 3 ? VKCachedDataLiveTimeOneMinute : VKCachedDataLiveTimeOneHour);
+
+        [index setEntry:entry];
+    }
+
+    STAssertTrue([[index expiredEntriesAtTimestamp:2000 limit:10] count] == 3, @"Wrong expired entries count");
+    STAssertTrue([[index expiredEntriesAtTimestamp:2000 limit:2] count] == 2, @"Batch limit was ignored");
+    STAssertTrue([[index expiredEntriesAtTimestamp:1000 limit:10] count] == 0, @"Entries should not be expired");
+}
+
+- (void)testMissIsAnsweredByIndex
+{
+    NSString *path = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) lastObject];
+    NSString *myCachePath = [path stringByAppendingFormat:@"/Vkontakte-iOS-SDK-v2.0/Caches/58789857/"];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:myCachePath];
+
+    NSURL *url = [NSURL URLWithString:@"https://api.vk.com/method/users.get?uids=0"];
+
+    STAssertNil([cachedData cachedDataForURL:url offlineMode:YES], @"Unknown URL should not be cached");
+}
+
+#pragma mark - cache key tests
+
+- (void)testCacheKeyHash
+{
+    NSData *data = [@"hello" dataUsingEncoding:NSUTF8StringEncoding];
+
+//    эталонное значение MurmurHash3 x64_128
+    STAssertEqualObjects([VKCacheKey keyForData:data], @"029bbd41b3a7d8cb191dae486a901e5b", @"Wrong hash");
+    STAssertEqualObjects([VKCacheKey keyForData:[NSData data]], @"00000000000000000000000000000000", @"Wrong empty data hash");
+    STAssertEqualObjects([VKCacheKey keyForData:[@"The quick brown fox jumps over the lazy dog" dataUsingEncoding:NSUTF8StringEncoding]],
+                         @"6c1b07bc7bbc4be347939ac4a93c437a",
+                         @"Wrong multi-block data hash");
+}
+
+- (void)testCacheKeyIgnoresAccessToken
+{
+    NSString *key1 = [VKCacheKey keyForMethod:@"users.get"
+                                      options:@{@"uids" : @"1", @"fields" : @"bdate", @"access_token" : @"token1"}];
+    NSString *key2 = [VKCacheKey keyForMethod:@"users.get"
+                                      options:@{@"fields" : @"bdate", @"uids" : @"1", @"access_token" : @"token2"}];
+    NSString *key3 = [VKCacheKey keyForMethod:@"users.get"
+                                      options:@{@"uids" : @"2", @"fields" : @"bdate"}];
+
+    STAssertEqualObjects(key1, key2, @"Keys of the same request should be equal");
+    STAssertFalse([key1 isEqualToString:key3], @"Keys of different requests should differ");
+    STAssertTrue([key1 length] == 32, @"Wrong key length");
+
+    NSURL *url1 = [NSURL URLWithString:@"https://api.vk.com/method/users.get?uids=1&access_token=token1"];
+    NSURL *url2 = [NSURL URLWithString:@"https://api.vk.com/method/users.get?uids=1&access_token=token2"];
+
+    STAssertEqualObjects([VKCacheKey keyForURL:url1], [VKCacheKey keyForURL:url2], @"URL keys should not depend on access token");
+}
+
+- (void)testCacheKeyAcceptsNilMethodAndNonStringValues
+{
+    NSString *numberKey = [VKCacheKey keyForMethod:@"users.get"
+                                           options:@{@"uids" : @1, @"count" : @[@1, @2]}];
+    NSString *stringKey = [VKCacheKey keyForMethod:@"users.get"
+                                           options:@{@"uids" : @"1", @"count" : [@[@1, @2] description]}];
+
+    STAssertEqualObjects(numberKey, stringKey, @"Non-string values should be keyed by their description");
+    STAssertTrue([[VKCacheKey keyForMethod:nil options:@{@"uids" : [NSNull null]}] length] == 32, @"Key without method name should be built");
+}
+
+#pragma mark - segment store tests
+
+- (void)testSegmentStoreWriteReadRemove
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"VKCachedDataSegmentStoreTest/"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    NSString *key1 = [VKCacheKey keyForData:[@"1" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSString *key2 = [VKCacheKey keyForData:[@"2" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSData *data1 = [@"{\"response\":[1]}" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *data2 = [@"{\"response\":[2]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    VKCachedDataSegmentStore *store = [[VKCachedDataSegmentStore alloc] initWithDirectory:path];
+
+    STAssertTrue([self writePayload:data1 toStore:store forKey:key1], @"Write failed");
+    STAssertTrue([self writePayload:data2 toStore:store forKey:key2], @"Write failed");
+    [store removeRecordForKey:key2];
+
+    STAssertEqualObjects([store recordForKey:key1].payload, data1, @"Wrong record payload");
+    STAssertNil([store recordForKey:key2], @"Removed record should not be read");
+    STAssertTrue(store.segmentsCount == 1, @"Records should be appended to a single segment");
+
+//    положение записей восстанавливается по сегментам, надгробие скрывает удалённую запись
+    VKCachedDataSegmentStore *reopenedStore = [[VKCachedDataSegmentStore alloc] initWithDirectory:path];
+
+    STAssertEqualObjects([reopenedStore recordForKey:key1].payload, data1, @"Record was not restored");
+    STAssertNil([reopenedStore recordForKey:key2], @"Removed record was restored");
+
+    [reopenedStore removeAllRecords];
+    STAssertNil([reopenedStore recordForKey:key1], @"Records were not removed");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testSegmentStoreCompaction
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"VKCachedDataSegmentStoreTest/"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    VKCachedDataSegmentStore *store = [[VKCachedDataSegmentStore alloc] initWithDirectory:path];
+    NSMutableData *payload = [NSMutableData dataWithLength:512 * 1024];
+    NSString *liveKey = [VKCacheKey keyForData:[@"live" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSString *deadKey = [VKCacheKey keyForData:[@"dead" dataUsingEncoding:NSUTF8StringEncoding]];
+
+    [self writePayload:payload toStore:store forKey:liveKey];
+
+//    многократная перезапись одной записи заполняет сегменты "мёртвыми" данными
+    for (NSUInteger i = 0; i < 20; i++)
+        [self writePayload:payload toStore:store forKey:deadKey];
+
+    NSUInteger totalSize = store.totalSize;
+
+    [store compact];
+
+    STAssertTrue(store.segmentsCount == 1, @"Sealed segments were not compacted");
+    STAssertTrue(store.totalSize < totalSize, @"Dead data was not reclaimed");
+    STAssertTrue([[store recordForKey:liveKey].payload length] == [payload length], @"Live record was lost");
+    STAssertTrue([[store recordForKey:deadKey].payload length] == [payload length], @"Live record was lost");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+#pragma mark - parsed object cache tests
+
+- (void)testParsedObjectCache
+{
+    NSString *path = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) lastObject];
+    NSString *myCachePath = [path stringByAppendingFormat:@"/Vkontakte-iOS-SDK-v2.0/Caches/58789857/"];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:myCachePath];
+
+    NSString *key = [VKCacheKey keyForData:[@"users.get" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSData *data = [@"{\"response\":[{\"uid\":1}]}" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *otherData = [@"{\"response\":[{\"uid\":2}]}" dataUsingEncoding:NSUTF8StringEncoding];
+    id object = [NSJSONSerialization JSONObjectWithData:data options:0 error:nil];
+
+    [cachedData addCachedData:data forKey:key liveTime:VKCachedDataLiveTimeOneHour];
+
+//    объект, разобранный не из текущих данных записи, не сохраняется
+    [cachedData setCachedObject:object parsedFromData:otherData forKey:key];
+    STAssertNil([cachedData cachedObjectForKey:key offlineMode:NO staleGraceTime:0 isStale:NULL], @"Object of other data was cached");
+
+    [cachedData setCachedObject:object parsedFromData:data forKey:key];
+    STAssertTrue([cachedData cachedObjectForKey:key offlineMode:NO staleGraceTime:0 isStale:NULL] == object, @"Parsed object should be returned as is");
+
+//    обновление данных делает объект недействительным
+    [cachedData addCachedData:otherData forKey:key liveTime:VKCachedDataLiveTimeOneHour];
+    STAssertNil([cachedData cachedObjectForKey:key offlineMode:NO staleGraceTime:0 isStale:NULL], @"Object of old data was returned");
+
+    [cachedData removeCachedDataForKey:key];
+}
+
+#pragma mark - write-behind tests
+
+- (void)testWriterCoalescesAndKeepsOrder
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingString:@"VKCachedDataWriterTest/"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    NSString *key = [VKCacheKey keyForData:[@"key" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSString *removedKey = [VKCacheKey keyForData:[@"removed" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSData *data1 = [@"{\"response\":[1]}" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *data2 = [@"{\"response\":[2]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:path];
+    cachedData.memoryCacheSize = 0;
+
+    [cachedData addCachedData:data1 forKey:key liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData removeCachedDataForKey:key];
+    [cachedData addCachedData:data2 forKey:key liveTime:VKCachedDataLiveTimeOneHour];
+
+    [cachedData addCachedData:data1 forKey:removedKey liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData removeCachedDataForKey:removedKey];
+
+//    до записи на диск данные возвращаются из очереди отложенной записи
+    STAssertEqualObjects([cachedData cachedDataForKey:key offlineMode:NO staleGraceTime:0 isStale:NULL], data2, @"Pending data should be returned");
+    STAssertNil([cachedData cachedDataForKey:removedKey offlineMode:NO staleGraceTime:0 isStale:NULL], @"Pending removal should hide data");
+
+    [cachedData flush];
+
+    STAssertTrue(cachedData.count == 1, @"Only the last write should reach the index");
+
+//    новый объект читает только то, что оказалось на диске
+    VKCachedData *reopenedCachedData = [[VKCachedData alloc]
+                                                      initWithCacheDirectory:path];
+
+    STAssertEqualObjects([reopenedCachedData cachedDataForKey:key offlineMode:NO staleGraceTime:0 isStale:NULL], data2, @"Last write should win");
+    STAssertNil([reopenedCachedData cachedDataForKey:removedKey offlineMode:NO staleGraceTime:0 isStale:NULL], @"Removed data was written");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+#pragma mark - deduplication tests
+
+- (void)testIdenticalPayloadsAreStoredOnce
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingString:@"VKCachedDataDeduplicationTest/"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    NSString *key1 = [VKCacheKey keyForData:[@"friends.get?uid=1" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSString *key2 = [VKCacheKey keyForData:[@"friends.get?uid=2" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSData *data = [@"{\"response\":[]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:path];
+
+    [cachedData addCachedData:data forKey:key1 methodName:@"friends.get" liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData addCachedData:data forKey:key2 methodName:@"friends.get" liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData flush];
+
+    VKCacheStatisticsCounters *counters = [cachedData.statistics snapshot].totalCounters;
+
+    STAssertTrue(cachedData.count == 2, @"Both entries should be in the index");
+    STAssertTrue(cachedData.size == [data length], @"Identical payloads should be stored once");
+    STAssertTrue(cachedData.referencedSize == 2 * [data length], @"Wrong referenced size");
+    STAssertTrue(counters.bytesDeduplicated == [data length] && counters.deduplicationRatio == 0.5, @"Wrong deduplication counters: %@", counters);
+
+//    содержимое остаётся на диске, пока на него ссылается хотя бы одна запись
+    STAssertTrue([cachedData removeCachedDataForKey:key1] == 0, @"Shared content should not be freed");
+    [cachedData flush];
+
+    VKCachedData *reopenedCachedData = [[VKCachedData alloc]
+                                                      initWithCacheDirectory:path];
+    reopenedCachedData.memoryCacheSize = 0;
+
+    STAssertEqualObjects([reopenedCachedData cachedDataForKey:key2 offlineMode:NO staleGraceTime:0 isStale:NULL], data, @"Shared content was removed with the first entry");
+    STAssertTrue([reopenedCachedData removeCachedDataForKey:key2] == [data length], @"Content should be freed with the last entry");
+    STAssertTrue(reopenedCachedData.size == 0, @"Released content is still counted");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+#pragma mark - tag invalidation tests
+
+- (void)testMutatingMethodInvalidatesTaggedEntries
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingString:@"VKCachedDataTagsTest/"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    VKCacheTagRules *rules = [VKCacheTagRules defaultRules];
+    NSDictionary *ownWall = @{@"owner_id" : @"1"};
+    NSDictionary *otherWall = @{@"owner_id" : @"2"};
+
+    NSString *ownWallKey = [VKCacheKey keyForMethod:@"wall.get" options:ownWall];
+    NSString *otherWallKey = [VKCacheKey keyForMethod:@"wall.get" options:otherWall];
+    NSString *friendsKey = [VKCacheKey keyForMethod:@"friends.get" options:@{}];
+    NSData *data = [@"{\"response\":[1]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:path];
+
+    [cachedData addCachedData:data forKey:ownWallKey methodName:@"wall.get" tags:[rules tagsForMethod:@"wall.get" options:ownWall userID:1] liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData addCachedData:data forKey:otherWallKey methodName:@"wall.get" tags:[rules tagsForMethod:@"wall.get" options:otherWall userID:1] liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData addCachedData:data forKey:friendsKey methodName:@"friends.get" tags:[rules tagsForMethod:@"friends.get" options:@{} userID:1] liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData flush];
+
+//    теги сохраняются в индексе вместе с записями
+    cachedData = [[VKCachedData alloc]
+                                initWithCacheDirectory:path];
+
+    NSArray *invalidatedTags = [rules invalidatedTagsForMethod:@"wall.post" options:@{@"message" : @"hello"} userID:1];
+
+    STAssertEqualObjects(invalidatedTags, (@[@"wall:1", @"wall:?"]), @"wall.post without owner_id should invalidate own wall");
+    STAssertTrue([cachedData invalidateCachedDataForTags:invalidatedTags] == 1, @"Only own wall should be invalidated");
+    STAssertNil([cachedData cachedDataForKey:ownWallKey offlineMode:NO staleGraceTime:0 isStale:NULL], @"Invalidated entry is still returned");
+    STAssertNotNil([cachedData cachedDataForKey:otherWallKey offlineMode:NO staleGraceTime:0 isStale:NULL], @"Other wall should stay in cache");
+    STAssertNotNil([cachedData cachedDataForKey:friendsKey offlineMode:NO staleGraceTime:0 isStale:NULL], @"Other resource should stay in cache");
+
+//    записи, ещё не записанные на диск, тоже инвалидируются
+    [cachedData addCachedData:data forKey:ownWallKey methodName:@"wall.get" tags:[rules tagsForMethod:@"wall.get" options:ownWall userID:1] liveTime:VKCachedDataLiveTimeOneHour];
+
+    STAssertTrue([cachedData invalidateCachedDataForTags:[rules invalidatedTagsForMethod:@"wall.repost" options:@{} userID:1]] == 2, @"wall.repost should invalidate all walls");
+    [cachedData flush];
+
+    STAssertTrue(cachedData.count == 1, @"Only friends entry should be left");
+    STAssertTrue([cachedData.statistics snapshot].totalCounters.invalidations == 3, @"Wrong invalidation counter");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testOwnerScopedMutationInvalidatesOwnerlessReads
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingString:@"VKCachedDataOwnerlessTagsTest/"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    VKCacheTagRules *rules = [VKCacheTagRules defaultRules];
+    NSData *data = [@"{\"response\":[1]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+//    читающий метод без владельца и изменяющий метод того же ресурса с владельцем
+    NSArray *pairs = @[
+            @[@"wall.getById", @{@"posts" : @"2_1"}, @"wall.post"],
+            @[@"photos.getById", @{@"photos" : @"2_1"}, @"photos.delete"],
+            @[@"photos.getUserPhotos", @{@"uid" : @"3"}, @"photos.edit"],
+            @[@"photos.getComments", @{@"pid" : @"1"}, @"photos.createComment"],
+            @[@"photos.getAllComments", @{@"album_id" : @"1"}, @"photos.deleteComment"],
+            @[@"photos.getTags", @{@"pid" : @"1"}, @"photos.putTag"],
+            @[@"groups.getMembers", @{@"gid" : @"1"}, @"groups.join"],
+            @[@"groups.isMember", @{@"gid" : @"1"}, @"groups.leave"],
+            @[@"groups.getBanned", @{@"gid" : @"1"}, @"groups.banUser"],
+            @[@"video.getUserVideos", @{@"uid" : @"3"}, @"video.edit"],
+            @[@"video.getComments", @{@"vid" : @"1"}, @"video.createComment"],
+            @[@"video.getTags", @{@"vid" : @"1"}, @"video.putTag"],
+            @[@"audio.getById", @{@"audios" : @"2_1"}, @"audio.edit"]
+    ];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:path];
+
+    for (NSArray *pair in pairs) {
+        NSString *readMethod = pair[0];
+        NSDictionary *readOptions = pair[1];
+        NSString *mutatingMethod = pair[2];
+        NSString *key = [VKCacheKey keyForMethod:readMethod options:readOptions];
+
+        [cachedData addCachedData:data forKey:key methodName:readMethod tags:[rules tagsForMethod:readMethod options:readOptions userID:1] liveTime:VKCachedDataLiveTimeOneHour];
+
+        NSArray *invalidatedTags = [rules invalidatedTagsForMethod:mutatingMethod options:@{@"owner_id" : @"2"} userID:1];
+
+        STAssertTrue([cachedData invalidateCachedDataForTags:invalidatedTags] == 1, @"%@ should invalidate %@", mutatingMethod, readMethod);
+        STAssertNil([cachedData cachedDataForKey:key offlineMode:NO staleGraceTime:0 isStale:NULL], @"%@ response is still returned after %@", readMethod, mutatingMethod);
+    }
+
+    [cachedData flush];
+
+    STAssertTrue(cachedData.count == 0, @"Some ownerless reads were not invalidated");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+#pragma mark - warm up tests
+
+- (void)testHotSetIsRecordedAcrossLaunches
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingString:@"VKCachedDataHotSetTest/"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    NSString *hotKey = [VKCacheKey keyForData:[@"hot" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSString *coldKey = [VKCacheKey keyForData:[@"cold" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSData *data = [@"{\"response\":[1]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:path];
+
+    [cachedData addCachedData:data forKey:hotKey methodName:@"users.get" liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData addCachedData:data forKey:coldKey liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData cachedDataForKey:hotKey offlineMode:NO staleGraceTime:0 isStale:NULL];
+    [cachedData flush];
+
+    VKCachedData *reopenedCachedData = [[VKCachedData alloc]
+                                                      initWithCacheDirectory:path];
+
+    STAssertEqualObjects(reopenedCachedData.hotSetKeys, @[hotKey], @"Only keys read in the previous launch should be in the hot set");
+
+    for (VKCacheIndexEntry *entry in [reopenedCachedData evictionCandidates]) {
+        uint32_t methodHash = ([entry.key isEqualToString:hotKey] ? [VKCacheKey hashForMethod:@"Users.Get"] : 0);
+
+        STAssertTrue(entry.methodHash == methodHash, @"Method of the entry was not saved in the index");
+    }
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+#pragma mark - index recovery tests
+
+- (void)testIndexJournalRestoresUnsavedChanges
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"VKCacheIndexJournalTest"];
+    NSString *journalPath = [path stringByAppendingPathExtension:@"journal"];
+    NSString *savedJournalPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"VKCacheIndexJournalTest.saved"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:journalPath error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:savedJournalPath error:nil];
+
+    VKCacheIndexEntry *savedEntry = [[VKCacheIndexEntry alloc] init];
+    savedEntry.key = @"00000000000000000000000000000001";
+    savedEntry.size = 1024;
+
+    VKCacheIndexEntry *journaledEntry = [[VKCacheIndexEntry alloc] init];
+    journaledEntry.key = @"00000000000000000000000000000002";
+    journaledEntry.contentKey = @"0123456789abcdef0123456789abcdef";
+    journaledEntry.size = 512;
+    journaledEntry.tagHashes = @[@1, @2];
+
+    VKCacheIndex *index = [[VKCacheIndex alloc] initWithContentsOfFile:path];
+
+    [index setEntry:savedEntry];
+    [index saveIfNeeded];
+
+//    приложение завершилось после записи журнала, но до сохранения индекса
+    [index setEntry:journaledEntry];
+    [index removeEntryForKey:savedEntry.key];
+    [index writeJournal];
+
+    VKCacheIndex *reloadedIndex = [[VKCacheIndex alloc] initWithContentsOfFile:path];
+    VKCacheIndexEntry *reloadedEntry = [reloadedIndex entryForKey:journaledEntry.key];
+
+    STAssertTrue(reloadedIndex.count == 1, @"Journal was not replayed");
+    STAssertNil([reloadedIndex entryForKey:savedEntry.key], @"Journaled removal was not replayed");
+    STAssertEqualObjects(reloadedEntry.contentKey, journaledEntry.contentKey, @"Content reference was not restored");
+    STAssertEqualObjects(reloadedEntry.tagHashes, journaledEntry.tagHashes, @"Tags were not restored");
+    STAssertTrue([reloadedIndex sizeOfContentForKey:journaledEntry.contentKey] == 512, @"Content size was not restored");
+
+//    журнал прежнего сохранения не применяется к более новому индексу
+    [[NSFileManager defaultManager] copyItemAtPath:journalPath toPath:savedJournalPath error:nil];
+    [index removeEntryForKey:journaledEntry.key];
+    [index saveIfNeeded];
+
+    STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:journalPath], @"Journal should be removed when the index is saved");
+
+    [[NSFileManager defaultManager] moveItemAtPath:savedJournalPath toPath:journalPath error:nil];
+
+    STAssertTrue([[VKCacheIndex alloc] initWithContentsOfFile:path].count == 0, @"Stale journal was replayed");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:journalPath error:nil];
+}
+
+- (void)testLostIndexRemovesUnreferencedContent
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingString:@"VKCachedDataRebuildTest/"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    NSString *key = [VKCacheKey keyForMethod:@"friends.get" options:@{}];
+    NSData *data = [@"{\"response\":[2]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:path
+                                                           storeType:VKCachedDataStoreTypeFiles];
+
+    [cachedData addCachedData:data forKey:key liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData cachedDataForKey:key offlineMode:NO staleGraceTime:0 isStale:NULL];
+    [cachedData flush];
+
+    [[NSFileManager defaultManager] removeItemAtPath:[path stringByAppendingString:kVKCacheIndexFileName] error:nil];
+
+//    ссылки на содержимое хранились лишь в индексе - содержимое больше не нужно
+    VKCachedData *rebuiltCachedData = [[VKCachedData alloc]
+                                                     initWithCacheDirectory:path
+                                                                  storeType:VKCachedDataStoreTypeFiles];
+    VKCachedDataFileStore *store = [[VKCachedDataFileStore alloc] initWithDirectory:path];
+
+    STAssertTrue(rebuiltCachedData.count == 0, @"Entries without index should be dropped");
+    STAssertNil([store recordForKey:[VKCacheKey keyForContent:data]], @"Unreferenced content was not removed");
+    STAssertEqualObjects(rebuiltCachedData.hotSetKeys, @[key], @"Hot set was removed with the index");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testStoreIsReconciledWithIndex
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingString:@"VKCachedDataReconcileTest/"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    NSString *key = [VKCacheKey keyForData:[@"saved" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSString *orphanContentKey = [VKCacheKey keyForData:[@"orphan" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSData *data = [@"{\"response\":[1]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:path
+                                                           storeType:VKCachedDataStoreTypeFiles];
+
+    [cachedData addCachedData:data forKey:key liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData flush];
+
+//    содержимое, на которое не ссылается ни одна запись
+    VKCachedDataRecordHeader header;
+    NSData *orphanData = [@"{\"response\":[3]}" dataUsingEncoding:NSUTF8StringEncoding];
+    VKCachedDataFileStore *store = [[VKCachedDataFileStore alloc] initWithDirectory:path];
+
+    [VKCachedDataRecord fillHeader:&header
+                       withPayload:orphanData
+                          liveTime:VKCachedDataLiveTimeOneHour
+                 creationTimestamp:1000];
+    header.flags |= kVKCachedDataRecordFlagContent;
+
+    STAssertTrue([store writeRecordWithHeader:&header payload:orphanData forKey:orphanContentKey], @"Orphan content was not written");
+
+    VKCachedData *reopenedCachedData = [[VKCachedData alloc]
+                                                      initWithCacheDirectory:path
+                                                                   storeType:VKCachedDataStoreTypeFiles];
+    reopenedCachedData.memoryCacheSize = 0;
+//    дожидаемся сверки хранилища с индексом
+    [reopenedCachedData flush];
+
+    STAssertTrue(reopenedCachedData.count == 1, @"Indexed entry was lost");
+    STAssertEqualObjects([reopenedCachedData cachedDataForKey:key offlineMode:NO staleGraceTime:0 isStale:NULL], data, @"Indexed entry returns wrong data");
+    STAssertNil([store recordForKey:orphanContentKey], @"Orphan content was not removed");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+#pragma mark - statistics tests
+
+- (void)testStatisticsCountsLookupsPerMethod
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingString:@"VKCacheStatisticsTest/"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    NSString *key = [VKCacheKey keyForData:[@"users.get" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSString *missingKey = [VKCacheKey keyForData:[@"missing" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSData *data = [@"{\"response\":[1]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:path];
+
+    [cachedData cachedDataForKey:key methodName:@"users.get" offlineMode:NO staleGraceTime:0 isStale:NULL];
+    [cachedData addCachedData:data forKey:key methodName:@"users.get" liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData cachedDataForKey:key methodName:@"users.get" offlineMode:NO staleGraceTime:0 isStale:NULL];
+    [cachedData cachedDataForKey:missingKey offlineMode:NO staleGraceTime:0 isStale:NULL];
+    [cachedData flush];
+
+    VKCacheStatisticsSnapshot *snapshot = [cachedData.statistics snapshot];
+    VKCacheStatisticsCounters *methodCounters = snapshot.countersByMethod[@"users.get"];
+
+    STAssertTrue(snapshot.totalCounters.hits == 1 && snapshot.totalCounters.misses == 2, @"Wrong total counters: %@", snapshot.totalCounters);
+    STAssertTrue(methodCounters.hits == 1 && methodCounters.misses == 1, @"Wrong method counters: %@", methodCounters);
+    STAssertTrue(methodCounters.bytesWritten == [data length], @"Written bytes should be counted per method");
+
+    uint64_t lookups = 0;
+
+    for (NSNumber *count in [snapshot.totalCounters latencyHistogramForOperation:VKCacheStatisticsOperationLookup])
+        lookups += [count unsignedLongLongValue];
+
+    STAssertTrue(lookups == 3, @"Every lookup should be in the latency histogram");
+
+    [cachedData.statistics reset];
+    snapshot = [cachedData.statistics snapshot];
+
+    STAssertTrue(snapshot.totalCounters.hits == 0 && 0 == [snapshot.countersByMethod count], @"Statistics should be reset");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+
+#pragma mark - multi-process tests
+
+// блокировки flock принадлежат открытому файлу, поэтому кэши одной директории,
+// открытые в одном процессе, исключают друг друга так же, как разные процессы
+- (void)testMultiProcessCachesShareDirectory
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingString:@"VKCachedDataMultiProcessTest/"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    NSUInteger const cachesCount = 4;
+    NSUInteger const keysCount = 50;
+    NSMutableArray *caches = [NSMutableArray array];
+
+    for (NSUInteger i = 0; i < cachesCount; i++) {
+        VKCachedData *cachedData = [[VKCachedData alloc]
+                                                  initWithCacheDirectory:path
+                                                               storeType:VKCachedDataStoreTypeSegments
+                                                            multiProcess:YES];
+        cachedData.memoryCacheSize = 0;
+
+        STAssertTrue(cachedData.isMultiProcess && VKCachedDataStoreTypeFiles == cachedData.storeType, @"Multi-process cache should use file store");
+
+        [caches addObject:cachedData];
+    }
+
+//    каждый кэш пишет свои ключи и перезаписывает общий
+    NSString *sharedKey = [VKCacheKey keyForData:[@"shared" dataUsingEncoding:NSUTF8StringEncoding]];
+
+    dispatch_apply(cachesCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i)
+    {
+        VKCachedData *cachedData = caches[i];
+
+        for (NSUInteger j = 0; j < keysCount; j++) {
+            NSString *value = [NSString stringWithFormat:@"%zu-%lu", i, (unsigned long) j];
+            NSData *data = [value dataUsingEncoding:NSUTF8StringEncoding];
+
+            [cachedData addCachedData:data forKey:[VKCacheKey keyForData:data] liveTime:VKCachedDataLiveTimeOneHour];
+            [cachedData addCachedData:data forKey:sharedKey liveTime:VKCachedDataLiveTimeOneHour];
+
+            if (0 == j % 10)
+                [cachedData flush];
+        }
+
+        [cachedData flush];
+    });
+
+    for (VKCachedData *cachedData in caches)
+        [cachedData flush];
+
+    for (VKCachedData *cachedData in caches) {
+        STAssertTrue(cachedData.count == cachesCount * keysCount + 1, @"Entries of other caches were lost: %lu", (unsigned long) cachedData.count);
+
+        for (NSUInteger i = 0; i < cachesCount; i++) {
+            NSData *data = [[NSString stringWithFormat:@"%lu-%lu", (unsigned long) i, (unsigned long) (keysCount - 1)]
+                                      dataUsingEncoding:NSUTF8StringEncoding];
+
+            STAssertEqualObjects([cachedData cachedDataForKey:[VKCacheKey keyForData:data] offlineMode:NO staleGraceTime:0 isStale:NULL], data, @"Entry written by other cache is not readable");
+        }
+
+        STAssertNotNil([cachedData cachedDataForKey:sharedKey offlineMode:NO staleGraceTime:0 isStale:NULL], @"Shared entry is not readable");
+    }
+
+//    удаление записи одним кэшем видно остальным после синхронизации
+    NSData *removedData = [@"0-0" dataUsingEncoding:NSUTF8StringEncoding];
+    NSString *removedKey = [VKCacheKey keyForData:removedData];
+
+    [caches[0] removeCachedDataForKey:removedKey];
+    [caches[0] flush];
+    [caches[1] flush];
+
+    STAssertNil([caches[1] cachedDataForKey:removedKey offlineMode:NO staleGraceTime:0 isStale:NULL], @"Entry removed by other cache is still returned");
+
+//    очистка не удаляет файл блокировки, с которым работают другие кэши
+    [caches[2] clearCachedData];
+    [caches[2] flush];
+    [caches[3] flush];
+
+    STAssertTrue([caches[3] count] == 0, @"Cleared entries are still in other cache");
+    STAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[path stringByAppendingString:kVKCacheDirectoryLockFileName]], @"Lock file was removed");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+// выполняется лишь в дочерних процессах testMultiProcessCachesShareDirectoryAcrossProcesses
+- (void)testMultiProcessWriter
+{
+    NSDictionary *environment = [[NSProcessInfo processInfo] environment];
+    NSString *path = environment[kTestVKCachedDataChildPathVariable];
+
+    if (nil == path)
+        return;
+
+    NSUInteger writer = (NSUInteger) [environment[kTestVKCachedDataChildWriterVariable] integerValue];
+    NSString *sharedKey = [VKCacheKey keyForData:[@"shared" dataUsingEncoding:NSUTF8StringEncoding]];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:path
+                                                           storeType:VKCachedDataStoreTypeFiles
+                                                        multiProcess:YES];
+
+    for (NSUInteger j = 0; j < kTestVKCachedDataChildKeysCount; j++) {
+        NSData *data = [[NSString stringWithFormat:@"%lu-%lu", (unsigned long) writer, (unsigned long) j]
+                                  dataUsingEncoding:NSUTF8StringEncoding];
+        NSString *key = [VKCacheKey keyForData:data];
+
+        [cachedData addCachedData:data forKey:key liveTime:VKCachedDataLiveTimeOneHour];
+        [cachedData addCachedData:data forKey:sharedKey liveTime:VKCachedDataLiveTimeOneHour];
+
+        if (0 == j % 10)
+            [cachedData flush];
+
+        STAssertEqualObjects([cachedData cachedDataForKey:key offlineMode:NO staleGraceTime:0 isStale:NULL], data, @"Own entry is not readable");
+        STAssertNotNil([cachedData cachedDataForKey:sharedKey offlineMode:NO staleGraceTime:0 isStale:NULL], @"Shared entry is not readable");
+    }
+
+    [cachedData flush];
+}
+
+- (void)testMultiProcessCachesShareDirectoryAcrossProcesses
+{
+#if !TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR
+    NSString *path = [NSTemporaryDirectory() stringByAppendingString:@"VKCachedDataMultiProcessSpawnTest/"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    NSUInteger const writersCount = 4;
+    NSString *sharedKey = [VKCacheKey keyForData:[@"shared" dataUsingEncoding:NSUTF8StringEncoding]];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:path
+                                                           storeType:VKCachedDataStoreTypeFiles
+                                                        multiProcess:YES];
+
+//    данные и разобранный объект общей записи попадают в кэш в оперативной памяти
+    [cachedData addCachedData:[@"parent" dataUsingEncoding:NSUTF8StringEncoding] forKey:sharedKey liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData flush];
+
+    NSData *parentData = [cachedData cachedDataForKey:sharedKey offlineMode:NO staleGraceTime:0 isStale:NULL];
+    [cachedData setCachedObject:@"parent" parsedFromData:parentData forKey:sharedKey];
+
+    STAssertEqualObjects([cachedData cachedObjectForKey:sharedKey offlineMode:NO staleGraceTime:0 isStale:NULL], @"parent", @"Parsed object was not cached");
+
+    NSMutableArray *pids = [NSMutableArray array];
+
+    for (NSUInteger i = 0; i < writersCount; i++) {
+        pid_t pid = [self spawnTestMethod:@"testMultiProcessWriter"
+                              environment:@{kTestVKCachedDataChildPathVariable : path,
+                                            kTestVKCachedDataChildWriterVariable : [@(i) stringValue]}];
+
+        STAssertTrue(pid > 0, @"Writer process was not started");
+
+        if (pid > 0)
+            [pids addObject:@(pid)];
+    }
+
+    for (NSNumber *pid in pids) {
+        int status = 0;
+
+        while (-1 == waitpid([pid intValue], &status, 0) && EINTR == errno);
+
+        STAssertTrue(WIFEXITED(status) && 0 == WEXITSTATUS(status), @"Writer process failed with status %d", status);
+    }
+
+//    записи других процессов видны без повторного открытия кэша, а данные в
+//    оперативной памяти, изменённые другими процессами, не возвращаются
+    NSString *sharedValue = [[NSString alloc] initWithData:[cachedData cachedDataForKey:sharedKey offlineMode:NO staleGraceTime:0 isStale:NULL]
+                                                  encoding:NSUTF8StringEncoding];
+    NSString *lastValueSuffix = [NSString stringWithFormat:@"-%lu", (unsigned long) (kTestVKCachedDataChildKeysCount - 1)];
+
+    STAssertTrue([sharedValue hasSuffix:lastValueSuffix], @"Stale shared entry was returned from memory: %@", sharedValue);
+    STAssertNil([cachedData cachedObjectForKey:sharedKey offlineMode:NO staleGraceTime:0 isStale:NULL], @"Stale parsed object was returned");
+    STAssertTrue(cachedData.count == writersCount * kTestVKCachedDataChildKeysCount + 1, @"Entries of other processes were lost: %lu", (unsigned long) cachedData.count);
+
+    for (NSUInteger i = 0; i < writersCount; i++) {
+        for (NSUInteger j = 0; j < kTestVKCachedDataChildKeysCount; j++) {
+            NSData *data = [[NSString stringWithFormat:@"%lu-%lu", (unsigned long) i, (unsigned long) j]
+                                      dataUsingEncoding:NSUTF8StringEncoding];
+
+            STAssertEqualObjects([cachedData cachedDataForKey:[VKCacheKey keyForData:data] offlineMode:NO staleGraceTime:0 isStale:NULL], data, @"Entry written by other process is not readable");
+        }
+    }
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+#endif
+}
+
+
+#pragma mark - pack tests
+
+- (void)testPackExportAndImport
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingString:@"VKCachedDataPackTest/"];
+    NSString *importPath = [NSTemporaryDirectory() stringByAppendingString:@"VKCachedDataPackImportTest/"];
+    NSString *packPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"VKCachedDataPackTest.pack"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:importPath error:nil];
+
+    NSString *key1 = [VKCacheKey keyForData:[@"users.get?uids=1" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSString *key2 = [VKCacheKey keyForData:[@"users.get?uids=2" dataUsingEncoding:NSUTF8StringEncoding]];
+    NSMutableData *largeData = [NSMutableData dataWithLength:64 * 1024];
+    NSData *data = [@"{\"response\":[1]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    VKCachedData *cachedData = [[VKCachedData alloc]
+                                              initWithCacheDirectory:path];
+
+    [cachedData addCachedData:largeData forKey:key1 methodName:@"users.get" liveTime:VKCachedDataLiveTimeOneHour];
+    [cachedData addCachedData:data forKey:key2 methodName:@"users.get" liveTime:VKCachedDataLiveTimeOneHour];
+
+    STAssertTrue([cachedData exportPackToFile:packPath], @"Pack was not exported");
+
+    VKCachePack *pack = [VKCachePack packWithContentsOfFile:packPath];
+
+    STAssertEqualObjects(pack.sectionNames, @[kVKCachePackDefaultSectionName], @"Wrong pack sections");
+    STAssertTrue(pack.count == 2, @"Wrong pack entries count");
+
+    VKCachedData *importedCachedData = [[VKCachedData alloc]
+                                                      initWithCacheDirectory:importPath];
+    importedCachedData.memoryCacheSize = 0;
+
+    STAssertTrue([importedCachedData importPackFromFile:packPath] == 2, @"Wrong imported entries count");
+    STAssertEqualObjects([importedCachedData cachedDataForKey:key1 offlineMode:NO staleGraceTime:0 isStale:NULL], largeData, @"Imported data differs");
+
+//    данные записей читаются из пакета, а не из отдельных файлов
+    [importedCachedData flush];
+    importedCachedData = [[VKCachedData alloc]
+                                        initWithCacheDirectory:importPath];
+    importedCachedData.memoryCacheSize = 0;
+
+    STAssertEqualObjects([importedCachedData cachedDataForKey:key2 offlineMode:NO staleGraceTime:0 isStale:NULL], data, @"Imported entry was lost after reopening");
+    STAssertTrue(importedCachedData.logicalSize == [largeData length] + [data length], @"Wrong logical size of imported entries");
+
+//    записи, созданные после импорта, не замещаются повторным импортом
+    NSData *newData = [@"{\"response\":[2]}" dataUsingEncoding:NSUTF8StringEncoding];
+    [importedCachedData addCachedData:newData forKey:key2 liveTime:VKCachedDataLiveTimeOneHour];
+    [importedCachedData flush];
+
+    STAssertTrue([importedCachedData importPackFromFile:packPath] == 1, @"Newer entry should not be replaced");
+    STAssertEqualObjects([importedCachedData cachedDataForKey:key2 offlineMode:NO staleGraceTime:0 isStale:NULL], newData, @"Newer entry was replaced");
+
+    [importedCachedData clearCachedData];
+    [importedCachedData flush];
+
+    STAssertNil([importedCachedData cachedDataForKey:key1 offlineMode:NO staleGraceTime:0 isStale:NULL], @"Imported entry survived clearing");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:importPath error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:packPath error:nil];
+}
+
 @end
@@ -0,0 +1,95 @@
+//
+//  TestVKJSONStreamParser.m
+//  Project
+//
+//  Created by AndrewShmig on 10/16/13.
+//  Copyright (c) 2013 AndrewShmig. All rights reserved.
+//
+
+#import "TestVKJSONStreamParser.h"
+#import "VKJSONStreamParser.h"
+
+
+@interface TestVKJSONStreamParser () <VKJSONStreamParserDelegate>
+@end
+
+
+@implementation TestVKJSONStreamParser
+{
+    NSMutableArray *_elements;
+}
+
+- (void)setUp
+{
+    [super setUp];
+
+    _elements = [NSMutableArray array];
+}
+
+- (void)JSONStreamParser:(VKJSONStreamParser *)parser
+ didParseResponseElement:(id)element
+{
+    [_elements addObject:element];
+}
+
+- (id)parseData:(NSData *)data
+      chunkSize:(NSUInteger)chunkSize
+{
+    VKJSONStreamParser *parser = [[VKJSONStreamParser alloc] init];
+    parser.delegate = self;
+
+    for (NSUInteger offset = 0; offset < [data length]; offset += chunkSize) {
+        NSData *chunk = [data subdataWithRange:NSMakeRange(offset, MIN(chunkSize, [data length] - offset))];
+
+        if (![parser parseData:chunk])
+            return nil;
+    }
+
+    return ([parser finish] ? parser.result : nil);
+}
+
+- (void)testResultMatchesNSJSONSerialization
+{
+    NSString *json = @"{\"response\": [3, {\"uid\": 1, \"first_name\": \"\\u041f\\u0430\\u0432\\u0435\\u043b\", "
+            "\"online\": true, \"deactivated\": null}, {\"text\": \"line\\nbreak \\\"quoted\\\" \\ud83d\\ude00\", "
+            "\"rating\": -1.5e2, \"tags\": [], \"meta\": {}}, \"Привет\", false, 12345678901234]}";
+    NSData *data = [json dataUsingEncoding:NSUTF8StringEncoding];
+
+    id expected = [NSJSONSerialization JSONObjectWithData:data
+                                                  options:NSJSONReadingAllowFragments
+                                                    error:NULL];
+
+    NSUInteger chunkSizes[] = {1, 2, 7, 64, [data length]};
+
+    for (NSUInteger i = 0; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]); i++) {
+        [_elements removeAllObjects];
+
+        id result = [self parseData:data
+                          chunkSize:chunkSizes[i]];
+
+        STAssertEqualObjects(result, expected, @"Wrong result for chunk size %lu", (unsigned long) chunkSizes[i]);
+        STAssertEqualObjects(_elements, expected[@"response"], @"Response elements should be streamed in order");
+    }
+}
+
+- (void)testFragments
+{
+    STAssertEqualObjects([VKJSONStreamParser JSONObjectWithData:[@"42" dataUsingEncoding:NSUTF8StringEncoding] error:NULL], @42, @"Top-level numbers should be parsed");
+    STAssertEqualObjects([VKJSONStreamParser JSONObjectWithData:[@" \"a\" " dataUsingEncoding:NSUTF8StringEncoding] error:NULL], @"a", @"Top-level strings should be parsed");
+}
+
+- (void)testInvalidJSON
+{
+    NSArray *invalid = @[@"{\"a\": 1,}", @"[1 2]", @"{\"a\" 1}", @"[tru]", @"\"unterminated", @"{} {}", @""];
+
+    for (NSString *json in invalid) {
+        NSError *error = nil;
+        id result = [VKJSONStreamParser JSONObjectWithData:[json dataUsingEncoding:NSUTF8StringEncoding]
+                                                     error:&error];
+
+        STAssertNil(result, @"Invalid JSON should not be parsed: %@", json);
+        STAssertNotNil(error, @"Error should be returned for: %@", json);
+    }
+}
+
+@end
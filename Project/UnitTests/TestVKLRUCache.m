@@ -0,0 +1,97 @@
+//
+//  TestVKLRUCache.m
+//  Project
+//
+//  Created by AndrewShmig on 10/16/13.
+//  Copyright (c) 2013 AndrewShmig. All rights reserved.
+//
+
+#import "TestVKLRUCache.h"
+#import "VKLRUCache.h"
+
+
+@implementation TestVKLRUCache
+
+- (void)testSetAndGetObject
+{
+    VKLRUCache *cache = [[VKLRUCache alloc] initWithTotalCostLimit:100];
+
+    [cache setObject:@"value" forKey:@"key" cost:10];
+
+    STAssertEqualObjects([cache objectForKey:@"key"], @"value", @"Wrong cached object");
+    STAssertTrue(cache.totalCost == 10, @"totalCost != 10");
+    STAssertTrue(cache.count == 1, @"count != 1");
+}
+
+- (void)testLeastRecentlyUsedObjectIsEvicted
+{
+    VKLRUCache *cache = [[VKLRUCache alloc] initWithTotalCostLimit:30];
+
+    [cache setObject:@"1" forKey:@"a" cost:10];
+    [cache setObject:@"2" forKey:@"b" cost:10];
+    [cache setObject:@"3" forKey:@"c" cost:10];
+
+//    обращение делает "a" самым свежим, вытеснен должен быть "b"
+    [cache objectForKey:@"a"];
+    [cache setObject:@"4" forKey:@"d" cost:10];
+
+    STAssertNotNil([cache objectForKey:@"a"], @"a should not be evicted");
+    STAssertNil([cache objectForKey:@"b"], @"b should be evicted");
+    STAssertNotNil([cache objectForKey:@"c"], @"c should not be evicted");
+    STAssertNotNil([cache objectForKey:@"d"], @"d should not be evicted");
+    STAssertTrue(cache.totalCost == 30, @"totalCost != 30");
+}
+
+- (void)testObjectLargerThanLimitIsNotStored
+{
+    VKLRUCache *cache = [[VKLRUCache alloc] initWithTotalCostLimit:10];
+
+    [cache setObject:@"small" forKey:@"key" cost:5];
+    [cache setObject:@"big" forKey:@"key" cost:11];
+
+    STAssertNil([cache objectForKey:@"key"], @"Object larger than limit should not be stored");
+    STAssertTrue(cache.totalCost == 0, @"totalCost != 0");
+}
+
+- (void)testReplaceObjectUpdatesCost
+{
+    VKLRUCache *cache = [[VKLRUCache alloc] initWithTotalCostLimit:100];
+
+    [cache setObject:@"1" forKey:@"key" cost:10];
+    [cache setObject:@"2" forKey:@"key" cost:20];
+
+    STAssertEqualObjects([cache objectForKey:@"key"], @"2", @"Object was not replaced");
+    STAssertTrue(cache.totalCost == 20, @"totalCost != 20");
+    STAssertTrue(cache.count == 1, @"count != 1");
+}
+
+- (void)testRemoveObjects
+{
+    VKLRUCache *cache = [[VKLRUCache alloc] initWithTotalCostLimit:100];
+
+    [cache setObject:@"1" forKey:@"a" cost:10];
+    [cache setObject:@"2" forKey:@"b" cost:10];
+
+    [cache removeObjectForKey:@"a"];
+    STAssertNil([cache objectForKey:@"a"], @"a should be removed");
+    STAssertTrue(cache.totalCost == 10, @"totalCost != 10");
+
+    [cache removeAllObjects];
+    STAssertNil([cache objectForKey:@"b"], @"b should be removed");
+    STAssertTrue(cache.count == 0, @"count != 0");
+}
+
+- (void)testDecreaseTotalCostLimit
+{
+    VKLRUCache *cache = [[VKLRUCache alloc] initWithTotalCostLimit:100];
+
+    [cache setObject:@"1" forKey:@"a" cost:40];
+    [cache setObject:@"2" forKey:@"b" cost:40];
+
+    cache.totalCostLimit = 50;
+
+    STAssertNil([cache objectForKey:@"a"], @"a should be evicted");
+    STAssertNotNil([cache objectForKey:@"b"], @"b should not be evicted");
+}
+
+@end
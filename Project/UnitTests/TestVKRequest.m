@@ -0,0 +1,605 @@
+//
+//  TestVKRequest.m
+//  Project
+//
+//  Created by AndrewShmig on 10/16/13.
+//  Copyright (c) 2013 AndrewShmig. All rights reserved.
+//
+
+#import "TestVKRequest.h"
+#import "VKRequest.h"
+#import "VKStorage.h"
+#import "VKRequestRetryPolicy.h"
+
+
+// ключ, по которому очереди, созданные тестами, хранят своё наименование
+static char kTestVKRequestQueueLabelKey;
+
+
+// делегат, запоминающий полученные ответы и ошибки, а также наименования очередей,
+// на которых были вызваны его методы
+@interface TestVKRequestDelegate : NSObject <VKRequestDelegate>
+
+@property (nonatomic, readonly) NSArray *responses;
+@property (nonatomic, readonly) NSArray *connectionErrors;
+@property (nonatomic, readonly) NSArray *callbackQueueLabels;
+
+@end
+
+@implementation TestVKRequestDelegate
+{
+    NSMutableArray *_responses;
+    NSMutableArray *_connectionErrors;
+    NSMutableArray *_callbackQueueLabels;
+}
+
+- (instancetype)init
+{
+    self = [super init];
+
+    if (nil != self) {
+        _responses = [[NSMutableArray alloc] init];
+        _connectionErrors = [[NSMutableArray alloc] init];
+        _callbackQueueLabels = [[NSMutableArray alloc] init];
+    }
+
+    return self;
+}
+
+- (NSArray *)callbackQueueLabels
+{
+    @synchronized (self) {
+        return [_callbackQueueLabels copy];
+    }
+}
+
+- (void)recordCallbackQueue
+{
+    const char *label = dispatch_get_specific(&kTestVKRequestQueueLabelKey);
+
+    [_callbackQueueLabels addObject:(NULL != label ? @(label) : @"")];
+}
+
+- (NSArray *)responses
+{
+    @synchronized (self) {
+        return [_responses copy];
+    }
+}
+
+- (NSArray *)connectionErrors
+{
+    @synchronized (self) {
+        return [_connectionErrors copy];
+    }
+}
+
+- (void)VKRequest:(VKRequest *)request
+         response:(id)response
+{
+    @synchronized (self) {
+        [_responses addObject:response];
+        [self recordCallbackQueue];
+    }
+}
+
+- (void)     VKRequest:(VKRequest *)request
+connectionErrorOccured:(NSError *)error
+{
+    @synchronized (self) {
+        [_connectionErrors addObject:error];
+        [self recordCallbackQueue];
+    }
+}
+
+- (void)VKRequest:(VKRequest *)request
+       totalBytes:(NSUInteger)totalBytes
+  downloadedBytes:(NSUInteger)downloadedBytes
+{
+    @synchronized (self) {
+        [self recordCallbackQueue];
+    }
+}
+
+@end
+
+
+// закрытые методы VKRequest, которые переопределяют тесты
+@interface VKRequest (TestVKRequest)
+
+- (void)enqueueConnection;
+
+@end
+
+
+// запрос, который вместо открытия соединения лишь считает попытки его открыть;
+// ответ передаётся запросу методами NSURLConnectionDataDelegate
+@interface TestVKOfflineRequest : VKRequest
+
+@property (nonatomic, readonly) NSUInteger connectionsCount;
+
+@end
+
+@implementation TestVKOfflineRequest
+
+- (void)enqueueConnection
+{
+    _connectionsCount++;
+}
+
+@end
+
+
+@implementation TestVKRequest
+
+// запрос, ответ на который не может оказаться в кэше от предыдущих запусков
+- (VKRequest *)requestWithMethod:(NSString *)methodName
+                        delegate:(id <VKRequestDelegate>)delegate
+{
+    NSDictionary *options = @{@"uids" : [[NSProcessInfo processInfo] globallyUniqueString]};
+    VKRequest *request = [[VKRequest alloc] initWithMethod:methodName
+                                                   options:options];
+    request.delegate = delegate;
+
+    return request;
+}
+
+// запрос, не открывающий соединения (см. TestVKOfflineRequest)
+- (TestVKOfflineRequest *)offlineRequestWithMethod:(NSString *)methodName
+                                           options:(NSDictionary *)options
+                                          delegate:(id <VKRequestDelegate>)delegate
+{
+    TestVKOfflineRequest *request = [[TestVKOfflineRequest alloc] initWithMethod:methodName
+                                                                         options:options];
+    request.delegate = delegate;
+
+    return request;
+}
+
+// последовательная очередь, вызовы на которой делегат запоминает под указанным
+// наименованием
+- (dispatch_queue_t)callbackQueueWithLabel:(const char *)label
+{
+    dispatch_queue_t queue = dispatch_queue_create(label, DISPATCH_QUEUE_SERIAL);
+    dispatch_queue_set_specific(queue, &kTestVKRequestQueueLabelKey, (void *) label, NULL);
+
+    return queue;
+}
+
+// запрос к общему кэшу, ответ на который уже закэширован
+- (VKRequest *)cachedRequestWithDelegate:(id <VKRequestDelegate>)delegate
+{
+    VKRequest *request = [self requestWithMethod:@"users.get"
+                                        delegate:delegate];
+    request.useSharedCache = YES;
+
+    [[[VKStorage sharedStorage] sharedCachedData] addCachedData:[@"{\"response\":[]}" dataUsingEncoding:NSUTF8StringEncoding]
+                                                         forKey:request.cacheKey
+                                                       liveTime:VKCachedDataLiveTimeOneHour];
+
+    return request;
+}
+
+// передаёт запросу ответ сервера так, как это делает NSURLConnection
+- (void)completeRequest:(VKRequest *)request
+           withResponse:(NSString *)response
+{
+    NSHTTPURLResponse *httpResponse = [[NSHTTPURLResponse alloc] initWithURL:[NSURL URLWithString:kVKAPIURLPrefix]
+                                                                  statusCode:200
+                                                                 HTTPVersion:@"HTTP/1.1"
+                                                                headerFields:@{}];
+
+    [request connection:nil didReceiveResponse:httpResponse];
+    [request connection:nil didReceiveData:[response dataUsingEncoding:NSUTF8StringEncoding]];
+    [request connectionDidFinishLoading:nil];
+}
+
+// обрабатывает события главной очереди в течение указанного времени
+- (void)processEventsForTimeInterval:(NSTimeInterval)interval
+{
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:interval]];
+}
+
+// обрабатывает события главной очереди, пока условие не выполнится
+- (BOOL)waitForCondition:(BOOL (^)(void))condition
+{
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+
+    while (!condition() && 0 < [deadline timeIntervalSinceNow])
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+                                 beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+
+    return condition();
+}
+
+#pragma mark - response tests
+
+- (void)testNetworkResponseIsImmutable
+{
+    TestVKRequestDelegate *delegate = [[TestVKRequestDelegate alloc] init];
+    VKRequest *request = [self requestWithMethod:@"users.get"
+                                        delegate:delegate];
+
+    [self completeRequest:request
+             withResponse:@"{\"response\":[{\"uid\":1,\"counters\":[1,2]}]}"];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == [delegate.responses count]);
+    }], @"Response was not delivered");
+
+    id response = delegate.responses[0];
+
+    STAssertEqualObjects(response, (@{@"response" : @[@{@"uid" : @1, @"counters" : @[@1, @2]}]}), @"Wrong response");
+    STAssertFalse([response isKindOfClass:[NSMutableDictionary class]], @"Response should be immutable");
+    STAssertFalse([response[@"response"] isKindOfClass:[NSMutableArray class]], @"Nested array should be immutable");
+    STAssertFalse([response[@"response"][0] isKindOfClass:[NSMutableDictionary class]], @"Nested dictionary should be immutable");
+    STAssertFalse([response[@"response"][0][@"counters"] isKindOfClass:[NSMutableArray class]], @"Nested array should be immutable");
+}
+
+- (void)testNetworkResponseIsCachedAsParsedObject
+{
+    TestVKRequestDelegate *delegate = [[TestVKRequestDelegate alloc] init];
+    TestVKOfflineRequest *request = [self offlineRequestWithMethod:@"users.get"
+                                                           options:@{@"uids" : [[NSProcessInfo processInfo] globallyUniqueString]}
+                                                          delegate:delegate];
+    request.useSharedCache = YES;
+
+    [request start];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == request.connectionsCount);
+    }], @"Connection was not opened");
+
+//    ответ передаётся через NSURLConnectionDataDelegate - буфер соединения изменяемый
+    [self completeRequest:request
+             withResponse:@"{\"response\":[{\"uid\":1}]}"];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == [delegate.responses count]);
+    }], @"Response was not delivered");
+
+    id cachedObject = [[[VKStorage sharedStorage] sharedCachedData] cachedObjectForKey:request.cacheKey
+                                                                           offlineMode:NO
+                                                                        staleGraceTime:0
+                                                                               isStale:NULL];
+
+    STAssertNotNil(cachedObject, @"Parsed network response was not cached");
+    STAssertTrue(cachedObject == delegate.responses[0], @"Cached object differs from the delivered one");
+}
+
+- (void)testNonIdempotentResponseIsNotCached
+{
+    TestVKRequestDelegate *delegate = [[TestVKRequestDelegate alloc] init];
+    TestVKOfflineRequest *request = [self offlineRequestWithMethod:@"messages.send"
+                                                           options:@{@"message" : [[NSProcessInfo processInfo] globallyUniqueString]}
+                                                          delegate:delegate];
+    request.useSharedCache = YES;
+
+//    время жизни кэша задано, но запрос к изменяющему методу не идемпотентен
+    request.cacheLiveTime = VKCachedDataLiveTimeOneHour;
+
+    [request start];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == request.connectionsCount);
+    }], @"Connection was not opened");
+
+    [self completeRequest:request
+             withResponse:@"{\"response\":1}"];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == [delegate.responses count]);
+    }], @"Response was not delivered");
+
+    NSData *cachedData = [[[VKStorage sharedStorage] sharedCachedData] cachedDataForKey:request.cacheKey
+                                                                            offlineMode:NO
+                                                                         staleGraceTime:0
+                                                                                isStale:NULL];
+
+    STAssertNil(cachedData, @"Response of a non-idempotent request should not be cached");
+}
+
+#pragma mark - retry tests
+
+- (void)testMutatingMethodsAreNotIdempotent
+{
+    for (NSString *methodName in @[@"messages.send", @"messages.delete", @"likes.add", @"status.set", @"wall.post", @"execute"])
+        STAssertTrue([VKRequest isMutatingMethod:methodName], @"%@ should be mutating", methodName);
+
+    for (NSString *methodName in @[@"users.get", @"messages.getDialogs", @"audio.search", @"groups.isMember", @"friends.areFriends", @"pages.parseWiki"])
+        STAssertFalse([VKRequest isMutatingMethod:methodName], @"%@ should not be mutating", methodName);
+
+//    идемпотентность определяется методом, а не HTTP методом запроса
+    STAssertFalse([self requestWithMethod:@"messages.send" delegate:nil].isIdempotent, @"GET request to messages.send should not be idempotent");
+    STAssertTrue([self requestWithMethod:@"users.get" delegate:nil].isIdempotent, @"users.get should be idempotent");
+}
+
+- (void)testMutatingRequestIsNotRetriedAfterTimeout
+{
+    TestVKRequestDelegate *delegate = [[TestVKRequestDelegate alloc] init];
+    VKRequestRetryPolicy *retryPolicy = [[VKRequestRetryPolicy alloc] initWithMaximumAttempts:3
+                                                                               initialDelay:0.01
+                                                                               maximumDelay:0.01
+                                                                                   deadline:10];
+    NSError *timeoutError = [NSError errorWithDomain:NSURLErrorDomain
+                                                code:NSURLErrorTimedOut
+                                            userInfo:nil];
+    NSDictionary *options = @{@"uids" : [[NSProcessInfo processInfo] globallyUniqueString]};
+
+    TestVKOfflineRequest *readRequest = [[TestVKOfflineRequest alloc] initWithMethod:@"users.get"
+                                                                             options:options];
+    TestVKOfflineRequest *sendRequest = [[TestVKOfflineRequest alloc] initWithMethod:@"messages.send"
+                                                                             options:options];
+
+    for (VKRequest *request in @[readRequest, sendRequest]) {
+        request.delegate = delegate;
+        request.retryPolicy = retryPolicy;
+        request.cacheLiveTime = VKCachedDataLiveTimeNever;
+
+        [request start];
+    }
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == readRequest.connectionsCount && 1 == sendRequest.connectionsCount);
+    }], @"Connections were not opened");
+
+    [readRequest connection:nil didFailWithError:timeoutError];
+    [sendRequest connection:nil didFailWithError:timeoutError];
+
+//    сервер мог получить запрос messages.send - сообщение было бы отправлено дважды
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (2 == readRequest.connectionsCount);
+    }], @"Idempotent request was not retried");
+
+    [self processEventsForTimeInterval:0.2];
+
+    STAssertTrue(1 == sendRequest.connectionsCount, @"messages.send was retried after timeout");
+    STAssertTrue(1 == [delegate.connectionErrors count], @"Timeout of messages.send was not delivered");
+
+    [readRequest cancel];
+}
+
+#pragma mark - coalescing tests
+
+- (void)testIdenticalRequestAttachesToRunningConnection
+{
+    NSDictionary *options = @{@"uids" : [[NSProcessInfo processInfo] globallyUniqueString]};
+    TestVKRequestDelegate *leaderDelegate = [[TestVKRequestDelegate alloc] init];
+    TestVKRequestDelegate *followerDelegate = [[TestVKRequestDelegate alloc] init];
+
+    TestVKOfflineRequest *leader = [self offlineRequestWithMethod:@"users.get" options:options delegate:leaderDelegate];
+    TestVKOfflineRequest *follower = [self offlineRequestWithMethod:@"users.get" options:options delegate:followerDelegate];
+
+    [leader start];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == leader.connectionsCount);
+    }], @"Connection was not opened");
+
+    [follower start];
+    [self processEventsForTimeInterval:0.2];
+
+    STAssertTrue(0 == follower.connectionsCount, @"Identical request opened its own connection");
+
+    [self completeRequest:leader
+             withResponse:@"{\"response\":[1]}"];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == [leaderDelegate.responses count] && 1 == [followerDelegate.responses count]);
+    }], @"Response was not delivered to both requests");
+
+//    объект ответа разбирается один раз
+    STAssertTrue(leaderDelegate.responses[0] == followerDelegate.responses[0], @"Response was parsed for each request");
+
+//    повторная отправка сообщения не должна быть объединена с первой
+    TestVKOfflineRequest *firstSend = [self offlineRequestWithMethod:@"messages.send" options:options delegate:leaderDelegate];
+    TestVKOfflineRequest *secondSend = [self offlineRequestWithMethod:@"messages.send" options:options delegate:followerDelegate];
+
+    [firstSend start];
+    [secondSend start];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == firstSend.connectionsCount && 1 == secondSend.connectionsCount);
+    }], @"Non-idempotent requests should not be coalesced");
+
+    [firstSend cancel];
+    [secondSend cancel];
+}
+
+- (void)testCancelledFollowerDoesNotAffectLeader
+{
+    NSDictionary *options = @{@"uids" : [[NSProcessInfo processInfo] globallyUniqueString]};
+    TestVKRequestDelegate *leaderDelegate = [[TestVKRequestDelegate alloc] init];
+    TestVKRequestDelegate *cancelledDelegate = [[TestVKRequestDelegate alloc] init];
+    TestVKRequestDelegate *followerDelegate = [[TestVKRequestDelegate alloc] init];
+
+    TestVKOfflineRequest *leader = [self offlineRequestWithMethod:@"users.get" options:options delegate:leaderDelegate];
+    TestVKOfflineRequest *cancelledFollower = [self offlineRequestWithMethod:@"users.get" options:options delegate:cancelledDelegate];
+    TestVKOfflineRequest *follower = [self offlineRequestWithMethod:@"users.get" options:options delegate:followerDelegate];
+
+    [leader start];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == leader.connectionsCount);
+    }], @"Connection was not opened");
+
+    [cancelledFollower start];
+    [follower start];
+    [self processEventsForTimeInterval:0.2];
+
+    [cancelledFollower cancel];
+    [self processEventsForTimeInterval:0.1];
+
+    [self completeRequest:leader
+             withResponse:@"{\"response\":[1]}"];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == [leaderDelegate.responses count] && 1 == [followerDelegate.responses count]);
+    }], @"Cancelling a follower affected the connection");
+
+    [self processEventsForTimeInterval:0.1];
+
+    STAssertTrue(0 == [cancelledDelegate.callbackQueueLabels count], @"Cancelled follower should not call delegate");
+    STAssertTrue(0 == cancelledFollower.connectionsCount && 0 == follower.connectionsCount, @"Followers opened their own connections");
+}
+
+- (void)testCancellingAllCoalescedRequestsTearsConnectionDown
+{
+    NSDictionary *options = @{@"uids" : [[NSProcessInfo processInfo] globallyUniqueString]};
+    TestVKRequestDelegate *delegate = [[TestVKRequestDelegate alloc] init];
+
+    TestVKOfflineRequest *leader = [self offlineRequestWithMethod:@"users.get" options:options delegate:delegate];
+    TestVKOfflineRequest *follower = [self offlineRequestWithMethod:@"users.get" options:options delegate:delegate];
+
+    [leader start];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == leader.connectionsCount);
+    }], @"Connection was not opened");
+
+    [follower start];
+    [self processEventsForTimeInterval:0.2];
+
+//    соединение продолжает работать, пока остаётся хотя бы один запрос
+    [leader cancel];
+    [self processEventsForTimeInterval:0.1];
+
+    TestVKOfflineRequest *lateFollower = [self offlineRequestWithMethod:@"users.get" options:options delegate:delegate];
+    [lateFollower start];
+    [self processEventsForTimeInterval:0.2];
+
+    STAssertTrue(0 == lateFollower.connectionsCount, @"Connection was torn down while followers were waiting");
+
+    [follower cancel];
+    [lateFollower cancel];
+    [self processEventsForTimeInterval:0.1];
+
+//    соединение закрыто - такой же запрос открывает новое
+    TestVKOfflineRequest *nextRequest = [self offlineRequestWithMethod:@"users.get" options:options delegate:delegate];
+    [nextRequest start];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == nextRequest.connectionsCount);
+    }], @"Connection of cancelled requests is still in flight");
+
+    [nextRequest cancel];
+    [self processEventsForTimeInterval:0.1];
+
+    STAssertTrue(0 == [delegate.callbackQueueLabels count], @"Cancelled requests should not call delegate");
+}
+
+- (void)testFollowerReceivesResponseOnItsCallbackQueue
+{
+    NSDictionary *options = @{@"uids" : [[NSProcessInfo processInfo] globallyUniqueString]};
+    TestVKRequestDelegate *leaderDelegate = [[TestVKRequestDelegate alloc] init];
+    TestVKRequestDelegate *followerDelegate = [[TestVKRequestDelegate alloc] init];
+
+    TestVKOfflineRequest *leader = [self offlineRequestWithMethod:@"users.get" options:options delegate:leaderDelegate];
+    TestVKOfflineRequest *follower = [self offlineRequestWithMethod:@"users.get" options:options delegate:followerDelegate];
+    leader.callbackQueue = [self callbackQueueWithLabel:"leader"];
+    follower.callbackQueue = [self callbackQueueWithLabel:"follower"];
+
+    [leader start];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == leader.connectionsCount);
+    }], @"Connection was not opened");
+
+    [follower start];
+    [self processEventsForTimeInterval:0.2];
+
+    [self completeRequest:leader
+             withResponse:@"{\"response\":[{\"uid\":1}]}"];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == [leaderDelegate.responses count] && 1 == [followerDelegate.responses count]);
+    }], @"Response was not delivered to both requests");
+
+    STAssertEqualObjects(followerDelegate.responses[0], (@{@"response" : @[@{@"uid" : @1}]}), @"Follower received wrong response");
+
+//    прогресс загрузки и ответ
+    STAssertEqualObjects(leaderDelegate.callbackQueueLabels, (@[@"leader", @"leader"]), @"Leader delegate was called on wrong queue");
+    STAssertEqualObjects(followerDelegate.callbackQueueLabels, (@[@"follower", @"follower"]), @"Follower delegate was called on wrong queue");
+}
+
+#pragma mark - callback queue tests
+
+- (void)testCachedResponseIsDeliveredOnCallbackQueue
+{
+    TestVKRequestDelegate *delegate = [[TestVKRequestDelegate alloc] init];
+    VKRequest *request = [self cachedRequestWithDelegate:delegate];
+    request.callbackQueue = [self callbackQueueWithLabel:"callback"];
+
+    [request start];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == [delegate.responses count]);
+    }], @"Cached response was not delivered");
+
+    STAssertEqualObjects(delegate.responses[0], (@{@"response" : @[]}), @"Wrong cached response");
+    STAssertEqualObjects(delegate.callbackQueueLabels, @[@"callback"], @"Delegate was called on wrong queue");
+}
+
+- (void)testCancelBeforeCacheLookupFinishesDeliversNothing
+{
+    TestVKRequestDelegate *delegate = [[TestVKRequestDelegate alloc] init];
+    VKRequest *request = [self cachedRequestWithDelegate:delegate];
+
+//    делегат вызывается на главной очереди, поэтому ответ из кэша не может быть
+//    передан раньше, чем запрос будет отменён
+    [request start];
+    [request cancel];
+
+    [self processEventsForTimeInterval:0.5];
+
+    STAssertTrue(0 == [delegate.responses count], @"Cancelled request should not deliver cached response");
+    STAssertTrue(0 == [delegate.callbackQueueLabels count], @"Cancelled request should not call delegate");
+}
+
+- (void)testDelegateCallsStayOnCallbackQueue
+{
+    TestVKRequestDelegate *delegate = [[TestVKRequestDelegate alloc] init];
+    dispatch_queue_t callbackQueue = [self callbackQueueWithLabel:"callback"];
+
+    VKRequest *request = [self requestWithMethod:@"users.get"
+                                        delegate:delegate];
+    request.callbackQueue = callbackQueue;
+
+    VKRequest *failedRequest = [self requestWithMethod:@"users.get"
+                                              delegate:delegate];
+    failedRequest.callbackQueue = callbackQueue;
+
+    [self completeRequest:request
+             withResponse:@"{\"response\":[]}"];
+
+    [failedRequest connection:nil didFailWithError:[NSError errorWithDomain:NSURLErrorDomain
+                                                                       code:NSURLErrorBadURL
+                                                                   userInfo:nil]];
+
+    STAssertTrue([self waitForCondition:^BOOL
+    {
+        return (1 == [delegate.responses count] && 1 == [delegate.connectionErrors count]);
+    }], @"Response and error were not delivered");
+
+//    прогресс загрузки, ответ и ошибка соединения
+    STAssertEqualObjects(delegate.callbackQueueLabels, (@[@"callback", @"callback", @"callback"]), @"Delegate was called on wrong queue");
+}
+
+@end
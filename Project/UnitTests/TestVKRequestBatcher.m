@@ -0,0 +1,119 @@
+//
+//  TestVKRequestBatcher.m
+//  Project
+//
+//  Created by AndrewShmig on 10/16/13.
+//  Copyright (c) 2013 AndrewShmig. All rights reserved.
+//
+
+#import "TestVKRequestBatcher.h"
+#import "VKRequestBatcher.h"
+
+
+// делегат, запоминающий параметры капчи
+@interface TestVKRequestBatcherCaptchaDelegate : NSObject <VKRequestDelegate>
+
+@property (nonatomic, assign) BOOL didReceiveCaptcha;
+@property (nonatomic, copy) NSString *captchaSid;
+@property (nonatomic, copy) NSString *captchaImage;
+
+@end
+
+@implementation TestVKRequestBatcherCaptchaDelegate
+
+- (void)VKRequest:(VKRequest *)request
+       captchaSid:(NSString *)captchaSid
+     captchaImage:(NSString *)captchaImage
+{
+    self.captchaSid = captchaSid;
+    self.captchaImage = captchaImage;
+    self.didReceiveCaptcha = YES;
+}
+
+@end
+
+
+@implementation TestVKRequestBatcher
+
+- (void)testBatchedOptions
+{
+    VKRequest *request = [[VKRequest alloc] initWithMethod:@"users.get"
+                                                   options:@{@"uids" : @1, @"Fields" : @"bdate", @"access_token" : @"token"}];
+
+    NSDictionary *expectedOptions = @{@"uids" : @"1", @"fields" : @"bdate"};
+
+    STAssertEqualObjects([request batchedOptions], expectedOptions, @"Batched options should not contain access token");
+    STAssertEqualObjects([request batchedAccessToken], @"token", @"Wrong access token");
+}
+
+- (void)testMaximumBatchSizeIsLimited
+{
+    VKRequestBatcher *batcher = [[VKRequestBatcher alloc] init];
+
+    STAssertTrue(batcher.maximumBatchSize == kVKRequestBatcherMaximumBatchSize, @"Wrong default batch size");
+
+    batcher.maximumBatchSize = 100;
+    STAssertTrue(batcher.maximumBatchSize == kVKRequestBatcherMaximumBatchSize, @"execute does not allow more than 25 calls");
+
+    batcher.maximumBatchSize = 0;
+    STAssertTrue(batcher.maximumBatchSize == 1, @"Batch should contain at least one call");
+}
+
+- (void)testCancelledRequestIsRemovedFromBatch
+{
+    VKRequestBatcher *batcher = [[VKRequestBatcher alloc] init];
+    VKRequest *first = [[VKRequest alloc] initWithMethod:@"users.get"
+                                                 options:@{@"uids" : @"1", @"access_token" : @"token"}];
+    VKRequest *second = [[VKRequest alloc] initWithMethod:@"wall.get"
+                                                  options:@{@"count" : @"10", @"access_token" : @"token"}];
+
+    [batcher addRequest:first];
+    [batcher addRequest:second];
+
+    STAssertTrue(batcher.pendingCount == 2, @"Requests with the same token should be batched together");
+
+    [batcher removeRequest:first];
+
+    STAssertTrue(batcher.pendingCount == 1, @"Cancelled request is still pending");
+
+    [batcher removeRequest:second];
+
+    STAssertTrue(batcher.pendingCount == 0, @"Cancelled request is still pending");
+}
+
+- (void)testCaptchaErrorWithoutImageIsPassedToBatchedRequests
+{
+    VKRequestBatcher *batcher = [[VKRequestBatcher alloc] init];
+    TestVKRequestBatcherCaptchaDelegate *delegate = [[TestVKRequestBatcherCaptchaDelegate alloc] init];
+
+    VKRequest *batchedRequest = [[VKRequest alloc] initWithMethod:@"users.get"
+                                                          options:@{@"uids" : @"1", @"access_token" : @"token"}];
+    batchedRequest.delegate = delegate;
+
+    VKRequest *executeRequest = [[VKRequest alloc] initWithMethod:@"execute"
+                                                          options:@{@"access_token" : @"token"}];
+    executeRequest.signature = @[batchedRequest];
+    executeRequest.delegate = batcher;
+
+//    ответ execute с ошибкой 14 без captcha_img
+    NSHTTPURLResponse *httpResponse = [[NSHTTPURLResponse alloc] initWithURL:[NSURL URLWithString:kVKAPIURLPrefix]
+                                                                  statusCode:200
+                                                                 HTTPVersion:@"HTTP/1.1"
+                                                                headerFields:@{}];
+
+    [executeRequest connection:nil didReceiveResponse:httpResponse];
+    [executeRequest connection:nil didReceiveData:[@"{\"error\":{\"error_code\":14,\"captcha_sid\":\"123\"}}" dataUsingEncoding:NSUTF8StringEncoding]];
+    [executeRequest connectionDidFinishLoading:nil];
+
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+
+    while (!delegate.didReceiveCaptcha && 0 < [deadline timeIntervalSinceNow])
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+                                 beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+
+    STAssertTrue(delegate.didReceiveCaptcha, @"Captcha error was not passed to batched request");
+    STAssertEqualObjects(delegate.captchaSid, @"123", @"Wrong captcha sid");
+    STAssertNil(delegate.captchaImage, @"Missing captcha image should stay nil");
+}
+
+@end
@@ -0,0 +1,59 @@
+//
+//  TestVKRequestRetryPolicy.m
+//  Project
+//
+//  Created by AndrewShmig on 10/16/13.
+//  Copyright (c) 2013 AndrewShmig. All rights reserved.
+//
+
+#import "TestVKRequestRetryPolicy.h"
+#import "VKRequestRetryPolicy.h"
+
+
+@implementation TestVKRequestRetryPolicy
+
+- (void)testErrorClassification
+{
+    VKRequestRetryPolicy *policy = [VKRequestRetryPolicy defaultPolicy];
+
+    NSError *notConnected = [NSError errorWithDomain:NSURLErrorDomain
+                                                code:NSURLErrorCannotConnectToHost
+                                            userInfo:nil];
+    NSError *timedOut = [NSError errorWithDomain:NSURLErrorDomain
+                                            code:NSURLErrorTimedOut
+                                        userInfo:nil];
+
+    STAssertTrue([policy shouldRetryAfterConnectionError:notConnected idempotent:NO], @"Request was not sent and can be retried");
+    STAssertTrue([policy shouldRetryAfterConnectionError:timedOut idempotent:YES], @"Idempotent request should be retried after timeout");
+    STAssertFalse([policy shouldRetryAfterConnectionError:timedOut idempotent:NO], @"Mutating request may have been executed");
+
+    STAssertTrue([policy shouldRetryAfterStatusCode:503 idempotent:YES], @"Server errors should be retried");
+    STAssertFalse([policy shouldRetryAfterStatusCode:503 idempotent:NO], @"Mutating request may have been executed");
+    STAssertFalse([policy shouldRetryAfterStatusCode:404 idempotent:YES], @"Client errors should not be retried");
+
+    STAssertTrue([policy shouldRetryAfterResponseError:@{@"error_code" : @6} idempotent:NO], @"Throttled request was not executed");
+    STAssertTrue([policy shouldRetryAfterResponseError:@{@"error_code" : @10} idempotent:YES], @"Internal server error should be retried");
+    STAssertFalse([policy shouldRetryAfterResponseError:@{@"error_code" : @10} idempotent:NO], @"Mutating request may have been executed");
+    STAssertFalse([policy shouldRetryAfterResponseError:@{@"error_code" : @5} idempotent:YES], @"Authorization errors should not be retried");
+}
+
+- (void)testDelayGrowsExponentially
+{
+    VKRequestRetryPolicy *policy = [[VKRequestRetryPolicy alloc]
+                                                          initWithMaximumAttempts:5
+                                                                     initialDelay:1
+                                                                     maximumDelay:4
+                                                                         deadline:60];
+
+    for (NSUInteger i = 0; i < 100; i++) {
+        NSTimeInterval first = [policy delayBeforeRetry:1];
+        NSTimeInterval third = [policy delayBeforeRetry:3];
+        NSTimeInterval fifth = [policy delayBeforeRetry:5];
+
+        STAssertTrue(first >= 0.5 && first <= 1, @"Wrong delay before the first retry: %f", first);
+        STAssertTrue(third >= 2 && third <= 4, @"Wrong delay before the third retry: %f", third);
+        STAssertTrue(fifth >= 2 && fifth <= 4, @"Delay should not exceed maximumDelay: %f", fifth);
+    }
+}
+
+@end
@@ -0,0 +1,13 @@
+//
+//  TestVKRequestScheduler.h
+//  Project
+//
+//  Created by AndrewShmig on 10/16/13.
+//  Copyright (c) 2013 AndrewShmig. All rights reserved.
+//
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@interface TestVKRequestScheduler : SenTestCase
+
+@end
@@ -0,0 +1,113 @@
+//
+//  TestVKRequestScheduler.m
+//  Project
+//
+//  Created by AndrewShmig on 10/16/13.
+//  Copyright (c) 2013 AndrewShmig. All rights reserved.
+//
+
+#import "TestVKRequestScheduler.h"
+#import "VKRequestScheduler.h"
+
+
+// запрос, который вместо открытия соединения запоминает факт запуска
+@interface TestVKScheduledRequest : VKRequest
+
+@property (nonatomic, assign) BOOL isStarted;
+
+@end
+
+@implementation TestVKScheduledRequest
+
+- (void)startScheduledConnection
+{
+    self.isStarted = YES;
+}
+
+@end
+
+
+@implementation TestVKRequestScheduler
+
+- (TestVKScheduledRequest *)requestWithAccessToken:(NSString *)accessToken
+                                          priority:(VKRequestPriority)priority
+{
+    NSDictionary *options = (nil != accessToken ? @{@"access_token" : accessToken} : @{});
+    TestVKScheduledRequest *request = [[TestVKScheduledRequest alloc] initWithMethod:@"users.get"
+                                                                              options:options];
+    request.priority = priority;
+
+    return request;
+}
+
+- (void)testUserVisibleRequestsHaveReservedSlot
+{
+    VKRequestScheduler *scheduler = [[VKRequestScheduler alloc] init];
+    scheduler.maximumConcurrentRequests = 2;
+    scheduler.requestsPerSecond = 0;
+
+    TestVKScheduledRequest *first = [self requestWithAccessToken:nil priority:VKRequestPriorityLow];
+    TestVKScheduledRequest *second = [self requestWithAccessToken:nil priority:VKRequestPriorityLow];
+    TestVKScheduledRequest *userVisible = [self requestWithAccessToken:nil priority:VKRequestPriorityHigh];
+
+    [scheduler addRequest:first];
+    [scheduler addRequest:second];
+
+    STAssertTrue(first.isStarted, @"Request should start immediately");
+    STAssertFalse(second.isStarted, @"The last slot is reserved for user-visible requests");
+
+    [scheduler addRequest:userVisible];
+
+    STAssertTrue(userVisible.isStarted, @"User-visible request should use the reserved slot");
+
+    [scheduler removeRequest:userVisible];
+    [scheduler removeRequest:first];
+
+    STAssertTrue(second.isStarted, @"Pending request should start after a slot is freed");
+    STAssertTrue(scheduler.pendingCount == 0, @"Wrong pending count");
+}
+
+- (void)testRequestsAreRateLimitedPerAccessToken
+{
+    VKRequestScheduler *scheduler = [[VKRequestScheduler alloc] init];
+    scheduler.requestsPerSecond = 1;
+
+    TestVKScheduledRequest *first = [self requestWithAccessToken:@"first" priority:VKRequestPriorityNormal];
+    TestVKScheduledRequest *second = [self requestWithAccessToken:@"first" priority:VKRequestPriorityNormal];
+    TestVKScheduledRequest *otherAccount = [self requestWithAccessToken:@"second" priority:VKRequestPriorityNormal];
+
+    [scheduler addRequest:first];
+    [scheduler addRequest:second];
+    [scheduler addRequest:otherAccount];
+
+    STAssertTrue(first.isStarted, @"Request should start immediately");
+    STAssertFalse(second.isStarted, @"Request should wait for the rate limit of its access token");
+    STAssertTrue(otherAccount.isStarted, @"Other accounts should not be limited");
+    STAssertTrue(scheduler.pendingCount == 1, @"Wrong pending count");
+}
+
+- (void)testPrefetchKeepsRateLimitReserve
+{
+    VKRequestScheduler *scheduler = [[VKRequestScheduler alloc] init];
+    scheduler.maximumConcurrentRequests = 10;
+    scheduler.requestsPerSecond = 3;
+
+    NSMutableArray *prefetch = [NSMutableArray array];
+
+    for (NSUInteger i = 0; i < 3; i++) {
+        TestVKScheduledRequest *request = [self requestWithAccessToken:@"token" priority:VKRequestPriorityLow];
+
+        [prefetch addObject:request];
+        [scheduler addRequest:request];
+    }
+
+    STAssertTrue([prefetch[0] isStarted] && [prefetch[1] isStarted], @"Prefetch should use the rate limit");
+    STAssertFalse([prefetch[2] isStarted], @"Prefetch should leave one request for user-visible requests");
+
+    TestVKScheduledRequest *userVisible = [self requestWithAccessToken:@"token" priority:VKRequestPriorityHigh];
+    [scheduler addRequest:userVisible];
+
+    STAssertTrue(userVisible.isStarted, @"User-visible request should not wait for prefetch");
+}
+
+@end
@@ -10,6 +10,7 @@
 #import "VKStorage.h"
 #import "VKStorageItem.h"
 #import "VKAccessToken.h"
+#import "VKCacheKey.h"
 
 @implementation TestVKStorage
 
@@ -215,4 +216,51 @@
     [[VKStorage sharedStorage] clean];
 }
 
+- (void)testCacheLimits
+{
+    VKStorage *storage = [VKStorage sharedStorage];
+
+    STAssertTrue(storage.maxCacheSize == kVKStorageDefaultMaxCacheSize, @"Wrong default cache size limit");
+
+    VKAccessToken *token = [[VKAccessToken alloc]
+                                           initWithUserID:1
+                                              accessToken:@"1"
+                                           expirationTime:0
+                                              permissions:@[@"offline",
+                                                            @"friends"]];
+    VKStorageItem *item = [storage createStorageItemForAccessToken:token];
+    [storage addItem:item];
+
+    storage.maxItemCacheSize = 1024;
+    storage.evictionPolicy = VKCachedDataEvictionPolicyLFU;
+
+    STAssertTrue(item.cachedData.maxCacheSize == 1024, @"Item cache size limit was not applied");
+    STAssertTrue(item.cachedData.evictionPolicy == VKCachedDataEvictionPolicyLFU, @"Item eviction policy was not applied");
+
+    storage.maxItemCacheSize = 0;
+    storage.evictionPolicy = VKCachedDataEvictionPolicyLRU;
+
+    [storage clean];
+}
+
+- (void)testSharedCache
+{
+    VKStorage *storage = [VKStorage sharedStorage];
+    NSString *key = [VKCacheKey keyForMethod:@"users.get" options:@{@"user_ids" : @"1"}];
+    NSData *data = [@"{\"response\":[1]}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    STAssertNotNil(storage.sharedCachedData, @"Shared cache is nil");
+
+    [storage.sharedCachedData addCachedData:data forKey:key liveTime:VKCachedDataLiveTimeOneHour];
+    [storage.sharedCachedData flush];
+
+//    общий кэш учитывается в размере кэша хранилища
+    STAssertTrue(storage.cacheSize >= [data length], @"Shared cache is not counted in cache size");
+    STAssertNotNil([storage cacheStatistics][kVKStorageSharedCacheStatisticsKey], @"No statistics of shared cache");
+
+    [storage cleanCachedData];
+
+    STAssertNil([storage.sharedCachedData cachedDataForKey:key offlineMode:YES staleGraceTime:0 isStale:NULL], @"Shared cache was not cleaned");
+}
+
 @end
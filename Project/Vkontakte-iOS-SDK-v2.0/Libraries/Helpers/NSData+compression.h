@@ -0,0 +1,61 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import <Foundation/Foundation.h>
+
+/** Сжатие данных блочными кодеками LZ4 (быстрый) и zlib (более сильное сжатие).
+
+Сжатые данные не содержат длину исходных данных - её необходимо хранить отдельно
+и передавать при распаковке.
+*/
+@interface NSData (compression)
+
+/** Сжатие в формате блока LZ4
+
+@return сжатые данные, либо nil, если данные не удалось сжать
+*/
+- (NSData *)LZ4CompressedData;
+
+/** Распаковка блока LZ4
+
+@param length длина исходных данных
+@return исходные данные, либо nil, если блок повреждён или длина не совпадает
+*/
+- (NSData *)LZ4DecompressedDataWithLength:(NSUInteger)length;
+
+/** Сжатие в формате zlib
+
+@return сжатые данные, либо nil, если данные не удалось сжать
+*/
+- (NSData *)zlibCompressedData;
+
+/** Распаковка данных в формате zlib
+
+@param length длина исходных данных
+@return исходные данные, либо nil, если данные повреждены или длина не совпадает
+*/
+- (NSData *)zlibDecompressedDataWithLength:(NSUInteger)length;
+
+@end
@@ -0,0 +1,273 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import "NSData+compression.h"
+#import <zlib.h>
+
+
+// параметры формата блока LZ4
+#define VKLZ4MinMatch 4
+#define VKLZ4LastLiterals 5
+#define VKLZ4MatchFindLimit 12
+#define VKLZ4MaxDistance 65535
+#define VKLZ4HashLog 12
+
+
+static uint32_t VKLZ4Read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+
+    return value;
+}
+
+static uint32_t VKLZ4Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32 - VKLZ4HashLog);
+}
+
+// длины, не помещающиеся в 4 бита токена, дописываются байтами по 255
+static uint8_t *VKLZ4WriteLength(uint8_t *op, size_t length)
+{
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+
+    *op++ = (uint8_t) length;
+
+    return op;
+}
+
+static size_t VKLZ4CompressBound(size_t length)
+{
+    return length + length / 255 + 16;
+}
+
+static uint8_t *VKLZ4WriteSequence(uint8_t *op,
+                                   const uint8_t *literals,
+                                   size_t literalsLength,
+                                   size_t offset,
+                                   size_t matchLength)
+{
+    uint8_t *token = op++;
+
+    if (literalsLength >= 15) {
+        *token = 15 << 4;
+        op = VKLZ4WriteLength(op, literalsLength - 15);
+    } else {
+        *token = (uint8_t) (literalsLength << 4);
+    }
+
+    memcpy(op, literals, literalsLength);
+    op += literalsLength;
+
+//    последняя последовательность состоит только из литералов
+    if (0 == matchLength)
+        return op;
+
+    *op++ = (uint8_t) (offset & 0xFF);
+    *op++ = (uint8_t) (offset >> 8);
+
+    size_t length = matchLength - VKLZ4MinMatch;
+
+    if (length >= 15) {
+        *token |= 15;
+        op = VKLZ4WriteLength(op, length - 15);
+    } else {
+        *token |= (uint8_t) length;
+    }
+
+    return op;
+}
+
+// жадный поиск совпадений по хэшу первых четырёх байт, формат блока LZ4
+static size_t VKLZ4Compress(const uint8_t *src, size_t srcLength, uint8_t *dst)
+{
+    uint32_t table[1 << VKLZ4HashLog];
+    memset(table, 0, sizeof(table));
+
+    uint8_t *op = dst;
+    size_t ip = 0;
+    size_t anchor = 0;
+
+    if (srcLength > VKLZ4MatchFindLimit) {
+        size_t matchFindLimit = srcLength - VKLZ4MatchFindLimit;
+        size_t matchLimit = srcLength - VKLZ4LastLiterals;
+
+        while (ip < matchFindLimit) {
+            uint32_t sequence = VKLZ4Read32(src + ip);
+            uint32_t hash = VKLZ4Hash(sequence);
+            size_t ref = table[hash];
+
+            table[hash] = (uint32_t) ip;
+
+            if (ref >= ip || ip - ref > VKLZ4MaxDistance || VKLZ4Read32(src + ref) != sequence) {
+                ip++;
+                continue;
+            }
+
+//            совпадение расширяется назад, в ещё не записанные литералы
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                ip--;
+                ref--;
+            }
+
+            size_t matchLength = VKLZ4MinMatch;
+
+            while (ip + matchLength < matchLimit && src[ref + matchLength] == src[ip + matchLength])
+                matchLength++;
+
+            op = VKLZ4WriteSequence(op, src + anchor, ip - anchor, ip - ref, matchLength);
+
+            ip += matchLength;
+            anchor = ip;
+        }
+    }
+
+    op = VKLZ4WriteSequence(op, src + anchor, srcLength - anchor, 0, 0);
+
+    return (size_t) (op - dst);
+}
+
+// проверяет каждую длину и смещение - повреждённый блок не выходит за границы буферов
+static BOOL VKLZ4Decompress(const uint8_t *src, size_t srcLength, uint8_t *dst, size_t dstLength)
+{
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < srcLength) {
+        uint8_t token = src[ip++];
+        size_t literalsLength = token >> 4;
+
+        if (15 == literalsLength) {
+            uint8_t byte;
+
+            do {
+                if (ip >= srcLength)
+                    return NO;
+
+                byte = src[ip++];
+                literalsLength += byte;
+            } while (255 == byte);
+        }
+
+        if (literalsLength > srcLength - ip || literalsLength > dstLength - op)
+            return NO;
+
+        memcpy(dst + op, src + ip, literalsLength);
+        ip += literalsLength;
+        op += literalsLength;
+
+//        последняя последовательность
+        if (ip == srcLength)
+            break;
+
+        if (ip + 2 > srcLength)
+            return NO;
+
+        size_t offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+
+        if (0 == offset || offset > op)
+            return NO;
+
+        size_t matchLength = token & 15;
+
+        if (15 == matchLength) {
+            uint8_t byte;
+
+            do {
+                if (ip >= srcLength)
+                    return NO;
+
+                byte = src[ip++];
+                matchLength += byte;
+            } while (255 == byte);
+        }
+
+        matchLength += VKLZ4MinMatch;
+
+        if (matchLength > dstLength - op)
+            return NO;
+
+//        области могут перекрываться - копируем побайтно
+        for (size_t i = 0; i < matchLength; i++)
+            dst[op + i] = dst[op - offset + i];
+
+        op += matchLength;
+    }
+
+    return (op == dstLength);
+}
+
+
+@implementation NSData (compression)
+
+- (NSData *)LZ4CompressedData
+{
+    NSMutableData *compressedData = [[NSMutableData alloc] initWithLength:VKLZ4CompressBound([self length])];
+
+    size_t compressedLength = VKLZ4Compress([self bytes], [self length], [compressedData mutableBytes]);
+    [compressedData setLength:compressedLength];
+
+    return compressedData;
+}
+
+- (NSData *)LZ4DecompressedDataWithLength:(NSUInteger)length
+{
+    NSMutableData *data = [[NSMutableData alloc] initWithLength:length];
+
+    if (!VKLZ4Decompress([self bytes], [self length], [data mutableBytes], length))
+        return nil;
+
+    return data;
+}
+
+- (NSData *)zlibCompressedData
+{
+    uLongf compressedLength = compressBound((uLong) [self length]);
+    NSMutableData *compressedData = [[NSMutableData alloc] initWithLength:compressedLength];
+
+    if (Z_OK != compress2([compressedData mutableBytes], &compressedLength, [self bytes], (uLong) [self length], Z_DEFAULT_COMPRESSION))
+        return nil;
+
+    [compressedData setLength:compressedLength];
+
+    return compressedData;
+}
+
+- (NSData *)zlibDecompressedDataWithLength:(NSUInteger)length
+{
+    NSMutableData *data = [[NSMutableData alloc] initWithLength:length];
+    uLongf decompressedLength = length;
+
+    if (Z_OK != uncompress([data mutableBytes], &decompressedLength, [self bytes], (uLong) [self length]) || decompressedLength != length)
+        return nil;
+
+    return data;
+}
+
+@end
@@ -0,0 +1,171 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+//
+#import <Foundation/Foundation.h>
+#import "VKRequest.h"
+
+
+/** Политика кэширования ответов метода API: время жизни кэша, время использования
+устаревших данных, хранение в общем кэше и приоритет запроса.
+
+Экземпляры класса неизменяемы.
+*/
+@interface VKCachePolicy : NSObject <NSCopying>
+
+/**
+@name Свойства
+*/
+/** Время жизни кэша ответа. VKCachedDataLiveTimeNever - ответ не кэшируется.
+*/
+@property (nonatomic, readonly) VKCachedDataLiveTime liveTime;
+
+/** Кэшируется ли ответ
+*/
+@property (nonatomic, readonly) BOOL isCacheable;
+
+/** Время (в секундах) после истечения срока жизни кэша, в течение которого
+устаревшие данные ещё могут быть использованы (см. VKRequest staleGraceTime)
+*/
+@property (nonatomic, readonly) NSTimeInterval staleGraceTime;
+
+/** Хранится ли ответ, полученный без токена доступа, в общем для всех учётных
+записей кэше (см. VKRequest useSharedCache)
+*/
+@property (nonatomic, readonly) BOOL useSharedCache;
+
+/** Приоритет запроса
+*/
+@property (nonatomic, readonly) VKRequestPriority priority;
+
+/**
+@name Методы класса
+*/
+/** Политика с указанным временем жизни кэша: устаревшие данные не используются,
+ответ хранится в кэше учётной записи, приоритет обычный
+
+@param liveTime время жизни кэша
+@return экземпляр класса VKCachePolicy
+*/
++ (instancetype)policyWithLiveTime:(VKCachedDataLiveTime)liveTime;
+
+/** Политика, при которой ответ не кэшируется
+
+@return экземпляр класса VKCachePolicy
+*/
++ (instancetype)uncacheablePolicy;
+
+/**
+@name Методы инициализации
+*/
+/** Инициализация политики
+
+@param liveTime время жизни кэша
+@param staleGraceTime время использования устаревших данных (в секундах)
+@param useSharedCache хранить ли ответы без токена доступа в общем кэше
+@param priority приоритет запроса
+@return экземпляр класса VKCachePolicy
+*/
+- (instancetype)initWithLiveTime:(VKCachedDataLiveTime)liveTime
+                  staleGraceTime:(NSTimeInterval)staleGraceTime
+                  useSharedCache:(BOOL)useSharedCache
+                        priority:(VKRequestPriority)priority;
+
+/**
+@name Применение
+*/
+/** Устанавливает параметры политики запросу
+
+@param request запрос
+*/
+- (void)applyToRequest:(VKRequest *)request;
+
+@end
+
+
+/** Таблица политик кэширования методов API.
+
+Для методов, которых нет в таблице, используется политика изменяющих методов
+mutatingMethodPolicy (если метод изменяет данные), либо политика по умолчанию
+defaultPolicy. Таблица может изменяться во время работы приложения, изменения
+применяются к создаваемым после этого запросам.
+
+Все методы потокобезопасны.
+*/
+@interface VKCachePolicyTable : NSObject <NSCopying>
+
+/**
+@name Свойства
+*/
+/** Политика методов, которых нет в таблице. По умолчанию - время жизни кэша
+один час.
+*/
+@property (atomic, copy, readwrite) VKCachePolicy *defaultPolicy;
+
+/** Политика изменяющих методов API (см. VKRequest isMutatingMethod:), которых
+нет в таблице, либо nil - для них используется defaultPolicy. По умолчанию nil.
+*/
+@property (atomic, copy, readwrite) VKCachePolicy *mutatingMethodPolicy;
+
+/**
+@name Методы класса
+*/
+/** Таблица политик по умолчанию: редко изменяющиеся данные (профили, справочники
+мест) кэшируются надолго, часто изменяющиеся (статусы онлайн, сообщения, лента
+новостей) - на несколько минут (сообщения, статусы онлайн и счётчики - без
+возврата устаревших данных), служебные методы (серверы загрузки, long poll) и
+изменяющие методы не кэшируются вовсе
+
+@return новый экземпляр класса VKCachePolicyTable
+*/
++ (instancetype)defaultTable;
+
+/**
+@name Политики методов
+*/
+/** Устанавливает политику метода API
+
+@param policy политика кэширования
+@param methodName наименование метода API
+*/
+- (void)setPolicy:(VKCachePolicy *)policy
+        forMethod:(NSString *)methodName;
+
+/** Удаляет политику метода API - для метода будет использоваться политика по
+умолчанию
+
+@param methodName наименование метода API
+*/
+- (void)removePolicyForMethod:(NSString *)methodName;
+
+/** Политика метода API
+
+@param methodName наименование метода API
+@return политика метода, либо, если метода нет в таблице, mutatingMethodPolicy
+или defaultPolicy
+*/
+- (VKCachePolicy *)policyForMethod:(NSString *)methodName;
+
+@end
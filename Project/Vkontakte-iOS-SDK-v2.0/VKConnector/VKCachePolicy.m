@@ -0,0 +1,258 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+//
+#import "VKCachePolicy.h"
+#import "VKMethods.h"
+
+
+@implementation VKCachePolicy
+
+#pragma mark Visible VKCachePolicy methods
+#pragma mark - Class methods
+
++ (instancetype)policyWithLiveTime:(VKCachedDataLiveTime)liveTime
+{
+    return [[VKCachePolicy alloc]
+                           initWithLiveTime:liveTime
+                             staleGraceTime:0
+                             useSharedCache:NO
+                                   priority:VKRequestPriorityNormal];
+}
+
++ (instancetype)uncacheablePolicy
+{
+    return [self policyWithLiveTime:VKCachedDataLiveTimeNever];
+}
+
+#pragma mark - Init methods
+
+- (instancetype)initWithLiveTime:(VKCachedDataLiveTime)liveTime
+                  staleGraceTime:(NSTimeInterval)staleGraceTime
+                  useSharedCache:(BOOL)useSharedCache
+                        priority:(VKRequestPriority)priority
+{
+    self = [super init];
+
+    if (self) {
+        _liveTime = liveTime;
+        _staleGraceTime = staleGraceTime;
+        _useSharedCache = useSharedCache;
+        _priority = priority;
+    }
+
+    return self;
+}
+
+#pragma mark - Getters
+
+- (BOOL)isCacheable
+{
+    return (VKCachedDataLiveTimeNever != _liveTime);
+}
+
+#pragma mark - Applying
+
+- (void)applyToRequest:(VKRequest *)request
+{
+    request.cacheLiveTime = _liveTime;
+    request.staleGraceTime = (self.isCacheable ? _staleGraceTime : 0);
+    request.priority = _priority;
+
+//    запрос с токеном доступа в общий кэш не попадёт, даже если политика
+//    это допускает (см. VKRequest useSharedCache)
+    request.useSharedCache = _useSharedCache;
+}
+
+#pragma mark - Overridden methods
+
+- (NSString *)description
+{
+    NSDictionary *description = @{
+            @"liveTime"       : @(self.liveTime),
+            @"staleGraceTime" : @(self.staleGraceTime),
+            @"useSharedCache" : (self.useSharedCache ? @"YES" : @"NO"),
+            @"priority"       : @(self.priority)
+    };
+
+    return [description description];
+}
+
+#pragma mark - NSCopying
+
+- (id)copyWithZone:(NSZone *)zone
+{
+//    экземпляры неизменяемы
+    return self;
+}
+
+@end
+
+
+@implementation VKCachePolicyTable
+{
+    NSMutableDictionary *_policies;
+}
+
+#pragma mark Visible VKCachePolicyTable methods
+#pragma mark - Init methods
+
+- (instancetype)init
+{
+    self = [super init];
+
+    if (self) {
+        _policies = [[NSMutableDictionary alloc] init];
+        _defaultPolicy = [VKCachePolicy policyWithLiveTime:VKCachedDataLiveTimeOneHour];
+    }
+
+    return self;
+}
+
+#pragma mark - Class methods
+
++ (instancetype)defaultTable
+{
+    VKCachePolicyTable *table = [[VKCachePolicyTable alloc] init];
+
+//    профили пользователей и групп меняются редко - допустимо показать их
+//    устаревшими, пока данные обновляются; запрошенные без токена профили не
+//    зависят от учётной записи и хранятся в общем кэше
+    VKCachePolicy *profilePolicy = [[VKCachePolicy alloc]
+                                                   initWithLiveTime:VKCachedDataLiveTimeOneDay
+                                                     staleGraceTime:VKCachedDataLiveTimeOneWeek
+                                                     useSharedCache:YES
+                                                           priority:VKRequestPriorityNormal];
+
+    for (NSString *methodName in @[kVKUsersGet, kVKGroupsGetById])
+        [table setPolicy:profilePolicy
+               forMethod:methodName];
+
+//    справочники не зависят от учётной записи и практически не меняются
+    VKCachePolicy *referencePolicy = [[VKCachePolicy alloc]
+                                                     initWithLiveTime:VKCachedDataLiveTimeOneMonth
+                                                       staleGraceTime:VKCachedDataLiveTimeOneYear
+                                                       useSharedCache:YES
+                                                             priority:VKRequestPriorityLow];
+
+    for (NSString *methodName in @[kVKPlacesGetTypes, kVKPlacesGetCountries, kVKPlacesGetRegions,
+                                   kVKPlacesGetCountryById, kVKPlacesGetCities, kVKPlacesGetCityById])
+        [table setPolicy:referencePolicy
+               forMethod:methodName];
+
+//    часто меняющиеся данные: устаревшие сообщения, статусы онлайн и счётчики
+//    вводят пользователя в заблуждение, поэтому из кэша не возвращаются
+    VKCachePolicy *volatilePolicy = [[VKCachePolicy alloc]
+                                                    initWithLiveTime:VKCachedDataLiveTimeOneMinute
+                                                      staleGraceTime:0
+                                                      useSharedCache:NO
+                                                            priority:VKRequestPriorityHigh];
+
+    for (NSString *methodName in @[kVKFriendsGetOnline, kVKMessagesGet, kVKMessagesGetDialogs,
+                                   kVKMessagesGetHistory, kVKMessagesGetLastActivity, kVKAccountGetCounters,
+                                   kVKNotificationsGet])
+        [table setPolicy:volatilePolicy
+               forMethod:methodName];
+
+    for (NSString *methodName in @[kVKNewsfeedGet, kVKStatusGet, kVKWallGet, kVKSearchGetHints])
+        [table setPolicy:[VKCachePolicy policyWithLiveTime:VKCachedDataLiveTimeFiveMinutes]
+               forMethod:methodName];
+
+//    одноразовые адреса серверов и данные, устаревающие сразу после получения
+    for (NSString *methodName in @[kVKMessagesGetLongPollServer, kVKMessagesGetLongPollHistory,
+                                   kVKPhotosGetUploadServer, kVKPhotosGetProfileUploadServer,
+                                   kVKPhotosGetWallUploadServer, kVKPhotosGetMessagesUploadServer,
+                                   kVKPhotosGetChatUploadServer, kVKAudioGetUploadServer,
+                                   kVKDocsGetUploadServer, kVKDocsGetWallUloadServer,
+                                   kVKAccountGetAppPermissions])
+        [table setPolicy:[VKCachePolicy uncacheablePolicy]
+               forMethod:methodName];
+
+//    ответ изменяющего метода (messages.send, wall.post etc) нельзя вернуть
+//    повторному вызову
+    table.mutatingMethodPolicy = [VKCachePolicy uncacheablePolicy];
+
+    return table;
+}
+
+#pragma mark - Policies
+
+- (void)setPolicy:(VKCachePolicy *)policy
+        forMethod:(NSString *)methodName
+{
+    if (nil == methodName)
+        return;
+
+    @synchronized (self) {
+        if (nil == policy)
+            [_policies removeObjectForKey:[methodName lowercaseString]];
+        else
+            _policies[[methodName lowercaseString]] = policy;
+    }
+}
+
+- (void)removePolicyForMethod:(NSString *)methodName
+{
+    [self setPolicy:nil
+          forMethod:methodName];
+}
+
+- (VKCachePolicy *)policyForMethod:(NSString *)methodName
+{
+    VKCachePolicy *policy = nil;
+
+    if (nil != methodName) {
+        @synchronized (self) {
+            policy = _policies[[methodName lowercaseString]];
+        }
+    }
+
+    if (nil != policy)
+        return policy;
+
+    VKCachePolicy *mutatingMethodPolicy = self.mutatingMethodPolicy;
+
+    if (nil != mutatingMethodPolicy && [VKRequest isMutatingMethod:methodName])
+        return mutatingMethodPolicy;
+
+    return self.defaultPolicy;
+}
+
+#pragma mark - NSCopying
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    VKCachePolicyTable *copy = [[VKCachePolicyTable alloc] init];
+    copy.defaultPolicy = self.defaultPolicy;
+    copy.mutatingMethodPolicy = self.mutatingMethodPolicy;
+
+    @synchronized (self) {
+        [copy->_policies addEntriesFromDictionary:_policies];
+    }
+
+    return copy;
+}
+
+@end
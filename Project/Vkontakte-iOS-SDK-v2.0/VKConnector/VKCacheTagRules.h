@@ -0,0 +1,136 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+//
+#import <Foundation/Foundation.h>
+
+/** Обозначение неизвестного владельца данных в тегах записей кэша
+*/
+static NSString *const kVKCacheTagUnknownOwner = @"?";
+
+
+/** Таблица правил, по которым ответы методов API помечаются тегами в кэше и по
+которым изменяющие методы API инвалидируют закэшированные ответы.
+
+Тег записи состоит из наименования ресурса (wall, friends, photos etc) и, если
+известен, идентификатора владельца данных: "wall" и "wall:1234". Владелец
+определяется по значению первого из указанных в правиле параметров запроса
+(owner_id, uid etc), а если ни один из них не указан - им считается текущий
+пользователь. Если значение параметра не является числовым идентификатором
+(например, короткое имя в параметре domain), то владелец считается неизвестным -
+"wall:?".
+
+Ответ читающего метода помечается тегами "ресурс" и "ресурс:владелец". Изменяющий
+метод с известным владельцем инвалидирует теги "ресурс:владелец" и "ресурс:?",
+в остальных случаях - весь ресурс ("ресурс"). Таким образом wall.post на стене
+пользователя удаляет из кэша лишь ответы wall.get для этой стены.
+
+Ответ читающего метода без параметров владельца (wall.getById, photos.getComments
+etc) может содержать данные любых владельцев, поэтому помечается тегом "ресурс:?" и
+инвалидируется любым изменяющим методом ресурса.
+
+Все методы потокобезопасны.
+*/
+@interface VKCacheTagRules : NSObject <NSCopying>
+
+/**
+@name Методы класса
+*/
+/** Таблица правил по умолчанию: стены (wall), друзья (friends), фотографии
+(photos), группы (groups), видео (video) и аудиозаписи (audio)
+
+@return новый экземпляр класса VKCacheTagRules
+*/
++ (instancetype)defaultRules;
+
+/**
+@name Правила
+*/
+/** Устанавливает правило для читающего метода API: ответы метода помечаются тегами
+ресурса
+
+@param resource наименование ресурса (wall, friends etc)
+@param ownerParameters наименования параметров запроса, определяющих владельца
+данных (owner_id, uid etc), в порядке приоритета, либо nil, если владелец данных
+ответа неизвестен
+@param methodName наименование метода API
+*/
+- (void)setResource:(NSString *)resource
+    ownerParameters:(NSArray *)ownerParameters
+          forMethod:(NSString *)methodName;
+
+/** Устанавливает правило для изменяющего метода API: успешный вызов метода
+инвалидирует закэшированные ответы, помеченные тегами ресурса
+
+@param resource наименование ресурса (wall, friends etc)
+@param ownerParameters наименования параметров запроса, определяющих владельца
+изменяемых данных, в порядке приоритета, либо nil, если метод инвалидирует весь
+ресурс
+@param methodName наименование метода API
+*/
+- (void)setInvalidatedResource:(NSString *)resource
+               ownerParameters:(NSArray *)ownerParameters
+                     forMethod:(NSString *)methodName;
+
+/** Удаляет правило метода API
+
+@param methodName наименование метода API
+*/
+- (void)removeRuleForMethod:(NSString *)methodName;
+
+/**
+@name Теги
+*/
+/** Является ли метод API изменяющим (см. setInvalidatedResource:ownerParameters:forMethod:)
+
+@param methodName наименование метода API
+@return YES, если для метода установлено правило инвалидации
+*/
+- (BOOL)isMutatingMethod:(NSString *)methodName;
+
+/** Теги, которыми помечается ответ читающего метода API
+
+@param methodName наименование метода API
+@param options параметры запроса
+@param userID идентификатор текущего пользователя, либо 0
+@return массив тегов (NSString), либо nil, если правила для метода нет или метод
+является изменяющим
+*/
+- (NSArray *)tagsForMethod:(NSString *)methodName
+                   options:(NSDictionary *)options
+                    userID:(NSUInteger)userID;
+
+/** Теги, которые инвалидирует успешный вызов изменяющего метода API
+
+@param methodName наименование метода API
+@param options параметры запроса
+@param userID идентификатор текущего пользователя, либо 0
+@return массив тегов (NSString), либо nil, если метод не является изменяющим
+*/
+- (NSArray *)invalidatedTagsForMethod:(NSString *)methodName
+                              options:(NSDictionary *)options
+                               userID:(NSUInteger)userID;
+
+@end
@@ -0,0 +1,373 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+//
+#import "VKCacheTagRules.h"
+#import "VKMethods.h"
+
+
+/** Правило одного метода API
+*/
+@interface VKCacheTagRule : NSObject
+
+@property (nonatomic, copy) NSString *resource;
+@property (nonatomic, copy) NSArray *ownerParameters;
+@property (nonatomic, assign) BOOL isMutating;
+
+@end
+
+@implementation VKCacheTagRule
+@end
+
+
+// значение параметра запроса (регистр наименования не учитывается)
+static id VKCacheTagRulesOptionValue(NSDictionary *options, NSString *parameter)
+{
+    id value = options[parameter];
+
+    if (nil != value)
+        return value;
+
+    for (id key in options) {
+        if (NSOrderedSame == [[key description] caseInsensitiveCompare:parameter])
+            return options[key];
+    }
+
+    return nil;
+}
+
+// владелец данных: значение первого указанного параметра владельца, либо текущий
+// пользователь; nil, если владелец неизвестен
+static NSString *VKCacheTagRulesOwner(NSArray *ownerParameters, NSDictionary *options, NSUInteger userID)
+{
+    for (NSString *parameter in ownerParameters) {
+        id value = VKCacheTagRulesOptionValue(options, parameter);
+
+        if (nil == value)
+            continue;
+
+//        короткие имена (durov) и списки идентификаторов владельцем не считаются
+        NSString *owner = [value description];
+        NSString *ownerID = [NSString stringWithFormat:@"%lld", [owner longLongValue]];
+
+        return ([ownerID isEqualToString:owner] ? owner : nil);
+    }
+
+    if (0 == userID)
+        return nil;
+
+    return [NSString stringWithFormat:@"%lu", (unsigned long) userID];
+}
+
+static NSString *VKCacheTagRulesTag(NSString *resource, NSString *owner)
+{
+    return [NSString stringWithFormat:@"%@:%@", resource, owner];
+}
+
+
+@implementation VKCacheTagRules
+{
+    NSMutableDictionary *_rules;
+}
+
+#pragma mark Visible VKCacheTagRules methods
+#pragma mark - Init methods
+
+- (instancetype)init
+{
+    self = [super init];
+
+    if (self) {
+        _rules = [[NSMutableDictionary alloc] init];
+    }
+
+    return self;
+}
+
+#pragma mark - Class methods
+
++ (instancetype)defaultRules
+{
+    VKCacheTagRules *rules = [[VKCacheTagRules alloc] init];
+
+//    стены
+    for (NSString *methodName in @[kVKWallGetComments, kVKWallGetReposts, kVKWallGetLikes])
+        [rules setResource:@"wall"
+           ownerParameters:@[@"owner_id"]
+                 forMethod:methodName];
+
+    [rules setResource:@"wall"
+       ownerParameters:@[@"owner_id", @"domain"]
+             forMethod:kVKWallGet];
+    [rules setResource:@"wall"
+       ownerParameters:nil
+             forMethod:kVKWallGetById];
+
+    for (NSString *methodName in @[kVKWallPost, kVKWallEdit, kVKWallDelete, kVKWallRestore,
+                                   kVKWallAddComment, kVKWallDeleteComment, kVKWallRestoreComment,
+                                   kVKWallAddLike, kVKWallDeleteLike])
+        [rules setInvalidatedResource:@"wall"
+                      ownerParameters:@[@"owner_id"]
+                            forMethod:methodName];
+
+//    запись публикуется на стене текущего пользователя, а счётчик репостов
+//    меняется у исходной записи - инвалидируются все стены
+    [rules setInvalidatedResource:@"wall"
+                  ownerParameters:nil
+                        forMethod:kVKWallRepost];
+
+//    друзья
+    [rules setResource:@"friends"
+       ownerParameters:@[@"uid", @"user_id"]
+             forMethod:kVKFriendsGet];
+
+    for (NSString *methodName in @[kVKFriendsGetOnline, kVKFriendsGetMutual, kVKFriendsGetRecent,
+                                   kVKFriendsGetRequests, kVKFriendsGetLists, kVKFriendsGetAppUsers,
+                                   kVKFriendsGetSuggestions, kVKFriendsAreFriends])
+        [rules setResource:@"friends"
+           ownerParameters:nil
+                 forMethod:methodName];
+
+//    дружба затрагивает списки обоих пользователей
+    for (NSString *methodName in @[kVKFriendsAdd, kVKFriendsEdit, kVKFriendsDelete, kVKFriendsAddList,
+                                   kVKFriendsEditList, kVKFriendsDeleteList, kVKFriendsDeleteAllRequests])
+        [rules setInvalidatedResource:@"friends"
+                      ownerParameters:nil
+                            forMethod:methodName];
+
+//    фотографии
+    for (NSString *methodName in @[kVKPhotosGet, kVKPhotosGetAlbums, kVKPhotosGetAlbumsCount,
+                                   kVKPhotosGetAll, kVKPhotosGetProfile])
+        [rules setResource:@"photos"
+           ownerParameters:@[@"owner_id", @"uid"]
+                 forMethod:methodName];
+
+    for (NSString *methodName in @[kVKPhotosGetById, kVKPhotosGetUserPhotos, kVKPhotosGetComments,
+                                   kVKPhotosGetAllComments, kVKPhotosGetTags])
+        [rules setResource:@"photos"
+           ownerParameters:nil
+                 forMethod:methodName];
+
+    for (NSString *methodName in @[kVKPhotosEditAlbum, kVKPhotosEdit, kVKPhotosMove, kVKPhotosMakeCover,
+                                   kVKPhotosReorderAlbums, kVKPhotosReorderPhotos, kVKPhotosDeleteAlbum,
+                                   kVKPhotosDelete, kVKPhotosCreateComment, kVKPhotosDeleteComment,
+                                   kVKPhotosRestoreComment, kVKPhotosEditComment, kVKPhotosPutTag,
+                                   kVKPhotosRemoveTag, kVKPhotosConfirmTag])
+        [rules setInvalidatedResource:@"photos"
+                      ownerParameters:@[@"owner_id"]
+                            forMethod:methodName];
+
+//    альбом может принадлежать группе (gid), а не владельцу
+    for (NSString *methodName in @[kVKPhotosCreateAlbum, kVKPhotosSave, kVKPhotosSaveWallPhoto,
+                                   kVKPhotosSaveProfilePhoto])
+        [rules setInvalidatedResource:@"photos"
+                      ownerParameters:nil
+                            forMethod:methodName];
+
+//    группы
+    [rules setResource:@"groups"
+       ownerParameters:@[@"uid", @"user_id"]
+             forMethod:kVKGroupsGet];
+
+    for (NSString *methodName in @[kVKGroupsGetMembers, kVKGroupsIsMember, kVKGroupsGetBanned])
+        [rules setResource:@"groups"
+           ownerParameters:nil
+                 forMethod:methodName];
+
+    for (NSString *methodName in @[kVKGroupsJoin, kVKGroupsLeave, kVKGroupsBanUser, kVKGroupsUnbanUser])
+        [rules setInvalidatedResource:@"groups"
+                      ownerParameters:nil
+                            forMethod:methodName];
+
+//    видео
+    for (NSString *methodName in @[kVKVideoGet, kVKVideoGetAlbums])
+        [rules setResource:@"video"
+           ownerParameters:@[@"owner_id", @"uid"]
+                 forMethod:methodName];
+
+    for (NSString *methodName in @[kVKVideoGetUserVideos, kVKVideoGetComments, kVKVideoGetTags])
+        [rules setResource:@"video"
+           ownerParameters:nil
+                 forMethod:methodName];
+
+    for (NSString *methodName in @[kVKVideoEdit, kVKVideoDelete, kVKVideoRestore, kVKVideoEditAlbum,
+                                   kVKVideoDeleteAlbum, kVKVideoMoveToAlbum, kVKVideoCreateComment,
+                                   kVKVideoDeleteComment, kVKVideoEditComment, kVKVideoRestoreComment,
+                                   kVKVideoPutTag, kVKVideoRemoveTag])
+        [rules setInvalidatedResource:@"video"
+                      ownerParameters:@[@"owner_id"]
+                            forMethod:methodName];
+
+//    owner_id в video.add - владелец добавляемой записи, а не списка, в который
+//    она добавляется
+    for (NSString *methodName in @[kVKVideoAdd, kVKVideoSave, kVKVideoAddAlbum])
+        [rules setInvalidatedResource:@"video"
+                      ownerParameters:nil
+                            forMethod:methodName];
+
+//    аудиозаписи
+    for (NSString *methodName in @[kVKAudioGet, kVKAudioGetAlbums, kVKAudioGetCount])
+        [rules setResource:@"audio"
+           ownerParameters:@[@"owner_id", @"uid"]
+                 forMethod:methodName];
+
+    [rules setResource:@"audio"
+       ownerParameters:nil
+             forMethod:kVKAudioGetById];
+
+    for (NSString *methodName in @[kVKAudioSave, kVKAudioAdd, kVKAudioDelete, kVKAudioEdit, kVKAudioReorder,
+                                   kVKAudioRestore, kVKAudioAddAlbum, kVKAudioEditAlbum, kVKAudioDeleteAlbum,
+                                   kVKAudioMoveToAlbum])
+        [rules setInvalidatedResource:@"audio"
+                      ownerParameters:nil
+                            forMethod:methodName];
+
+    return rules;
+}
+
+#pragma mark - Rules
+
+- (void)setResource:(NSString *)resource
+    ownerParameters:(NSArray *)ownerParameters
+          forMethod:(NSString *)methodName
+{
+    [self setRuleWithResource:resource
+              ownerParameters:ownerParameters
+                   isMutating:NO
+                    forMethod:methodName];
+}
+
+- (void)setInvalidatedResource:(NSString *)resource
+               ownerParameters:(NSArray *)ownerParameters
+                     forMethod:(NSString *)methodName
+{
+    [self setRuleWithResource:resource
+              ownerParameters:ownerParameters
+                   isMutating:YES
+                    forMethod:methodName];
+}
+
+- (void)removeRuleForMethod:(NSString *)methodName
+{
+    if (nil == methodName)
+        return;
+
+    @synchronized (self) {
+        [_rules removeObjectForKey:[methodName lowercaseString]];
+    }
+}
+
+#pragma mark - Tags
+
+- (BOOL)isMutatingMethod:(NSString *)methodName
+{
+    return [self ruleForMethod:methodName].isMutating;
+}
+
+- (NSArray *)tagsForMethod:(NSString *)methodName
+                   options:(NSDictionary *)options
+                    userID:(NSUInteger)userID
+{
+    VKCacheTagRule *rule = [self ruleForMethod:methodName];
+
+    if (nil == rule || rule.isMutating)
+        return nil;
+
+//    ответ может содержать данные любых владельцев
+    if (nil == rule.ownerParameters)
+        return @[rule.resource,
+                 VKCacheTagRulesTag(rule.resource, kVKCacheTagUnknownOwner)];
+
+    NSString *owner = VKCacheTagRulesOwner(rule.ownerParameters, options, userID);
+
+    return @[rule.resource,
+             VKCacheTagRulesTag(rule.resource, (nil == owner ? kVKCacheTagUnknownOwner : owner))];
+}
+
+- (NSArray *)invalidatedTagsForMethod:(NSString *)methodName
+                              options:(NSDictionary *)options
+                               userID:(NSUInteger)userID
+{
+    VKCacheTagRule *rule = [self ruleForMethod:methodName];
+
+    if (nil == rule || !rule.isMutating)
+        return nil;
+
+    NSString *owner = (nil == rule.ownerParameters ? nil :
+            VKCacheTagRulesOwner(rule.ownerParameters, options, userID));
+
+//    чьи данные изменились - неизвестно, инвалидируется весь ресурс
+    if (nil == owner)
+        return @[rule.resource];
+
+//    ответы с неизвестным владельцем тоже могли содержать изменённые данные
+    return @[VKCacheTagRulesTag(rule.resource, owner),
+             VKCacheTagRulesTag(rule.resource, kVKCacheTagUnknownOwner)];
+}
+
+#pragma mark - NSCopying
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    VKCacheTagRules *copy = [[VKCacheTagRules alloc] init];
+
+    @synchronized (self) {
+        [copy->_rules addEntriesFromDictionary:_rules];
+    }
+
+    return copy;
+}
+
+#pragma mark - Private methods
+
+- (void)setRuleWithResource:(NSString *)resource
+            ownerParameters:(NSArray *)ownerParameters
+                 isMutating:(BOOL)isMutating
+                  forMethod:(NSString *)methodName
+{
+    if (0 == [resource length] || nil == methodName)
+        return;
+
+    VKCacheTagRule *rule = [[VKCacheTagRule alloc] init];
+    rule.resource = resource;
+    rule.ownerParameters = ([ownerParameters count] > 0 ? ownerParameters : nil);
+    rule.isMutating = isMutating;
+
+    @synchronized (self) {
+        _rules[[methodName lowercaseString]] = rule;
+    }
+}
+
+- (VKCacheTagRule *)ruleForMethod:(NSString *)methodName
+{
+    if (nil == methodName)
+        return nil;
+
+    @synchronized (self) {
+        return _rules[[methodName lowercaseString]];
+    }
+}
+
+@end
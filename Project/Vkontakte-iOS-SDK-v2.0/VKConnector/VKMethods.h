@@ -362,3 +362,8 @@ static NSString *const kVKSearchGetHints = @"search.getHints";
 // Apps
 // -----------------------------------------------------------------------------
 static NSString *const kVKAppsGetCatalog = @"apps.getCatalog";
+
+// -----------------------------------------------------------------------------
+// Execute
+// -----------------------------------------------------------------------------
+static NSString *const kVKExecute = @"execute";
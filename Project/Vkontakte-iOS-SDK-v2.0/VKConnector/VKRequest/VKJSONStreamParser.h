@@ -0,0 +1,106 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+//
+#import <Foundation/Foundation.h>
+
+
+@class VKJSONStreamParser;
+
+
+/** Протокол получения элементов ответа по мере их разбора
+*/
+@protocol VKJSONStreamParserDelegate <NSObject>
+
+/** Вызывается для каждого разобранного элемента массива "response" корневого
+объекта ({"response": [...]}), в порядке следования элементов
+
+@param parser парсер
+@param element элемент массива в виде неизменяемого Foundation объекта
+*/
+- (void)JSONStreamParser:(VKJSONStreamParser *)parser
+ didParseResponseElement:(id)element;
+
+@end
+
+
+/** Парсер JSON, разбирающий данные по частям - по мере их получения из сети.
+К моменту получения последней части данных почти весь ответ уже разобран, поэтому
+разбор не добавляет задержки к загрузке.
+
+Результат совпадает с результатом NSJSONSerialization с опцией
+NSJSONReadingAllowFragments: неизменяемые NSDictionary, NSArray, NSString, NSNumber
+и NSNull.
+
+Экземпляры класса не потокобезопасны - данные передаются парсеру на одной
+последовательной очереди.
+*/
+@interface VKJSONStreamParser : NSObject
+
+/**
+@name Свойства
+*/
+/** Делегат, получающий элементы массива "response" по мере их разбора, либо nil
+*/
+@property (nonatomic, weak, readwrite) id <VKJSONStreamParserDelegate> delegate;
+
+/** Разобранный объект. Доступен после успешного вызова finish.
+*/
+@property (nonatomic, readonly) id result;
+
+/** Ошибка разбора, либо nil
+*/
+@property (nonatomic, readonly) NSError *error;
+
+/**
+@name Методы класса
+*/
+/** Разбирает данные целиком
+
+@param data данные в кодировке UTF-8
+@param error ошибка разбора
+@return разобранный объект либо nil в случае ошибки
+*/
++ (id)JSONObjectWithData:(NSData *)data
+                   error:(NSError **)error;
+
+/**
+@name Методы экземпляра
+*/
+/** Разбирает очередную часть данных. Значения, разрезанные границей частей,
+дописываются при получении следующей части.
+
+@param data часть данных в кодировке UTF-8
+@return NO, если данные не являются корректным JSON (см. error)
+*/
+- (BOOL)parseData:(NSData *)data;
+
+/** Завершает разбор - данных больше не будет
+
+@return YES, если данные являются законченным корректным JSON (см. result)
+*/
+- (BOOL)finish;
+
+@end
@@ -0,0 +1,638 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+//
+#import "VKJSONStreamParser.h"
+
+
+// что ожидается следующим (без учёта пробельных символов)
+typedef enum
+{
+
+    VKJSONStateValue,
+    VKJSONStateValueOrArrayEnd,
+    VKJSONStateKeyOrObjectEnd,
+    VKJSONStateKey,
+    VKJSONStateColon,
+    VKJSONStateCommaOrEnd,
+    VKJSONStateDone,
+    VKJSONStateFailed,
+
+} VKJSONState;
+
+// разбираемая лексема, которая может быть разрезана границей частей данных
+typedef enum
+{
+
+    VKJSONTokenNone,
+    VKJSONTokenString,
+    VKJSONTokenNumber,
+    VKJSONTokenLiteral,
+
+} VKJSONToken;
+
+
+// максимальная длина записи числа
+#define kVKJSONMaximumNumberLength 512
+
+
+static BOOL VKJSONIsWhitespace(uint8_t c)
+{
+    return (' ' == c || '\n' == c || '\r' == c || '\t' == c);
+}
+
+static BOOL VKJSONIsNumberCharacter(uint8_t c)
+{
+    return (('0' <= c && '9' >= c) || '-' == c || '+' == c || '.' == c || 'e' == c || 'E' == c);
+}
+
+static BOOL VKJSONReadHex(const uint8_t *bytes,
+                          NSUInteger length,
+                          NSUInteger offset,
+                          uint32_t *value)
+{
+    if (offset + 4 > length)
+        return NO;
+
+    uint32_t result = 0;
+
+    for (NSUInteger i = offset; i < offset + 4; i++) {
+        uint8_t c = bytes[i];
+        result <<= 4;
+
+        if ('0' <= c && '9' >= c)
+            result |= (uint32_t) (c - '0');
+        else if ('a' <= c && 'f' >= c)
+            result |= (uint32_t) (c - 'a' + 10);
+        else if ('A' <= c && 'F' >= c)
+            result |= (uint32_t) (c - 'A' + 10);
+        else
+            return NO;
+    }
+
+    *value = result;
+
+    return YES;
+}
+
+static void VKJSONAppendUTF8(NSMutableData *data,
+                             uint32_t codePoint)
+{
+    uint8_t buffer[4];
+    NSUInteger length;
+
+//    одиночные суррогаты заменяются символом U+FFFD
+    if (0xD800 <= codePoint && 0xE000 > codePoint)
+        codePoint = 0xFFFD;
+
+    if (0x80 > codePoint) {
+        buffer[0] = (uint8_t) codePoint;
+        length = 1;
+    } else if (0x800 > codePoint) {
+        buffer[0] = (uint8_t) (0xC0 | (codePoint >> 6));
+        buffer[1] = (uint8_t) (0x80 | (codePoint & 0x3F));
+        length = 2;
+    } else if (0x10000 > codePoint) {
+        buffer[0] = (uint8_t) (0xE0 | (codePoint >> 12));
+        buffer[1] = (uint8_t) (0x80 | ((codePoint >> 6) & 0x3F));
+        buffer[2] = (uint8_t) (0x80 | (codePoint & 0x3F));
+        length = 3;
+    } else {
+        buffer[0] = (uint8_t) (0xF0 | (codePoint >> 18));
+        buffer[1] = (uint8_t) (0x80 | ((codePoint >> 12) & 0x3F));
+        buffer[2] = (uint8_t) (0x80 | ((codePoint >> 6) & 0x3F));
+        buffer[3] = (uint8_t) (0x80 | (codePoint & 0x3F));
+        length = 4;
+    }
+
+    [data appendBytes:buffer
+               length:length];
+}
+
+// строка из содержимого строкового литерала (без кавычек) с escape-последовательностями
+static NSString *VKJSONUnescapedString(const uint8_t *bytes,
+                                       NSUInteger length)
+{
+    NSMutableData *utf8 = [NSMutableData dataWithCapacity:length];
+    NSUInteger start = 0;
+    NSUInteger i = 0;
+
+    while (i < length) {
+        if ('\\' != bytes[i]) {
+            i++;
+            continue;
+        }
+
+        [utf8 appendBytes:bytes + start
+                   length:i - start];
+
+        if (i + 1 >= length)
+            return nil;
+
+        uint8_t c = bytes[i + 1];
+        uint8_t unescaped;
+        i += 2;
+
+        switch (c) {
+            case '"':
+            case '\\':
+            case '/':
+                unescaped = c;
+                break;
+
+            case 'b':
+                unescaped = '\b';
+                break;
+
+            case 'f':
+                unescaped = '\f';
+                break;
+
+            case 'n':
+                unescaped = '\n';
+                break;
+
+            case 'r':
+                unescaped = '\r';
+                break;
+
+            case 't':
+                unescaped = '\t';
+                break;
+
+            case 'u': {
+                uint32_t codePoint;
+
+                if (!VKJSONReadHex(bytes, length, i, &codePoint))
+                    return nil;
+
+                i += 4;
+
+//                символ вне BMP записывается суррогатной парой
+                uint32_t lowSurrogate;
+
+                if (0xD800 <= codePoint && 0xDC00 > codePoint &&
+                        i + 6 <= length && '\\' == bytes[i] && 'u' == bytes[i + 1] &&
+                        VKJSONReadHex(bytes, length, i + 2, &lowSurrogate) &&
+                        0xDC00 <= lowSurrogate && 0xE000 > lowSurrogate) {
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (lowSurrogate - 0xDC00);
+                    i += 6;
+                }
+
+                VKJSONAppendUTF8(utf8, codePoint);
+                start = i;
+
+                continue;
+            }
+
+            default:
+                return nil;
+        }
+
+        [utf8 appendBytes:&unescaped
+                   length:1];
+        start = i;
+    }
+
+    [utf8 appendBytes:bytes + start
+               length:length - start];
+
+    return [[NSString alloc] initWithData:utf8
+                                 encoding:NSUTF8StringEncoding];
+}
+
+
+@implementation VKJSONStreamParser
+{
+    VKJSONState _state;
+    VKJSONToken _token;
+
+//    начало лексемы из предыдущих частей данных
+    NSMutableData *_tokenBuffer;
+
+//    состояние строкового литерала: предыдущий символ - "\", в литерале есть
+//    escape-последовательности, литерал является ключом объекта
+    BOOL _isEscaped;
+    BOOL _hasEscapes;
+    BOOL _isKey;
+
+//    незакрытые массивы и объекты и ключи, значения которых разбираются
+//    (NSNull, если ключа нет)
+    NSMutableArray *_containers;
+    NSMutableArray *_keys;
+
+//    кол-во байт в уже разобранных частях - для сообщений об ошибках
+    NSUInteger _offset;
+}
+
+#pragma mark Visible VKJSONStreamParser methods
+#pragma mark - Class methods
+
++ (id)JSONObjectWithData:(NSData *)data
+                   error:(NSError **)error
+{
+    VKJSONStreamParser *parser = [[VKJSONStreamParser alloc] init];
+
+    if ([parser parseData:data] && [parser finish])
+        return parser.result;
+
+    if (NULL != error)
+        *error = parser.error;
+
+    return nil;
+}
+
+#pragma mark - Init methods
+
+- (instancetype)init
+{
+    self = [super init];
+
+    if (self) {
+        _state = VKJSONStateValue;
+        _token = VKJSONTokenNone;
+        _tokenBuffer = [[NSMutableData alloc] init];
+        _containers = [[NSMutableArray alloc] init];
+        _keys = [[NSMutableArray alloc] init];
+        _offset = 0;
+    }
+
+    return self;
+}
+
+#pragma mark - Parsing
+
+- (BOOL)parseData:(NSData *)data
+{
+    const uint8_t *bytes = [data bytes];
+    NSUInteger length = [data length];
+    NSUInteger i = 0;
+
+    while (i < length && VKJSONStateFailed != _state) {
+
+//        продолжение лексемы
+        if (VKJSONTokenNone != _token) {
+            i = [self scanTokenInBytes:bytes
+                                length:length
+                                  from:i];
+            continue;
+        }
+
+        uint8_t c = bytes[i];
+
+        if (VKJSONIsWhitespace(c)) {
+            i++;
+            continue;
+        }
+
+        switch (_state) {
+            case VKJSONStateValueOrArrayEnd:
+                if (']' == c) {
+                    [self closeContainer];
+                    i++;
+                    break;
+                }
+
+//                иначе - значение
+
+            case VKJSONStateValue:
+                if ('{' == c) {
+                    [self openContainer:[[NSMutableDictionary alloc] init]];
+                    _state = VKJSONStateKeyOrObjectEnd;
+                    i++;
+                } else if ('[' == c) {
+                    [self openContainer:[[NSMutableArray alloc] init]];
+                    _state = VKJSONStateValueOrArrayEnd;
+                    i++;
+                } else if ('"' == c) {
+                    [self beginStringAsKey:NO];
+                    i++;
+                } else if ('-' == c || ('0' <= c && '9' >= c)) {
+//                    первый символ - часть числа
+                    _token = VKJSONTokenNumber;
+                } else if ('t' == c || 'f' == c || 'n' == c) {
+                    _token = VKJSONTokenLiteral;
+                } else {
+                    [self failAtOffset:_offset + i];
+                }
+                break;
+
+            case VKJSONStateKeyOrObjectEnd:
+                if ('}' == c) {
+                    [self closeContainer];
+                    i++;
+                    break;
+                }
+
+//                иначе - ключ
+
+            case VKJSONStateKey:
+                if ('"' == c) {
+                    [self beginStringAsKey:YES];
+                    i++;
+                } else {
+                    [self failAtOffset:_offset + i];
+                }
+                break;
+
+            case VKJSONStateColon:
+                if (':' == c) {
+                    _state = VKJSONStateValue;
+                    i++;
+                } else {
+                    [self failAtOffset:_offset + i];
+                }
+                break;
+
+            case VKJSONStateCommaOrEnd: {
+                BOOL isArray = [[_containers lastObject] isKindOfClass:[NSArray class]];
+
+                if (',' == c) {
+                    _state = (isArray ? VKJSONStateValue : VKJSONStateKey);
+                    i++;
+                } else if ((']' == c && isArray) || ('}' == c && !isArray)) {
+                    [self closeContainer];
+                    i++;
+                } else {
+                    [self failAtOffset:_offset + i];
+                }
+                break;
+            }
+
+            case VKJSONStateDone:
+            case VKJSONStateFailed:
+                [self failAtOffset:_offset + i];
+                break;
+        }
+    }
+
+    _offset += length;
+
+    return (VKJSONStateFailed != _state);
+}
+
+- (BOOL)finish
+{
+//    число или литерал заканчиваются вместе с данными
+    if (VKJSONStateFailed != _state &&
+            (VKJSONTokenNumber == _token || VKJSONTokenLiteral == _token))
+        [self completeToken];
+
+    if (VKJSONStateDone != _state && VKJSONStateFailed != _state)
+        [self failAtOffset:_offset];
+
+    return (VKJSONStateDone == _state);
+}
+
+#pragma mark - Private methods
+
+// возвращает индекс первого байта после лексемы либо length, если лексема
+// продолжается в следующей части данных
+- (NSUInteger)scanTokenInBytes:(const uint8_t *)bytes
+                        length:(NSUInteger)length
+                          from:(NSUInteger)start
+{
+    NSUInteger i = start;
+
+    if (VKJSONTokenString == _token) {
+        while (i < length) {
+            uint8_t c = bytes[i];
+
+            if (_isEscaped) {
+                _isEscaped = NO;
+            } else if ('\\' == c) {
+                _isEscaped = YES;
+                _hasEscapes = YES;
+            } else if ('"' == c) {
+                [self completeStringWithBytes:bytes + start
+                                       length:i - start];
+                return i + 1;
+            } else if (0x20 > c) {
+                [self failAtOffset:_offset + i];
+                return length;
+            }
+
+            i++;
+        }
+    } else {
+        BOOL isNumber = (VKJSONTokenNumber == _token);
+
+        while (i < length) {
+            uint8_t c = bytes[i];
+
+            if (isNumber ? !VKJSONIsNumberCharacter(c) : !('a' <= c && 'z' >= c)) {
+                [_tokenBuffer appendBytes:bytes + start
+                                   length:i - start];
+                [self completeToken];
+
+//                разделитель разбирается как обычный символ
+                return i;
+            }
+
+            i++;
+        }
+    }
+
+    [_tokenBuffer appendBytes:bytes + start
+                       length:length - start];
+
+    return length;
+}
+
+- (void)beginStringAsKey:(BOOL)isKey
+{
+    _token = VKJSONTokenString;
+    _isKey = isKey;
+    _isEscaped = NO;
+    _hasEscapes = NO;
+}
+
+- (void)completeStringWithBytes:(const uint8_t *)bytes
+                         length:(NSUInteger)length
+{
+//    строка целиком в одной части данных - разбирается без копирования
+    if (0 != [_tokenBuffer length]) {
+        [_tokenBuffer appendBytes:bytes
+                           length:length];
+
+        bytes = [_tokenBuffer bytes];
+        length = [_tokenBuffer length];
+    }
+
+    NSString *string;
+
+    if (_hasEscapes)
+        string = VKJSONUnescapedString(bytes, length);
+    else
+        string = [[NSString alloc] initWithBytes:bytes
+                                          length:length
+                                        encoding:NSUTF8StringEncoding];
+
+    [_tokenBuffer setLength:0];
+    _token = VKJSONTokenNone;
+
+    if (nil == string) {
+        [self failAtOffset:_offset];
+        return;
+    }
+
+    if (_isKey) {
+        [_keys replaceObjectAtIndex:[_keys count] - 1
+                         withObject:string];
+        _state = VKJSONStateColon;
+        return;
+    }
+
+    [self addValue:string];
+}
+
+// завершает число или литерал, накопленные в _tokenBuffer
+- (void)completeToken
+{
+    VKJSONToken token = _token;
+    id value = nil;
+
+    _token = VKJSONTokenNone;
+
+    if (VKJSONTokenLiteral == token) {
+        NSString *literal = [[NSString alloc] initWithData:_tokenBuffer
+                                                  encoding:NSUTF8StringEncoding];
+
+        if ([@"true" isEqualToString:literal])
+            value = (__bridge id) kCFBooleanTrue;
+        else if ([@"false" isEqualToString:literal])
+            value = (__bridge id) kCFBooleanFalse;
+        else if ([@"null" isEqualToString:literal])
+            value = [NSNull null];
+    } else {
+        value = [self numberFromTokenBuffer];
+    }
+
+    [_tokenBuffer setLength:0];
+
+    if (nil == value) {
+        [self failAtOffset:_offset];
+        return;
+    }
+
+    [self addValue:value];
+}
+
+- (NSNumber *)numberFromTokenBuffer
+{
+    NSUInteger length = [_tokenBuffer length];
+
+//    число такой длины - заведомо ошибка в данных
+    if (kVKJSONMaximumNumberLength < length)
+        return nil;
+
+    char buffer[length + 1];
+
+    memcpy(buffer, [_tokenBuffer bytes], length);
+    buffer[length] = '\0';
+
+    if ('+' == buffer[0])
+        return nil;
+
+    char *end = NULL;
+    BOOL isInteger = (NULL == strpbrk(buffer, ".eE"));
+
+//    целые числа, не помещающиеся в long long, разбираются как double
+    if (isInteger) {
+        errno = 0;
+        long long value = strtoll(buffer, &end, 10);
+
+        if (0 == errno && '\0' == *end)
+            return @(value);
+    }
+
+    double value = strtod(buffer, &end);
+
+    if ('\0' != *end)
+        return nil;
+
+    return @(value);
+}
+
+- (void)openContainer:(id)container
+{
+    [_containers addObject:container];
+    [_keys addObject:[NSNull null]];
+}
+
+- (void)closeContainer
+{
+    id container = [[_containers lastObject] copy];
+
+    [_containers removeLastObject];
+    [_keys removeLastObject];
+
+    [self addValue:container];
+}
+
+- (void)addValue:(id)value
+{
+    if (0 == [_containers count]) {
+        _result = value;
+        _state = VKJSONStateDone;
+        return;
+    }
+
+    id container = [_containers lastObject];
+    _state = VKJSONStateCommaOrEnd;
+
+    if ([container isKindOfClass:[NSMutableArray class]]) {
+        [container addObject:value];
+
+//        элемент массива {"response": [...]}
+        if (nil != _delegate && 2 == [_containers count] &&
+                [@"response" isEqual:_keys[0]])
+            [_delegate JSONStreamParser:self
+                didParseResponseElement:value];
+
+        return;
+    }
+
+    container[[_keys lastObject]] = value;
+    [_keys replaceObjectAtIndex:[_keys count] - 1
+                     withObject:[NSNull null]];
+}
+
+- (void)failAtOffset:(NSUInteger)offset
+{
+    if (VKJSONStateFailed == _state)
+        return;
+
+    _state = VKJSONStateFailed;
+    _result = nil;
+    _error = [NSError errorWithDomain:@"VKJSONStreamParserErrorDomain"
+                                 code:0
+                             userInfo:@{
+                                     NSLocalizedDescriptionKey : [NSString stringWithFormat:@"Invalid JSON around byte %lu",
+                                                                                            (unsigned long) offset]
+                             }];
+}
+
+@end
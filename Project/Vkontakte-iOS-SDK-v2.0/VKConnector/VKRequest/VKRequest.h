@@ -38,7 +38,26 @@
 static NSString *const kVKAPIURLPrefix = @"https://api.vk.com/method/";
 
 
+/** Приоритет запроса. Определяет приоритет очереди, на которой производится
+обращение к кэшу и разбор ответа запроса, а также очерёдность выполнения запросов
+к серверу (см. VKRequestScheduler).
+*/
+typedef enum
+{
+
+//    предзагрузка данных
+    VKRequestPriorityLow = 0,
+//    фоновые запросы
+    VKRequestPriorityNormal = 1,
+//    запросы, ответа которых ждёт пользователь
+    VKRequestPriorityHigh = 2,
+
+} VKRequestPriority;
+
+
 @class VKRequest;
+@class VKRequestBatcher;
+@class VKRequestRetryPolicy;
 
 
 /** Протокол инкапсулирует в себе основные методы для отслеживания состояния
@@ -55,8 +74,14 @@ static NSString *const kVKAPIURLPrefix = @"https://api.vk.com/method/";
 */
 /** Возвращает ответ сервера в виде Foundation объекта
 
+Объект ответа неизменяемый (NSDictionary, NSArray, NSString, NSNumber, NSNull) -
+как для ответов из кэша, так и для ответов сервера: повторные запросы тех же
+данных из кэша и объединённые запросы получают тот же самый объект без
+повторного разбора JSON. Ранее ответы сервера передавались изменяемыми
+контейнерами; если ответ нужно изменить, используйте mutableCopy.
+
 @param request запрос к которому относится вызов метода делегата
-@param response ответ сервера в виде Foundation объекта
+@param response ответ сервера в виде неизменяемого Foundation объекта
 */
 - (void)VKRequest:(VKRequest *)request
          response:(id)response;
@@ -101,6 +126,22 @@ responseErrorOccured:(id)error;
        captchaSid:(NSString *)captchaSid
      captchaImage:(NSString *)captchaImage;
 
+/** Вызывается для каждого элемента массива "response" ответа сервера
+({"response": [...]}) по мере загрузки и разбора ответа - до того, как ответ будет
+загружен целиком. Удобно для отображения больших списков (groups.getMembers,
+photos.getAll etc) по частям.
+
+Полный ответ по-прежнему передаётся методом VKRequest:response:. Элементы
+передаются только для ответов сервера (не для ответов из кэша) и не передаются
+при обновлении устаревших данных (см. staleGraceTime). Запрос, элементы ответа
+которого уже переданы делегату, после обрыва соединения не повторяется.
+
+@param request запрос к которому относится вызов метода делегата
+@param element элемент массива в виде неизменяемого Foundation объекта
+*/
+- (void)VKRequest:(VKRequest *)request
+  responseElement:(id)element;
+
 /** Вызывается каждый раз, когда получена новая порция данных (метод удобно
 использовать для отображения статуса загрузки данных)
 
@@ -146,6 +187,8 @@ responseErrorOccured:(id)error;
 @property (nonatomic, strong, readwrite) id signature;
 
 /** Время жизни кэша текущего запроса. По умолчанию время жизни кэша один час.
+Ответы неидемпотентных запросов (см. idempotent) не кэшируются независимо от
+времени жизни кэша.
 */
 @property (nonatomic, assign, readwrite) VKCachedDataLiveTime cacheLiveTime;
 
@@ -155,6 +198,105 @@ responseErrorOccured:(id)error;
 */
 @property (nonatomic, assign, readwrite) BOOL offlineMode;
 
+/** Хранить ли ответ в общем для всех учётных записей кэше (см. VKStorage
+sharedCachedData), а не в кэше текущего пользователя. Допустимо только для запросов
+без токена доступа - для запросов с токеном значение игнорируется. По умолчанию NO.
+*/
+@property (nonatomic, assign, readwrite) BOOL useSharedCache;
+
+/** Приоритет запроса. По умолчанию VKRequestPriorityNormal.
+*/
+@property (nonatomic, assign, readwrite) VKRequestPriority priority;
+
+/** Время (в секундах) после истечения срока жизни кэша запроса, в течение которого
+устаревшие данные из кэша ещё могут быть использованы. По умолчанию равно 0 -
+устаревшие данные не используются.
+
+Если кэш запроса устарел не более чем на staleGraceTime секунд, то делегат сразу
+получает ответ из кэша (isResponseStale при этом равно YES), после чего запрос
+обновляет данные с сервера и перезаписывает кэш. Повторно делегат вызывается
+только в том случае, если ответ сервера отличается от закэшированного.
+Ошибки, возникшие при обновлении данных, делегату не передаются.
+
+Время хранения устаревших записей на диске ограничено свойством staleRetentionTime
+кэша (VKCachedData).
+*/
+@property (nonatomic, assign, readwrite) NSTimeInterval staleGraceTime;
+
+/** Теги, которыми помечается ответ запроса в кэше (см. VKCachedData
+invalidateCachedDataForTags:), либо nil. VKUser заполняет теги по таблице правил
+cacheTagRules.
+*/
+@property (nonatomic, copy, readwrite) NSArray *cacheTags;
+
+/** Теги, записи с которыми удаляются из кэша текущего пользователя и общего кэша
+после успешного выполнения запроса (ответ получен и не содержит ошибки), либо nil.
+Задаётся для запросов к изменяющим методам API (wall.post, friends.add etc) -
+закэшированные ответы, содержащие изменённые данные, больше не возвращаются.
+*/
+@property (nonatomic, copy, readwrite) NSArray *invalidatedCacheTags;
+
+/** Объединять ли запрос с одинаковыми запросами, выполняющимися в данный момент.
+По умолчанию YES.
+
+Если к серверу уже идёт такой же запрос (тот же метод API с теми же параметрами
+к тому же кэшу), то запрос не открывает собственного соединения, а ждёт ответа
+уже выполняющегося запроса. JSON разбирается один раз, каждый из объединённых
+запросов получает тот же объект ответа (а также ошибки и прогресс загрузки) через
+своего делегата на своей очереди callbackQueue. Отмена одного из объединённых
+запросов не отменяет остальные - соединение закрывается лишь после отмены всех.
+
+Объединяются только кэшируемые идемпотентные (см. idempotent) GET запросы, не
+удаляющие записи из кэша (см. invalidatedCacheTags) - запросы к изменяющим методам
+API всегда выполняются отдельно.
+*/
+@property (nonatomic, assign, readwrite) BOOL coalescesIdenticalRequests;
+
+/** Планировщик пакетного выполнения, либо nil (по умолчанию). Если планировщик
+задан, то GET запрос к методу API с токеном доступа не открывает собственного
+соединения, а выполняется вместе с другими запросами в одном запросе к методу
+execute (см. VKRequestBatcher). VKUser назначает запросам свой requestBatcher.
+*/
+@property (nonatomic, strong, readwrite) VKRequestBatcher *batcher;
+
+/** Политика повторения запроса при временных сбоях (ошибки соединения, HTTP
+статусы 429 и 5xx, ошибки API "слишком много запросов" и "внутренняя ошибка
+сервера"), либо nil - запрос не повторяется. По умолчанию - [VKRequestRetryPolicy
+defaultPolicy].
+
+Пока запрос повторяется, делегат ошибок не получает - он получит лишь ответ либо
+ошибку последней попытки.
+*/
+@property (nonatomic, strong, readwrite) VKRequestRetryPolicy *retryPolicy;
+
+/** Идемпотентен ли запрос - можно ли безопасно выполнить его повторно, если
+неизвестно, выполнил ли его сервер. Для запросов к методам API по умолчанию NO,
+если метод изменяет данные (см. isMutatingMethod:), и YES для остальных; для
+прочих запросов - NO для POST запросов и YES для остальных.
+*/
+@property (nonatomic, assign, getter=isIdempotent, readwrite) BOOL idempotent;
+
+/** Ключ записи кэша запроса (см. VKCacheKey). Вычисляется один раз при создании
+запроса. Токен доступа на ключ не влияет.
+*/
+@property (nonatomic, readonly) NSString *cacheKey;
+
+/** Наименование метода API (users.get, friends.get etc), к которому обращается
+запрос, либо nil, если запрос обращается не к API
+*/
+@property (nonatomic, readonly) NSString *methodName;
+
+/** Является ли ответ, переданный делегату в данный момент, устаревшими данными из
+кэша. Значение следует проверять в методе делегата VKRequest:response:.
+*/
+@property (nonatomic, readonly) BOOL isResponseStale;
+
+/** Очередь, на которой вызываются методы делегата. По умолчанию - главная очередь.
+Очередь должна быть последовательной, иначе порядок вызовов делегата не
+гарантируется.
+*/
+@property (nonatomic, strong, readwrite) dispatch_queue_t callbackQueue;
+
 /**
 @name Методы класса
 */
@@ -199,6 +341,19 @@ responseErrorOccured:(id)error;
                       options:(NSDictionary *)options
                      delegate:(id <VKRequestDelegate>)delegate;
 
+/** Изменяет ли метод API данные (messages.send, wall.post, likes.add etc).
+
+Данные не изменяют лишь методы, действие которых начинается с get, search, is
+или are (users.get, audio.search, groups.isMember, friends.areFriends etc), а
+также pages.parseWiki. Все остальные методы, в том числе неизвестные и execute,
+считаются изменяющими: запросы к ним не повторяются, если неизвестно, выполнил ли
+их сервер, а их ответы не кэшируются.
+
+@param methodName наименование метода API
+@return YES, если метод изменяет данные
+*/
++ (BOOL)isMutatingMethod:(NSString *)methodName;
+
 /**
 @name Методы экземпляра
 */
@@ -244,10 +399,17 @@ responseErrorOccured:(id)error;
                        options:(NSDictionary *)options;
 
 /** Старт запроса
+
+Метод возвращает управление сразу: обращение к кэшу, чтение данных с диска и
+разбор ответа производятся в фоне, соединение с сервером работает в главном потоке,
+а делегат вызывается на очереди callbackQueue. Соединение открывается, когда это
+позволяют ограничения планировщика (см. VKRequestScheduler).
 */
 - (void)start;
 
-/** Отмена запроса
+/** Отмена запроса. После отмены делегат больше не вызывается (если отмена
+производится на очереди callbackQueue). Запросы, объединённые с отменённым (см.
+coalescesIdenticalRequests), продолжают выполняться.
 */
 - (void)cancel;
 
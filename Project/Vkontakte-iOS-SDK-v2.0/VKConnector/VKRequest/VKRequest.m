@@ -24,12 +24,19 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
 // THE SOFTWARE.
 //
+#import <stdatomic.h>
 #import "VKRequest.h"
 #import "VKUser.h"
 #import "NSString+encodeURL.h"
 #import "VKStorage.h"
 #import "VKStorageItem.h"
 #import "VKAccessToken.h"
+#import "VKCacheKey.h"
+#import "VKMethods.h"
+#import "VKRequestBatcher.h"
+#import "VKRequestScheduler.h"
+#import "VKRequestRetryPolicy.h"
+#import "VKJSONStreamParser.h"
 
 
 #define INFO_LOG() NSLog(@"%s", __FUNCTION__)
@@ -38,15 +45,155 @@
 #define kCaptchaErrorCode 14
 
 
+// очередь, на которой производится обращение к кэшу и разбор ответов запросов
+// с указанным приоритетом
+static dispatch_queue_t VKRequestProcessingQueue(VKRequestPriority priority)
+{
+    static dispatch_queue_t processingQueues[3];
+    static dispatch_once_t onceToken;
+
+    dispatch_once(&onceToken, ^
+    {
+        processingQueues[VKRequestPriorityLow] = dispatch_queue_create("com.vk.request.processing.low", DISPATCH_QUEUE_CONCURRENT);
+        processingQueues[VKRequestPriorityNormal] = dispatch_queue_create("com.vk.request.processing", DISPATCH_QUEUE_CONCURRENT);
+        processingQueues[VKRequestPriorityHigh] = dispatch_queue_create("com.vk.request.processing.high", DISPATCH_QUEUE_CONCURRENT);
+
+        dispatch_set_target_queue(processingQueues[VKRequestPriorityLow], dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+        dispatch_set_target_queue(processingQueues[VKRequestPriorityHigh], dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0));
+    });
+
+    if (priority > VKRequestPriorityHigh)
+        priority = VKRequestPriorityHigh;
+
+    return processingQueues[priority];
+}
+
+// запросы, соединение которых установлено, по ключам объединения (см. coalescingKey);
+// доступ производится только из главной очереди
+static NSMutableDictionary *VKRequestInFlightRequests(void)
+{
+    static NSMutableDictionary *inFlightRequests;
+    static dispatch_once_t onceToken;
+
+    dispatch_once(&onceToken, ^
+    {
+        inFlightRequests = [[NSMutableDictionary alloc] init];
+    });
+
+    return inFlightRequests;
+}
+
+// флаги запроса, которые изменяются и читаются на разных очередях
+static inline BOOL VKRequestFlagIsSet(atomic_int *flag)
+{
+    return (0 != atomic_load(flag));
+}
+
+static inline void VKRequestSetFlag(atomic_int *flag, BOOL value)
+{
+    atomic_store(flag, (value ? 1 : 0));
+}
+
+// токен доступа из параметров запроса (URL либо тело формы), либо nil
+static NSString *VKRequestAccessToken(NSURLRequest *request)
+{
+    NSMutableArray *params = [NSMutableArray array];
+
+    if (nil != [request.URL query])
+        [params addObjectsFromArray:[[request.URL query] componentsSeparatedByString:@"&"]];
+
+    if (nil != request.HTTPBody &&
+            [[request valueForHTTPHeaderField:@"Content-Type"] hasPrefix:@"application/x-www-form-urlencoded"]) {
+        NSString *body = [[NSString alloc] initWithData:request.HTTPBody
+                                               encoding:NSUTF8StringEncoding];
+
+        [params addObjectsFromArray:[body componentsSeparatedByString:@"&"]];
+    }
+
+    for (NSString *param in params) {
+        if ([param hasPrefix:@"access_token="])
+            return [[param substringFromIndex:[@"access_token=" length]]
+                           stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+    }
+
+    return nil;
+}
+
+// наименование метода API, к которому обращается запрос, либо nil
+static NSString *VKRequestMethodName(NSURL *url)
+{
+    if (![[url absoluteString] hasPrefix:kVKAPIURLPrefix])
+        return nil;
+
+    return [[url path] lastPathComponent];
+}
+
+// читающие методы API, действие которых не начинается с get, search, is или are
+static NSSet *VKRequestReadMethodNames(void)
+{
+    static NSSet *readMethodNames;
+    static dispatch_once_t onceToken;
+
+    dispatch_once(&onceToken, ^
+    {
+        readMethodNames = [NSSet setWithObjects:[kVKPagesParseWiki lowercaseString], nil];
+    });
+
+    return readMethodNames;
+}
+
+
+@interface VKRequest () <VKJSONStreamParserDelegate>
+@end
+
+
 @implementation VKRequest
 {
     NSMutableURLRequest *_request;
     NSURLConnection *_connection;
 
     NSMutableData *_receivedData;
+    NSData *_cachedResponseData;
+    id _cachedResponseObject;
     NSUInteger _expectedDataSize;
-
-    BOOL _isDataFromCache;
+    NSString *_cacheKey;
+
+//    параметры вызова метода API, если запрос создан по методу, иначе nil
+    NSDictionary *_options;
+
+//    токен доступа, с которым выполняется запрос, либо nil
+    NSString *_accessToken;
+
+//    кэш учётной записи, для которой запущен запрос
+    VKCachedData *_cachedData;
+
+//    идёт обновление устаревших данных, которые уже переданы делегату
+    BOOL _isRevalidating;
+
+//    номер текущей попытки (начиная с 0) и время старта запроса - определяют,
+//    можно ли повторить запрос (см. retryPolicy)
+    NSUInteger _attempt;
+    NSTimeInterval _startTime;
+
+//    ответ разбирается по мере загрузки на последовательной очереди
+//    _parsingQueue; элементы массива "response" передаются запросам
+//    _streamingRequests, делегаты которых их принимают
+    VKJSONStreamParser *_parser;
+    dispatch_queue_t _parsingQueue;
+    NSArray *_streamingRequests;
+    atomic_int _hasStreamedElements;
+
+//    запрос отменён - делегат больше не вызывается; флаг устанавливается на
+//    очереди вызывающего, а проверяется на главной очереди и очереди callbackQueue
+    atomic_int _isCancelled;
+
+//    объединение одинаковых запросов: запрос, соединение которого используется
+//    вместо собственного, либо присоединившиеся к соединению этого запроса
+//    запросы и ключ, под которым он находится в VKRequestInFlightRequests;
+//    изменяются только на главной очереди
+    __weak VKRequest *_leader;
+    NSMutableArray *_followers;
+    id _coalescingKey;
 }
 
 #pragma mark Visible VKRequest methods
@@ -98,6 +245,30 @@
     return request;
 }
 
++ (BOOL)isMutatingMethod:(NSString *)methodName
+{
+    if (nil == methodName)
+        return NO;
+
+    NSRange separatorRange = [methodName rangeOfString:@"."];
+
+//    execute может вызывать любые методы
+    if (NSNotFound == separatorRange.location)
+        return YES;
+
+    if ([VKRequestReadMethodNames() containsObject:[methodName lowercaseString]])
+        return NO;
+
+    NSString *action = [methodName substringFromIndex:NSMaxRange(separatorRange)];
+
+    for (NSString *prefix in @[@"get", @"search", @"is", @"are"]) {
+        if (NSNotFound != [action rangeOfString:prefix options:(NSAnchoredSearch | NSCaseInsensitiveSearch)].location)
+            return NO;
+    }
+
+    return YES;
+}
+
 #pragma mark - Init methods
 
 - (instancetype)initWithRequest:(NSURLRequest *)request
@@ -118,7 +289,27 @@
     _expectedDataSize = NSURLResponseUnknownContentLength;
     _cacheLiveTime = VKCachedDataLiveTimeOneHour;
     _offlineMode = NO;
-    _isDataFromCache = NO;
+    _useSharedCache = NO;
+    _priority = VKRequestPriorityNormal;
+    _staleGraceTime = 0;
+    _isRevalidating = NO;
+    _isResponseStale = NO;
+    atomic_init(&_isCancelled, 0);
+    atomic_init(&_hasStreamedElements, 0);
+    _coalescesIdenticalRequests = YES;
+    _retryPolicy = [VKRequestRetryPolicy defaultPolicy];
+    _attempt = 0;
+    _startTime = 0;
+    _followers = [[NSMutableArray alloc] init];
+    _callbackQueue = dispatch_get_main_queue();
+    _methodName = VKRequestMethodName(_request.URL);
+
+//    повторный вызов изменяющего метода мог бы, например, отправить сообщение
+//    дважды - независимо от того, GET это запрос или POST
+    _idempotent = (nil != _methodName ?
+            ![VKRequest isMutatingMethod:_methodName] :
+            ![@"POST" isEqualToString:[_request HTTPMethod]]);
+    _accessToken = VKRequestAccessToken(_request);
 
     return self;
 }
@@ -175,7 +366,16 @@
     NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:url];
     [request setHTTPMethod:@"GET"];
 
-    return [self initWithRequest:request];
+    self = [self initWithRequest:request];
+
+//    ключ кэша строится один раз по наименованию метода и параметрам, без разбора URL
+    if (nil != self) {
+        _cacheKey = [VKCacheKey keyForMethod:methodName
+                                     options:options];
+        _options = [options copy];
+    }
+
+    return self;
 }
 
 #pragma mark - Start & cancel request
@@ -188,32 +388,49 @@
     if (nil == self.delegate)
         return;
 
-//    перед тем как начать выполнение запроса проверим кэш
-    NSUInteger currentUserID = [[[VKUser currentUser] accessToken] userID];
-    VKStorageItem *item = [[VKStorage sharedStorage]
-                                      storageItemForUserID:currentUserID];
-
-    NSData *cachedResponseData = [item.cachedData cachedDataForURL:[self removeAccessTokenFromURL:_connection.currentRequest.URL]
-                                                       offlineMode:_offlineMode];
-    if (nil != cachedResponseData) {
-        _receivedData = [cachedResponseData mutableCopy];
-        _isDataFromCache = YES;
+    VKRequestSetFlag(&_isCancelled, NO);
+    VKRequestSetFlag(&_hasStreamedElements, NO);
+    _attempt = 0;
+    _startTime = [NSDate timeIntervalSinceReferenceDate];
+    _cachedResponseData = nil;
+    _cachedResponseObject = nil;
+
+//    кэш и ключ определяются сразу - учётная запись может смениться до того,
+//    как запрос будет обработан
+    _cachedData = [self cachedDataForRequest];
+    [self cacheKey];
+
+//    обращение к кэшу (чтение с диска и разбор JSON) производится в фоне,
+//    управление возвращается сразу
+    dispatch_async(VKRequestProcessingQueue(_priority), ^
+    {
+        [self startWithCachedResponse];
+    });
+}
 
-        [self connectionDidFinishLoading:_connection];
+- (void)cancel
+{
+    INFO_LOG();
 
-        return;
-    }
+//    состояние соединения сбрасывается на главной очереди - соединение может
+//    продолжать работать для присоединившихся запросов
+    VKRequestSetFlag(&_isCancelled, YES);
 
-    [_connection start];
+    dispatch_async(dispatch_get_main_queue(), ^
+    {
+        [self cancelConnection];
+    });
 }
 
-- (void)cancel
+#pragma mark - Getters
+
+- (NSString *)cacheKey
 {
-    INFO_LOG();
+//    запрос создан не по методу API - ключ строится по URL запроса
+    if (nil == _cacheKey)
+        _cacheKey = [VKCacheKey keyForURL:_request.URL];
 
-    _receivedData = nil;
-    _expectedDataSize = NSURLResponseUnknownContentLength;
-    [_connection cancel];
+    return _cacheKey;
 }
 
 #pragma mark - Overridden methods
@@ -221,11 +438,12 @@
 - (NSString *)description
 {
     NSDictionary *description = @{
-            @"delegate"      : self.delegate,
-            @"signature"     : self.signature,
-            @"cacheLiveTime" : @(self.cacheLiveTime),
-            @"offlineMode"   : (self.offlineMode ? @"YES" : @"NO"),
-            @"request"       : [_request description]
+            @"delegate"       : self.delegate,
+            @"signature"      : self.signature,
+            @"cacheLiveTime"  : @(self.cacheLiveTime),
+            @"offlineMode"    : (self.offlineMode ? @"YES" : @"NO"),
+            @"staleGraceTime" : @(self.staleGraceTime),
+            @"request"        : [_request description]
     };
 
     return [description description];
@@ -239,6 +457,18 @@
     copy.signature = _signature;
     copy.cacheLiveTime = _cacheLiveTime;
     copy.offlineMode = _offlineMode;
+    copy.useSharedCache = _useSharedCache;
+    copy.priority = _priority;
+    copy.staleGraceTime = _staleGraceTime;
+    copy.cacheTags = _cacheTags;
+    copy.invalidatedCacheTags = _invalidatedCacheTags;
+    copy.coalescesIdenticalRequests = _coalescesIdenticalRequests;
+    copy.batcher = _batcher;
+    copy.retryPolicy = _retryPolicy;
+    copy.idempotent = _idempotent;
+    copy.callbackQueue = _callbackQueue;
+    copy->_cacheKey = _cacheKey;
+    copy->_options = _options;
 
     return copy;
 }
@@ -254,17 +484,27 @@ didReceiveResponse:(NSURLResponse *)response
 
     if (200 != [httpResponse statusCode]) {
 
-        if (nil != self.delegate && [self.delegate respondsToSelector:@selector(VKRequest:connectionErrorOccured:)]) {
+//        временный сбой сервера - запрос будет повторён
+        NSTimeInterval retryDelay = 0;
+
+        if ([_retryPolicy shouldRetryAfterStatusCode:[httpResponse statusCode]
+                                          idempotent:_idempotent] &&
+                [self canRetryAfterDelay:&retryDelay]) {
+            [self retryAfterDelay:retryDelay
+                        followers:nil];
+            return;
+        }
 
-            NSError *error = [NSError errorWithDomain:@"VKRequestErrorDomain"
-                                                 code:[httpResponse statusCode]
-                                             userInfo:@{
-                                                     @"Response headers"             : [httpResponse allHeaderFields],
-                                                     @"Localized status code string" : [NSHTTPURLResponse localizedStringForStatusCode:[httpResponse statusCode]]
-                                             }];
+        NSError *error = [NSError errorWithDomain:@"VKRequestErrorDomain"
+                                             code:[httpResponse statusCode]
+                                         userInfo:@{
+                                                 @"Response headers"             : [httpResponse allHeaderFields],
+                                                 @"Localized status code string" : [NSHTTPURLResponse localizedStringForStatusCode:[httpResponse statusCode]]
+                                         }];
 
-            [self.delegate VKRequest:self
-              connectionErrorOccured:error];
+        for (VKRequest *request in [self coalescedRequests]) {
+            if (!request->_isRevalidating)
+                [request notifyDelegateWithConnectionError:error];
         }
 
         return;
@@ -281,6 +521,26 @@ didReceiveResponse:(NSURLResponse *)response
     } else {
         _expectedDataSize = (NSUInteger) response.expectedContentLength;
     }
+
+//    разбор начинается с первой порции данных, а не после загрузки всего ответа
+    _parser = [[VKJSONStreamParser alloc] init];
+    _parsingQueue = dispatch_queue_create("com.vk.request.parsing", DISPATCH_QUEUE_SERIAL);
+    dispatch_set_target_queue(_parsingQueue, VKRequestProcessingQueue(_priority));
+
+//    делегат, уже получивший устаревшие данные, элементов не получает; запросы,
+//    присоединившиеся после начала загрузки, получают лишь полный ответ
+    NSMutableArray *streamingRequests = [NSMutableArray array];
+
+    for (VKRequest *request in [self coalescedRequests]) {
+        if (!request->_isRevalidating &&
+                [request.delegate respondsToSelector:@selector(VKRequest:responseElement:)])
+            [streamingRequests addObject:request];
+    }
+
+    _streamingRequests = streamingRequests;
+
+    if (0 != [streamingRequests count])
+        _parser.delegate = self;
 }
 
 - (void)connection:(NSURLConnection *)connection
@@ -290,14 +550,26 @@ didReceiveResponse:(NSURLResponse *)response
 
     [_receivedData appendData:data];
 
-    if (nil != self.delegate && [self.delegate respondsToSelector:@selector(VKRequest:totalBytes:downloadedBytes:)]) {
+    if (nil != _parser) {
+        VKJSONStreamParser *parser = _parser;
 
-        if (nil != self.delegate && [self.delegate respondsToSelector:@selector(VKRequest:totalBytes:downloadedBytes:)]) {
+        dispatch_async(_parsingQueue, ^
+        {
+            [parser parseData:data];
+        });
+    }
 
-            [self.delegate VKRequest:self
-                          totalBytes:_expectedDataSize
-                     downloadedBytes:[_receivedData length]];
-        }
+    NSUInteger totalBytes = _expectedDataSize;
+    NSUInteger downloadedBytes = [_receivedData length];
+
+    for (VKRequest *request in [self coalescedRequests]) {
+        [request notifyDelegateUsingBlock:^(id <VKRequestDelegate> delegate)
+        {
+            if ([delegate respondsToSelector:@selector(VKRequest:totalBytes:downloadedBytes:)])
+                [delegate VKRequest:request
+                         totalBytes:totalBytes
+                    downloadedBytes:downloadedBytes];
+        }];
     }
 }
 
@@ -308,122 +580,712 @@ totalBytesExpectedToWrite:(NSInteger)totalBytesExpectedToWrite
 {
     INFO_LOG();
 
-    if (nil != self.delegate && [self.delegate respondsToSelector:@selector(VKRequest:totalBytes:uploadedBytes:)]) {
+    [self notifyDelegateUsingBlock:^(id <VKRequestDelegate> delegate)
+    {
+        if ([delegate respondsToSelector:@selector(VKRequest:totalBytes:uploadedBytes:)])
+            [delegate VKRequest:self
+                     totalBytes:(NSUInteger) totalBytesExpectedToWrite
+                  uploadedBytes:(NSUInteger) totalBytesWritten];
+    }];
+}
 
-        if (nil != self.delegate && [self.delegate respondsToSelector:@selector(VKRequest:totalBytes:uploadedBytes:)]) {
+- (void)connectionDidFinishLoading:(NSURLConnection *)connection
+{
+    INFO_LOG();
 
-            [self.delegate VKRequest:self
-                          totalBytes:(NSUInteger) totalBytesExpectedToWrite
-                       uploadedBytes:(NSUInteger) totalBytesWritten];
-        }
-    }
+//    разбор ответа сервера завершается в фоне; буфер не копируется - соединение
+//    завершено и больше в него не пишет
+    NSData *responseData = _receivedData;
+    _receivedData = [[NSMutableData alloc] init];
+
+    VKJSONStreamParser *parser = _parser;
+    _parser = nil;
+
+    BOOL isCacheable = ([self isResponseCacheable] &&
+            ![@"POST" isEqualToString:connection.currentRequest.HTTPMethod]);
+
+//    последующие одинаковые запросы открывают собственное соединение
+    NSArray *followers = [self detachFollowers];
+
+    [[VKRequestScheduler sharedScheduler] removeRequest:self];
+
+//    очередь разбора выполняет блок после всех уже переданных парсеру данных
+    dispatch_queue_t queue = (nil != parser ? _parsingQueue : VKRequestProcessingQueue(_priority));
+
+    dispatch_async(queue, ^
+    {
+        [self processResponseData:responseData
+                           parser:parser
+                      isCacheable:isCacheable
+                        followers:followers];
+    });
 }
 
-- (void)connectionDidFinishLoading:(NSURLConnection *)connection
+- (void)connection:(NSURLConnection *)connection
+  didFailWithError:(NSError *)error
 {
     INFO_LOG();
 
-//    обработка полного ответа сервера
-    NSJSONReadingOptions mask = NSJSONReadingAllowFragments |
-            NSJSONReadingMutableContainers |
-            NSJSONReadingMutableLeaves;
-    NSError *error;
-    id json = [NSJSONSerialization JSONObjectWithData:_receivedData
-                                              options:mask
-                                                error:&error];
+    if ([self retryAfterConnectionError:error])
+        return;
 
-    if (nil != error) {
-        if (nil != self.delegate && [self.delegate respondsToSelector:@selector(VKRequest:parsingErrorOccured:)]) {
-            [self.delegate VKRequest:self
-                 parsingErrorOccured:error];
-        }
+    [[VKRequestScheduler sharedScheduler] removeRequest:self];
+
+    [self failWithConnectionError:error];
+}
+
+#pragma mark - VKRequestBatcher
+
+- (NSDictionary *)batchedOptions
+{
+//    значения передаются строками, как и в URL запроса
+    NSMutableDictionary *options = [NSMutableDictionary dictionary];
+
+    [_options enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop)
+    {
+        options[[[key description] lowercaseString]] = [obj description];
+    }];
+
+    [options removeObjectForKey:@"access_token"];
+
+    return options;
+}
+
+- (NSString *)batchedAccessToken
+{
+    return _accessToken;
+}
+
+- (void)completeBatchedCallWithResponse:(id)response
+                           parsingError:(NSError *)error
+{
+//    ответ вызова кэшируется так же, как ответ отдельного запроса
+    NSData *responseData = nil;
+
+    if (nil != response)
+        responseData = [NSJSONSerialization dataWithJSONObject:response
+                                                       options:0
+                                                         error:NULL];
+
+    BOOL isCacheable = [self isResponseCacheable];
+    NSArray *followers = [self detachFollowers];
+
+    dispatch_async(VKRequestProcessingQueue(_priority), ^
+    {
+        [self processResponseData:responseData
+                           object:response
+                     parsingError:error
+                      isCacheable:isCacheable
+                        followers:followers];
+    });
+}
 
+- (void)failBatchedCallWithConnectionError:(NSError *)error
+{
+//    запрос execute не повторяется - каждый вызов повторяется по своей политике
+    if ([self retryAfterConnectionError:error])
         return;
+
+    [self failWithConnectionError:error];
+}
+
+#pragma mark - VKRequestScheduler
+
+- (NSString *)scheduledAccessToken
+{
+    return _accessToken;
+}
+
+- (void)startScheduledConnection
+{
+    [_connection start];
+}
+
+#pragma mark - VKJSONStreamParserDelegate
+
+// вызывается на очереди _parsingQueue
+- (void)JSONStreamParser:(VKJSONStreamParser *)parser
+ didParseResponseElement:(id)element
+{
+    VKRequestSetFlag(&_hasStreamedElements, YES);
+
+    for (VKRequest *request in _streamingRequests) {
+        [request notifyDelegateUsingBlock:^(id <VKRequestDelegate> delegate)
+        {
+            if ([delegate respondsToSelector:@selector(VKRequest:responseElement:)])
+                [delegate VKRequest:request
+                    responseElement:element];
+        }];
     }
+}
 
-//    проверим, если в ответе содержится ошибка
-    if(nil != json[@"error"]){
+#pragma mark - private methods
 
-//      капча ли?
-        if(kCaptchaErrorCode == [json[@"error"][@"error_code"] integerValue]){
+- (VKCachedData *)cachedDataForRequest
+{
+//    ответ на запрос с токеном доступа зависит от учётной записи - в общий кэш
+//    он попасть не должен
+    NSString *query = [_request.URL query];
+    BOOL hasAccessToken = (nil != query && NSNotFound != [query rangeOfString:@"access_token="].location);
 
-            if(nil != self.delegate && [self.delegate respondsToSelector:@selector(VKRequest:captchaSid:captchaImage:)]){
-                NSString *captchaSid = json[@"error"][@"captcha_sid"];
-                NSString *captchaImage = json[@"error"][@"captcha_img"];
+    if (_useSharedCache && !hasAccessToken)
+        return [[VKStorage sharedStorage] sharedCachedData];
 
-                [self.delegate VKRequest:self
-                              captchaSid:captchaSid
-                            captchaImage:captchaImage];
-            }
+    return [self cachedDataOfCurrentUser];
+}
+
+- (VKCachedData *)cachedDataOfCurrentUser
+{
+    NSUInteger currentUserID = [[[VKUser currentUser] accessToken] userID];
+    VKStorageItem *item = [[VKStorage sharedStorage]
+                                      storageItemForUserID:currentUserID];
+
+    return item.cachedData;
+}
+
+// вызывается на очереди VKRequestProcessingQueue
+- (void)startWithCachedResponse
+{
+    BOOL isStale = NO;
+
+//    уже разобранный ответ передаём делегату как есть
+    id cachedResponseObject = [_cachedData cachedObjectForKey:_cacheKey
+                                                   methodName:_methodName
+                                                  offlineMode:_offlineMode
+                                               staleGraceTime:_staleGraceTime
+                                                      isStale:&isStale];
+
+    if (nil != cachedResponseObject) {
+        _cachedResponseObject = cachedResponseObject;
+
+        [self notifyDelegateWithResponse:cachedResponseObject
+                                 isStale:isStale];
 
-//        прекращаем дальнейшую обработку
-//        кэшировать ошибки не будем
+//        свежие данные (или оффлайн режим) - обращаться к серверу не нужно
+        if (!isStale || _offlineMode)
+            return;
+
+//        исходные данные нужны, чтобы сравнить с ними обновлённые
+        _cachedResponseData = [_cachedData cachedDataForKey:_cacheKey
+                                                offlineMode:YES
+                                             staleGraceTime:0
+                                                    isStale:NULL];
+
+        [self startConnectionRevalidating:YES];
+
+        return;
+    }
+
+    NSData *cachedResponseData = [_cachedData cachedDataForKey:_cacheKey
+                                                    methodName:_methodName
+                                                   offlineMode:_offlineMode
+                                                staleGraceTime:_staleGraceTime
+                                                       isStale:&isStale];
+
+    if (nil == cachedResponseData) {
+        [self startConnectionRevalidating:NO];
+        return;
+    }
+
+//    данные из кэша не копируем - они разбираются напрямую
+    _cachedResponseData = cachedResponseData;
+
+    BOOL delivered = [self processCachedResponseData:cachedResponseData
+                                             isStale:isStale];
+
+//    свежие данные (или оффлайн режим) - обращаться к серверу не нужно,
+//    так же как и в случае, если данные из кэша не удалось разобрать
+    if (!isStale || _offlineMode || !delivered)
+        return;
+
+//    устаревшие данные уже переданы делегату, обновляем их в фоне
+    [self startConnectionRevalidating:YES];
+}
+
+- (void)startConnectionRevalidating:(BOOL)isRevalidating
+{
+    _isRevalidating = isRevalidating;
+
+//    соединение работает в цикле обработки событий главного потока
+    dispatch_async(dispatch_get_main_queue(), ^
+    {
+        if (VKRequestFlagIsSet(&_isCancelled))
+            return;
+
+//        такой же запрос уже выполняется - ждём его ответа вместо того, чтобы
+//        открывать ещё одно соединение
+        id coalescingKey = [self coalescingKey];
+        VKRequest *leader = (nil != coalescingKey ? VKRequestInFlightRequests()[coalescingKey] : nil);
+
+        if (self == leader)
+            return;
+
+        if (nil != leader) {
+            _leader = leader;
+            [leader->_followers addObject:self];
             return;
         }
 
-//        другая ошибка
-        if(nil != self.delegate && [self.delegate respondsToSelector:@selector(VKRequest:responseErrorOccured:)]){
-            [self.delegate VKRequest:self
-                responseErrorOccured:json[@"error"]];
+        if (nil != coalescingKey) {
+            _coalescingKey = coalescingKey;
+            VKRequestInFlightRequests()[coalescingKey] = self;
         }
 
-//        прекращаем дальнейшую обработку
-//        кэшировать ошибки не будем
+        [self enqueueConnection];
+    });
+}
+
+// вызывается на главной очереди
+- (void)enqueueConnection
+{
+//    вызов метода API будет отправлен в пакете с другими вызовами
+    if ([self isBatchable]) {
+        [_batcher addRequest:self];
         return;
     }
 
-//    кэшируем данные запроса, если:
-//    1. данные запроса не из кэша
-//    2. время жизни кэша не установлено в "никогда"
-//    3. метод запроса GET
-    if (!_isDataFromCache && VKCachedDataLiveTimeNever != self.cacheLiveTime && ![@"POST" isEqualToString:connection.currentRequest.HTTPMethod]) {
+//    соединение будет открыто, когда позволят ограничения планировщика
+    [[VKRequestScheduler sharedScheduler] addRequest:self];
+}
+
+// можно ли повторить запрос: попытки и время, отведённые политикой, не исчерпаны
+- (BOOL)canRetryAfterDelay:(NSTimeInterval *)delay
+{
+    if (nil == _retryPolicy || _attempt + 1 >= _retryPolicy.maximumAttempts)
+        return NO;
+
+    NSTimeInterval retryDelay = [_retryPolicy delayBeforeRetry:_attempt + 1];
+    NSTimeInterval retryTime = [NSDate timeIntervalSinceReferenceDate] + retryDelay;
 
-        NSUInteger currentUserID = [[[VKUser currentUser] accessToken] userID];
-        VKStorageItem *item = [[VKStorage sharedStorage]
-                                          storageItemForUserID:currentUserID];
+    if (retryTime - _startTime > _retryPolicy.deadline)
+        return NO;
 
-        [item.cachedData addCachedData:_receivedData
-                                forURL:[self removeAccessTokenFromURL:connection.currentRequest.URL]
-                              liveTime:self.cacheLiveTime];
+    *delay = retryDelay;
 
-        _isDataFromCache = NO;
+    return YES;
+}
+
+// вызывается на главной очереди
+- (BOOL)retryAfterConnectionError:(NSError *)error
+{
+    NSTimeInterval retryDelay = 0;
+
+//    делегат уже получил часть элементов ответа - повтор передал бы их заново
+    if (VKRequestFlagIsSet(&_hasStreamedElements) ||
+            ![_retryPolicy shouldRetryAfterConnectionError:error
+                                                idempotent:_idempotent] ||
+            ![self canRetryAfterDelay:&retryDelay])
+        return NO;
+
+    [self retryAfterDelay:retryDelay
+                followers:nil];
+
+    return YES;
+}
+
+// вызывается на главной очереди; присоединившиеся запросы, уже отсоединённые
+// от завершившегося соединения, ждут повтора вместе с запросом
+- (void)retryAfterDelay:(NSTimeInterval)delay
+              followers:(NSArray *)followers
+{
+    for (VKRequest *follower in followers) {
+        if (VKRequestFlagIsSet(&follower->_isCancelled))
+            continue;
+
+        follower->_leader = self;
+        [_followers addObject:follower];
     }
 
-//    возвращаем Foundation объект
-    [self.delegate VKRequest:self
-                    response:json];
+    _attempt++;
+
+//    соединение NSURLConnection нельзя запустить повторно
+    [[VKRequestScheduler sharedScheduler] removeRequest:self];
+    [_connection cancel];
+
+    _receivedData = [[NSMutableData alloc] init];
+    _expectedDataSize = NSURLResponseUnknownContentLength;
+    _parser = nil;
+    _connection = [[NSURLConnection alloc]
+                                    initWithRequest:_request
+                                           delegate:self
+                                   startImmediately:NO];
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (delay * NSEC_PER_SEC)),
+                   dispatch_get_main_queue(), ^
+    {
+//        запрос и все присоединившиеся к нему отменены
+        if (VKRequestFlagIsSet(&_isCancelled) && 0 == [_followers count])
+            return;
+
+        [self enqueueConnection];
+    });
 }
 
-- (void)connection:(NSURLConnection *)connection
-  didFailWithError:(NSError *)error
+// может ли запрос быть выполнен в пакете (см. VKRequestBatcher)
+- (BOOL)isBatchable
 {
-    INFO_LOG();
+    return (nil != _batcher &&
+            nil != _options &&
+            nil != _accessToken &&
+            ![kVKExecute isEqualToString:_methodName] &&
+            [@"GET" isEqualToString:[_request HTTPMethod]]);
+}
+
+// ключ, по которому объединяются одинаковые запросы, либо nil, если запрос не
+// может быть объединён с другими: объединяются лишь кэшируемые идемпотентные GET
+// запросы, не изменяющие данные, к одному и тому же кэшу
+- (id)coalescingKey
+{
+    if (!_coalescesIdenticalRequests ||
+            !_idempotent ||
+            VKCachedDataLiveTimeNever == self.cacheLiveTime ||
+            0 != [_invalidatedCacheTags count] ||
+            ![@"GET" isEqualToString:[_request HTTPMethod]])
+        return nil;
+
+//    без кэша учётная запись определяется лишь токеном доступа в URL
+    if (nil == _cachedData)
+        return @[[_request.URL absoluteString]];
+
+    return @[self.cacheKey, [NSValue valueWithNonretainedObject:_cachedData]];
+}
+
+// запрос и присоединившиеся к его соединению запросы; вызывается на главной очереди
+- (NSArray *)coalescedRequests
+{
+    return [@[self] arrayByAddingObjectsFromArray:_followers];
+}
+
+// завершает объединение: соединение больше не принимает новых запросов;
+// вызывается на главной очереди
+- (NSArray *)detachFollowers
+{
+    NSArray *followers = [_followers copy];
+
+    for (VKRequest *follower in followers)
+        follower->_leader = nil;
+
+    [_followers removeAllObjects];
+
+    if (nil != _coalescingKey && self == VKRequestInFlightRequests()[_coalescingKey])
+        [VKRequestInFlightRequests() removeObjectForKey:_coalescingKey];
+
+    _coalescingKey = nil;
+
+    return followers;
+}
+
+// вызывается на главной очереди
+- (void)cancelConnection
+{
+//    присоединившийся запрос лишь покидает чужое соединение
+    VKRequest *leader = _leader;
+
+    if (nil != leader) {
+        _leader = nil;
+        [leader->_followers removeObject:self];
+
+        if (VKRequestFlagIsSet(&leader->_isCancelled) && 0 == [leader->_followers count])
+            [leader cancelConnection];
+
+        return;
+    }
+
+//    соединение продолжает работать для присоединившихся запросов, пока хотя
+//    бы один из них не отменён
+    if (0 != [_followers count])
+        return;
+
+    [self detachFollowers];
+    [_batcher removeRequest:self];
+    [[VKRequestScheduler sharedScheduler] removeRequest:self];
+    [_connection cancel];
+
+    _receivedData = [[NSMutableData alloc] init];
+    _expectedDataSize = NSURLResponseUnknownContentLength;
+    _parser = nil;
+}
 
-    if (nil != self.delegate && [self.delegate respondsToSelector:@selector(VKRequest:connectionErrorOccured:)]) {
-        [self.delegate VKRequest:self
-          connectionErrorOccured:error];
+// вызывается на главной очереди
+- (void)failWithConnectionError:(NSError *)error
+{
+    for (VKRequest *request in [@[self] arrayByAddingObjectsFromArray:[self detachFollowers]]) {
+
+//        делегат уже получил устаревшие данные, ошибку обновления не передаём
+        if (request->_isRevalidating) {
+            request->_isRevalidating = NO;
+            continue;
+        }
+
+        [request notifyDelegateWithConnectionError:error];
     }
 }
 
-#pragma mark - private methods
+// вызывается на очереди VKRequestProcessingQueue
+- (BOOL)processCachedResponseData:(NSData *)responseData
+                          isStale:(BOOL)isStale
+{
+    NSError *error;
+    id json = [NSJSONSerialization JSONObjectWithData:responseData
+                                              options:NSJSONReadingAllowFragments
+                                                error:&error];
+
+    if (nil == json) {
+        [self notifyDelegateWithParsingError:error];
+        return NO;
+    }
+
+//    ошибки не кэшируются, но на всякий случай проверим
+    if (nil != json[@"error"]) {
+        [self notifyDelegateWithResponseError:json[@"error"]];
+        return NO;
+    }
+
+    _cachedResponseObject = json;
+
+    [_cachedData setCachedObject:json
+                  parsedFromData:responseData
+                          forKey:_cacheKey];
+
+    [self notifyDelegateWithResponse:json
+                             isStale:isStale];
+
+    return YES;
+}
+
+// вызывается на очереди VKRequestProcessingQueue
+- (void)processResponseData:(NSData *)responseData
+                     parser:(VKJSONStreamParser *)parser
+                isCacheable:(BOOL)isCacheable
+                  followers:(NSArray *)followers
+{
+//    обновлённые данные совпадают с уже переданными делегату - разбирать их
+//    повторно не нужно, лишь продлеваем срок жизни кэша
+    BOOL isUnchanged = (_isRevalidating && nil != _cachedResponseObject &&
+            [responseData isEqualToData:_cachedResponseData]);
+
+//    разобранный объект неизменяемый, поэтому его можно закэшировать и передавать
+//    последующим запросам без копирования
+    NSError *error = nil;
+    id json = _cachedResponseObject;
+
+//    данные уже разобраны по мере загрузки; если это не удалось, то
+//    NSJSONSerialization опишет ошибку
+    if (!isUnchanged) {
+        if ([parser finish])
+            json = parser.result;
+        else
+            json = [NSJSONSerialization JSONObjectWithData:responseData
+                                                   options:NSJSONReadingAllowFragments
+                                                     error:&error];
+    }
+
+    [self processResponseData:responseData
+                       object:json
+                 parsingError:error
+                  isCacheable:isCacheable
+                    followers:followers];
+}
+
+// вызывается на очереди VKRequestProcessingQueue
+- (void)processResponseData:(NSData *)responseData
+                     object:(id)json
+               parsingError:(NSError *)error
+                isCacheable:(BOOL)isCacheable
+                  followers:(NSArray *)followers
+{
+//    временная ошибка API (слишком много запросов etc) - повторяем запрос, не
+//    передавая ошибку делегату
+    id responseError = (nil != json ? json[@"error"] : nil);
+    NSTimeInterval retryDelay = 0;
+
+    if (nil != responseError &&
+            [_retryPolicy shouldRetryAfterResponseError:responseError
+                                             idempotent:_idempotent] &&
+            [self canRetryAfterDelay:&retryDelay]) {
+        dispatch_async(dispatch_get_main_queue(), ^
+        {
+            [self retryAfterDelay:retryDelay
+                        followers:followers];
+        });
+
+        return;
+    }
+
+//    кэшировать ошибки не будем
+    if (nil != json && nil == json[@"error"]) {
+
+//        изменяющий запрос выполнен - затронутые им ответы в кэше устарели
+        if (!_isRevalidating || ![responseData isEqualToData:_cachedResponseData])
+            [self invalidateCachedResponses];
+
+//        данные получены от сервера - кэшируем их вместе с разобранным объектом
+        if (isCacheable)
+            [self cacheResponseData:responseData
+                             object:json];
+    }
+
+//    присоединившиеся запросы получают тот же разобранный объект
+    [self deliverResponseData:responseData
+                       object:json
+                 parsingError:error];
+
+    for (VKRequest *follower in followers)
+        [follower deliverResponseData:responseData
+                               object:json
+                         parsingError:error];
+}
+
+// вызывается на очереди VKRequestProcessingQueue
+- (void)deliverResponseData:(NSData *)responseData
+                     object:(id)json
+               parsingError:(NSError *)error
+{
+//    обновлённые данные совпадают с уже переданными делегату - повторно его не
+//    вызываем
+    BOOL isRevalidation = _isRevalidating;
+    _isRevalidating = NO;
+
+    if (isRevalidation) {
+        if ([responseData isEqualToData:_cachedResponseData])
+            return;
+
+        _cachedResponseData = nil;
+        _cachedResponseObject = nil;
+    }
+
+//    делегат уже получил устаревшие данные, ошибки обновления не передаём
+    if (nil == json) {
+        if (!isRevalidation)
+            [self notifyDelegateWithParsingError:error];
+
+        return;
+    }
+
+//    проверим, если в ответе содержится ошибка
+    if (nil != json[@"error"]) {
+        if (!isRevalidation)
+            [self notifyDelegateWithResponseError:json[@"error"]];
+
+        return;
+    }
+
+//    возвращаем Foundation объект
+    [self notifyDelegateWithResponse:json
+                             isStale:NO];
+}
+
+- (BOOL)isResponseCacheable
+{
+//    ответ неидемпотентного запроса (messages.send etc) нельзя вернуть повторному
+//    вызову, даже если время жизни кэша было задано
+    return (VKCachedDataLiveTimeNever != self.cacheLiveTime && _idempotent);
+}
+
+- (void)cacheResponseData:(NSData *)responseData
+                   object:(id)responseObject
+{
+//    буфер соединения изменяемый: кэш сохранил бы собственную копию, и объект,
+//    привязанный к версии данных (см. VKCachedData setCachedObject:parsedFromData:forKey:),
+//    не был бы сохранён; данные копируются один раз
+    NSData *payload = [responseData copy];
+
+    [_cachedData addCachedData:payload
+                        forKey:_cacheKey
+                    methodName:_methodName
+                          tags:_cacheTags
+                      liveTime:self.cacheLiveTime];
+
+    [_cachedData setCachedObject:responseObject
+                  parsedFromData:payload
+                          forKey:_cacheKey];
+}
+
+- (void)invalidateCachedResponses
+{
+    if (0 == [_invalidatedCacheTags count])
+        return;
+
+    [_cachedData invalidateCachedDataForTags:_invalidatedCacheTags];
+
+//    ответы, полученные без токена доступа, могли попасть в общий кэш
+    VKCachedData *sharedCachedData = [[VKStorage sharedStorage] sharedCachedData];
+
+    if (sharedCachedData != _cachedData)
+        [sharedCachedData invalidateCachedDataForTags:_invalidatedCacheTags];
+}
+
+// вызывает делегата на очереди callbackQueue, если запрос не был отменён
+- (void)notifyDelegateUsingBlock:(void (^)(id <VKRequestDelegate> delegate))block
+{
+    dispatch_async(_callbackQueue, ^
+    {
+        id <VKRequestDelegate> delegate = self.delegate;
+
+        if (VKRequestFlagIsSet(&_isCancelled) || nil == delegate)
+            return;
+
+        block(delegate);
+    });
+}
 
-- (NSURL *)removeAccessTokenFromURL:(NSURL *)url
+- (void)notifyDelegateWithResponse:(id)response
+                           isStale:(BOOL)isStale
 {
-//    уберем токен доступа из строки запроса
-//    токен доступа может меняться при каждом обновлении (повторном входе пользователя),
-//    но создавать каждый раз новый кэш для одинаковых запросов с всего лишь разными
-//    токенами доступа нет смысла.
-    NSString *query = [url query];
-    NSArray *params = [query componentsSeparatedByString:@"&"];
+    [self notifyDelegateUsingBlock:^(id <VKRequestDelegate> delegate)
+    {
+        _isResponseStale = isStale;
+
+        [delegate VKRequest:self
+                   response:response];
+
+        _isResponseStale = NO;
+    }];
+}
+
+- (void)notifyDelegateWithConnectionError:(NSError *)error
+{
+    [self notifyDelegateUsingBlock:^(id <VKRequestDelegate> delegate)
+    {
+        if ([delegate respondsToSelector:@selector(VKRequest:connectionErrorOccured:)])
+            [delegate VKRequest:self
+         connectionErrorOccured:error];
+    }];
+}
+
+- (void)notifyDelegateWithParsingError:(NSError *)error
+{
+    [self notifyDelegateUsingBlock:^(id <VKRequestDelegate> delegate)
+    {
+        if ([delegate respondsToSelector:@selector(VKRequest:parsingErrorOccured:)])
+            [delegate VKRequest:self
+            parsingErrorOccured:error];
+    }];
+}
 
-    NSPredicate *predicate = [NSPredicate predicateWithFormat:@"NOT (SELF BEGINSWITH \"access_token\")"];
-    NSArray *newParams = [params filteredArrayUsingPredicate:predicate];
+- (void)notifyDelegateWithResponseError:(id)responseError
+{
+    [self notifyDelegateUsingBlock:^(id <VKRequestDelegate> delegate)
+    {
+//        капча ли?
+        if (kCaptchaErrorCode == [responseError[@"error_code"] integerValue]) {
+            if ([delegate respondsToSelector:@selector(VKRequest:captchaSid:captchaImage:)]) {
+                NSString *captchaSid = responseError[@"captcha_sid"];
+                NSString *captchaImage = responseError[@"captcha_img"];
+
+                [delegate VKRequest:self
+                         captchaSid:captchaSid
+                       captchaImage:captchaImage];
+            }
 
-    NSString *part1 = [[url absoluteString] componentsSeparatedByString:@"?"][0];
-    NSString *part2 = [newParams componentsJoinedByString:@"&"];
-    NSURL *newURL = [NSURL URLWithString:[NSString stringWithFormat:@"%@?%@", part1, part2]];
+            return;
+        }
 
-    return newURL;
+//        другая ошибка
+        if ([delegate respondsToSelector:@selector(VKRequest:responseErrorOccured:)])
+            [delegate VKRequest:self
+           responseErrorOccured:responseError];
+    }];
 }
 
-@end
\ No newline at end of file
+@end
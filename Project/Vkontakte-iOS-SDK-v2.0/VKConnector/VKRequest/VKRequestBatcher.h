@@ -0,0 +1,129 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+//
+#import <Foundation/Foundation.h>
+#import "VKRequest.h"
+
+
+/** Максимальное кол-во вызовов методов API в одном запросе execute
+*/
+static NSUInteger const kVKRequestBatcherMaximumBatchSize = 25;
+
+/** Интервал (в секундах), в течение которого запросы по умолчанию собираются в
+один пакет
+*/
+static NSTimeInterval const kVKRequestBatcherDefaultBatchInterval = 0.05;
+
+
+/** Планировщик пакетного выполнения запросов. Запросы к методам API, которым
+назначен планировщик (см. VKRequest batcher), не открывают собственного соединения:
+вызовы, выполненные в течение batchInterval секунд (либо до заполнения пакета),
+отправляются на сервер одним запросом к методу execute, а его ответ разбивается
+на ответы исходных запросов.
+
+Каждый запрос получает свой ответ через своего делегата на своей очереди
+callbackQueue, как если бы он выполнялся отдельно: ответ кэшируется, ошибка
+вызова передаётся методом делегата VKRequest:responseErrorOccured:. Ошибки
+соединения и ошибка всего запроса execute передаются всем запросам пакета.
+
+Пакетно выполняются только GET запросы к методам API с токеном доступа, причём в
+один пакет попадают лишь запросы с одинаковым токеном. Обращение к кэшу
+по-прежнему производится каждым запросом самостоятельно - в пакет попадают лишь
+запросы, которым нужен ответ сервера.
+
+Методы класса вызываются на главной очереди.
+*/
+@interface VKRequestBatcher : NSObject <VKRequestDelegate>
+
+/**
+@name Свойства
+*/
+/** Интервал (в секундах) от первого запроса пакета до его отправки. По умолчанию
+kVKRequestBatcherDefaultBatchInterval.
+*/
+@property (nonatomic, assign, readwrite) NSTimeInterval batchInterval;
+
+/** Максимальное кол-во запросов в пакете - заполненный пакет отправляется сразу.
+По умолчанию и не более kVKRequestBatcherMaximumBatchSize.
+*/
+@property (nonatomic, assign, readwrite) NSUInteger maximumBatchSize;
+
+/** Кол-во запросов, ожидающих отправки
+*/
+@property (nonatomic, readonly) NSUInteger pendingCount;
+
+/**
+@name Методы экземпляра
+*/
+/** Добавляет запрос в текущий пакет. Если пакет заполнен либо содержит запросы
+с другим токеном доступа, то он отправляется.
+
+@param request запрос к методу API
+*/
+- (void)addRequest:(VKRequest *)request;
+
+/** Удаляет запрос из ещё не отправленного пакета (запрос отменён)
+
+@param request запрос
+*/
+- (void)removeRequest:(VKRequest *)request;
+
+/** Отправляет текущий пакет, не дожидаясь истечения batchInterval
+*/
+- (void)flush;
+
+@end
+
+
+/** Методы VKRequest, через которые планировщик получает параметры вызова и
+возвращает запросу его часть ответа. Вызываются на главной очереди.
+*/
+@interface VKRequest (VKRequestBatcher)
+
+/** Параметры вызова метода API без токена доступа
+*/
+- (NSDictionary *)batchedOptions;
+
+/** Токен доступа, с которым выполняется запрос
+*/
+- (NSString *)batchedAccessToken;
+
+/** Передаёт запросу его часть ответа execute
+
+@param response ответ в виде Foundation объекта ("response" либо "error" на
+верхнем уровне) либо nil, если ответ не удалось разобрать
+@param error ошибка разбора ответа
+*/
+- (void)completeBatchedCallWithResponse:(id)response
+                           parsingError:(NSError *)error;
+
+/** Передаёт запросу ошибку соединения запроса execute
+
+@param error ошибка соединения
+*/
+- (void)failBatchedCallWithConnectionError:(NSError *)error;
+
+@end
@@ -0,0 +1,272 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+//
+#import "VKRequestBatcher.h"
+#import "VKMethods.h"
+#import "NSString+encodeURL.h"
+
+
+@implementation VKRequestBatcher
+{
+//    запросы текущего (ещё не отправленного) пакета и их токен доступа
+    NSMutableArray *_pendingRequests;
+    NSString *_pendingAccessToken;
+
+//    номер текущего пакета - отложенная отправка уже отправленного пакета
+//    не производится
+    NSUInteger _batchNumber;
+}
+
+#pragma mark Visible VKRequestBatcher methods
+#pragma mark - Init methods
+
+- (instancetype)init
+{
+    self = [super init];
+
+    if (self) {
+        _pendingRequests = [[NSMutableArray alloc] init];
+        _batchInterval = kVKRequestBatcherDefaultBatchInterval;
+        _maximumBatchSize = kVKRequestBatcherMaximumBatchSize;
+        _batchNumber = 0;
+    }
+
+    return self;
+}
+
+#pragma mark - Setters & Getters
+
+- (void)setMaximumBatchSize:(NSUInteger)maximumBatchSize
+{
+    _maximumBatchSize = MAX(1, MIN(maximumBatchSize, kVKRequestBatcherMaximumBatchSize));
+}
+
+- (NSUInteger)pendingCount
+{
+    return [_pendingRequests count];
+}
+
+#pragma mark - Batching
+
+- (void)addRequest:(VKRequest *)request
+{
+    NSString *accessToken = [request batchedAccessToken];
+
+//    вызовы выполняются от имени одного пользователя
+    if (nil != _pendingAccessToken && ![_pendingAccessToken isEqualToString:accessToken])
+        [self flush];
+
+    [_pendingRequests addObject:request];
+    _pendingAccessToken = accessToken;
+
+    if ([_pendingRequests count] >= _maximumBatchSize) {
+        [self flush];
+        return;
+    }
+
+//    первый запрос пакета - отправляем пакет через batchInterval секунд
+    if (1 == [_pendingRequests count]) {
+        NSUInteger batchNumber = _batchNumber;
+
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (_batchInterval * NSEC_PER_SEC)),
+                       dispatch_get_main_queue(), ^
+        {
+            if (batchNumber == _batchNumber)
+                [self flush];
+        });
+    }
+}
+
+- (void)removeRequest:(VKRequest *)request
+{
+    [_pendingRequests removeObjectIdenticalTo:request];
+
+    if (0 == [_pendingRequests count]) {
+        _pendingAccessToken = nil;
+        _batchNumber++;
+    }
+}
+
+- (void)flush
+{
+    if (0 == [_pendingRequests count])
+        return;
+
+    NSArray *requests = [_pendingRequests copy];
+    NSString *accessToken = _pendingAccessToken;
+
+    [_pendingRequests removeAllObjects];
+    _pendingAccessToken = nil;
+    _batchNumber++;
+
+    [self sendRequests:requests
+           accessToken:accessToken];
+}
+
+#pragma mark - VKRequestDelegate
+
+- (void)VKRequest:(VKRequest *)request
+         response:(id)response
+{
+    NSArray *requests = request.signature;
+    id results = response[@"response"];
+
+//    неудачные вызовы возвращают false, а их ошибки перечислены по порядку в
+//    execute_errors
+    NSArray *executeErrors = response[@"execute_errors"];
+    NSUInteger errorIndex = 0;
+
+    if (![results isKindOfClass:[NSArray class]])
+        results = nil;
+
+    for (NSUInteger i = 0; i < [requests count]; i++) {
+        VKRequest *batchedRequest = requests[i];
+
+        if (i >= [results count]) {
+            NSError *error = [NSError errorWithDomain:@"VKRequestBatcherErrorDomain"
+                                                 code:0
+                                             userInfo:@{
+                                                     NSLocalizedDescriptionKey : @"execute response does not contain the call result"
+                                             }];
+
+            [batchedRequest completeBatchedCallWithResponse:nil
+                                               parsingError:error];
+            continue;
+        }
+
+        id result = results[i];
+
+        if ((__bridge id) kCFBooleanFalse == result && errorIndex < [executeErrors count]) {
+            [batchedRequest completeBatchedCallWithResponse:@{@"error" : executeErrors[errorIndex++]}
+                                               parsingError:nil];
+            continue;
+        }
+
+        [batchedRequest completeBatchedCallWithResponse:@{@"response" : result}
+                                           parsingError:nil];
+    }
+}
+
+- (void)     VKRequest:(VKRequest *)request
+connectionErrorOccured:(NSError *)error
+{
+    for (VKRequest *batchedRequest in request.signature)
+        [batchedRequest failBatchedCallWithConnectionError:error];
+}
+
+- (void)  VKRequest:(VKRequest *)request
+parsingErrorOccured:(NSError *)error
+{
+    for (VKRequest *batchedRequest in request.signature)
+        [batchedRequest completeBatchedCallWithResponse:nil
+                                           parsingError:error];
+}
+
+- (void)   VKRequest:(VKRequest *)request
+responseErrorOccured:(id)error
+{
+    [self completeRequests:request.signature
+                 responseError:error];
+}
+
+- (void)VKRequest:(VKRequest *)request
+       captchaSid:(NSString *)captchaSid
+     captchaImage:(NSString *)captchaImage
+{
+//    сервер может не вернуть captcha_sid или captcha_img - ошибка передаётся
+//    вызовам с теми значениями, что есть
+    NSMutableDictionary *error = [NSMutableDictionary dictionary];
+    error[@"error_code"] = @14;
+
+    if (nil != captchaSid)
+        error[@"captcha_sid"] = captchaSid;
+
+    if (nil != captchaImage)
+        error[@"captcha_img"] = captchaImage;
+
+    [self completeRequests:request.signature
+                 responseError:error];
+}
+
+#pragma mark - Private methods
+
+// ошибка всего запроса execute (неверный токен etc) - ошибка каждого вызова
+- (void)completeRequests:(NSArray *)requests
+           responseError:(id)error
+{
+    for (VKRequest *batchedRequest in requests)
+        [batchedRequest completeBatchedCallWithResponse:@{@"error" : error}
+                                           parsingError:nil];
+}
+
+- (void)sendRequests:(NSArray *)requests
+         accessToken:(NSString *)accessToken
+{
+//    параметры передаются объектами VKScript, а результаты вызовов возвращаются
+//    массивом в порядке запросов
+    NSMutableArray *calls = [NSMutableArray array];
+    VKRequestPriority priority = VKRequestPriorityLow;
+
+    for (VKRequest *request in requests) {
+        NSData *options = [NSJSONSerialization dataWithJSONObject:[request batchedOptions]
+                                                          options:0
+                                                            error:NULL];
+
+        [calls addObject:[NSString stringWithFormat:@"API.%@(%@)",
+                                                    request.methodName,
+                                                    [[NSString alloc] initWithData:options
+                                                                          encoding:NSUTF8StringEncoding]]];
+
+        priority = MAX(priority, request.priority);
+    }
+
+    NSString *code = [NSString stringWithFormat:@"return [%@];",
+                                                [calls componentsJoinedByString:@","]];
+
+//    код передаётся в теле запроса - в URL он может не поместиться
+    NSString *body = [NSString stringWithFormat:@"code=%@&access_token=%@",
+                                                [code encodeURL],
+                                                [accessToken encodeURL]];
+
+    NSURL *url = [NSURL URLWithString:[kVKAPIURLPrefix stringByAppendingString:kVKExecute]];
+    VKRequest *executeRequest = [VKRequest requestHTTPMethod:@"POST"
+                                                         URL:url
+                                                     headers:@{@"Content-Type" : @"application/x-www-form-urlencoded"}
+                                                        body:[body dataUsingEncoding:NSUTF8StringEncoding]
+                                                    delegate:self];
+
+//    ответ execute не кэшируется - кэшируются ответы отдельных вызовов; execute
+//    не повторяется - каждый вызов повторяется по политике своего запроса
+    executeRequest.signature = requests;
+    executeRequest.cacheLiveTime = VKCachedDataLiveTimeNever;
+    executeRequest.coalescesIdenticalRequests = NO;
+    executeRequest.retryPolicy = nil;
+    executeRequest.priority = priority;
+
+    [executeRequest start];
+}
+
+@end
@@ -0,0 +1,127 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+//
+#import <Foundation/Foundation.h>
+#import "VKRequest.h"
+
+
+/** Кол-во одновременно выполняющихся запросов по умолчанию
+*/
+static NSUInteger const kVKRequestSchedulerDefaultMaximumConcurrentRequests = 4;
+
+/** Кол-во запросов в секунду с одним токеном доступа по умолчанию (ограничение
+сервера ВКонтакте)
+*/
+static double const kVKRequestSchedulerDefaultRequestsPerSecond = 3;
+
+
+/** Планировщик запросов к серверу. Через него проходит каждый запрос VKRequest,
+которому нужен ответ сервера: соединение открывается лишь тогда, когда это
+позволяют ограничения планировщика.
+
+- Кол-во одновременно выполняющихся запросов не превышает maximumConcurrentRequests.
+Одно место всегда остаётся за запросами с приоритетом VKRequestPriorityHigh
+(ответа которых ждёт пользователь).
+- Запросы с одним токеном доступа выполняются не чаще requestsPerSecond раз в
+секунду (token bucket), поэтому сервер не возвращает ошибку "Too many requests per
+second". Запросы с приоритетом VKRequestPriorityLow (предзагрузка) оставляют в
+запасе один запрос для запросов с более высоким приоритетом.
+- Запросы выполняются в порядке приоритета. Запрос с низким приоритетом не
+обгоняет ожидающий запрос с более высоким приоритетом и тем же токеном.
+- Запросы с одинаковым приоритетом, но разными токенами, выполняются по очереди:
+первым выполняется запрос учётной записи, которая дольше всех ждала.
+
+Запросы без токена доступа (загрузка файлов etc) ограничены только кол-вом
+одновременно выполняющихся запросов.
+
+Методы класса вызываются на главной очереди.
+*/
+@interface VKRequestScheduler : NSObject
+
+/**
+@name Свойства
+*/
+/** Максимальное кол-во одновременно выполняющихся запросов. По умолчанию
+kVKRequestSchedulerDefaultMaximumConcurrentRequests, не менее 1.
+*/
+@property (nonatomic, assign, readwrite) NSUInteger maximumConcurrentRequests;
+
+/** Максимальное кол-во запросов в секунду с одним токеном доступа. По умолчанию
+kVKRequestSchedulerDefaultRequestsPerSecond, 0 - без ограничения.
+*/
+@property (nonatomic, assign, readwrite) double requestsPerSecond;
+
+/** Кол-во запросов, ожидающих выполнения
+*/
+@property (nonatomic, readonly) NSUInteger pendingCount;
+
+/** Кол-во выполняющихся запросов
+*/
+@property (nonatomic, readonly) NSUInteger runningCount;
+
+/**
+@name Методы класса
+*/
+/** Планировщик, через который проходят все запросы
+
+@return экземпляр класса VKRequestScheduler
+*/
++ (instancetype)sharedScheduler;
+
+/**
+@name Методы экземпляра
+*/
+/** Ставит запрос в очередь. Соединение запроса открывается сразу, если
+ограничения это позволяют.
+
+@param request запрос
+*/
+- (void)addRequest:(VKRequest *)request;
+
+/** Удаляет запрос из очереди либо из выполняющихся (запрос выполнен или отменён)
+и запускает следующие запросы
+
+@param request запрос
+*/
+- (void)removeRequest:(VKRequest *)request;
+
+@end
+
+
+/** Методы VKRequest, через которые планировщик управляет запросом. Вызываются на
+главной очереди.
+*/
+@interface VKRequest (VKRequestScheduler)
+
+/** Токен доступа, с которым выполняется запрос, либо nil
+*/
+- (NSString *)scheduledAccessToken;
+
+/** Открывает соединение запроса
+*/
+- (void)startScheduledConnection;
+
+@end
@@ -0,0 +1,310 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+//
+#import "VKRequestScheduler.h"
+
+
+/** Token bucket запросов одного токена доступа
+*/
+@interface VKRequestRateLimit : NSObject
+
+@property (nonatomic, assign) double tokens;
+@property (nonatomic, assign) NSTimeInterval refillTime;
+
+// время запуска последнего запроса - дольше всех ждавшая учётная запись
+// обслуживается первой
+@property (nonatomic, assign) NSTimeInterval startTime;
+
+@end
+
+@implementation VKRequestRateLimit
+@end
+
+
+@implementation VKRequestScheduler
+{
+//    ожидающие запросы по приоритетам (индекс - VKRequestPriority), в порядке
+//    поступления
+    NSArray *_pendingRequests;
+    NSMutableArray *_runningRequests;
+
+//    ограничения по токенам доступа; запросы без токена учитываются под NSNull
+    NSMutableDictionary *_rateLimits;
+
+    BOOL _isWakeUpScheduled;
+}
+
+#pragma mark Visible VKRequestScheduler methods
+#pragma mark - Class methods
+
++ (instancetype)sharedScheduler
+{
+    static VKRequestScheduler *sharedScheduler;
+    static dispatch_once_t onceToken;
+
+    dispatch_once(&onceToken, ^
+    {
+        sharedScheduler = [[VKRequestScheduler alloc] init];
+    });
+
+    return sharedScheduler;
+}
+
+#pragma mark - Init methods
+
+- (instancetype)init
+{
+    self = [super init];
+
+    if (self) {
+        _pendingRequests = @[
+                [[NSMutableArray alloc] init],
+                [[NSMutableArray alloc] init],
+                [[NSMutableArray alloc] init]
+        ];
+        _runningRequests = [[NSMutableArray alloc] init];
+        _rateLimits = [[NSMutableDictionary alloc] init];
+        _maximumConcurrentRequests = kVKRequestSchedulerDefaultMaximumConcurrentRequests;
+        _requestsPerSecond = kVKRequestSchedulerDefaultRequestsPerSecond;
+        _isWakeUpScheduled = NO;
+    }
+
+    return self;
+}
+
+#pragma mark - Setters & Getters
+
+- (void)setMaximumConcurrentRequests:(NSUInteger)maximumConcurrentRequests
+{
+    _maximumConcurrentRequests = MAX(1, maximumConcurrentRequests);
+
+    [self startPendingRequests];
+}
+
+- (void)setRequestsPerSecond:(double)requestsPerSecond
+{
+    _requestsPerSecond = requestsPerSecond;
+
+    [self startPendingRequests];
+}
+
+- (NSUInteger)pendingCount
+{
+    NSUInteger pendingCount = 0;
+
+    for (NSArray *requests in _pendingRequests)
+        pendingCount += [requests count];
+
+    return pendingCount;
+}
+
+- (NSUInteger)runningCount
+{
+    return [_runningRequests count];
+}
+
+#pragma mark - Scheduling
+
+- (void)addRequest:(VKRequest *)request
+{
+    NSUInteger priority = MIN(request.priority, VKRequestPriorityHigh);
+
+    [_pendingRequests[priority] addObject:request];
+
+    [self startPendingRequests];
+}
+
+- (void)removeRequest:(VKRequest *)request
+{
+    for (NSMutableArray *requests in _pendingRequests)
+        [requests removeObjectIdenticalTo:request];
+
+    [_runningRequests removeObjectIdenticalTo:request];
+
+    [self startPendingRequests];
+}
+
+#pragma mark - Private methods
+
+- (void)startPendingRequests
+{
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    NSTimeInterval wakeUpDelay = DBL_MAX;
+
+    while (YES) {
+        VKRequest *request = [self nextRequestAtTime:now
+                                         wakeUpDelay:&wakeUpDelay];
+
+        if (nil == request)
+            break;
+
+        for (NSMutableArray *requests in _pendingRequests)
+            [requests removeObjectIdenticalTo:request];
+
+        [_runningRequests addObject:request];
+
+        VKRequestRateLimit *rateLimit = _rateLimits[[self rateLimitKeyForRequest:request]];
+        rateLimit.startTime = now;
+
+        if (nil != [request scheduledAccessToken] && [self isRateLimited])
+            rateLimit.tokens -= 1;
+
+        [request startScheduledConnection];
+    }
+
+//    запросы ждут пополнения token bucket - проверим их позже
+    if (DBL_MAX != wakeUpDelay && !_isWakeUpScheduled) {
+        _isWakeUpScheduled = YES;
+
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (wakeUpDelay * NSEC_PER_SEC)),
+                       dispatch_get_main_queue(), ^
+        {
+            _isWakeUpScheduled = NO;
+            [self startPendingRequests];
+        });
+    }
+
+//    ограничения простаивающих учётных записей больше не нужны
+    if (0 == [self pendingCount])
+        [self removeIdleRateLimitsAtTime:now];
+}
+
+- (VKRequest *)nextRequestAtTime:(NSTimeInterval)now
+                     wakeUpDelay:(NSTimeInterval *)wakeUpDelay
+{
+//    учётные записи, запросы которых с более высоким приоритетом ещё ждут -
+//    менее важные запросы не должны их обгонять
+    NSMutableSet *waitingKeys = [NSMutableSet set];
+
+    for (NSInteger priority = VKRequestPriorityHigh; priority >= VKRequestPriorityLow; priority--) {
+
+//        одно место всегда остаётся за запросами, ответа которых ждёт пользователь
+        NSUInteger concurrencyLimit = _maximumConcurrentRequests;
+
+        if (VKRequestPriorityHigh != priority)
+            concurrencyLimit = MAX(1, _maximumConcurrentRequests - 1);
+
+        if ([_runningRequests count] >= concurrencyLimit)
+            return nil;
+
+//        предзагрузка оставляет в запасе запрос для более важных запросов
+        double requiredTokens = 1;
+
+        if (VKRequestPriorityLow == priority)
+            requiredTokens = MIN(2, [self bucketCapacity]);
+
+        VKRequest *candidate = nil;
+        VKRequestRateLimit *candidateRateLimit = nil;
+
+        for (VKRequest *request in _pendingRequests[(NSUInteger) priority]) {
+            id key = [self rateLimitKeyForRequest:request];
+
+            if ([waitingKeys containsObject:key])
+                continue;
+
+            VKRequestRateLimit *rateLimit = [self rateLimitForKey:key
+                                                           atTime:now];
+
+            if (nil != [request scheduledAccessToken] && [self isRateLimited] &&
+                    rateLimit.tokens < requiredTokens) {
+                *wakeUpDelay = MIN(*wakeUpDelay, (requiredTokens - rateLimit.tokens) / _requestsPerSecond);
+                continue;
+            }
+
+//            запросы одной учётной записи выполняются в порядке поступления
+            if (nil == candidate || rateLimit.startTime < candidateRateLimit.startTime) {
+                candidate = request;
+                candidateRateLimit = rateLimit;
+            }
+        }
+
+        if (nil != candidate)
+            return candidate;
+
+        for (VKRequest *request in _pendingRequests[(NSUInteger) priority])
+            [waitingKeys addObject:[self rateLimitKeyForRequest:request]];
+    }
+
+    return nil;
+}
+
+- (BOOL)isRateLimited
+{
+    return (0 < _requestsPerSecond);
+}
+
+// не менее одного запроса, иначе при дробном ограничении запрос никогда не
+// будет выполнен
+- (double)bucketCapacity
+{
+    return MAX(1, _requestsPerSecond);
+}
+
+- (id)rateLimitKeyForRequest:(VKRequest *)request
+{
+    NSString *accessToken = [request scheduledAccessToken];
+
+    return (nil != accessToken ? accessToken : [NSNull null]);
+}
+
+- (VKRequestRateLimit *)rateLimitForKey:(id)key
+                                 atTime:(NSTimeInterval)now
+{
+    VKRequestRateLimit *rateLimit = _rateLimits[key];
+
+    if (nil == rateLimit) {
+        rateLimit = [[VKRequestRateLimit alloc] init];
+        rateLimit.tokens = [self bucketCapacity];
+        rateLimit.refillTime = now;
+        rateLimit.startTime = 0;
+
+        _rateLimits[key] = rateLimit;
+
+        return rateLimit;
+    }
+
+    if ([self isRateLimited]) {
+        rateLimit.tokens = MIN([self bucketCapacity],
+                               rateLimit.tokens + (now - rateLimit.refillTime) * _requestsPerSecond);
+    }
+
+    rateLimit.refillTime = now;
+
+    return rateLimit;
+}
+
+- (void)removeIdleRateLimitsAtTime:(NSTimeInterval)now
+{
+    for (id key in [_rateLimits allKeys]) {
+        VKRequestRateLimit *rateLimit = [self rateLimitForKey:key
+                                                       atTime:now];
+
+        if (rateLimit.tokens >= [self bucketCapacity])
+            [_rateLimits removeObjectForKey:key];
+    }
+}
+
+@end
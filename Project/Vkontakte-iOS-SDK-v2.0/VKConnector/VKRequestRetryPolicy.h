@@ -0,0 +1,140 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+//
+#import <Foundation/Foundation.h>
+
+
+/** Политика повторения запросов при временных сбоях: кол-во попыток, экспоненциально
+растущая задержка между ними (со случайным разбросом, чтобы повторы множества
+запросов не приходились на один момент) и общее время, в течение которого запрос
+ещё может быть повторён.
+
+Повторяются запросы, завершившиеся временной ошибкой:
+
+- ошибкой соединения (нет сети, не удалось соединиться с сервером, соединение
+прервано, истекло время ожидания);
+- HTTP статусом 429 либо 5xx;
+- ошибкой API с кодом 6 (слишком много запросов в секунду), 1 (неизвестная ошибка)
+либо 10 (внутренняя ошибка сервера).
+
+Неидемпотентные запросы (POST запросы и запросы к изменяющим методам API)
+повторяются только в том случае, если ошибка означает, что сервер запрос не
+выполнял: соединение не было установлено, HTTP статус 429 либо код ошибки API 6.
+
+Экземпляры класса неизменяемы.
+*/
+@interface VKRequestRetryPolicy : NSObject <NSCopying>
+
+/**
+@name Свойства
+*/
+/** Максимальное кол-во попыток выполнения запроса, включая первую
+*/
+@property (nonatomic, readonly) NSUInteger maximumAttempts;
+
+/** Задержка (в секундах) перед первым повтором. Каждый следующий повтор ждёт
+вдвое дольше.
+*/
+@property (nonatomic, readonly) NSTimeInterval initialDelay;
+
+/** Максимальная задержка (в секундах) перед повтором
+*/
+@property (nonatomic, readonly) NSTimeInterval maximumDelay;
+
+/** Время (в секундах) от старта запроса, после которого запрос больше не
+повторяется
+*/
+@property (nonatomic, readonly) NSTimeInterval deadline;
+
+/**
+@name Методы класса
+*/
+/** Политика по умолчанию: не более трёх попыток, задержка от 0.5 до 8 секунд,
+повторы в течение 30 секунд
+
+@return экземпляр класса VKRequestRetryPolicy
+*/
++ (instancetype)defaultPolicy;
+
+/**
+@name Методы инициализации
+*/
+/** Инициализация политики
+
+@param maximumAttempts максимальное кол-во попыток, включая первую (не менее 1)
+@param initialDelay задержка перед первым повтором (в секундах)
+@param maximumDelay максимальная задержка перед повтором (в секундах)
+@param deadline время от старта запроса, в течение которого он может быть повторён
+(в секундах)
+@return экземпляр класса VKRequestRetryPolicy
+*/
+- (instancetype)initWithMaximumAttempts:(NSUInteger)maximumAttempts
+                           initialDelay:(NSTimeInterval)initialDelay
+                           maximumDelay:(NSTimeInterval)maximumDelay
+                               deadline:(NSTimeInterval)deadline;
+
+/**
+@name Классификация ошибок
+*/
+/** Следует ли повторить запрос после ошибки соединения
+
+@param error ошибка соединения
+@param isIdempotent идемпотентен ли запрос
+@return YES, если ошибка временная и повтор безопасен
+*/
+- (BOOL)shouldRetryAfterConnectionError:(NSError *)error
+                             idempotent:(BOOL)isIdempotent;
+
+/** Следует ли повторить запрос после ответа с HTTP статусом, отличным от 200
+
+@param statusCode HTTP статус ответа
+@param isIdempotent идемпотентен ли запрос
+@return YES, если ошибка временная и повтор безопасен
+*/
+- (BOOL)shouldRetryAfterStatusCode:(NSInteger)statusCode
+                        idempotent:(BOOL)isIdempotent;
+
+/** Следует ли повторить запрос после ошибки API
+
+@param responseError ошибка из ответа сервера (значение ключа "error")
+@param isIdempotent идемпотентен ли запрос
+@return YES, если ошибка временная и повтор безопасен
+*/
+- (BOOL)shouldRetryAfterResponseError:(id)responseError
+                           idempotent:(BOOL)isIdempotent;
+
+/**
+@name Задержка
+*/
+/** Задержка перед повтором: initialDelay * 2^(retryNumber - 1), но не более
+maximumDelay, из которой случайная часть (до половины) отбрасывается
+
+@param retryNumber номер повтора, начиная с 1
+@return задержка в секундах
+*/
+- (NSTimeInterval)delayBeforeRetry:(NSUInteger)retryNumber;
+
+@end
@@ -0,0 +1,156 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+//
+#import "VKRequestRetryPolicy.h"
+
+
+// коды ошибок API
+#define kVKUnknownErrorCode 1
+#define kVKTooManyRequestsErrorCode 6
+#define kVKInternalServerErrorCode 10
+
+
+@implementation VKRequestRetryPolicy
+
+#pragma mark Visible VKRequestRetryPolicy methods
+#pragma mark - Class methods
+
++ (instancetype)defaultPolicy
+{
+    return [[VKRequestRetryPolicy alloc]
+                                  initWithMaximumAttempts:3
+                                             initialDelay:0.5
+                                             maximumDelay:8
+                                                 deadline:30];
+}
+
+#pragma mark - Init methods
+
+- (instancetype)initWithMaximumAttempts:(NSUInteger)maximumAttempts
+                           initialDelay:(NSTimeInterval)initialDelay
+                           maximumDelay:(NSTimeInterval)maximumDelay
+                               deadline:(NSTimeInterval)deadline
+{
+    self = [super init];
+
+    if (self) {
+        _maximumAttempts = MAX(1, maximumAttempts);
+        _initialDelay = initialDelay;
+        _maximumDelay = MAX(initialDelay, maximumDelay);
+        _deadline = deadline;
+    }
+
+    return self;
+}
+
+#pragma mark - Classification
+
+- (BOOL)shouldRetryAfterConnectionError:(NSError *)error
+                             idempotent:(BOOL)isIdempotent
+{
+    if (![NSURLErrorDomain isEqualToString:error.domain])
+        return NO;
+
+    switch (error.code) {
+//        соединение не установлено - сервер запрос не получал
+        case NSURLErrorNotConnectedToInternet:
+        case NSURLErrorCannotFindHost:
+        case NSURLErrorCannotConnectToHost:
+        case NSURLErrorDNSLookupFailed:
+            return YES;
+
+//        запрос мог быть выполнен сервером
+        case NSURLErrorTimedOut:
+        case NSURLErrorNetworkConnectionLost:
+            return isIdempotent;
+
+        default:
+            return NO;
+    }
+}
+
+- (BOOL)shouldRetryAfterStatusCode:(NSInteger)statusCode
+                        idempotent:(BOOL)isIdempotent
+{
+//    сервер отказался обрабатывать запрос
+    if (429 == statusCode)
+        return YES;
+
+    return (500 <= statusCode && 600 > statusCode && isIdempotent);
+}
+
+- (BOOL)shouldRetryAfterResponseError:(id)responseError
+                           idempotent:(BOOL)isIdempotent
+{
+    if (![responseError isKindOfClass:[NSDictionary class]])
+        return NO;
+
+    NSInteger errorCode = [responseError[@"error_code"] integerValue];
+
+//    превышено кол-во запросов в секунду - запрос не выполнялся
+    if (kVKTooManyRequestsErrorCode == errorCode)
+        return YES;
+
+    return ((kVKUnknownErrorCode == errorCode || kVKInternalServerErrorCode == errorCode) &&
+            isIdempotent);
+}
+
+#pragma mark - Delay
+
+- (NSTimeInterval)delayBeforeRetry:(NSUInteger)retryNumber
+{
+    NSTimeInterval delay = _initialDelay * pow(2, MAX(1, retryNumber) - 1);
+    delay = MIN(delay, _maximumDelay);
+
+//    случайный разброс не даёт повторам одновременно упавших запросов совпасть
+    double jitter = (double) arc4random_uniform(1001) / 1000;
+
+    return delay / 2 + delay / 2 * jitter;
+}
+
+#pragma mark - Overridden methods
+
+- (NSString *)description
+{
+    NSDictionary *description = @{
+            @"maximumAttempts" : @(self.maximumAttempts),
+            @"initialDelay"    : @(self.initialDelay),
+            @"maximumDelay"    : @(self.maximumDelay),
+            @"deadline"        : @(self.deadline)
+    };
+
+    return [description description];
+}
+
+#pragma mark - NSCopying
+
+- (id)copyWithZone:(NSZone *)zone
+{
+//    экземпляры неизменяемы
+    return self;
+}
+
+@end
@@ -25,6 +25,7 @@
 // THE SOFTWARE.
 //
 #import <Foundation/Foundation.h>
+#import "VKCachedData.h"
 
 /** Основной ключ используемый для хранения информации о токенах доступа содержащихся
 в хранилище.
@@ -41,6 +42,25 @@ static NSString *const kVKStoragePath = @"/Vkontakte-iOS-SDK-v2.0-Storage/";
 */
 static NSString *const kVKStorageCachePath = @"/Vkontakte-iOS-SDK-v2.0-Storage/Cache/";
 
+/** Максимальный суммарный размер (в байтах) кэша всех элементов хранилища по умолчанию
+*/
+static NSUInteger const kVKStorageDefaultMaxCacheSize = 50 * 1024 * 1024;
+
+/** Директория общего кэша (см. sharedCachedData) внутри основной директории кэша
+хранилища
+*/
+static NSString *const kVKStorageSharedCachePath = @"shared/";
+
+/** Ключ, под которым статистика общего кэша возвращается методом cacheStatistics
+*/
+static NSString *const kVKStorageSharedCacheStatisticsKey = @"shared";
+
+/** Наименование раздела пакета кэша (см. exportCachePackToFile:), в котором
+хранятся записи общего кэша. Записи кэша элементов хранилища хранятся в разделах,
+наименованием которых является пользовательский идентификатор.
+*/
+static NSString *const kVKStorageSharedCachePackSectionName = @"shared";
+
 
 @class VKStorageItem;
 @class VKAccessToken;
@@ -71,6 +91,61 @@ static NSString *const kVKStorageCachePath = @"/Vkontakte-iOS-SDK-v2.0-Storage/C
 */
 @property (nonatomic, readonly) NSString *fullCacheStoragePath;
 
+/** Максимальный суммарный размер (в байтах) кэша всех элементов хранилища.
+При превышении вытесняются записи всех элементов хранилища в соответствии с
+политикой вытеснения evictionPolicy (сравниваются записи разных элементов между
+собой). По умолчанию равен kVKStorageDefaultMaxCacheSize, значение 0 снимает
+ограничение.
+*/
+@property (nonatomic, assign, readwrite) NSUInteger maxCacheSize;
+
+/** Максимальный размер (в байтах) кэша каждого отдельного элемента хранилища.
+Применяется ко всем текущим и новым элементам хранилища. По умолчанию равен 0 -
+размер кэша элемента ограничен лишь общим ограничением maxCacheSize.
+*/
+@property (nonatomic, assign, readwrite) NSUInteger maxItemCacheSize;
+
+/** Политика вытеснения записей кэша. Применяется как при общем вытеснении, так и
+ко всем текущим и новым элементам хранилища. По умолчанию VKCachedDataEvictionPolicyLRU.
+*/
+@property (nonatomic, assign, readwrite) VKCachedDataEvictionPolicy evictionPolicy;
+
+/** Суммарный размер (в байтах) кэша всех элементов хранилища на диске (с учётом
+сжатия). Именно этот размер ограничивается свойством maxCacheSize.
+*/
+@property (nonatomic, readonly) NSUInteger cacheSize;
+
+/** Суммарный размер (в байтах) исходных (несжатых) данных кэша всех элементов
+хранилища
+*/
+@property (nonatomic, readonly) NSUInteger cacheLogicalSize;
+
+/** Интервал (в секундах) между запусками фоновой очистки кэша элементов хранилища
+от записей с истёкшим сроком жизни. Применяется ко всем текущим и новым элементам
+хранилища. По умолчанию равен kVKCachedDataDefaultExpirySweepInterval, значение 0
+отключает фоновую очистку.
+*/
+@property (nonatomic, assign, readwrite) NSTimeInterval expirySweepInterval;
+
+/** Максимальное кол-во записей, удаляемых за один запуск фоновой очистки кэша
+каждого элемента хранилища. По умолчанию равно kVKCachedDataDefaultExpirySweepBatchSize.
+*/
+@property (nonatomic, assign, readwrite) NSUInteger expirySweepBatchSize;
+
+/** Суммарный размер (в байтах) данных с истёкшим сроком жизни, удалённых очисткой
+из кэша всех элементов хранилища
+*/
+@property (nonatomic, readonly) NSUInteger reclaimedSize;
+
+/** Общий для всех учётных записей кэш ответов методов API, вызываемых без токена
+доступа: такие ответы не зависят от учётной записи, поэтому хранятся в одном
+экземпляре. Общий кэш учитывается в cacheSize и ограничении maxCacheSize, к нему
+применяются те же настройки, что и к кэшам элементов хранилища. Ответы каких
+методов хранятся в общем кэше, определяет таблица политик кэширования (см.
+VKCachePolicy useSharedCache).
+*/
+@property (nonatomic, readonly) VKCachedData *sharedCachedData;
+
 /**
 @name Инициализация
 */
@@ -113,6 +188,52 @@ static NSString *const kVKStorageCachePath = @"/Vkontakte-iOS-SDK-v2.0-Storage/C
 */
 - (void)cleanCachedData;
 
+/** Удаляет из кэша всех элементов хранилища записи, срок жизни которых истёк.
+Удаление производится порциями по expirySweepBatchSize записей и не блокирует
+работу с кэшем, однако сам вызов синхронный - его не следует выполнять в главном
+потоке.
+
+@return кол-во освобождённых байт
+*/
+- (NSUInteger)removeExpiredCachedData;
+
+/**
+@name Статистика кэша
+*/
+/** Снимки статистики кэша всех элементов хранилища (см. VKCachedData statistics)
+
+@return словарь, ключом которого является пользовательский идентификатор
+(NSNumber), а значением - экземпляр VKCacheStatisticsSnapshot. Статистика общего
+кэша находится под ключом kVKStorageSharedCacheStatisticsKey.
+*/
+- (NSDictionary *)cacheStatistics;
+
+/** Обнуляет статистику кэша всех элементов хранилища и общего кэша
+*/
+- (void)resetCacheStatistics;
+
+/**
+@name Пакеты кэша
+*/
+/** Сохраняет снимок кэша всех элементов хранилища и общего кэша в единый файл
+пакета (см. VKCachePack). Вызов синхронный - его не следует выполнять в главном
+потоке.
+
+@param path путь к файлу пакета
+@return YES, если пакет сохранён
+*/
+- (BOOL)exportCachePackToFile:(NSString *)path;
+
+/** Импортирует пакет кэша, сохранённый методом exportCachePackToFile: (см.
+VKCachedData importPackFromFile:section:). Разделы пакета, для которых в хранилище
+нет элементов, пропускаются. Вызов синхронный - его не следует выполнять в главном
+потоке.
+
+@param path путь к файлу пакета
+@return кол-во импортированных записей
+*/
+- (NSUInteger)importCachePackFromFile:(NSString *)path;
+
 /**
 @name Чтение элементов хранилища
 */
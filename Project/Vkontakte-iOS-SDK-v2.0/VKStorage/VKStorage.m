@@ -33,9 +33,25 @@
 #define INFO_LOG() NSLog(@"%s", __FUNCTION__)
 
 
+/** Кандидат на вытеснение при соблюдении общего ограничения размера кэша
+*/
+@interface VKStorageEvictionCandidate : NSObject
+
+@property (nonatomic, strong) VKCacheIndexEntry *entry;
+@property (nonatomic, strong) VKCachedData *cachedData;
+
+@end
+
+@implementation VKStorageEvictionCandidate
+@end
+
+
 @implementation VKStorage
 {
     NSMutableDictionary *_storageItems;
+
+    dispatch_queue_t _evictionQueue;
+    BOOL _isEvictionScheduled;
 }
 
 #pragma mark Visible VKStorage methods
@@ -50,12 +66,37 @@
     if (self) {
         _storageItems = [[NSMutableDictionary alloc] init];
 
+        _maxCacheSize = kVKStorageDefaultMaxCacheSize;
+        _maxItemCacheSize = 0;
+        _evictionPolicy = VKCachedDataEvictionPolicyLRU;
+        _expirySweepInterval = kVKCachedDataDefaultExpirySweepInterval;
+        _expirySweepBatchSize = kVKCachedDataDefaultExpirySweepBatchSize;
+        _evictionQueue = dispatch_queue_create("com.vk.storage.eviction", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_evictionQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+
+        _sharedCachedData = [[VKCachedData alloc]
+                                           initWithCacheDirectory:[[self fullCacheStoragePath] stringByAppendingString:kVKStorageSharedCachePath]];
+        [self configureCachedData:_sharedCachedData];
+        [_sharedCachedData warmUpHotSet];
+
         [self loadStorage];
+
+//        общее ограничение размера кэша проверяется после каждого его увеличения
+        [[NSNotificationCenter defaultCenter]
+                               addObserver:self
+                                  selector:@selector(cachedDataDidChangeSize:)
+                                      name:kVKCachedDataDidChangeSizeNotification
+                                    object:nil];
     }
 
     return self;
 }
 
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
 #pragma mark - Shared storage
 
 + (instancetype)sharedStorage
@@ -103,6 +144,95 @@
     return [_storageItems count];
 }
 
+- (NSUInteger)cacheSize
+{
+    INFO_LOG();
+
+    NSUInteger cacheSize = 0;
+
+    for (VKCachedData *cachedData in [self allCachedData])
+        cacheSize += cachedData.size;
+
+    return cacheSize;
+}
+
+- (NSUInteger)cacheLogicalSize
+{
+    INFO_LOG();
+
+    NSUInteger cacheLogicalSize = 0;
+
+    for (VKCachedData *cachedData in [self allCachedData])
+        cacheLogicalSize += cachedData.logicalSize;
+
+    return cacheLogicalSize;
+}
+
+- (NSUInteger)reclaimedSize
+{
+    INFO_LOG();
+
+    NSUInteger reclaimedSize = 0;
+
+    for (VKCachedData *cachedData in [self allCachedData])
+        reclaimedSize += cachedData.reclaimedSize;
+
+    return reclaimedSize;
+}
+
+#pragma mark - Setters
+
+- (void)setMaxCacheSize:(NSUInteger)maxCacheSize
+{
+    INFO_LOG();
+
+    _maxCacheSize = maxCacheSize;
+
+    [self scheduleEviction];
+}
+
+- (void)setMaxItemCacheSize:(NSUInteger)maxItemCacheSize
+{
+    INFO_LOG();
+
+    _maxItemCacheSize = maxItemCacheSize;
+
+    for (VKCachedData *cachedData in [self allCachedData])
+        [self configureCachedData:cachedData];
+}
+
+- (void)setEvictionPolicy:(VKCachedDataEvictionPolicy)evictionPolicy
+{
+    INFO_LOG();
+
+    _evictionPolicy = evictionPolicy;
+
+    for (VKCachedData *cachedData in [self allCachedData])
+        [self configureCachedData:cachedData];
+}
+
+- (void)setExpirySweepInterval:(NSTimeInterval)expirySweepInterval
+{
+    INFO_LOG();
+
+    _expirySweepInterval = expirySweepInterval;
+
+    for (VKCachedData *cachedData in [self allCachedData])
+        [self configureCachedData:cachedData];
+}
+
+- (void)setExpirySweepBatchSize:(NSUInteger)expirySweepBatchSize
+{
+    INFO_LOG();
+
+    _expirySweepBatchSize = expirySweepBatchSize;
+
+    for (VKCachedData *cachedData in [self allCachedData])
+        [self configureCachedData:cachedData];
+}
+
+#pragma mark - Storage items
+
 - (VKStorageItem *)createStorageItemForAccessToken:(VKAccessToken *)token
 {
     INFO_LOG();
@@ -111,6 +241,8 @@
                                                  initWithAccessToken:token
                                                 mainCacheStoragePath:[self fullCacheStoragePath]];
 
+    [self configureCachedData:storageItem.cachedData];
+
     return storageItem;
 }
 
@@ -162,6 +294,11 @@
 {
     INFO_LOG();
 
+//    кэши элементов хранят индекс и данные в оперативной памяти - очищаем их
+//    явно, а затем удаляем всё, что осталось на диске
+    for (VKCachedData *cachedData in [self allCachedData])
+        [cachedData clearCachedData];
+
     dispatch_queue_t backgroundQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0);
 
     dispatch_async(backgroundQueue, ^
@@ -179,6 +316,27 @@
     });
 }
 
+- (NSUInteger)removeExpiredCachedData
+{
+    INFO_LOG();
+
+    NSUInteger batchSize = MAX(_expirySweepBatchSize, 1);
+    NSUInteger freedSize = 0;
+
+//    между порциями очередь обслуживания кэша освобождается, поэтому
+//    фоновые операции элемента не ждут окончания всей очистки
+    for (VKCachedData *cachedData in [self allCachedData]) {
+        NSUInteger batchFreedSize;
+
+        do {
+            batchFreedSize = [cachedData removeExpiredCachedDataWithLimit:batchSize];
+            freedSize += batchFreedSize;
+        } while (batchFreedSize > 0);
+    }
+
+    return freedSize;
+}
+
 - (VKStorageItem *)storageItemForUserID:(NSUInteger)userID
 {
     INFO_LOG();
@@ -187,6 +345,73 @@
     return _storageItems[storageKey];
 }
 
+#pragma mark - Cache statistics
+
+- (NSDictionary *)cacheStatistics
+{
+    INFO_LOG();
+
+    NSMutableDictionary *cacheStatistics = [NSMutableDictionary dictionary];
+
+    [_storageItems enumerateKeysAndObjectsUsingBlock:^(id storageKey, VKStorageItem *item, BOOL *stop)
+    {
+        cacheStatistics[storageKey] = [item.cachedData.statistics snapshot];
+    }];
+
+    cacheStatistics[kVKStorageSharedCacheStatisticsKey] = [_sharedCachedData.statistics snapshot];
+
+    return cacheStatistics;
+}
+
+- (void)resetCacheStatistics
+{
+    INFO_LOG();
+
+    for (VKCachedData *cachedData in [self allCachedData])
+        [cachedData.statistics reset];
+}
+
+#pragma mark - Cache packs
+
+- (BOOL)exportCachePackToFile:(NSString *)path
+{
+    INFO_LOG();
+
+    VKCachePackWriter *packWriter = [[VKCachePackWriter alloc] initWithPath:path];
+
+    [_sharedCachedData exportEntriesToPackWriter:packWriter
+                                         section:kVKStorageSharedCachePackSectionName];
+
+    [_storageItems enumerateKeysAndObjectsUsingBlock:^(id storageKey, VKStorageItem *item, BOOL *stop)
+    {
+        [item.cachedData exportEntriesToPackWriter:packWriter
+                                           section:[storageKey stringValue]];
+    }];
+
+    return [packWriter finish];
+}
+
+- (NSUInteger)importCachePackFromFile:(NSString *)path
+{
+    INFO_LOG();
+
+    NSUInteger importedCount = 0;
+
+    for (NSString *sectionName in [VKCachePack packWithContentsOfFile:path].sectionNames) {
+        VKCachedData *cachedData;
+
+        if ([sectionName isEqualToString:kVKStorageSharedCachePackSectionName])
+            cachedData = _sharedCachedData;
+        else
+            cachedData = [self storageItemForUserID:(NSUInteger) [sectionName longLongValue]].cachedData;
+
+        importedCount += [cachedData importPackFromFile:path
+                                                section:sectionName];
+    }
+
+    return importedCount;
+}
+
 #pragma mark - Storage paths
 
 - (NSString *)fullStoragePath
@@ -232,11 +457,154 @@
                                                          initWithAccessToken:token
                                                         mainCacheStoragePath:[self fullCacheStoragePath]];
 
+            [self configureCachedData:storageItem.cachedData];
+
             _storageItems[@(token.userID)] = storageItem;
         }];
     }
 }
 
+// кэши всех элементов хранилища и общий кэш
+- (NSArray *)allCachedData
+{
+    NSMutableArray *allCachedData = [[NSMutableArray alloc] initWithCapacity:[_storageItems count] + 1];
+
+    for (VKStorageItem *item in [_storageItems allValues])
+        [allCachedData addObject:item.cachedData];
+
+    [allCachedData addObject:_sharedCachedData];
+
+    return allCachedData;
+}
+
+- (void)configureCachedData:(VKCachedData *)cachedData
+{
+    cachedData.maxCacheSize = _maxItemCacheSize;
+    cachedData.evictionPolicy = _evictionPolicy;
+    cachedData.expirySweepBatchSize = _expirySweepBatchSize;
+
+    if (cachedData.expirySweepInterval != _expirySweepInterval)
+        cachedData.expirySweepInterval = _expirySweepInterval;
+}
+
+#pragma mark - Cache eviction
+
+- (void)cachedDataDidChangeSize:(NSNotification *)notification
+{
+    [self scheduleEviction];
+}
+
+- (void)scheduleEviction
+{
+//    список элементов хранилища изменяется в главном потоке, поэтому снимок
+//    кэшей делается там же, а само вытеснение выполняется в фоне
+    dispatch_async(dispatch_get_main_queue(), ^
+    {
+        if (_isEvictionScheduled)
+            return;
+
+        _isEvictionScheduled = YES;
+
+        NSArray *caches = [self allCachedData];
+        NSUInteger maxCacheSize = _maxCacheSize;
+        VKCachedDataEvictionPolicy evictionPolicy = _evictionPolicy;
+
+        dispatch_async(_evictionQueue, ^
+        {
+            [self evictCachedDataOfCaches:caches
+                             maxCacheSize:maxCacheSize
+                           evictionPolicy:evictionPolicy];
+
+            dispatch_async(dispatch_get_main_queue(), ^
+            {
+                _isEvictionScheduled = NO;
+            });
+        });
+    });
+}
+
+- (void)evictCachedDataOfCaches:(NSArray *)caches
+                   maxCacheSize:(NSUInteger)maxCacheSize
+                 evictionPolicy:(VKCachedDataEvictionPolicy)evictionPolicy
+{
+    NSUInteger totalSize = 0;
+
+    for (VKCachedData *cachedData in caches)
+        totalSize += cachedData.size;
+
+    if (0 == maxCacheSize || totalSize <= maxCacheSize)
+        return;
+
+    INFO_LOG();
+
+//    записи всех кэшей сравниваются между собой - вытесняются наименее ценные
+//    записи хранилища, независимо от того, какому элементу они принадлежат
+    NSMutableArray *candidates = [[NSMutableArray alloc] init];
+
+//    кол-во ссылок на каждое содержимое каждого кэша: место освобождается лишь
+//    при вытеснении последней записи, ссылающейся на содержимое
+    NSMapTable *contentReferencesByCache = [NSMapTable strongToStrongObjectsMapTable];
+
+    for (VKCachedData *cachedData in caches) {
+        NSCountedSet *contentReferences = [[NSCountedSet alloc] init];
+
+        for (VKCacheIndexEntry *entry in [cachedData evictionCandidates]) {
+            VKStorageEvictionCandidate *candidate = [[VKStorageEvictionCandidate alloc] init];
+            candidate.entry = entry;
+            candidate.cachedData = cachedData;
+
+            [candidates addObject:candidate];
+
+            if (nil != entry.contentKey)
+                [contentReferences addObject:entry.contentKey];
+        }
+
+        [contentReferencesByCache setObject:contentReferences
+                                     forKey:cachedData];
+    }
+
+    [candidates sortUsingComparator:^NSComparisonResult(VKStorageEvictionCandidate *candidate1,
+                                                        VKStorageEvictionCandidate *candidate2)
+    {
+        return [candidate1.entry compareForEviction:candidate2.entry
+                                             policy:evictionPolicy];
+    }];
+
+//    ключи группируются по кэшам, чтобы удаление производилось пакетно
+    NSUInteger targetSize = (NSUInteger) (maxCacheSize * kVKCachedDataEvictionTargetRatio);
+    NSUInteger evictedSize = 0;
+    NSMapTable *keysByCache = [NSMapTable strongToStrongObjectsMapTable];
+
+    for (VKStorageEvictionCandidate *candidate in candidates) {
+        if (totalSize - evictedSize <= targetSize)
+            break;
+
+        NSMutableArray *keys = [keysByCache objectForKey:candidate.cachedData];
+
+        if (nil == keys) {
+            keys = [[NSMutableArray alloc] init];
+            [keysByCache setObject:keys forKey:candidate.cachedData];
+        }
+
+        [keys addObject:candidate.entry.key];
+
+        NSString *contentKey = candidate.entry.contentKey;
+
+        if (nil != contentKey) {
+            NSCountedSet *contentReferences = [contentReferencesByCache objectForKey:candidate.cachedData];
+            [contentReferences removeObject:contentKey];
+
+            if (0 != [contentReferences countForObject:contentKey])
+                continue;
+        }
+
+        evictedSize += candidate.entry.size;
+    }
+
+    for (VKCachedData *cachedData in keysByCache)
+        [cachedData evictCachedDataForKeys:[keysByCache objectForKey:cachedData]];
+}
+
 - (void)saveStorage
 {
     INFO_LOG();
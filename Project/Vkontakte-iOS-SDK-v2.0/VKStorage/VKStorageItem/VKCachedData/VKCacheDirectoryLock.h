@@ -0,0 +1,67 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import <Foundation/Foundation.h>
+
+/** Имя файла блокировки в директории кэша
+*/
+static NSString *const kVKCacheDirectoryLockFileName = @"lock";
+
+/** Блокировка директории кэша, общая для всех процессов, работающих с директорией
+(например, приложения и его расширений).
+
+Межпроцессная блокировка реализована через flock(2) на файле блокировки, внутри
+процесса - рекурсивной блокировкой: поток, уже владеющий блокировкой, может
+захватить её повторно, блокировка файла снимается при последнем освобождении.
+Блокировки flock принадлежат открытому файлу, поэтому разные экземпляры класса
+исключают друг друга так же, как разные процессы.
+
+Если файл блокировки не удалось открыть, то блокировка действует лишь в пределах
+экземпляра.
+*/
+@interface VKCacheDirectoryLock : NSObject <NSLocking>
+
+/**
+@name Методы инициализации
+*/
+/** Инициализация блокировки
+
+@param path путь к файлу блокировки. Если файла нет, то он будет создан.
+@return экземпляр класса VKCacheDirectoryLock
+*/
+- (instancetype)initWithPath:(NSString *)path;
+
+/**
+@name Блокировка
+*/
+/** Захватывает блокировку, ожидая её освобождения другими процессами и потоками
+*/
+- (void)lock;
+
+/** Освобождает блокировку
+*/
+- (void)unlock;
+
+@end
@@ -0,0 +1,84 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import "VKCacheDirectoryLock.h"
+#import <sys/file.h>
+#import <fcntl.h>
+#import <errno.h>
+#import <unistd.h>
+
+
+@implementation VKCacheDirectoryLock
+{
+    int _fd;
+
+//    кол-во вложенных захватов потоком-владельцем, изменяется только под _threadLock
+    NSUInteger _depth;
+    NSRecursiveLock *_threadLock;
+}
+
+#pragma mark Visible VKCacheDirectoryLock methods
+#pragma mark - Init methods
+
+- (instancetype)initWithPath:(NSString *)path
+{
+    self = [super init];
+
+    if (self) {
+        _fd = open([path fileSystemRepresentation], O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        _depth = 0;
+        _threadLock = [[NSRecursiveLock alloc] init];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    if (-1 != _fd)
+        close(_fd);
+}
+
+#pragma mark - Locking
+
+- (void)lock
+{
+    [_threadLock lock];
+
+    if (0 == _depth++ && -1 != _fd) {
+//        ожидание может быть прервано сигналом
+        while (-1 == flock(_fd, LOCK_EX) && EINTR == errno);
+    }
+}
+
+- (void)unlock
+{
+    if (0 == --_depth && -1 != _fd)
+        flock(_fd, LOCK_UN);
+
+    [_threadLock unlock];
+}
+
+@end
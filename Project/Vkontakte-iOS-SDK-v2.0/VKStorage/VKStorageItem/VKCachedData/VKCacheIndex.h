@@ -0,0 +1,353 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import <Foundation/Foundation.h>
+
+/** Имя файла индекса в директории кэша
+*/
+static NSString *const kVKCacheIndexFileName = @"index";
+
+/** Максимальное кол-во тегов одной записи индекса (см. VKCacheIndexEntry tagHashes)
+*/
+#define kVKCacheIndexMaxTagCount 4
+
+/** Политика вытеснения записей при превышении допустимого размера кэша
+*/
+typedef enum
+{
+
+    /** Вытесняются записи, к которым дольше всего не было обращений
+    */
+    VKCachedDataEvictionPolicyLRU = 0,
+
+    /** Вытесняются записи, к которым было меньше всего обращений (при равенстве -
+    те, к которым дольше всего не было обращений)
+    */
+    VKCachedDataEvictionPolicyLFU = 1,
+
+} VKCachedDataEvictionPolicy;
+
+/** Запись индекса кэша - метаданные одной закэшированной записи
+*/
+@interface VKCacheIndexEntry : NSObject <NSCopying>
+
+/** Ключ записи (32 шестнадцатеричных символа)
+*/
+@property (nonatomic, copy) NSString *key;
+
+/** Размер данных записи на диске в байтах (после сжатия)
+*/
+@property (nonatomic, assign) NSUInteger size;
+
+/** Размер исходных (несжатых) данных записи в байтах
+*/
+@property (nonatomic, assign) NSUInteger logicalSize;
+
+/** Время создания записи
+*/
+@property (nonatomic, assign) NSUInteger creationTimestamp;
+
+/** Время жизни записи
+*/
+@property (nonatomic, assign) NSUInteger liveTime;
+
+/** Время последнего обращения к записи
+*/
+@property (nonatomic, assign) NSUInteger lastAccessTimestamp;
+
+/** Кол-во обращений к записи
+*/
+@property (nonatomic, assign) NSUInteger accessCount;
+
+/** Хэш наименования метода API, ответ которого хранится в записи (см. VKCacheKey
+hashForMethod:), либо 0, если метод неизвестен
+*/
+@property (nonatomic, assign) uint32_t methodHash;
+
+/** Ключ содержимого, под которым данные записи хранятся в хранилище записей (см.
+VKCacheKey keyForContent:), либо nil, если данные хранятся под ключом самой записи.
+Записи с одинаковыми данными ссылаются на одно и то же содержимое.
+*/
+@property (nonatomic, copy) NSString *contentKey;
+
+/** Хэши тегов записи (см. VKCacheKey hashForTag:) - массив объектов типа NSNumber.
+Хранится не более kVKCacheIndexMaxTagCount тегов, по тегам записи удаляются при
+инвалидации (см. VKCacheIndex keysForTagHash:).
+*/
+@property (nonatomic, copy) NSArray *tagHashes;
+
+/** Истекло ли время жизни записи к указанному моменту времени
+
+@param timestamp момент времени
+@return YES, если время жизни записи истекло
+*/
+- (BOOL)isExpiredAtTimestamp:(NSUInteger)timestamp;
+
+/** Сравнивает записи в порядке вытеснения: записи, которые должны быть вытеснены
+раньше, считаются "меньшими"
+
+@param entry запись, с которой производится сравнение
+@param policy политика вытеснения
+@return результат сравнения
+*/
+- (NSComparisonResult)compareForEviction:(VKCacheIndexEntry *)entry
+                                  policy:(VKCachedDataEvictionPolicy)policy;
+
+@end
+
+
+@class VKCacheIndex;
+
+
+/** Протокол делегата индекса кэша
+*/
+@protocol VKCacheIndexDelegate <NSObject>
+
+@required
+/** Индекс загрузил изменения, сделанные другими процессами (см. VKCacheIndex
+synchronize). Вызывается на произвольном потоке.
+
+@param index индекс кэша
+@param keys ключи записей, которые были добавлены, изменены или удалены другими
+процессами
+*/
+- (void)cacheIndex:(VKCacheIndex *)index
+didLoadChangesForKeys:(NSSet *)keys;
+
+@end
+
+
+/** Индекс директории кэша.
+
+Хранит в оперативной памяти метаданные всех записей директории (размер, время
+создания, время жизни), что позволяет отвечать на промахи и принимать решения
+об истечении срока жизни записей без обращения к файловой системе.
+
+Индекс ведёт учёт ссылок записей на содержимое (см. VKCacheIndexEntry contentKey):
+размер содержимого, на которое ссылается несколько записей, учитывается однократно.
+
+Индекс также хранит обратное отображение тегов записей в их ключи, что позволяет
+находить все записи с указанным тегом без перебора индекса.
+
+Индекс сохраняется на диск в компактном бинарном формате. Сохранение
+происходит отложенно, спустя некоторое время после добавления, изменения или
+удаления записей. Статистика обращений к записям (см. touchEntryForKey:atTimestamp:)
+хранится в памяти и сохраняется вместе с такими изменениями, либо методом flush.
+
+Изменения записей, сделанные после последнего сохранения, дописываются в журнал
+рядом с файлом индекса (см. writeJournal) и применяются к индексу при загрузке:
+записи, сохранённые незадолго до завершения приложения, не теряются, даже если
+индекс не успел сохраниться. Журнал относится к одному сохранению индекса и
+удаляется при следующем.
+
+Индекс, инициализированный с блокировкой директории, может использоваться
+несколькими процессами одновременно. Каждое сохранение в этом случае является
+синхронизацией (см. synchronize): под блокировкой индекс читается с диска,
+изменения других процессов объединяются с изменениями текущего процесса, после
+чего результат сохраняется. Номер поколения увеличивается только при добавлении,
+изменении или удалении записей - сохранение одной лишь статистики обращений его
+не меняет. Изменённые другими процессами записи сообщаются делегату.
+
+Все методы потокобезопасны.
+*/
+@interface VKCacheIndex : NSObject
+
+/**
+@name Свойства
+*/
+/** Кол-во записей в индексе
+*/
+@property (nonatomic, readonly) NSUInteger count;
+
+/** Суммарный размер данных всех записей индекса на диске. Содержимое, общее для
+нескольких записей, учитывается однократно.
+*/
+@property (nonatomic, readonly) NSUInteger totalSize;
+
+/** Суммарный размер исходных (несжатых) данных всех записей индекса. Содержимое,
+общее для нескольких записей, учитывается однократно.
+*/
+@property (nonatomic, readonly) NSUInteger totalLogicalSize;
+
+/** Суммарный размер данных всех записей индекса на диске без учёта общего
+содержимого - размер, который занимали бы записи без дедупликации
+*/
+@property (nonatomic, readonly) NSUInteger totalReferencedSize;
+
+/**
+@name Методы инициализации
+*/
+/** Инициализация индекса с загрузкой его из файла
+
+@param path путь к файлу индекса
+@return экземпляр класса VKCacheIndex. Если файла нет или он повреждён, то индекс
+будет пустым, а свойство isLoaded - равным NO
+*/
+- (instancetype)initWithContentsOfFile:(NSString *)path;
+
+/** Инициализация индекса, файл которого используется несколькими процессами
+
+@param path путь к файлу индекса
+@param lock блокировка директории кэша, общая для всех процессов, либо nil, если
+файл индекса используется одним процессом
+@return экземпляр класса VKCacheIndex
+*/
+- (instancetype)initWithContentsOfFile:(NSString *)path
+                                  lock:(id <NSLocking>)lock;
+
+/** Был ли индекс успешно загружен из файла
+*/
+@property (nonatomic, readonly) BOOL isLoaded;
+
+/** Делегат индекса
+*/
+@property (nonatomic, weak) id <VKCacheIndexDelegate> delegate;
+
+/**
+@name Манипулирование записями
+*/
+/** Возвращает копию записи индекса по ключу
+
+@param key ключ записи
+@return экземпляр класса VKCacheIndexEntry, либо nil
+*/
+- (VKCacheIndexEntry *)entryForKey:(NSString *)key;
+
+/** Добавляет (заменяет) запись индекса
+
+@param entry запись индекса
+@return ключ содержимого заменённой записи, если на это содержимое больше не
+ссылается ни одна запись, иначе nil
+*/
+- (NSString *)setEntry:(VKCacheIndexEntry *)entry;
+
+/** Отмечает обращение к записи: обновляет время последнего обращения и
+увеличивает счётчик обращений. Сохранения индекса не вызывает.
+
+@param key ключ записи
+@param timestamp время обращения
+*/
+- (void)touchEntryForKey:(NSString *)key
+             atTimestamp:(NSUInteger)timestamp;
+
+/** Удаляет запись индекса
+
+@param key ключ записи
+@return удалённая запись, либо nil, если записи не было
+*/
+- (VKCacheIndexEntry *)removeEntryForKey:(NSString *)key;
+
+/** Удаляет запись индекса
+
+@param key ключ записи
+@param isContentReleased после вызова содержит YES, если данные удалённой записи
+больше никому не принадлежат: на её содержимое не ссылается ни одна запись, либо
+данные хранились под ключом самой записи. Может быть NULL.
+@return удалённая запись, либо nil, если записи не было
+*/
+- (VKCacheIndexEntry *)removeEntryForKey:(NSString *)key
+                       isContentReleased:(BOOL *)isContentReleased;
+
+/** Размер содержимого на диске
+
+@param contentKey ключ содержимого
+@return размер содержимого (после сжатия), либо NSNotFound, если на содержимое не
+ссылается ни одна запись индекса
+*/
+- (NSUInteger)sizeOfContentForKey:(NSString *)contentKey;
+
+/** Ключи записей, помеченных указанным тегом
+
+@param tagHash хэш тега (см. VKCacheKey hashForTag:)
+@return массив ключей записей (NSString), пустой, если таких записей нет
+*/
+- (NSArray *)keysForTagHash:(uint32_t)tagHash;
+
+/** Удаляет все записи индекса
+*/
+- (void)removeAllEntries;
+
+/** Копии всех записей индекса
+
+@return массив объектов типа VKCacheIndexEntry
+*/
+- (NSArray *)allEntries;
+
+/** Копии всех записей индекса в порядке вытеснения (первыми идут записи, которые
+должны быть вытеснены раньше остальных)
+
+@param policy политика вытеснения
+@return массив объектов типа VKCacheIndexEntry
+*/
+- (NSArray *)entriesSortedForEvictionPolicy:(VKCachedDataEvictionPolicy)policy;
+
+/** Копии записей индекса, срок жизни которых истёк к указанному моменту времени
+
+@param timestamp момент времени (UNIX timestamp), на который проверяется срок жизни
+@param limit максимальное кол-во возвращаемых записей
+@return массив объектов типа VKCacheIndexEntry
+*/
+- (NSArray *)expiredEntriesAtTimestamp:(NSUInteger)timestamp
+                                 limit:(NSUInteger)limit;
+
+/**
+@name Сохранение
+*/
+/** Немедленно сохраняет индекс, если в нём есть несохранённые добавления,
+изменения или удаления записей. Несохранённая статистика обращений к записям
+сохранения не вызывает. Для индекса с блокировкой директории - синхронизирует
+его (см. synchronize).
+*/
+- (void)saveIfNeeded;
+
+/** Немедленно сохраняет индекс, если в нём есть любые несохранённые изменения,
+включая статистику обращений к записям. Вызывается при сбросе кэша на диск и
+переходе приложения в фон.
+*/
+- (void)flush;
+
+/** Дописывает в журнал индекса изменения записей, сделанные после последнего
+сохранения индекса или записи журнала, и сбрасывает журнал на диск. Если индекс
+ещё не сохранялся, то сохраняет сам индекс. Для индекса с блокировкой директории
+ничего не делает - такой индекс синхронизируется с файлом (см. synchronize).
+*/
+- (void)writeJournal;
+
+/** Синхронизирует индекс с файлом, который могут изменять другие процессы: под
+блокировкой директории объединяет содержимое файла с изменениями текущего
+процесса и сохраняет результат. При одновременном изменении одной записи
+несколькими процессами сохраняется изменение процесса, синхронизировавшегося
+последним. Для индекса без блокировки равносилен saveIfNeeded.
+*/
+- (void)synchronize;
+
+/** Был ли файл индекса изменён другим процессом с момента последней синхронизации.
+Проверяется лишь заголовок файла, блокировка не захватывается.
+
+@return YES, если индекс следует синхронизировать
+*/
+- (BOOL)isChangedOnDisk;
+
+@end
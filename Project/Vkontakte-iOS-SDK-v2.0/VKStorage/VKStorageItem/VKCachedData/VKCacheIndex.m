@@ -0,0 +1,1151 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import "VKCacheIndex.h"
+#import "VKCacheKey.h"
+#import <fcntl.h>
+#import <unistd.h>
+#import <zlib.h>
+
+
+/** Сигнатура файла индекса ("VKCI")
+*/
+static uint32_t const kVKCacheIndexMagic = 0x49434B56;
+
+/** Текущая версия формата файла индекса
+*/
+static uint32_t const kVKCacheIndexVersion = 8;
+
+/** Сигнатура файла журнала индекса ("VKCJ")
+*/
+static uint32_t const kVKCacheIndexJournalMagic = 0x4A434B56;
+
+/** Расширение файла журнала индекса (журнал хранится рядом с файлом индекса)
+*/
+static NSString *const kVKCacheIndexJournalPathExtension = @"journal";
+
+/** Задержка (в секундах) перед сохранением изменённого индекса
+*/
+static int64_t const kVKCacheIndexSaveDelay = 2;
+
+/** Флаг записи файла индекса, данные которой хранятся под ключом содержимого
+*/
+static uint32_t const kVKCacheIndexRecordFlagContentKey = 1 << 0;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    uint64_t generation;
+    uint64_t journalIdentifier;
+} VKCacheIndexFileHeader;
+
+typedef struct
+{
+    uint8_t key[kVKCacheKeyLength];
+    uint64_t size;
+    uint64_t logicalSize;
+    uint64_t creationTimestamp;
+    uint64_t lastAccessTimestamp;
+    uint32_t liveTime;
+    uint32_t accessCount;
+    uint32_t methodHash;
+    uint32_t flags;
+    uint8_t contentKey[kVKCacheKeyLength];
+    uint32_t tagHashes[kVKCacheIndexMaxTagCount];
+} VKCacheIndexFileRecord;
+
+typedef enum
+{
+    VKCacheIndexJournalOperationSet = 1,
+    VKCacheIndexJournalOperationRemove = 2,
+    VKCacheIndexJournalOperationRemoveAll = 3,
+} VKCacheIndexJournalOperation;
+
+// журнал относится к тому сохранению индекса, идентификатор которого совпадает
+// с journalIdentifier заголовка файла индекса
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t identifier;
+} VKCacheIndexJournalHeader;
+
+typedef struct
+{
+    uint32_t operation;
+    uint32_t checksum;
+    VKCacheIndexFileRecord record;
+} VKCacheIndexJournalRecord;
+
+
+/** Содержимое, на которое ссылаются записи индекса
+*/
+@interface VKCacheIndexContent : NSObject
+
+@property (nonatomic, assign) NSUInteger size;
+@property (nonatomic, assign) NSUInteger logicalSize;
+@property (nonatomic, assign) NSUInteger referenceCount;
+
+@end
+
+@implementation VKCacheIndexContent
+@end
+
+
+// заполняет запись файла индекса; NO, если ключ записи некорректен
+static BOOL VKCacheIndexFillFileRecord(VKCacheIndexFileRecord *record, VKCacheIndexEntry *entry)
+{
+    memset(record, 0, sizeof(*record));
+
+    if (!VKCacheKeyGetBytes(entry.key, record->key))
+        return NO;
+
+    record->size = entry.size;
+    record->logicalSize = entry.logicalSize;
+    record->creationTimestamp = entry.creationTimestamp;
+    record->lastAccessTimestamp = entry.lastAccessTimestamp;
+    record->liveTime = (uint32_t) entry.liveTime;
+    record->accessCount = (uint32_t) entry.accessCount;
+    record->methodHash = entry.methodHash;
+
+    if (VKCacheKeyGetBytes(entry.contentKey, record->contentKey))
+        record->flags |= kVKCacheIndexRecordFlagContentKey;
+
+    NSUInteger tagCount = MIN([entry.tagHashes count], kVKCacheIndexMaxTagCount);
+
+    for (NSUInteger i = 0; i < tagCount; i++)
+        record->tagHashes[i] = [entry.tagHashes[i] unsignedIntValue];
+
+    return YES;
+}
+
+static VKCacheIndexEntry *VKCacheIndexEntryWithFileRecord(const VKCacheIndexFileRecord *record)
+{
+    VKCacheIndexEntry *entry = [[VKCacheIndexEntry alloc] init];
+    entry.key = VKCacheKeyWithBytes(record->key);
+    entry.size = (NSUInteger) record->size;
+    entry.logicalSize = (NSUInteger) record->logicalSize;
+    entry.creationTimestamp = (NSUInteger) record->creationTimestamp;
+    entry.liveTime = record->liveTime;
+    entry.lastAccessTimestamp = (NSUInteger) record->lastAccessTimestamp;
+    entry.accessCount = record->accessCount;
+    entry.methodHash = record->methodHash;
+
+    if (record->flags & kVKCacheIndexRecordFlagContentKey)
+        entry.contentKey = VKCacheKeyWithBytes(record->contentKey);
+
+    NSMutableArray *tagHashes = [[NSMutableArray alloc] init];
+
+    for (NSUInteger i = 0; i < kVKCacheIndexMaxTagCount && 0 != record->tagHashes[i]; i++)
+        [tagHashes addObject:@(record->tagHashes[i])];
+
+    entry.tagHashes = tagHashes;
+
+    return entry;
+}
+
+// ссылаются ли записи на одни и те же данные (записи могут отсутствовать)
+static BOOL VKCacheIndexEntriesHaveSameData(VKCacheIndexEntry *entry1, VKCacheIndexEntry *entry2)
+{
+    if (nil == entry1 || nil == entry2)
+        return (entry1 == entry2);
+
+    return (entry1.creationTimestamp == entry2.creationTimestamp &&
+            entry1.size == entry2.size &&
+            (entry1.contentKey == entry2.contentKey || [entry1.contentKey isEqualToString:entry2.contentKey]));
+}
+
+
+@implementation VKCacheIndexEntry
+
+- (BOOL)isExpiredAtTimestamp:(NSUInteger)timestamp
+{
+    return (_creationTimestamp + _liveTime) < timestamp;
+}
+
+- (NSComparisonResult)compareForEviction:(VKCacheIndexEntry *)entry
+                                  policy:(VKCachedDataEvictionPolicy)policy
+{
+    if (VKCachedDataEvictionPolicyLFU == policy && _accessCount != entry.accessCount)
+        return (_accessCount < entry.accessCount ? NSOrderedAscending : NSOrderedDescending);
+
+    if (_lastAccessTimestamp != entry.lastAccessTimestamp)
+        return (_lastAccessTimestamp < entry.lastAccessTimestamp ? NSOrderedAscending : NSOrderedDescending);
+
+    return NSOrderedSame;
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    VKCacheIndexEntry *copy = [[VKCacheIndexEntry alloc] init];
+
+    copy.key = _key;
+    copy.size = _size;
+    copy.logicalSize = _logicalSize;
+    copy.creationTimestamp = _creationTimestamp;
+    copy.liveTime = _liveTime;
+    copy.lastAccessTimestamp = _lastAccessTimestamp;
+    copy.accessCount = _accessCount;
+    copy.methodHash = _methodHash;
+    copy.contentKey = _contentKey;
+    copy.tagHashes = _tagHashes;
+
+    return copy;
+}
+
+@end
+
+
+@implementation VKCacheIndex
+{
+    NSString *_path;
+    NSMutableDictionary *_entries;
+    NSMutableDictionary *_contents;
+    NSMutableDictionary *_keysByTagHash;
+    NSUInteger _totalSize;
+    NSUInteger _totalLogicalSize;
+    NSUInteger _totalReferencedSize;
+
+    BOOL _isDirty;
+    BOOL _isSaveScheduled;
+
+//    статистика обращений к записям изменилась после последнего сохранения;
+//    сама по себе она сохранения не вызывает (см. flush)
+    BOOL _hasUnsavedAccessStatistics;
+
+//    межпроцессная синхронизация: поколение файла индекса, с которым индекс был
+//    синхронизирован последний раз, и изменения текущего процесса с того момента
+    id <NSLocking> _lock;
+    uint64_t _generation;
+    NSMutableSet *_changedKeys;
+    NSMutableSet *_touchedKeys;
+    BOOL _isClearPending;
+
+//    журнал изменений записей с момента последнего сохранения индекса: ещё не
+//    записанные в файл журнала операции и идентификатор сохранения, к которому
+//    относится журнал (0 - индекс ещё не сохранялся). Сохранение индекса и запись
+//    журнала выполняются под _fileLock. Индекс с блокировкой директории
+//    синхронизируется после каждой порции отложенной записи, журнал ему не нужен
+    NSString *_journalPath;
+    NSMutableData *_journalRecords;
+    uint64_t _journalIdentifier;
+    NSLock *_fileLock;
+
+    dispatch_queue_t _queue;
+}
+
+#pragma mark Visible VKCacheIndex methods
+#pragma mark - Init methods
+
+- (instancetype)initWithContentsOfFile:(NSString *)path
+{
+    return [self initWithContentsOfFile:path
+                                   lock:nil];
+}
+
+- (instancetype)initWithContentsOfFile:(NSString *)path
+                                  lock:(id <NSLocking>)lock
+{
+    self = [super init];
+
+    if (self) {
+        _path = [path copy];
+        _entries = [[NSMutableDictionary alloc] init];
+        _contents = [[NSMutableDictionary alloc] init];
+        _keysByTagHash = [[NSMutableDictionary alloc] init];
+        _totalSize = 0;
+        _totalLogicalSize = 0;
+        _totalReferencedSize = 0;
+        _queue = dispatch_queue_create("com.vk.cacheindex", DISPATCH_QUEUE_SERIAL);
+
+        _lock = lock;
+        _generation = 0;
+        _changedKeys = [[NSMutableSet alloc] init];
+        _touchedKeys = [[NSMutableSet alloc] init];
+        _isClearPending = NO;
+
+        _journalPath = [_path stringByAppendingPathExtension:kVKCacheIndexJournalPathExtension];
+        _journalRecords = (nil == lock ? [[NSMutableData alloc] init] : nil);
+        _journalIdentifier = 0;
+        _fileLock = [[NSLock alloc] init];
+
+        [_lock lock];
+        _isLoaded = [self loadFromFile];
+        [_lock unlock];
+    }
+
+    return self;
+}
+
+#pragma mark - Getters
+
+- (NSUInteger)count
+{
+    __block NSUInteger count;
+
+    dispatch_sync(_queue, ^
+    {
+        count = [_entries count];
+    });
+
+    return count;
+}
+
+- (NSUInteger)totalSize
+{
+    __block NSUInteger totalSize;
+
+    dispatch_sync(_queue, ^
+    {
+        totalSize = _totalSize;
+    });
+
+    return totalSize;
+}
+
+- (NSUInteger)totalLogicalSize
+{
+    __block NSUInteger totalLogicalSize;
+
+    dispatch_sync(_queue, ^
+    {
+        totalLogicalSize = _totalLogicalSize;
+    });
+
+    return totalLogicalSize;
+}
+
+- (NSUInteger)totalReferencedSize
+{
+    __block NSUInteger totalReferencedSize;
+
+    dispatch_sync(_queue, ^
+    {
+        totalReferencedSize = _totalReferencedSize;
+    });
+
+    return totalReferencedSize;
+}
+
+#pragma mark - Entries manipulation
+
+- (VKCacheIndexEntry *)entryForKey:(NSString *)key
+{
+    if (nil == key)
+        return nil;
+
+    __block VKCacheIndexEntry *entry;
+
+    dispatch_sync(_queue, ^
+    {
+        entry = [_entries[key] copy];
+    });
+
+    return entry;
+}
+
+- (NSString *)setEntry:(VKCacheIndexEntry *)entry
+{
+    if (nil == entry.key)
+        return nil;
+
+    VKCacheIndexEntry *newEntry = [entry copy];
+    __block NSString *releasedContentKey = nil;
+
+    dispatch_sync(_queue, ^
+    {
+        VKCacheIndexEntry *oldEntry = _entries[newEntry.key];
+
+//        ссылка новой записи учитывается раньше, чем освобождается ссылка старой, -
+//        иначе общее для них содержимое на мгновение осталось бы без ссылок
+        _entries[newEntry.key] = newEntry;
+        [self retainContentOfEntry:newEntry];
+
+        if (nil != oldEntry && [self releaseContentOfEntry:oldEntry])
+            releasedContentKey = oldEntry.contentKey;
+
+        if (nil != oldEntry)
+            [self removeTagsOfEntry:oldEntry];
+
+        [self addTagsOfEntry:newEntry];
+
+        if (nil != _lock)
+            [_changedKeys addObject:newEntry.key];
+
+        [self appendJournalOperation:VKCacheIndexJournalOperationSet
+                               entry:newEntry];
+        [self setNeedsSave];
+    });
+
+    return releasedContentKey;
+}
+
+- (void)touchEntryForKey:(NSString *)key
+             atTimestamp:(NSUInteger)timestamp
+{
+    if (nil == key)
+        return;
+
+    dispatch_sync(_queue, ^
+    {
+        VKCacheIndexEntry *entry = _entries[key];
+
+        if (nil == entry)
+            return;
+
+        entry.lastAccessTimestamp = timestamp;
+        entry.accessCount++;
+
+        if (nil != _lock)
+            [_touchedKeys addObject:key];
+
+        _hasUnsavedAccessStatistics = YES;
+    });
+}
+
+- (VKCacheIndexEntry *)removeEntryForKey:(NSString *)key
+{
+    return [self removeEntryForKey:key
+                 isContentReleased:NULL];
+}
+
+- (VKCacheIndexEntry *)removeEntryForKey:(NSString *)key
+                       isContentReleased:(BOOL *)isContentReleased
+{
+    if (NULL != isContentReleased)
+        *isContentReleased = NO;
+
+    if (nil == key)
+        return nil;
+
+    __block VKCacheIndexEntry *removedEntry;
+    __block BOOL released = NO;
+
+    dispatch_sync(_queue, ^
+    {
+        removedEntry = _entries[key];
+
+        if (nil == removedEntry)
+            return;
+
+        released = [self releaseContentOfEntry:removedEntry];
+        [self removeTagsOfEntry:removedEntry];
+        [_entries removeObjectForKey:key];
+
+        if (nil != _lock)
+            [_changedKeys addObject:key];
+
+        [self appendJournalOperation:VKCacheIndexJournalOperationRemove
+                               entry:removedEntry];
+        [self setNeedsSave];
+    });
+
+    if (NULL != isContentReleased)
+        *isContentReleased = released;
+
+    return removedEntry;
+}
+
+- (NSUInteger)sizeOfContentForKey:(NSString *)contentKey
+{
+    if (nil == contentKey)
+        return NSNotFound;
+
+    __block NSUInteger size;
+
+    dispatch_sync(_queue, ^
+    {
+        VKCacheIndexContent *content = _contents[contentKey];
+
+        size = (nil == content ? NSNotFound : content.size);
+    });
+
+    return size;
+}
+
+- (NSArray *)keysForTagHash:(uint32_t)tagHash
+{
+    __block NSArray *keys;
+
+    dispatch_sync(_queue, ^
+    {
+        keys = [_keysByTagHash[@(tagHash)] allObjects];
+    });
+
+    return (nil == keys ? @[] : keys);
+}
+
+- (void)removeAllEntries
+{
+    dispatch_sync(_queue, ^
+    {
+        [_entries removeAllObjects];
+        [_contents removeAllObjects];
+        [_keysByTagHash removeAllObjects];
+        _totalSize = 0;
+        _totalLogicalSize = 0;
+        _totalReferencedSize = 0;
+
+//        записи, добавленные другими процессами, удаляются при синхронизации
+        [_changedKeys removeAllObjects];
+        [_touchedKeys removeAllObjects];
+        _isClearPending = (nil != _lock);
+
+//        предыдущие операции журнала больше не нужны
+        [_journalRecords setLength:0];
+        [self appendJournalOperation:VKCacheIndexJournalOperationRemoveAll
+                               entry:nil];
+        [self setNeedsSave];
+    });
+}
+
+- (NSArray *)allEntries
+{
+    __block NSMutableArray *entries;
+
+    dispatch_sync(_queue, ^
+    {
+        entries = [[NSMutableArray alloc] initWithCapacity:[_entries count]];
+
+        for (VKCacheIndexEntry *entry in [_entries objectEnumerator])
+            [entries addObject:[entry copy]];
+    });
+
+    return entries;
+}
+
+- (NSArray *)entriesSortedForEvictionPolicy:(VKCachedDataEvictionPolicy)policy
+{
+    NSMutableArray *entries = (NSMutableArray *) [self allEntries];
+
+    [entries sortUsingComparator:^NSComparisonResult(VKCacheIndexEntry *entry1,
+                                                     VKCacheIndexEntry *entry2)
+    {
+        return [entry1 compareForEviction:entry2
+                                   policy:policy];
+    }];
+
+    return entries;
+}
+
+- (NSArray *)expiredEntriesAtTimestamp:(NSUInteger)timestamp
+                                 limit:(NSUInteger)limit
+{
+    __block NSMutableArray *entries;
+
+    dispatch_sync(_queue, ^
+    {
+        entries = [[NSMutableArray alloc] init];
+
+        for (VKCacheIndexEntry *entry in [_entries objectEnumerator]) {
+            if ([entries count] >= limit)
+                break;
+
+            if ([entry isExpiredAtTimestamp:timestamp])
+                [entries addObject:[entry copy]];
+        }
+    });
+
+    return entries;
+}
+
+#pragma mark - Saving
+
+- (void)saveIfNeeded
+{
+    [self saveIncludingAccessStatistics:NO];
+}
+
+- (void)flush
+{
+    [self saveIncludingAccessStatistics:YES];
+}
+
+- (void)synchronize
+{
+    [self synchronizeIncludingAccessStatistics:NO];
+}
+
+- (void)writeJournal
+{
+    if (nil == _journalRecords)
+        return;
+
+    [_fileLock lock];
+
+    __block NSData *records = nil;
+    __block uint64_t identifier;
+
+    dispatch_sync(_queue, ^
+    {
+        records = [_journalRecords copy];
+        identifier = _journalIdentifier;
+
+//        индекс ещё не сохранялся - журналу не к чему относиться, сохраняем сам индекс
+        if (0 != identifier)
+            [_journalRecords setLength:0];
+    });
+
+    if (0 != [records length] && 0 != identifier)
+        [self appendJournalRecords:records
+                        identifier:identifier];
+
+    [_fileLock unlock];
+
+    if (0 == identifier)
+        [self saveIfNeeded];
+}
+
+- (BOOL)isChangedOnDisk
+{
+    if (nil == _lock)
+        return NO;
+
+    int fd = open([_path fileSystemRepresentation], O_RDONLY);
+
+    if (-1 == fd)
+        return NO;
+
+    VKCacheIndexFileHeader header;
+    ssize_t length = pread(fd, &header, sizeof(header), 0);
+    close(fd);
+
+    if (sizeof(header) != length || kVKCacheIndexMagic != header.magic || kVKCacheIndexVersion != header.version)
+        return NO;
+
+    __block BOOL isChanged;
+
+    dispatch_sync(_queue, ^
+    {
+        isChanged = (header.generation != _generation);
+    });
+
+    return isChanged;
+}
+
+#pragma mark - Private methods
+
+// вызывается только из _queue
+- (void)retainContentOfEntry:(VKCacheIndexEntry *)entry
+{
+    _totalReferencedSize += entry.size;
+
+//    данные хранятся под ключом самой записи и принадлежат только ей
+    if (nil == entry.contentKey) {
+        _totalSize += entry.size;
+        _totalLogicalSize += entry.logicalSize;
+        return;
+    }
+
+    VKCacheIndexContent *content = _contents[entry.contentKey];
+
+    if (nil == content) {
+        content = [[VKCacheIndexContent alloc] init];
+        content.size = entry.size;
+        content.logicalSize = entry.logicalSize;
+        _contents[entry.contentKey] = content;
+
+        _totalSize += content.size;
+        _totalLogicalSize += content.logicalSize;
+    }
+
+    content.referenceCount++;
+}
+
+// вызывается только из _queue, возвращает YES, если данные записи больше
+// никому не принадлежат
+- (BOOL)releaseContentOfEntry:(VKCacheIndexEntry *)entry
+{
+    _totalReferencedSize -= entry.size;
+
+    if (nil == entry.contentKey) {
+        _totalSize -= entry.size;
+        _totalLogicalSize -= entry.logicalSize;
+        return YES;
+    }
+
+    VKCacheIndexContent *content = _contents[entry.contentKey];
+
+    if (nil == content)
+        return YES;
+
+    content.referenceCount--;
+
+    if (content.referenceCount > 0)
+        return NO;
+
+    _totalSize -= content.size;
+    _totalLogicalSize -= content.logicalSize;
+    [_contents removeObjectForKey:entry.contentKey];
+
+    return YES;
+}
+
+// вызывается только из _queue
+- (void)addTagsOfEntry:(VKCacheIndexEntry *)entry
+{
+    for (NSNumber *tagHash in entry.tagHashes) {
+        NSMutableSet *keys = _keysByTagHash[tagHash];
+
+        if (nil == keys) {
+            keys = [[NSMutableSet alloc] init];
+            _keysByTagHash[tagHash] = keys;
+        }
+
+        [keys addObject:entry.key];
+    }
+}
+
+// вызывается только из _queue
+- (void)removeTagsOfEntry:(VKCacheIndexEntry *)entry
+{
+    for (NSNumber *tagHash in entry.tagHashes) {
+        NSMutableSet *keys = _keysByTagHash[tagHash];
+
+        [keys removeObject:entry.key];
+
+        if (0 == [keys count])
+            [_keysByTagHash removeObjectForKey:tagHash];
+    }
+}
+
+// вызывается только из _queue (либо при инициализации)
+- (void)resetWithEntries:(NSMutableDictionary *)entries
+{
+    _entries = entries;
+    [_contents removeAllObjects];
+    [_keysByTagHash removeAllObjects];
+    _totalSize = 0;
+    _totalLogicalSize = 0;
+    _totalReferencedSize = 0;
+
+    for (VKCacheIndexEntry *entry in [_entries objectEnumerator]) {
+        [self retainContentOfEntry:entry];
+        [self addTagsOfEntry:entry];
+    }
+}
+
+// вызывается только из _queue, возвращает ключи записей, изменённых другими
+// процессами с момента последней синхронизации
+- (NSSet *)mergeEntries:(NSMutableDictionary *)fileEntries
+{
+    NSMutableSet *changedKeys = [[NSMutableSet alloc] init];
+    NSMutableDictionary *entries = fileEntries;
+
+    if (_isClearPending) {
+//        текущий процесс удалил все записи - записи файла не нужны
+        entries = [[NSMutableDictionary alloc] init];
+    } else {
+        for (NSString *key in fileEntries) {
+            if (![_changedKeys containsObject:key] && !VKCacheIndexEntriesHaveSameData(_entries[key], fileEntries[key]))
+                [changedKeys addObject:key];
+        }
+
+        for (NSString *key in _entries) {
+            if (nil == fileEntries[key] && ![_changedKeys containsObject:key])
+                [changedKeys addObject:key];
+        }
+    }
+
+//    изменения текущего процесса применяются поверх содержимого файла
+    for (NSString *key in _changedKeys) {
+        VKCacheIndexEntry *entry = _entries[key];
+
+        if (nil == entry)
+            [entries removeObjectForKey:key];
+        else
+            entries[key] = entry;
+    }
+
+//    у записей, к которым лишь обращались, обновляется только статистика обращений
+    for (NSString *key in _touchedKeys) {
+        VKCacheIndexEntry *entry = entries[key];
+        VKCacheIndexEntry *localEntry = _entries[key];
+
+        if ([_changedKeys containsObject:key] || nil == entry || nil == localEntry)
+            continue;
+
+        entry.lastAccessTimestamp = MAX(entry.lastAccessTimestamp, localEntry.lastAccessTimestamp);
+        entry.accessCount = MAX(entry.accessCount, localEntry.accessCount);
+    }
+
+    [self resetWithEntries:entries];
+
+    return changedKeys;
+}
+
+- (void)saveIncludingAccessStatistics:(BOOL)includeAccessStatistics
+{
+    if (nil != _lock) {
+        [self synchronizeIncludingAccessStatistics:includeAccessStatistics];
+        return;
+    }
+
+    [_fileLock lock];
+
+    __block NSData *serializedIndex = nil;
+
+    dispatch_sync(_queue, ^
+    {
+        if (!_isDirty && !(includeAccessStatistics && _hasUnsavedAccessStatistics))
+            return;
+
+//        статистика обращений сохраняется вместе с любым сохранением индекса
+        serializedIndex = [self serializedIndex];
+        _isDirty = NO;
+        _hasUnsavedAccessStatistics = NO;
+    });
+
+    if (nil != serializedIndex)
+        [self writeSerializedIndex:serializedIndex];
+
+    [_fileLock unlock];
+}
+
+- (void)synchronizeIncludingAccessStatistics:(BOOL)includeAccessStatistics
+{
+    if (nil == _lock) {
+        [self saveIncludingAccessStatistics:includeAccessStatistics];
+        return;
+    }
+
+    [_lock lock];
+
+    uint64_t generation = 0;
+    NSMutableDictionary *fileEntries = [self entriesFromFile:&generation];
+
+    __block NSData *serializedIndex = nil;
+    __block NSSet *changedKeys = nil;
+
+    dispatch_sync(_queue, ^
+    {
+//        файл изменён другим процессом (либо отсутствует) - объединяем его
+//        содержимое с изменениями текущего процесса
+        if (nil == fileEntries || generation != _generation) {
+            changedKeys = [self mergeEntries:(nil == fileEntries ? [NSMutableDictionary dictionary] : fileEntries)];
+            _generation = generation;
+        }
+
+        BOOL isAccessStatisticsOnly = (!_isDirty && includeAccessStatistics && _hasUnsavedAccessStatistics);
+
+//        изменения текущего процесса с этого момента учтены в индексе файла
+        [_changedKeys removeAllObjects];
+        [_touchedKeys removeAllObjects];
+        _isClearPending = NO;
+
+//        собственных изменений нет - индекс совпадает с файлом
+        if (!_isDirty && !isAccessStatisticsOnly && nil != fileEntries)
+            return;
+
+//        поколение меняется только вместе с набором записей: статистика обращений
+//        не делает устаревшими данные других процессов
+        if (!isAccessStatisticsOnly || nil == fileEntries)
+            _generation++;
+
+        serializedIndex = [self serializedIndex];
+        _isDirty = NO;
+        _hasUnsavedAccessStatistics = NO;
+    });
+
+    if (nil != serializedIndex)
+        [self writeSerializedIndex:serializedIndex];
+
+    [_lock unlock];
+
+    if (0 != [changedKeys count])
+        [_delegate cacheIndex:self
+        didLoadChangesForKeys:changedKeys];
+}
+
+// вызывается только из _queue
+- (void)setNeedsSave
+{
+    _isDirty = YES;
+
+    if (_isSaveScheduled)
+        return;
+
+    _isSaveScheduled = YES;
+
+    dispatch_time_t saveTime = dispatch_time(DISPATCH_TIME_NOW, kVKCacheIndexSaveDelay * NSEC_PER_SEC);
+    dispatch_queue_t backgroundQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0);
+
+    __weak VKCacheIndex *weakSelf = self;
+
+    dispatch_after(saveTime, backgroundQueue, ^
+    {
+        VKCacheIndex *strongSelf = weakSelf;
+
+        if (nil == strongSelf)
+            return;
+
+        dispatch_sync(strongSelf->_queue, ^
+        {
+            strongSelf->_isSaveScheduled = NO;
+        });
+
+        [strongSelf saveIfNeeded];
+    });
+}
+
+// вызывается только из _queue
+- (NSData *)serializedIndex
+{
+    NSMutableData *data = [[NSMutableData alloc]
+                                          initWithCapacity:sizeof(VKCacheIndexFileHeader) +
+                                                  [_entries count] * sizeof(VKCacheIndexFileRecord)];
+
+//    сохранённый индекс включает все операции журнала - новый журнал будет
+//    относиться уже к этому сохранению
+    do {
+        _journalIdentifier = ((uint64_t) arc4random() << 32) | arc4random();
+    } while (0 == _journalIdentifier);
+
+    [_journalRecords setLength:0];
+
+    VKCacheIndexFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kVKCacheIndexMagic;
+    header.version = kVKCacheIndexVersion;
+    header.generation = _generation;
+    header.journalIdentifier = _journalIdentifier;
+    [data appendBytes:&header length:sizeof(header)];
+
+    uint64_t count = 0;
+
+    for (VKCacheIndexEntry *entry in [_entries objectEnumerator]) {
+        VKCacheIndexFileRecord record;
+
+        if (!VKCacheIndexFillFileRecord(&record, entry))
+            continue;
+
+        [data appendBytes:&record length:sizeof(record)];
+        count++;
+    }
+
+    ((VKCacheIndexFileHeader *) [data mutableBytes])->count = count;
+
+    return data;
+}
+
+- (BOOL)loadFromFile
+{
+    uint64_t generation = 0;
+    uint64_t journalIdentifier = 0;
+    NSMutableDictionary *entries = [self entriesFromFile:&generation
+                                       journalIdentifier:&journalIdentifier];
+
+    if (nil == entries) {
+//        журнал относится к утерянному индексу
+        unlink([_journalPath fileSystemRepresentation]);
+        return NO;
+    }
+
+    _generation = generation;
+    _journalIdentifier = journalIdentifier;
+
+//    изменения, сделанные после последнего сохранения индекса, сохранятся
+//    вместе со следующим его сохранением
+    if (nil != _journalRecords && [self replayJournalIntoEntries:entries])
+        _isDirty = YES;
+
+    [self resetWithEntries:entries];
+
+    return YES;
+}
+
+// применяет к записям операции журнала, относящегося к загруженному индексу;
+// недописанная последняя операция (приложение завершилось во время записи)
+// отбрасывается. YES, если была применена хотя бы одна операция
+- (BOOL)replayJournalIntoEntries:(NSMutableDictionary *)entries
+{
+    NSData *data = [NSData dataWithContentsOfFile:_journalPath
+                                          options:NSDataReadingMappedIfSafe
+                                            error:nil];
+
+    if ([data length] < sizeof(VKCacheIndexJournalHeader))
+        return NO;
+
+    VKCacheIndexJournalHeader header;
+    memcpy(&header, [data bytes], sizeof(header));
+
+    if (kVKCacheIndexJournalMagic != header.magic || kVKCacheIndexVersion != header.version ||
+            _journalIdentifier != header.identifier)
+        return NO;
+
+    BOOL isReplayed = NO;
+    const uint8_t *bytes = [data bytes];
+
+    for (NSUInteger offset = sizeof(header);
+         offset + sizeof(VKCacheIndexJournalRecord) <= [data length];
+         offset += sizeof(VKCacheIndexJournalRecord)) {
+        VKCacheIndexJournalRecord journalRecord;
+        memcpy(&journalRecord, bytes + offset, sizeof(journalRecord));
+
+        if (journalRecord.checksum != (uint32_t) crc32(0, (const Bytef *) &journalRecord.record, sizeof(journalRecord.record)))
+            break;
+
+        switch (journalRecord.operation) {
+            case VKCacheIndexJournalOperationSet: {
+                VKCacheIndexEntry *entry = VKCacheIndexEntryWithFileRecord(&journalRecord.record);
+                entries[entry.key] = entry;
+                break;
+            }
+
+            case VKCacheIndexJournalOperationRemove:
+                [entries removeObjectForKey:VKCacheKeyWithBytes(journalRecord.record.key)];
+                break;
+
+            case VKCacheIndexJournalOperationRemoveAll:
+                [entries removeAllObjects];
+                break;
+
+            default:
+                return isReplayed;
+        }
+
+        isReplayed = YES;
+    }
+
+    return isReplayed;
+}
+
+// вызывается только из _queue
+- (void)appendJournalOperation:(VKCacheIndexJournalOperation)operation
+                         entry:(VKCacheIndexEntry *)entry
+{
+    if (nil == _journalRecords)
+        return;
+
+    VKCacheIndexJournalRecord journalRecord;
+    memset(&journalRecord, 0, sizeof(journalRecord));
+    journalRecord.operation = operation;
+
+    if (nil != entry && !VKCacheIndexFillFileRecord(&journalRecord.record, entry))
+        return;
+
+    journalRecord.checksum = (uint32_t) crc32(0, (const Bytef *) &journalRecord.record, sizeof(journalRecord.record));
+
+    [_journalRecords appendBytes:&journalRecord
+                          length:sizeof(journalRecord)];
+}
+
+// вызывается под _fileLock: дописывает операции в файл журнала и сбрасывает
+// его на диск; журнал, относящийся к другому сохранению индекса, начинается заново
+- (void)appendJournalRecords:(NSData *)records
+                  identifier:(uint64_t)identifier
+{
+    int fd = open([_journalPath fileSystemRepresentation], O_RDWR | O_CREAT, 0644);
+
+    if (-1 == fd)
+        return;
+
+    VKCacheIndexJournalHeader header;
+    ssize_t length = pread(fd, &header, sizeof(header), 0);
+
+    if (sizeof(header) != length || kVKCacheIndexJournalMagic != header.magic ||
+            kVKCacheIndexVersion != header.version || identifier != header.identifier) {
+        memset(&header, 0, sizeof(header));
+        header.magic = kVKCacheIndexJournalMagic;
+        header.version = kVKCacheIndexVersion;
+        header.identifier = identifier;
+
+        if (0 != ftruncate(fd, 0) || sizeof(header) != pwrite(fd, &header, sizeof(header), 0)) {
+            close(fd);
+            return;
+        }
+    }
+
+//    операции дописываются целиком; недописанная из-за сбоя операция
+//    отбрасывается при загрузке по контрольной сумме
+    off_t offset = lseek(fd, 0, SEEK_END);
+
+    if (-1 != offset && (ssize_t) [records length] == pwrite(fd, [records bytes], [records length], offset))
+        fsync(fd);
+
+    close(fd);
+}
+
+// журнал прежнего сохранения индекса больше не нужен: его операции вошли в
+// сохранённый индекс
+- (void)writeSerializedIndex:(NSData *)serializedIndex
+{
+    if ([serializedIndex writeToFile:_path atomically:YES])
+        unlink([_journalPath fileSystemRepresentation]);
+}
+
+// читает записи файла индекса, не затрагивая состояние индекса; nil, если файла
+// нет или он повреждён
+- (NSMutableDictionary *)entriesFromFile:(uint64_t *)generation
+{
+    return [self entriesFromFile:generation
+               journalIdentifier:NULL];
+}
+
+- (NSMutableDictionary *)entriesFromFile:(uint64_t *)generation
+                       journalIdentifier:(uint64_t *)journalIdentifier
+{
+    NSData *data = [NSData dataWithContentsOfFile:_path
+                                          options:NSDataReadingMappedIfSafe
+                                            error:nil];
+
+    if ([data length] < sizeof(VKCacheIndexFileHeader))
+        return nil;
+
+    VKCacheIndexFileHeader header;
+    memcpy(&header, [data bytes], sizeof(header));
+
+    if (kVKCacheIndexMagic != header.magic || kVKCacheIndexVersion != header.version)
+        return nil;
+
+    NSUInteger recordsLength = [data length] - sizeof(header);
+
+    if (0 != recordsLength % sizeof(VKCacheIndexFileRecord) ||
+            header.count != recordsLength / sizeof(VKCacheIndexFileRecord))
+        return nil;
+
+    NSMutableDictionary *entries = [[NSMutableDictionary alloc] initWithCapacity:(NSUInteger) header.count];
+    const uint8_t *bytes = (const uint8_t *) [data bytes] + sizeof(header);
+
+    for (uint64_t i = 0; i < header.count; i++) {
+        VKCacheIndexFileRecord record;
+        memcpy(&record, bytes + i * sizeof(record), sizeof(record));
+
+        VKCacheIndexEntry *entry = VKCacheIndexEntryWithFileRecord(&record);
+        entries[entry.key] = entry;
+    }
+
+    if (NULL != generation)
+        *generation = header.generation;
+
+    if (NULL != journalIdentifier)
+        *journalIdentifier = header.journalIdentifier;
+
+    return entries;
+}
+
+@end
@@ -0,0 +1,110 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import <Foundation/Foundation.h>
+
+/** Длина ключа записи кэша в байтах (128 бит)
+*/
+#define kVKCacheKeyLength 16
+
+/** Преобразует ключ записи кэша (строка из 32 шестнадцатеричных символов) в байты
+
+@param key ключ записи
+@param bytes буфер длиной kVKCacheKeyLength байт
+@return NO, если строка не является ключом записи
+*/
+BOOL VKCacheKeyGetBytes(NSString *key, uint8_t bytes[kVKCacheKeyLength]);
+
+/** Строит ключ записи кэша по его байтам
+
+@param bytes буфер длиной kVKCacheKeyLength байт
+@return ключ записи (строка из 32 шестнадцатеричных символов)
+*/
+NSString *VKCacheKeyWithBytes(const uint8_t bytes[kVKCacheKeyLength]);
+
+
+/** Построение ключей записей кэша.
+
+Ключ записи - 128-битный некриптографический хэш (MurmurHash3 x64_128)
+канонического представления запроса в виде строки из 32 шестнадцатеричных
+символов. Каноническое представление запроса к API строится по наименованию
+метода и параметрам запроса: параметры авторизации (access_token, sig)
+отбрасываются, остальные параметры упорядочиваются по имени. Одинаковые запросы
+с разными токенами доступа имеют один и тот же ключ.
+*/
+@interface VKCacheKey : NSObject
+
+/** Ключ запроса к методу API
+
+@param methodName наименование метода API (users.get, groups.join etc)
+@param options параметры запроса
+@return ключ записи кэша
+*/
++ (NSString *)keyForMethod:(NSString *)methodName
+                   options:(NSDictionary *)options;
+
+/** Ключ запроса по его URL. Параметры авторизации из строки запроса не учитываются.
+
+@param url URL запроса
+@return ключ записи кэша
+*/
++ (NSString *)keyForURL:(NSURL *)url;
+
+/** Ключ произвольных данных
+
+@param data данные
+@return 128-битный хэш данных в виде строки из 32 шестнадцатеричных символов
+*/
++ (NSString *)keyForData:(NSData *)data;
+
+/** Ключ содержимого записи, под которым данные хранятся в хранилище записей
+(одинаковые данные разных записей хранятся однократно).
+
+В отличие от ключей запросов строится по криптографическому хэшу (первые 128 бит
+SHA-256): совпадение ключей разных данных означало бы подмену ответа одного
+запроса ответом другого.
+
+@param data данные записи
+@return ключ содержимого в виде строки из 32 шестнадцатеричных символов
+*/
++ (NSString *)keyForContent:(NSData *)data;
+
+/** 32-битный хэш наименования метода API (регистр не учитывается). Хранится в
+индексе кэша вместо наименования метода.
+
+@param methodName наименование метода API (users.get, groups.join etc)
+@return хэш наименования метода, либо 0, если наименование не указано
+*/
++ (uint32_t)hashForMethod:(NSString *)methodName;
+
+/** 32-битный хэш тега записи кэша (регистр не учитывается). Хранится в индексе
+кэша вместо самого тега (см. VKCachedData invalidateCachedDataForTags:).
+
+@param tag тег записи (wall, wall:1234 etc)
+@return хэш тега, либо 0, если тег не указан
+*/
++ (uint32_t)hashForTag:(NSString *)tag;
+
+@end
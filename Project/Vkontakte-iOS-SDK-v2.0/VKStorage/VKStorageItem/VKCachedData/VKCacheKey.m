@@ -0,0 +1,303 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import "VKCacheKey.h"
+#import <CommonCrypto/CommonDigest.h>
+
+
+static uint64_t VKCacheKeyRotateLeft(uint64_t x, int8_t r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t VKCacheKeyFinalMix(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+
+    return k;
+}
+
+// MurmurHash3 x64_128 (Austin Appleby, public domain), seed 0
+static void VKCacheKeyHash128(const uint8_t *data, size_t length, uint8_t digest[kVKCacheKeyLength])
+{
+    const size_t blocksCount = length / 16;
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+    uint64_t h1 = 0;
+    uint64_t h2 = 0;
+
+    for (size_t i = 0; i < blocksCount; i++) {
+        uint64_t k1;
+        uint64_t k2;
+
+        memcpy(&k1, data + i * 16, sizeof(k1));
+        memcpy(&k2, data + i * 16 + 8, sizeof(k2));
+
+        k1 *= c1;
+        k1 = VKCacheKeyRotateLeft(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+
+        h1 = VKCacheKeyRotateLeft(h1, 27);
+        h1 += h2;
+        h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2;
+        k2 = VKCacheKeyRotateLeft(k2, 33);
+        k2 *= c1;
+        h2 ^= k2;
+
+        h2 = VKCacheKeyRotateLeft(h2, 31);
+        h2 += h1;
+        h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    const uint8_t *tail = data + blocksCount * 16;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+
+    switch (length & 15) {
+        case 15: k2 ^= ((uint64_t) tail[14]) << 48;
+        case 14: k2 ^= ((uint64_t) tail[13]) << 40;
+        case 13: k2 ^= ((uint64_t) tail[12]) << 32;
+        case 12: k2 ^= ((uint64_t) tail[11]) << 24;
+        case 11: k2 ^= ((uint64_t) tail[10]) << 16;
+        case 10: k2 ^= ((uint64_t) tail[9]) << 8;
+        case 9:
+            k2 ^= ((uint64_t) tail[8]);
+            k2 *= c2;
+            k2 = VKCacheKeyRotateLeft(k2, 33);
+            k2 *= c1;
+            h2 ^= k2;
+
+        case 8: k1 ^= ((uint64_t) tail[7]) << 56;
+        case 7: k1 ^= ((uint64_t) tail[6]) << 48;
+        case 6: k1 ^= ((uint64_t) tail[5]) << 40;
+        case 5: k1 ^= ((uint64_t) tail[4]) << 32;
+        case 4: k1 ^= ((uint64_t) tail[3]) << 24;
+        case 3: k1 ^= ((uint64_t) tail[2]) << 16;
+        case 2: k1 ^= ((uint64_t) tail[1]) << 8;
+        case 1:
+            k1 ^= ((uint64_t) tail[0]);
+            k1 *= c1;
+            k1 = VKCacheKeyRotateLeft(k1, 31);
+            k1 *= c2;
+            h1 ^= k1;
+        default:
+            break;
+    }
+
+    h1 ^= (uint64_t) length;
+    h2 ^= (uint64_t) length;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = VKCacheKeyFinalMix(h1);
+    h2 = VKCacheKeyFinalMix(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+//    порядок байт фиксирован (little-endian) и не зависит от платформы
+    for (int i = 0; i < 8; i++) {
+        digest[i] = (uint8_t) (h1 >> (8 * i));
+        digest[8 + i] = (uint8_t) (h2 >> (8 * i));
+    }
+}
+
+static int VKCacheKeyHexDigitValue(unichar digit)
+{
+    if (digit >= '0' && digit <= '9')
+        return digit - '0';
+
+    if (digit >= 'a' && digit <= 'f')
+        return digit - 'a' + 10;
+
+    if (digit >= 'A' && digit <= 'F')
+        return digit - 'A' + 10;
+
+    return -1;
+}
+
+BOOL VKCacheKeyGetBytes(NSString *key, uint8_t bytes[kVKCacheKeyLength])
+{
+    if (kVKCacheKeyLength * 2 != [key length])
+        return NO;
+
+    unichar hex[kVKCacheKeyLength * 2];
+    [key getCharacters:hex range:NSMakeRange(0, kVKCacheKeyLength * 2)];
+
+    for (NSUInteger i = 0; i < kVKCacheKeyLength; i++) {
+        int high = VKCacheKeyHexDigitValue(hex[i * 2]);
+        int low = VKCacheKeyHexDigitValue(hex[i * 2 + 1]);
+
+        if (high < 0 || low < 0)
+            return NO;
+
+        bytes[i] = (uint8_t) ((high << 4) | low);
+    }
+
+    return YES;
+}
+
+NSString *VKCacheKeyWithBytes(const uint8_t bytes[kVKCacheKeyLength])
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    char hex[kVKCacheKeyLength * 2];
+
+    for (NSUInteger i = 0; i < kVKCacheKeyLength; i++) {
+        hex[i * 2] = hexDigits[bytes[i] >> 4];
+        hex[i * 2 + 1] = hexDigits[bytes[i] & 0x0F];
+    }
+
+    return [[NSString alloc] initWithBytes:hex
+                                    length:sizeof(hex)
+                                  encoding:NSASCIIStringEncoding];
+}
+
+static BOOL VKCacheKeyIsAuthParameter(NSString *name)
+{
+    return ([name isEqualToString:@"access_token"] || [name isEqualToString:@"sig"]);
+}
+
+// каждая часть канонического представления предваряется своей длиной, поэтому
+// разные наборы параметров не могут дать одно и то же представление; значения,
+// не являющиеся строками, представляются своим описанием, nil - пустой строкой
+static void VKCacheKeyAppendComponent(NSMutableData *canonical, id component)
+{
+    const char *bytes = [[component description] UTF8String];
+    uint32_t length = (NULL == bytes ? 0 : (uint32_t) strlen(bytes));
+
+    [canonical appendBytes:&length length:sizeof(length)];
+    [canonical appendBytes:bytes length:length];
+}
+
+// 32-битный хэш строки без учёта регистра, 0 зарезервирован за отсутствующей строкой
+static uint32_t VKCacheKeyHash32(NSString *string)
+{
+    if (0 == [string length])
+        return 0;
+
+    NSData *data = [[string lowercaseString] dataUsingEncoding:NSUTF8StringEncoding];
+    uint8_t digest[kVKCacheKeyLength];
+    uint32_t hash;
+
+    VKCacheKeyHash128([data bytes], [data length], digest);
+    memcpy(&hash, digest, sizeof(hash));
+
+    return (0 == hash ? 1 : hash);
+}
+
+
+@implementation VKCacheKey
+
+#pragma mark Visible VKCacheKey methods
+
++ (NSString *)keyForMethod:(NSString *)methodName
+                   options:(NSDictionary *)options
+{
+    NSMutableData *canonical = [[NSMutableData alloc] initWithCapacity:256];
+
+    VKCacheKeyAppendComponent(canonical, methodName);
+
+    NSArray *names = [[options allKeys] sortedArrayUsingComparator:^NSComparisonResult(id name1, id name2)
+    {
+        return [[name1 description] caseInsensitiveCompare:[name2 description]];
+    }];
+
+    for (id name in names) {
+        NSString *parameterName = [[name description] lowercaseString];
+
+        if (VKCacheKeyIsAuthParameter(parameterName))
+            continue;
+
+        VKCacheKeyAppendComponent(canonical, parameterName);
+        VKCacheKeyAppendComponent(canonical, options[name]);
+    }
+
+    return [self keyForData:canonical];
+}
+
++ (NSString *)keyForURL:(NSURL *)url
+{
+    NSString *query = [url query];
+
+    if (nil == query)
+        return [self keyForData:[[url absoluteString] dataUsingEncoding:NSUTF8StringEncoding]];
+
+    NSMutableData *canonical = [[NSMutableData alloc] initWithCapacity:256];
+    NSString *absoluteString = [url absoluteString];
+    NSRange queryStart = [absoluteString rangeOfString:@"?"];
+
+    VKCacheKeyAppendComponent(canonical, [absoluteString substringToIndex:queryStart.location]);
+
+    for (NSString *parameter in [query componentsSeparatedByString:@"&"]) {
+        NSRange separator = [parameter rangeOfString:@"="];
+        NSString *parameterName = (NSNotFound == separator.location ? parameter : [parameter substringToIndex:separator.location]);
+
+        if (VKCacheKeyIsAuthParameter(parameterName))
+            continue;
+
+        VKCacheKeyAppendComponent(canonical, parameter);
+    }
+
+    return [self keyForData:canonical];
+}
+
++ (NSString *)keyForData:(NSData *)data
+{
+    uint8_t digest[kVKCacheKeyLength];
+
+    VKCacheKeyHash128([data bytes], [data length], digest);
+
+    return VKCacheKeyWithBytes(digest);
+}
+
++ (NSString *)keyForContent:(NSData *)data
+{
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+
+    CC_SHA256([data bytes], (CC_LONG) [data length], digest);
+
+    return VKCacheKeyWithBytes(digest);
+}
+
++ (uint32_t)hashForMethod:(NSString *)methodName
+{
+    return VKCacheKeyHash32(methodName);
+}
+
++ (uint32_t)hashForTag:(NSString *)tag
+{
+    return VKCacheKeyHash32(tag);
+}
+
+@end
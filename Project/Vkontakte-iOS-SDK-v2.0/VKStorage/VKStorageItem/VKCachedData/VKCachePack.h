@@ -0,0 +1,160 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import <Foundation/Foundation.h>
+#import "VKCachedDataRecord.h"
+
+@class VKCacheIndexEntry;
+
+/** Имя файла пакета, подключённого к кэшу, в директории кэша
+*/
+static NSString *const kVKCachePackFileName = @"pack";
+
+/** Наименование раздела пакета, в который экспортируется отдельный кэш (см.
+VKCachedData exportPackToFile:)
+*/
+static NSString *const kVKCachePackDefaultSectionName = @"default";
+
+
+/** Пакет кэша - единый файл, доступный только для чтения, со снимком записей одного
+или нескольких кэшей.
+
+Файл пакета состоит из заголовка, бинарных записей (VKCachedDataRecord) подряд и
+таблицы записей индекса в конце файла. Каждая запись таблицы содержит метаданные
+записи кэша (как в индексе кэша, см. VKCacheIndexEntry) и смещение её данных в
+файле. Одинаковые данные нескольких записей хранятся однократно.
+
+Записи разбиты на именованные разделы (например, по одному на кэш каждой учётной
+записи VKStorage).
+
+Пакет не распаковывается: таблица записей отображается в память при открытии, а
+данные записей читаются из файла пакета отображением в память так же, как из
+хранилища кэша.
+*/
+@interface VKCachePack : NSObject
+
+/**
+@name Свойства
+*/
+/** Наименования разделов пакета - массив объектов типа NSString
+*/
+@property (nonatomic, readonly) NSArray *sectionNames;
+
+/** Кол-во записей во всех разделах пакета
+*/
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+@name Открытие пакета
+*/
+/** Открывает пакет
+
+@param path путь к файлу пакета
+@return экземпляр класса VKCachePack, либо nil, если файла нет или его формат не
+совпадает
+*/
++ (instancetype)packWithContentsOfFile:(NSString *)path;
+
+/**
+@name Чтение пакета
+*/
+/** Записи индекса раздела пакета. Время последнего обращения к записям равно
+времени их создания.
+
+@param sectionName наименование раздела
+@return массив объектов типа VKCacheIndexEntry, либо nil, если раздела нет
+*/
+- (NSArray *)entriesInSection:(NSString *)sectionName;
+
+/** Читает запись пакета
+
+@param key ключ, под которым данные записи хранятся в хранилище (ключ содержимого,
+либо ключ самой записи, см. VKCacheIndexEntry contentKey)
+@return запись, либо nil, если записи нет или она повреждена
+*/
+- (VKCachedDataRecord *)recordForKey:(NSString *)key;
+
+/** Находятся ли в пакете данные с указанным ключом
+
+@param key ключ, под которым данные записи хранятся в хранилище
+@return YES, если данные находятся в пакете
+*/
+- (BOOL)containsRecordForKey:(NSString *)key;
+
+@end
+
+
+/** Построитель пакета кэша (см. VKCachePack).
+
+Записи добавляются в пакет последовательно, пакет появляется по указанному пути
+атомарно лишь после вызова finish.
+*/
+@interface VKCachePackWriter : NSObject
+
+/**
+@name Свойства
+*/
+/** Кол-во добавленных записей
+*/
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+@name Методы инициализации
+*/
+/** Инициализация построителя пакета
+
+@param path путь к файлу пакета
+@return экземпляр класса VKCachePackWriter
+*/
+- (instancetype)initWithPath:(NSString *)path;
+
+/**
+@name Построение пакета
+*/
+/** Добавляет запись в пакет
+
+@param entry запись индекса кэша
+@param record данные записи
+@param sectionName наименование раздела пакета
+@param compression способ сжатия данных записи
+@return YES, если запись добавлена
+*/
+- (BOOL)addEntry:(VKCacheIndexEntry *)entry
+          record:(VKCachedDataRecord *)record
+       toSection:(NSString *)sectionName
+     compression:(VKCachedDataCompression)compression;
+
+/** Завершает построение пакета: дописывает таблицу записей и сбрасывает файл на
+диск
+
+@return YES, если пакет сохранён
+*/
+- (BOOL)finish;
+
+/** Отменяет построение пакета и удаляет недостроенный файл
+*/
+- (void)cancel;
+
+@end
@@ -0,0 +1,442 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import "VKCachePack.h"
+#import "VKCacheIndex.h"
+#import "VKCacheKey.h"
+#import <fcntl.h>
+#import <unistd.h>
+
+
+/** Сигнатура файла пакета ("VKCP")
+*/
+static uint32_t const kVKCachePackMagic = 0x50434B56;
+
+/** Текущая версия формата файла пакета
+*/
+static uint32_t const kVKCachePackVersion = 1;
+
+/** Флаг записи таблицы пакета, данные которой хранятся под ключом содержимого
+*/
+static uint32_t const kVKCachePackEntryFlagContentKey = 1 << 0;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    uint64_t entriesOffset;
+    uint64_t namesOffset;
+    uint32_t sectionCount;
+    uint32_t reserved;
+} VKCachePackFileHeader;
+
+typedef struct
+{
+    uint8_t key[kVKCacheKeyLength];
+    uint8_t contentKey[kVKCacheKeyLength];
+    uint64_t recordOffset;
+    uint64_t size;
+    uint64_t logicalSize;
+    uint64_t creationTimestamp;
+    uint32_t liveTime;
+    uint32_t methodHash;
+    uint32_t section;
+    uint32_t flags;
+    uint32_t tagHashes[kVKCacheIndexMaxTagCount];
+} VKCachePackFileEntry;
+
+
+@implementation VKCachePack
+{
+    int _fd;
+
+//    таблица записей пакета, отображённая в память
+    NSData *_entriesData;
+
+//    смещения данных записей в файле по ключам, под которыми они хранятся
+    NSDictionary *_recordOffsets;
+}
+
+#pragma mark Visible VKCachePack methods
+#pragma mark - Init methods
+
++ (instancetype)packWithContentsOfFile:(NSString *)path
+{
+    int fd = open([path fileSystemRepresentation], O_RDONLY | O_CLOEXEC);
+
+    if (-1 == fd)
+        return nil;
+
+    VKCachePack *pack = [[VKCachePack alloc] initWithFileDescriptor:fd];
+
+    if (![pack loadTableOfFile:path])
+        return nil;
+
+    return pack;
+}
+
+- (instancetype)initWithFileDescriptor:(int)fd
+{
+    self = [super init];
+
+    if (self) {
+        _fd = fd;
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    close(_fd);
+}
+
+#pragma mark - Reading
+
+- (NSUInteger)count
+{
+    return [_entriesData length] / sizeof(VKCachePackFileEntry);
+}
+
+- (NSArray *)entriesInSection:(NSString *)sectionName
+{
+    NSUInteger section = [_sectionNames indexOfObject:sectionName];
+
+    if (NSNotFound == section)
+        return nil;
+
+    NSMutableArray *entries = [[NSMutableArray alloc] init];
+    const VKCachePackFileEntry *fileEntries = [_entriesData bytes];
+
+    for (NSUInteger i = 0; i < self.count; i++) {
+        const VKCachePackFileEntry *fileEntry = &fileEntries[i];
+
+        if (section != fileEntry->section)
+            continue;
+
+        VKCacheIndexEntry *entry = [[VKCacheIndexEntry alloc] init];
+        entry.key = VKCacheKeyWithBytes(fileEntry->key);
+        entry.size = (NSUInteger) fileEntry->size;
+        entry.logicalSize = (NSUInteger) fileEntry->logicalSize;
+        entry.creationTimestamp = (NSUInteger) fileEntry->creationTimestamp;
+        entry.liveTime = fileEntry->liveTime;
+        entry.lastAccessTimestamp = entry.creationTimestamp;
+        entry.accessCount = 1;
+        entry.methodHash = fileEntry->methodHash;
+
+        if (fileEntry->flags & kVKCachePackEntryFlagContentKey)
+            entry.contentKey = VKCacheKeyWithBytes(fileEntry->contentKey);
+
+        NSMutableArray *tagHashes = [NSMutableArray arrayWithCapacity:kVKCacheIndexMaxTagCount];
+
+        for (NSUInteger j = 0; j < kVKCacheIndexMaxTagCount && 0 != fileEntry->tagHashes[j]; j++)
+            [tagHashes addObject:@(fileEntry->tagHashes[j])];
+
+        entry.tagHashes = tagHashes;
+
+        [entries addObject:entry];
+    }
+
+    return entries;
+}
+
+- (VKCachedDataRecord *)recordForKey:(NSString *)key
+{
+    NSNumber *offset = (nil != key ? _recordOffsets[key] : nil);
+
+    if (nil == offset)
+        return nil;
+
+    return [VKCachedDataRecord recordWithFileDescriptor:_fd
+                                                 offset:(off_t) [offset unsignedLongLongValue]];
+}
+
+- (BOOL)containsRecordForKey:(NSString *)key
+{
+    return (nil != key && nil != _recordOffsets[key]);
+}
+
+#pragma mark - Private methods
+
+- (BOOL)loadTableOfFile:(NSString *)path
+{
+    VKCachePackFileHeader header;
+    struct stat fileInfo;
+
+    if ((ssize_t) sizeof(header) != pread(_fd, &header, sizeof(header), 0) ||
+            kVKCachePackMagic != header.magic ||
+            kVKCachePackVersion != header.version ||
+            0 != fstat(_fd, &fileInfo))
+        return NO;
+
+    uint64_t fileSize = (uint64_t) fileInfo.st_size;
+    uint64_t entriesLength = header.count * sizeof(VKCachePackFileEntry);
+
+    if (header.entriesOffset < sizeof(header) ||
+            header.count > fileSize / sizeof(VKCachePackFileEntry) ||
+            header.entriesOffset + entriesLength != header.namesOffset ||
+            header.namesOffset > fileSize)
+        return NO;
+
+//    файл отображается в память целиком, но с диска загружаются лишь страницы
+//    таблицы записей и наименований разделов в конце файла
+    NSData *data = [NSData dataWithContentsOfFile:path
+                                          options:NSDataReadingMappedAlways
+                                            error:nil];
+
+    if ([data length] != fileSize)
+        return NO;
+
+    _entriesData = [data subdataWithRange:NSMakeRange((NSUInteger) header.entriesOffset, (NSUInteger) entriesLength)];
+
+    NSMutableArray *sectionNames = [[NSMutableArray alloc] initWithCapacity:header.sectionCount];
+    const char *names = (const char *) [data bytes] + header.namesOffset;
+    NSUInteger namesLength = (NSUInteger) (fileSize - header.namesOffset);
+    NSUInteger position = 0;
+
+    for (uint32_t i = 0; i < header.sectionCount; i++) {
+        const char *name = names + position;
+        size_t length = strnlen(name, namesLength - position);
+
+        if (position + length >= namesLength)
+            return NO;
+
+        NSString *sectionName = [[NSString alloc] initWithBytes:name
+                                                         length:length
+                                                       encoding:NSUTF8StringEncoding];
+
+        if (nil == sectionName)
+            return NO;
+
+        [sectionNames addObject:sectionName];
+        position += length + 1;
+    }
+
+    NSMutableDictionary *recordOffsets = [[NSMutableDictionary alloc] initWithCapacity:(NSUInteger) header.count];
+    const VKCachePackFileEntry *fileEntries = [_entriesData bytes];
+
+    for (uint64_t i = 0; i < header.count; i++) {
+        const VKCachePackFileEntry *fileEntry = &fileEntries[i];
+
+        if (fileEntry->section >= header.sectionCount ||
+                fileEntry->recordOffset + sizeof(VKCachedDataRecordHeader) + fileEntry->size > header.entriesOffset)
+            return NO;
+
+        const uint8_t *keyBytes = (fileEntry->flags & kVKCachePackEntryFlagContentKey ? fileEntry->contentKey : fileEntry->key);
+        recordOffsets[VKCacheKeyWithBytes(keyBytes)] = @(fileEntry->recordOffset);
+    }
+
+    _sectionNames = sectionNames;
+    _recordOffsets = recordOffsets;
+
+    return YES;
+}
+
+@end
+
+
+@implementation VKCachePackWriter
+{
+    NSString *_path;
+    NSString *_temporaryPath;
+    int _fd;
+    uint64_t _offset;
+
+    NSMutableData *_entriesData;
+    NSMutableArray *_sectionNames;
+
+//    смещения уже записанных данных по ключам, под которыми они хранятся
+    NSMutableDictionary *_recordOffsets;
+}
+
+#pragma mark Visible VKCachePackWriter methods
+#pragma mark - Init methods
+
+- (instancetype)initWithPath:(NSString *)path
+{
+    self = [super init];
+
+    if (self) {
+        _path = [path copy];
+        _temporaryPath = [_path stringByAppendingString:@".tmp"];
+        _fd = open([_temporaryPath fileSystemRepresentation], O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        _entriesData = [[NSMutableData alloc] init];
+        _sectionNames = [[NSMutableArray alloc] init];
+        _recordOffsets = [[NSMutableDictionary alloc] init];
+
+//        место под заголовок, он записывается последним
+        _offset = sizeof(VKCachePackFileHeader);
+
+        if (-1 != _fd && -1 == lseek(_fd, (off_t) _offset, SEEK_SET))
+            [self cancel];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [self cancel];
+}
+
+#pragma mark - Building
+
+- (NSUInteger)count
+{
+    return [_entriesData length] / sizeof(VKCachePackFileEntry);
+}
+
+- (BOOL)addEntry:(VKCacheIndexEntry *)entry
+          record:(VKCachedDataRecord *)record
+       toSection:(NSString *)sectionName
+     compression:(VKCachedDataCompression)compression
+{
+    if (-1 == _fd || nil == entry || nil == record || nil == sectionName)
+        return NO;
+
+    VKCachePackFileEntry fileEntry;
+    memset(&fileEntry, 0, sizeof(fileEntry));
+
+    if (!VKCacheKeyGetBytes(entry.key, fileEntry.key))
+        return NO;
+
+    NSString *storeKey = entry.key;
+
+    if (VKCacheKeyGetBytes(entry.contentKey, fileEntry.contentKey)) {
+        fileEntry.flags |= kVKCachePackEntryFlagContentKey;
+        storeKey = entry.contentKey;
+    }
+
+//    одинаковые данные нескольких записей записываются однократно
+    NSArray *recordLocation = _recordOffsets[storeKey];
+
+    if (nil == recordLocation) {
+        VKCachedDataRecordHeader header;
+        NSData *storedPayload = [VKCachedDataRecord fillHeader:&header
+                                                   withPayload:record.payload
+                                                      liveTime:record.liveTime
+                                             creationTimestamp:record.creationTimestamp
+                                                   compression:compression];
+
+        struct iovec parts[2];
+        parts[0].iov_base = &header;
+        parts[0].iov_len = sizeof(header);
+        parts[1].iov_base = (void *) [storedPayload bytes];
+        parts[1].iov_len = [storedPayload length];
+
+        if (!VKWriteVectorFully(_fd, parts, 2)) {
+//            частично записанную запись отбрасываем
+            ftruncate(_fd, (off_t) _offset);
+            lseek(_fd, (off_t) _offset, SEEK_SET);
+            return NO;
+        }
+
+        recordLocation = @[@(_offset), @([storedPayload length])];
+        _recordOffsets[storeKey] = recordLocation;
+        _offset += sizeof(header) + [storedPayload length];
+    }
+
+    NSUInteger section = [_sectionNames indexOfObject:sectionName];
+
+    if (NSNotFound == section) {
+        section = [_sectionNames count];
+        [_sectionNames addObject:[sectionName copy]];
+    }
+
+    fileEntry.recordOffset = [recordLocation[0] unsignedLongLongValue];
+    fileEntry.size = [recordLocation[1] unsignedLongLongValue];
+    fileEntry.logicalSize = [record.payload length];
+    fileEntry.creationTimestamp = entry.creationTimestamp;
+    fileEntry.liveTime = (uint32_t) entry.liveTime;
+    fileEntry.methodHash = entry.methodHash;
+    fileEntry.section = (uint32_t) section;
+
+    NSUInteger tagCount = MIN([entry.tagHashes count], kVKCacheIndexMaxTagCount);
+
+    for (NSUInteger i = 0; i < tagCount; i++)
+        fileEntry.tagHashes[i] = [entry.tagHashes[i] unsignedIntValue];
+
+    [_entriesData appendBytes:&fileEntry length:sizeof(fileEntry)];
+
+    return YES;
+}
+
+- (BOOL)finish
+{
+    if (-1 == _fd)
+        return NO;
+
+    NSMutableData *namesData = [[NSMutableData alloc] init];
+
+    for (NSString *sectionName in _sectionNames) {
+        const char *name = [sectionName UTF8String];
+        [namesData appendBytes:name length:strlen(name) + 1];
+    }
+
+    VKCachePackFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kVKCachePackMagic;
+    header.version = kVKCachePackVersion;
+    header.count = self.count;
+    header.entriesOffset = _offset;
+    header.namesOffset = _offset + [_entriesData length];
+    header.sectionCount = (uint32_t) [_sectionNames count];
+
+    struct iovec parts[2];
+    parts[0].iov_base = [_entriesData mutableBytes];
+    parts[0].iov_len = [_entriesData length];
+    parts[1].iov_base = [namesData mutableBytes];
+    parts[1].iov_len = [namesData length];
+
+//    заголовок записывается после всего остального: недописанный пакет не
+//    будет принят за целый
+    BOOL written = (VKWriteVectorFully(_fd, parts, 2) &&
+            (ssize_t) sizeof(header) == pwrite(_fd, &header, sizeof(header), 0) &&
+            0 == fsync(_fd));
+
+    close(_fd);
+    _fd = -1;
+
+    if (!written || 0 != rename([_temporaryPath fileSystemRepresentation], [_path fileSystemRepresentation])) {
+        unlink([_temporaryPath fileSystemRepresentation]);
+        return NO;
+    }
+
+    return YES;
+}
+
+- (void)cancel
+{
+    if (-1 == _fd)
+        return;
+
+    close(_fd);
+    _fd = -1;
+
+    unlink([_temporaryPath fileSystemRepresentation]);
+}
+
+@end
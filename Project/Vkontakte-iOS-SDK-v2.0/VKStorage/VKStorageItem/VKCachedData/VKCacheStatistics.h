@@ -0,0 +1,241 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+//
+#import <Foundation/Foundation.h>
+
+/** Кол-во интервалов гистограммы времени выполнения операций. Интервал с номером
+i > 0 содержит операции, выполнявшиеся от 2^(i-1) до 2^i микросекунд, интервал 0 -
+операции короче микросекунды, последний интервал - все более долгие операции.
+*/
+#define kVKCacheStatisticsLatencyBucketCount 24
+
+/** Перечисление событий кэша, для которых ведётся статистика
+*/
+typedef enum
+{
+
+//    данные найдены, срок их жизни не истёк
+    VKCacheStatisticsEventHit = 0,
+//    данных нет в кэше
+    VKCacheStatisticsEventMiss = 1,
+//    возвращены данные, срок жизни которых истёк (оффлайн режим, staleGraceTime)
+    VKCacheStatisticsEventStaleHit = 2,
+//    запись удалена из-за истечения срока жизни
+    VKCacheStatisticsEventExpiration = 3,
+//    запись вытеснена из-за превышения размера кэша
+    VKCacheStatisticsEventEviction = 4,
+//    запись удалена инвалидацией по тегу
+    VKCacheStatisticsEventInvalidation = 5,
+
+} VKCacheStatisticsEvent;
+
+/** Перечисление операций, для которых строятся гистограммы времени выполнения
+*/
+typedef enum
+{
+
+//    поиск данных в кэше (от обращения до ответа, включая чтение с диска)
+    VKCacheStatisticsOperationLookup = 0,
+//    чтение записи с диска
+    VKCacheStatisticsOperationRead = 1,
+//    сжатие и запись записи на диск
+    VKCacheStatisticsOperationWrite = 2,
+
+    VKCacheStatisticsOperationCount = 3,
+
+} VKCacheStatisticsOperation;
+
+/** Текущее время для измерения длительности операций
+(см. recordLatencySinceTimestamp:operation:methodName:)
+
+@return время в единицах mach_absolute_time
+*/
+uint64_t VKCacheStatisticsTimestamp(void);
+
+
+/** Значения счётчиков статистики кэша. Экземпляр неизменяем.
+*/
+@interface VKCacheStatisticsCounters : NSObject
+
+/** Кол-во попаданий
+*/
+@property (nonatomic, readonly) uint64_t hits;
+
+/** Кол-во промахов
+*/
+@property (nonatomic, readonly) uint64_t misses;
+
+/** Кол-во попаданий в устаревшие данные
+*/
+@property (nonatomic, readonly) uint64_t staleHits;
+
+/** Кол-во записей, удалённых из-за истечения срока жизни
+*/
+@property (nonatomic, readonly) uint64_t expirations;
+
+/** Кол-во вытесненных записей
+*/
+@property (nonatomic, readonly) uint64_t evictions;
+
+/** Кол-во записей, удалённых инвалидацией по тегам
+*/
+@property (nonatomic, readonly) uint64_t invalidations;
+
+/** Кол-во байт, прочитанных с диска (с учётом сжатия)
+*/
+@property (nonatomic, readonly) uint64_t bytesRead;
+
+/** Кол-во байт, записанных на диск (с учётом сжатия)
+*/
+@property (nonatomic, readonly) uint64_t bytesWritten;
+
+/** Кол-во байт, которые не пришлось записывать на диск, потому что такое же
+содержимое уже хранилось в кэше (см. VKCacheKey keyForContent:)
+*/
+@property (nonatomic, readonly) uint64_t bytesDeduplicated;
+
+/** Доля данных, сэкономленных дедупликацией, среди всех сохранённых в кэше данных
+(bytesDeduplicated / (bytesWritten + bytesDeduplicated)), либо 0, если данные не
+сохранялись
+*/
+@property (nonatomic, readonly) double deduplicationRatio;
+
+/** Доля попаданий (в том числе в устаревшие данные) среди всех обращений к кэшу,
+либо 0, если обращений не было
+*/
+@property (nonatomic, readonly) double hitRatio;
+
+/** Гистограмма времени выполнения операции
+
+@param operation операция
+@return массив из kVKCacheStatisticsLatencyBucketCount экземпляров NSNumber -
+кол-во операций в каждом интервале
+*/
+- (NSArray *)latencyHistogramForOperation:(VKCacheStatisticsOperation)operation;
+
+@end
+
+
+/** Снимок статистики кэша на определённый момент времени
+*/
+@interface VKCacheStatisticsSnapshot : NSObject
+
+/** Время, с которого накапливалась статистика (создание либо сброс)
+*/
+@property (nonatomic, readonly) NSDate *startDate;
+
+/** Суммарные значения счётчиков
+*/
+@property (nonatomic, readonly) VKCacheStatisticsCounters *totalCounters;
+
+/** Значения счётчиков по методам API. Ключом является наименование метода,
+значением - экземпляр VKCacheStatisticsCounters. События, метод которых неизвестен,
+учитываются только в totalCounters.
+*/
+@property (nonatomic, readonly) NSDictionary *countersByMethod;
+
+@end
+
+
+/** Статистика работы кэша: попадания, промахи, истечения срока жизни, вытеснения,
+объём прочитанных, записанных и дедуплицированных данных, гистограммы времени выполнения операций.
+Статистика ведётся суммарно и по методам API.
+
+Учёт события - несколько арифметических операций под блокировкой, поэтому
+статистика может быть включена постоянно.
+
+Все методы потокобезопасны.
+*/
+@interface VKCacheStatistics : NSObject
+
+/**
+@name Учёт событий
+*/
+/** Учитывает событие
+
+@param event событие
+@param methodName наименование метода API, либо nil
+*/
+- (void)recordEvent:(VKCacheStatisticsEvent)event
+         methodName:(NSString *)methodName;
+
+/** Учитывает данные, прочитанные с диска
+
+@param length кол-во байт
+@param methodName наименование метода API, либо nil
+*/
+- (void)recordBytesRead:(NSUInteger)length
+             methodName:(NSString *)methodName;
+
+/** Учитывает данные, записанные на диск
+
+@param length кол-во байт
+@param methodName наименование метода API, либо nil
+*/
+- (void)recordBytesWritten:(NSUInteger)length
+                methodName:(NSString *)methodName;
+
+/** Учитывает данные, которые не были записаны на диск, потому что такое же
+содержимое уже хранится в кэше
+
+@param length кол-во байт
+@param methodName наименование метода API, либо nil
+*/
+- (void)recordBytesDeduplicated:(NSUInteger)length
+                     methodName:(NSString *)methodName;
+
+/** Учитывает время выполнения операции
+
+@param startTimestamp время начала операции (см. VKCacheStatisticsTimestamp)
+@param operation операция
+@param methodName наименование метода API, либо nil
+*/
+- (void)recordLatencySinceTimestamp:(uint64_t)startTimestamp
+                          operation:(VKCacheStatisticsOperation)operation
+                         methodName:(NSString *)methodName;
+
+/** Наименование метода API по его хэшу (см. VKCacheKey hashForMethod:). Известны
+наименования методов, события которых уже учитывались.
+
+@param methodHash хэш наименования метода
+@return наименование метода, либо nil, если метод неизвестен
+*/
+- (NSString *)methodNameForHash:(uint32_t)methodHash;
+
+/**
+@name Снимок и сброс
+*/
+/** Текущие значения статистики
+
+@return экземпляр класса VKCacheStatisticsSnapshot
+*/
+- (VKCacheStatisticsSnapshot *)snapshot;
+
+/** Обнуляет все счётчики
+*/
+- (void)reset;
+
+@end
@@ -0,0 +1,442 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+//
+#import <mach/mach_time.h>
+#import <pthread.h>
+#import "VKCacheStatistics.h"
+#import "VKCacheKey.h"
+
+
+/** Значения счётчиков статистики
+*/
+typedef struct
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t staleHits;
+    uint64_t expirations;
+    uint64_t evictions;
+    uint64_t invalidations;
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    uint64_t bytesDeduplicated;
+    uint64_t latencyHistograms[VKCacheStatisticsOperationCount][kVKCacheStatisticsLatencyBucketCount];
+} VKCacheStatisticsData;
+
+
+uint64_t VKCacheStatisticsTimestamp(void)
+{
+    return mach_absolute_time();
+}
+
+static uint64_t VKCacheStatisticsMicroseconds(uint64_t duration)
+{
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t onceToken;
+
+    dispatch_once(&onceToken, ^
+    {
+        mach_timebase_info(&timebase);
+    });
+
+    return duration * timebase.numer / timebase.denom / 1000;
+}
+
+// номер интервала гистограммы - номер старшего единичного бита длительности
+// в микросекундах
+static NSUInteger VKCacheStatisticsLatencyBucket(uint64_t microseconds)
+{
+    if (0 == microseconds)
+        return 0;
+
+    NSUInteger bucket = (NSUInteger) (64 - __builtin_clzll(microseconds));
+
+    return MIN(bucket, kVKCacheStatisticsLatencyBucketCount - 1);
+}
+
+static void VKCacheStatisticsCountEvent(VKCacheStatisticsData *data, VKCacheStatisticsEvent event)
+{
+    switch (event) {
+        case VKCacheStatisticsEventHit:
+            data->hits++;
+            break;
+
+        case VKCacheStatisticsEventMiss:
+            data->misses++;
+            break;
+
+        case VKCacheStatisticsEventStaleHit:
+            data->staleHits++;
+            break;
+
+        case VKCacheStatisticsEventExpiration:
+            data->expirations++;
+            break;
+
+        case VKCacheStatisticsEventEviction:
+            data->evictions++;
+            break;
+
+        case VKCacheStatisticsEventInvalidation:
+            data->invalidations++;
+            break;
+    }
+}
+
+
+@interface VKCacheStatisticsCounters ()
+
+- (instancetype)initWithData:(const VKCacheStatisticsData *)data;
+
+@end
+
+
+@implementation VKCacheStatisticsCounters
+{
+    VKCacheStatisticsData _data;
+}
+
+#pragma mark Visible VKCacheStatisticsCounters methods
+#pragma mark - Init methods
+
+- (instancetype)initWithData:(const VKCacheStatisticsData *)data
+{
+    self = [super init];
+
+    if (self)
+        _data = *data;
+
+    return self;
+}
+
+#pragma mark - Getters
+
+- (uint64_t)hits
+{
+    return _data.hits;
+}
+
+- (uint64_t)misses
+{
+    return _data.misses;
+}
+
+- (uint64_t)staleHits
+{
+    return _data.staleHits;
+}
+
+- (uint64_t)expirations
+{
+    return _data.expirations;
+}
+
+- (uint64_t)evictions
+{
+    return _data.evictions;
+}
+
+- (uint64_t)invalidations
+{
+    return _data.invalidations;
+}
+
+- (uint64_t)bytesRead
+{
+    return _data.bytesRead;
+}
+
+- (uint64_t)bytesWritten
+{
+    return _data.bytesWritten;
+}
+
+- (uint64_t)bytesDeduplicated
+{
+    return _data.bytesDeduplicated;
+}
+
+- (double)deduplicationRatio
+{
+    uint64_t bytesStored = _data.bytesWritten + _data.bytesDeduplicated;
+
+    return (0 == bytesStored ? 0.0 : (double) _data.bytesDeduplicated / bytesStored);
+}
+
+- (double)hitRatio
+{
+    uint64_t hits = _data.hits + _data.staleHits;
+    uint64_t lookups = hits + _data.misses;
+
+    return (0 == lookups ? 0.0 : (double) hits / lookups);
+}
+
+- (NSArray *)latencyHistogramForOperation:(VKCacheStatisticsOperation)operation
+{
+    if (operation >= VKCacheStatisticsOperationCount)
+        return nil;
+
+    NSMutableArray *histogram = [NSMutableArray arrayWithCapacity:kVKCacheStatisticsLatencyBucketCount];
+
+    for (NSUInteger i = 0; i < kVKCacheStatisticsLatencyBucketCount; i++)
+        [histogram addObject:@(_data.latencyHistograms[operation][i])];
+
+    return histogram;
+}
+
+#pragma mark - Overridden methods
+
+- (NSString *)description
+{
+    NSDictionary *description = @{
+            @"hits"               : @(self.hits),
+            @"misses"             : @(self.misses),
+            @"staleHits"          : @(self.staleHits),
+            @"expirations"        : @(self.expirations),
+            @"evictions"          : @(self.evictions),
+            @"invalidations"      : @(self.invalidations),
+            @"bytesRead"          : @(self.bytesRead),
+            @"bytesWritten"       : @(self.bytesWritten),
+            @"bytesDeduplicated"  : @(self.bytesDeduplicated),
+            @"hitRatio"           : @(self.hitRatio),
+            @"deduplicationRatio" : @(self.deduplicationRatio)
+    };
+
+    return [description description];
+}
+
+@end
+
+
+@interface VKCacheStatisticsSnapshot ()
+
+- (instancetype)initWithStartDate:(NSDate *)startDate
+                    totalCounters:(VKCacheStatisticsCounters *)totalCounters
+                 countersByMethod:(NSDictionary *)countersByMethod;
+
+@end
+
+
+@implementation VKCacheStatisticsSnapshot
+
+#pragma mark Visible VKCacheStatisticsSnapshot methods
+#pragma mark - Init methods
+
+- (instancetype)initWithStartDate:(NSDate *)startDate
+                    totalCounters:(VKCacheStatisticsCounters *)totalCounters
+                 countersByMethod:(NSDictionary *)countersByMethod
+{
+    self = [super init];
+
+    if (self) {
+        _startDate = startDate;
+        _totalCounters = totalCounters;
+        _countersByMethod = [countersByMethod copy];
+    }
+
+    return self;
+}
+
+@end
+
+
+@implementation VKCacheStatistics
+{
+    pthread_mutex_t _mutex;
+    NSDate *_startDate;
+
+    VKCacheStatisticsData _totalData;
+
+//    наименование метода -> NSMutableData со значениями счётчиков метода
+    NSMutableDictionary *_methodData;
+
+//    хэш наименования метода -> наименование метода
+    NSMutableDictionary *_methodNames;
+}
+
+#pragma mark Visible VKCacheStatistics methods
+#pragma mark - Init methods
+
+- (instancetype)init
+{
+    self = [super init];
+
+    if (self) {
+        pthread_mutex_init(&_mutex, NULL);
+        _startDate = [NSDate date];
+        memset(&_totalData, 0, sizeof(_totalData));
+        _methodData = [[NSMutableDictionary alloc] init];
+        _methodNames = [[NSMutableDictionary alloc] init];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    pthread_mutex_destroy(&_mutex);
+}
+
+#pragma mark - Recording
+
+- (void)recordEvent:(VKCacheStatisticsEvent)event
+         methodName:(NSString *)methodName
+{
+    [self updateDataForMethod:methodName
+                   usingBlock:^(VKCacheStatisticsData *data)
+                   {
+                       VKCacheStatisticsCountEvent(data, event);
+                   }];
+}
+
+- (void)recordBytesRead:(NSUInteger)length
+             methodName:(NSString *)methodName
+{
+    [self updateDataForMethod:methodName
+                   usingBlock:^(VKCacheStatisticsData *data)
+                   {
+                       data->bytesRead += length;
+                   }];
+}
+
+- (void)recordBytesWritten:(NSUInteger)length
+                methodName:(NSString *)methodName
+{
+    [self updateDataForMethod:methodName
+                   usingBlock:^(VKCacheStatisticsData *data)
+                   {
+                       data->bytesWritten += length;
+                   }];
+}
+
+- (void)recordBytesDeduplicated:(NSUInteger)length
+                     methodName:(NSString *)methodName
+{
+    [self updateDataForMethod:methodName
+                   usingBlock:^(VKCacheStatisticsData *data)
+                   {
+                       data->bytesDeduplicated += length;
+                   }];
+}
+
+- (void)recordLatencySinceTimestamp:(uint64_t)startTimestamp
+                          operation:(VKCacheStatisticsOperation)operation
+                         methodName:(NSString *)methodName
+{
+    if (operation >= VKCacheStatisticsOperationCount)
+        return;
+
+    uint64_t duration = VKCacheStatisticsTimestamp() - startTimestamp;
+    NSUInteger bucket = VKCacheStatisticsLatencyBucket(VKCacheStatisticsMicroseconds(duration));
+
+    [self updateDataForMethod:methodName
+                   usingBlock:^(VKCacheStatisticsData *data)
+                   {
+                       data->latencyHistograms[operation][bucket]++;
+                   }];
+}
+
+- (NSString *)methodNameForHash:(uint32_t)methodHash
+{
+    if (0 == methodHash)
+        return nil;
+
+    NSString *methodName;
+
+    pthread_mutex_lock(&_mutex);
+    methodName = _methodNames[@(methodHash)];
+    pthread_mutex_unlock(&_mutex);
+
+    return methodName;
+}
+
+#pragma mark - Snapshot & reset
+
+- (VKCacheStatisticsSnapshot *)snapshot
+{
+    VKCacheStatisticsCounters *totalCounters;
+    NSMutableDictionary *countersByMethod = [NSMutableDictionary dictionary];
+    NSDate *startDate;
+
+    pthread_mutex_lock(&_mutex);
+
+    startDate = _startDate;
+    totalCounters = [[VKCacheStatisticsCounters alloc] initWithData:&_totalData];
+
+    [_methodData enumerateKeysAndObjectsUsingBlock:^(NSString *methodName, NSMutableData *data, BOOL *stop)
+    {
+        countersByMethod[methodName] = [[VKCacheStatisticsCounters alloc]
+                                                                   initWithData:[data bytes]];
+    }];
+
+    pthread_mutex_unlock(&_mutex);
+
+    return [[VKCacheStatisticsSnapshot alloc]
+                                       initWithStartDate:startDate
+                                           totalCounters:totalCounters
+                                        countersByMethod:countersByMethod];
+}
+
+- (void)reset
+{
+    pthread_mutex_lock(&_mutex);
+
+    _startDate = [NSDate date];
+    memset(&_totalData, 0, sizeof(_totalData));
+
+//    наименования методов не сбрасываются - хэши записей кэша остаются прежними
+    [_methodData removeAllObjects];
+
+    pthread_mutex_unlock(&_mutex);
+}
+
+#pragma mark - Private methods
+
+// вызывает block для суммарных счётчиков и счётчиков метода под блокировкой
+- (void)updateDataForMethod:(NSString *)methodName
+                 usingBlock:(void (^)(VKCacheStatisticsData *data))block
+{
+    pthread_mutex_lock(&_mutex);
+
+    block(&_totalData);
+
+    if (nil != methodName) {
+        NSMutableData *methodData = _methodData[methodName];
+
+        if (nil == methodData) {
+            methodData = [NSMutableData dataWithLength:sizeof(VKCacheStatisticsData)];
+
+            _methodData[methodName] = methodData;
+            _methodNames[@([VKCacheKey hashForMethod:methodName])] = methodName;
+        }
+
+        block([methodData mutableBytes]);
+    }
+
+    pthread_mutex_unlock(&_mutex);
+}
+
+@end
@@ -25,6 +25,10 @@
 // THE SOFTWARE.
 //
 #import <Foundation/Foundation.h>
+#import "VKCacheIndex.h"
+#import "VKCachedDataRecord.h"
+#import "VKCacheStatistics.h"
+#import "VKCachePack.h"
 
 /** Перечисление возможных сроков действия кэша.
 */
@@ -44,12 +48,245 @@ typedef enum
 
 } VKCachedDataLiveTime;
 
+/** Перечисление возможных способов хранения записей кэша на диске.
+*/
+typedef enum
+{
+
+    VKCachedDataStoreTypeFiles = 0,
+    VKCachedDataStoreTypeSegments = 1,
+
+} VKCachedDataStoreType;
+
+/** Размер (в байтах) кэша в оперативной памяти по умолчанию
+*/
+static NSUInteger const kVKCachedDataDefaultMemoryCacheSize = 2 * 1024 * 1024;
+
+/** Доля от допустимого размера кэша, до которой производится вытеснение записей.
+Вытеснение с запасом позволяет не запускать его заново после каждой записи.
+*/
+static double const kVKCachedDataEvictionTargetRatio = 0.9;
+
+/** Интервал (в секундах) между запусками фоновой очистки кэша от записей с истёкшим
+сроком жизни по умолчанию
+*/
+static NSTimeInterval const kVKCachedDataDefaultExpirySweepInterval = 60.0;
+
+/** Максимальное кол-во записей, удаляемых за один запуск фоновой очистки, по умолчанию
+*/
+static NSUInteger const kVKCachedDataDefaultExpirySweepBatchSize = 50;
+
+/** Максимальный размер (в байтах) кэша разобранных объектов ответов по умолчанию
+*/
+static NSUInteger const kVKCachedDataDefaultObjectCacheSize = 4 * 1024 * 1024;
+
+/** Время (в секундах), в течение которого фоновая очистка сохраняет записи с истёкшим
+сроком жизни, по умолчанию
+*/
+static NSTimeInterval const kVKCachedDataDefaultStaleRetentionTime = VKCachedDataLiveTimeOneDay;
+
+/** Минимальный размер (в байтах) данных записи, при котором они сжимаются,
+по умолчанию
+*/
+static NSUInteger const kVKCachedDataDefaultCompressionThreshold = 1024;
+
+/** Максимальное кол-во ключей записей в "горячем" наборе
+*/
+static NSUInteger const kVKCachedDataHotSetMaxCount = 64;
+
+/** Наименование файла "горячего" набора в директории кэша
+*/
+static NSString *const kVKCachedDataHotSetFileName = @"hotset";
+
+/** Уведомление рассылается каждый раз, когда размер кэша на диске увеличился.
+Объектом уведомления является экземпляр VKCachedData.
+*/
+static NSString *const kVKCachedDataDidChangeSizeNotification = @"VKCachedDataDidChangeSizeNotification";
+
 /** Класс предназначен для хранения, получения, удаления кэша запросов.
 Хранение кэша осуществляется на диске и в директории указанной при инициализации
 класса.
+
+Записи хранятся в компактном бинарном формате (см. VKCachedDataRecord) и при
+чтении отображаются в память без копирования. Способ размещения записей на диске
+определяется типом хранилища: каждая запись в отдельном файле
+(VKCachedDataStoreTypeFiles, см. VKCachedDataFileStore), либо журнал из
+нескольких файлов-сегментов с фоновым уплотнением (VKCachedDataStoreTypeSegments,
+см. VKCachedDataSegmentStore).
+
+Метаданные всех записей хранятся в индексе (см. VKCacheIndex), который
+загружается в память при инициализации. Промахи и решения об истечении срока
+жизни записей принимаются по индексу, файл записи открывается только при
+подтверждённом попадании.
+
+Запись на диск отложенная (см. VKCachedDataWriter): операции накапливаются в
+течение короткого времени и выполняются порцией на отдельной очереди с низким
+приоритетом, повторные записи одного ключа объединяются, а сброс на диск
+производится один раз на порцию. До записи на диск данные возвращаются из
+очереди отложенной записи. Метод flush позволяет дождаться записи всех данных.
+
+Данные записей размером не менее compressionThreshold байт сжимаются при записи
+на диск (по умолчанию быстрым кодеком LZ4) и прозрачно распаковываются при чтении.
+Распакованные данные, как и отображённые в память несжатые, сохраняются в кэше
+в оперативной памяти, а разобранный из них объект - в кэше разобранных объектов:
+повторные обращения к записи распаковку не повторяют.
+Размер кэша на диске (size) и квоты учитывают размер сжатых данных, размер
+исходных данных доступен в свойстве logicalSize.
+
+Данные хранятся на диске под ключом своего содержимого (см. VKCacheKey
+keyForContent:), а записи индекса лишь ссылаются на него: одинаковые ответы разных
+запросов (пустые списки, одни и те же профили) хранятся в единственном экземпляре.
+Содержимое удаляется вместе с последней ссылающейся на него записью. Объём
+сэкономленных данных учитывается в статистике (см. VKCacheStatisticsCounters
+deduplicationRatio) и свойстве referencedSize.
+
+Записи могут быть помечены тегами (например, "wall:1234" - стена пользователя),
+по которым они удаляются при изменении соответствующих данных (см.
+invalidateCachedDataForTags:). Индекс хранит обратное отображение тегов в ключи
+записей, поэтому инвалидация не требует перебора всех записей.
+
+Записи с истёкшим сроком жизни удаляются фоновой очисткой небольшими порциями
+(не более expirySweepBatchSize записей раз в expirySweepInterval секунд), поэтому
+кэш не разрастается за счёт данных, которые больше никогда не будут запрошены.
+
+Перед диском находится ограниченный по размеру кэш в оперативной памяти (LRU),
+который отвечает на повторные запросы одних и тех же данных без обращения к
+файловой системе.
+
+Рядом с ним находится кэш разобранных объектов ответов (см. cachedObjectForKey:
+offlineMode:staleGraceTime:isStale:): повторный запрос тех же данных получает уже
+разобранный неизменяемый объект без повторного разбора JSON.
+
+Кэш в оперативной памяти можно заранее "прогреть" (см. методы раздела Прогрев):
+выбранные записи загружаются с диска в фоне с низким приоритетом. Записи, к которым
+обращались в начале сеанса работы ("горячий" набор), запоминаются на диске при
+вызове flush и загружаются в следующем сеансе методом warmUpHotSet.
+
+Снимок кэша можно сохранить в единый файл-пакет (см. VKCachePack и
+exportPackToFile:) и импортировать позже (см. importPackFromFile:). Импортированный
+пакет не распаковывается: он копируется в директорию кэша, его записи добавляются в
+индекс, а данные читаются прямо из файла пакета. Пакет доступен только для чтения -
+удалённые и вытесненные записи лишь перестают на него ссылаться, файл пакета
+удаляется при очистке кэша или замещается следующим импортированным пакетом.
+
+Кэш, инициализированный в многопроцессном режиме (см.
+initWithCacheDirectory:storeType:multiProcess:), может одновременно использоваться
+несколькими процессами (например, приложением и его расширениями). Порции
+отложенной записи и синхронизация индекса выполняются под общей блокировкой
+директории (см. VKCacheDirectoryLock), изменения индекса других процессов
+объединяются с изменениями текущего процесса, а соответствующие им записи удаляются
+из кэша в оперативной памяти. Поколение индекса на диске проверяется при каждом
+обращении к кэшу (одно чтение заголовка файла индекса), поэтому данные, изменённые
+другими процессами, не возвращаются из оперативной памяти. В многопроцессном режиме всегда используется
+хранилище VKCachedDataStoreTypeFiles - положение записей журнального хранилища
+известно лишь создавшему их процессу.
+
+Статистика работы кэша (попадания, промахи, вытеснения, время выполнения операций
+и т.д.) доступна в свойстве statistics. Чтобы статистика учитывалась по методам API,
+наименование метода следует передавать при обращении к кэшу (см.
+cachedDataForKey:methodName:offlineMode:staleGraceTime:isStale:).
 */
 @interface VKCachedData : NSObject
 
+/**
+@name Свойства
+*/
+/** Максимальный размер (в байтах) кэша в оперативной памяти.
+По умолчанию равен kVKCachedDataDefaultMemoryCacheSize. Значение 0 отключает кэш
+в оперативной памяти.
+*/
+@property (nonatomic, assign, readwrite) NSUInteger memoryCacheSize;
+
+/** Максимальный размер кэша разобранных объектов ответов. Размер объекта
+оценивается размером данных, из которых он был разобран.
+По умолчанию равен kVKCachedDataDefaultObjectCacheSize. Значение 0 отключает кэш
+разобранных объектов.
+*/
+@property (nonatomic, assign, readwrite) NSUInteger objectCacheSize;
+
+/** Тип хранилища записей кэша на диске
+*/
+@property (nonatomic, readonly) VKCachedDataStoreType storeType;
+
+/** Используется ли директория кэша несколькими процессами одновременно
+*/
+@property (nonatomic, readonly) BOOL isMultiProcess;
+
+/** Кол-во записей, находящихся в кэше на диске
+*/
+@property (nonatomic, readonly) NSUInteger count;
+
+/** Суммарный размер (в байтах) данных записей, находящихся в кэше на диске
+(с учётом сжатия). Одинаковые данные разных записей хранятся и учитываются
+однократно.
+*/
+@property (nonatomic, readonly) NSUInteger size;
+
+/** Суммарный размер (в байтах) исходных (несжатых) данных записей, находящихся
+в кэше на диске
+*/
+@property (nonatomic, readonly) NSUInteger logicalSize;
+
+/** Суммарный размер (в байтах) данных записей на диске без учёта дедупликации -
+размер, который занимали бы данные, если бы каждая запись хранила свою копию.
+Отношение size к referencedSize показывает выигрыш от дедупликации.
+*/
+@property (nonatomic, readonly) NSUInteger referencedSize;
+
+/** Способ сжатия данных записей на диске. По умолчанию VKCachedDataCompressionLZ4.
+Изменение не затрагивает уже записанные данные - записи с любым способом сжатия
+читаются прозрачно.
+*/
+@property (nonatomic, assign, readwrite) VKCachedDataCompression compression;
+
+/** Минимальный размер (в байтах) данных записи, при котором они сжимаются.
+По умолчанию равен kVKCachedDataDefaultCompressionThreshold.
+*/
+@property (nonatomic, assign, readwrite) NSUInteger compressionThreshold;
+
+/** Максимальный размер (в байтах) кэша на диске. При превышении этого размера
+после очередной записи вытесняются записи в соответствии с политикой вытеснения
+evictionPolicy. По умолчанию равен 0 - размер кэша не ограничен.
+*/
+@property (nonatomic, assign, readwrite) NSUInteger maxCacheSize;
+
+/** Политика вытеснения записей. По умолчанию VKCachedDataEvictionPolicyLRU.
+*/
+@property (nonatomic, assign, readwrite) VKCachedDataEvictionPolicy evictionPolicy;
+
+/** Интервал (в секундах) между запусками фоновой очистки кэша от записей с истёкшим
+сроком жизни. По умолчанию равен kVKCachedDataDefaultExpirySweepInterval.
+Значение 0 отключает фоновую очистку.
+*/
+@property (nonatomic, assign, readwrite) NSTimeInterval expirySweepInterval;
+
+/** Максимальное кол-во записей, удаляемых за один запуск фоновой очистки.
+По умолчанию равно kVKCachedDataDefaultExpirySweepBatchSize.
+*/
+@property (nonatomic, assign, readwrite) NSUInteger expirySweepBatchSize;
+
+/** Время (в секундах) после истечения срока жизни записи, в течение которого она
+не удаляется фоновой очисткой и может быть использована как устаревшая
+(см. cachedDataForURL:offlineMode:staleGraceTime:isStale:).
+По умолчанию равно kVKCachedDataDefaultStaleRetentionTime.
+*/
+@property (nonatomic, assign, readwrite) NSTimeInterval staleRetentionTime;
+
+/** Суммарный размер (в байтах) данных записей с истёкшим сроком жизни, удалённых
+очисткой с момента инициализации объекта
+*/
+@property (nonatomic, readonly) NSUInteger reclaimedSize;
+
+/** Ключи записей "горячего" набора, сохранённого в предыдущих сеансах работы
+(не более kVKCachedDataHotSetMaxCount), в порядке первого обращения к ним
+*/
+@property (nonatomic, readonly) NSArray *hotSetKeys;
+
+/** Статистика работы кэша с момента инициализации объекта (либо последнего
+сброса статистики)
+*/
+@property (nonatomic, readonly) VKCacheStatistics *statistics;
+
 /**
 @name Методы инициализации
 */
@@ -61,6 +298,68 @@ typedef enum
 */
 - (instancetype)initWithCacheDirectory:(NSString *)path;
 
+/** Инициализация объекта для кэширования запросов с указанным типом хранилища
+
+Тип хранилища для одной и той же директории не должен меняться между запусками
+приложения - записи хранилища другого типа не будут найдены.
+
+@param path директория в которой должны будут храниться кэшируемые данные.
+Если директория не существует, то будет создана.
+@param storeType тип хранилища записей
+@return объект типа VKCachedData
+*/
+- (instancetype)initWithCacheDirectory:(NSString *)path
+                             storeType:(VKCachedDataStoreType)storeType;
+
+/** Инициализация объекта для кэширования запросов с указанным типом хранилища,
+директория которого может использоваться несколькими процессами
+
+Все процессы, работающие с одной директорией, должны инициализировать кэш в
+многопроцессном режиме.
+
+@param path директория в которой должны будут храниться кэшируемые данные.
+Если директория не существует, то будет создана.
+@param storeType тип хранилища записей. В многопроцессном режиме игнорируется -
+используется VKCachedDataStoreTypeFiles.
+@param multiProcess YES, если директория используется несколькими процессами
+@return объект типа VKCachedData
+*/
+- (instancetype)initWithCacheDirectory:(NSString *)path
+                             storeType:(VKCachedDataStoreType)storeType
+                          multiProcess:(BOOL)multiProcess;
+
+/** Тип хранилища, используемый при инициализации методом initWithCacheDirectory:
+(в том числе кэшами элементов VKStorage). По умолчанию VKCachedDataStoreTypeFiles.
+
+@return тип хранилища записей
+*/
++ (VKCachedDataStoreType)defaultStoreType;
+
+/** Устанавливает тип хранилища, используемый при инициализации методом
+initWithCacheDirectory:. Значение следует устанавливать при запуске приложения,
+до первого обращения к VKStorage.
+
+@param storeType тип хранилища записей
+*/
++ (void)setDefaultStoreType:(VKCachedDataStoreType)storeType;
+
+/** Используется ли многопроцессный режим при инициализации методами
+initWithCacheDirectory: и initWithCacheDirectory:storeType: (в том числе кэшами
+элементов VKStorage). По умолчанию NO.
+
+@return YES, если кэши по умолчанию инициализируются в многопроцессном режиме
+*/
++ (BOOL)defaultMultiProcess;
+
+/** Устанавливает многопроцессный режим, используемый при инициализации методами
+initWithCacheDirectory: и initWithCacheDirectory:storeType:. Значение следует
+устанавливать при запуске приложения (и каждого из его расширений), до первого
+обращения к VKStorage.
+
+@param multiProcess YES, если кэши по умолчанию используются несколькими процессами
+*/
++ (void)setDefaultMultiProcess:(BOOL)multiProcess;
+
 /**
 @name Методы манипуляции с кэшем
 */
@@ -90,6 +389,53 @@ typedef enum
 */
 - (void)removeCachedDataForURL:(NSURL *)url;
 
+/** Добавляет данные в кэш по ключу записи
+
+@param cache данные, которые необходимо закэшировать
+@param key ключ записи (см. VKCacheKey)
+@param cacheLiveTime время жизни кэша
+*/
+- (void)addCachedData:(NSData *)cache
+               forKey:(NSString *)key
+             liveTime:(VKCachedDataLiveTime)cacheLiveTime;
+
+/** Добавляет данные в кэш по ключу записи с указанием метода API, ответ
+которого кэшируется. Записи метода могут быть загружены в память методом
+warmUpEntriesForMethods:limit:.
+
+@param cache данные, которые необходимо закэшировать
+@param key ключ записи (см. VKCacheKey)
+@param methodName наименование метода API, либо nil
+@param cacheLiveTime время жизни кэша
+*/
+- (void)addCachedData:(NSData *)cache
+               forKey:(NSString *)key
+           methodName:(NSString *)methodName
+             liveTime:(VKCachedDataLiveTime)cacheLiveTime;
+
+/** Добавляет данные в кэш по ключу записи с указанием метода API и тегов записи.
+По тегам запись будет удалена методом invalidateCachedDataForTags:.
+
+@param cache данные, которые необходимо закэшировать
+@param key ключ записи (см. VKCacheKey)
+@param methodName наименование метода API, либо nil
+@param tags массив тегов записи (NSString), либо nil. Учитываются лишь первые
+kVKCacheIndexMaxTagCount тегов
+@param cacheLiveTime время жизни кэша
+*/
+- (void)addCachedData:(NSData *)cache
+               forKey:(NSString *)key
+           methodName:(NSString *)methodName
+                 tags:(NSArray *)tags
+             liveTime:(VKCachedDataLiveTime)cacheLiveTime;
+
+/** Удаление кэша по ключу записи
+
+@param key ключ записи (см. VKCacheKey)
+@return кол-во освобождённых байт
+*/
+- (NSUInteger)removeCachedDataForKey:(NSString *)key;
+
 /** Удаление всех закэшированных данных в директории, которой был инициализирован
 данный объект
 */
@@ -99,6 +445,61 @@ typedef enum
 */
 - (void)removeCachedDataDirectory;
 
+/** Немедленно записывает на диск все данные, ожидающие отложенной записи, и
+сохраняет индекс. Вызов синхронный, вызывается автоматически при уходе
+приложения в фон.
+*/
+- (void)flush;
+
+/**
+@name Инвалидация
+*/
+/** Удаляет все записи, помеченные хотя бы одним из указанных тегов (см.
+addCachedData:forKey:methodName:tags:liveTime:), в том числе ещё не записанные
+на диск
+
+@param tags массив тегов (NSString)
+@return кол-во удалённых записей
+*/
+- (NSUInteger)invalidateCachedDataForTags:(NSArray *)tags;
+
+/**
+@name Вытеснение
+*/
+/** Вытесняет записи в соответствии с политикой вытеснения до тех пор, пока
+суммарный размер кэша не станет меньше либо равен указанному
+
+@param size размер кэша (в байтах), до которого необходимо произвести вытеснение
+@return кол-во освобождённых байт
+*/
+- (NSUInteger)evictCachedDataToSize:(NSUInteger)size;
+
+/** Записи кэша в порядке вытеснения согласно политике evictionPolicy (первыми идут
+записи, которые должны быть вытеснены раньше остальных)
+
+@return массив объектов типа VKCacheIndexEntry
+*/
+- (NSArray *)evictionCandidates;
+
+/** Вытесняет записи с указанными ключами
+
+@param keys массив ключей записей (VKCacheIndexEntry.key)
+@return кол-во освобождённых байт
+*/
+- (NSUInteger)evictCachedDataForKeys:(NSArray *)keys;
+
+/** Удаляет записи, срок жизни которых истёк
+
+Удаление выполняется синхронно на очереди фонового обслуживания кэша (той же,
+на которой работает периодическая очистка, см. expirySweepInterval), поэтому
+не пересекается с ней. Если метод вызван с этой очереди, удаление выполняется
+сразу же, без повторной постановки в очередь.
+
+@param limit максимальное кол-во удаляемых записей
+@return кол-во освобождённых байт
+*/
+- (NSUInteger)removeExpiredCachedDataWithLimit:(NSUInteger)limit;
+
 /**
 @name Получение закэшированных данных
 */
@@ -129,4 +530,197 @@ YES и в кэше есть данные для этого URL, но срок и
 - (NSData *)cachedDataForURL:(NSURL *)url
                  offlineMode:(BOOL)offlineMode;
 
+/** Возвращает закэшированные данные по указанному URL с учётом времени, в течение
+которого допускается использование устаревших данных
+
+Если срок жизни данных истёк менее staleGraceTime секунд назад, то данные
+возвращаются (без удаления), а по указателю isStale записывается YES. Такие данные
+следует показать пользователю сразу, а затем обновить запросом к серверу.
+Данные, срок жизни которых истёк ранее, удаляются (если только не включен оффлайн
+режим, см. cachedDataForURL:offlineMode:).
+
+@param url URL, закэшированные данные по которому необходимо получить
+@param offlineMode оффлайн режим запроса кэша
+@param staleGraceTime время (в секундах) после истечения срока жизни данных, в течение
+которого они ещё могут быть использованы
+@param isStale указатель, по которому будет записано истёк ли срок жизни возвращаемых
+данных. Может быть NULL.
+@return экземпляр класса NSData, закэшированные данные указанного URL
+*/
+- (NSData *)cachedDataForURL:(NSURL *)url
+                 offlineMode:(BOOL)offlineMode
+              staleGraceTime:(NSTimeInterval)staleGraceTime
+                     isStale:(BOOL *)isStale;
+
+/** Возвращает закэшированные данные по ключу записи. Работает аналогично
+cachedDataForURL:offlineMode:staleGraceTime:isStale:
+
+@param key ключ записи (см. VKCacheKey)
+@param offlineMode оффлайн режим запроса кэша
+@param staleGraceTime время (в секундах) после истечения срока жизни данных, в течение
+которого они ещё могут быть использованы
+@param isStale указатель, по которому будет записано истёк ли срок жизни возвращаемых
+данных. Может быть NULL.
+@return экземпляр класса NSData, закэшированные данные
+*/
+- (NSData *)cachedDataForKey:(NSString *)key
+                 offlineMode:(BOOL)offlineMode
+              staleGraceTime:(NSTimeInterval)staleGraceTime
+                     isStale:(BOOL *)isStale;
+
+/** Возвращает закэшированные данные по ключу записи, учитывая обращение в
+статистике указанного метода API. Работает аналогично
+cachedDataForKey:offlineMode:staleGraceTime:isStale:
+
+@param key ключ записи (см. VKCacheKey)
+@param methodName наименование метода API, либо nil
+@param offlineMode оффлайн режим запроса кэша
+@param staleGraceTime время (в секундах) после истечения срока жизни данных, в течение
+которого они ещё могут быть использованы
+@param isStale указатель, по которому будет записано истёк ли срок жизни возвращаемых
+данных. Может быть NULL.
+@return экземпляр класса NSData, закэшированные данные
+*/
+- (NSData *)cachedDataForKey:(NSString *)key
+                  methodName:(NSString *)methodName
+                 offlineMode:(BOOL)offlineMode
+              staleGraceTime:(NSTimeInterval)staleGraceTime
+                     isStale:(BOOL *)isStale;
+
+/**
+@name Разобранные объекты
+*/
+/** Возвращает разобранный объект ответа по ключу записи, либо nil, если объекта
+нет в кэше (в этом случае следует получить данные методом
+cachedDataForKey:offlineMode:staleGraceTime:isStale:). Срок жизни объекта совпадает
+со сроком жизни данных, из которых он разобран, и проверяется так же.
+
+@param key ключ записи (см. VKCacheKey)
+@param offlineMode оффлайн режим запроса кэша
+@param staleGraceTime время (в секундах) после истечения срока жизни данных, в течение
+которого они ещё могут быть использованы
+@param isStale указатель, по которому будет записано истёк ли срок жизни возвращаемого
+объекта. Может быть NULL.
+@return разобранный объект (неизменяемый)
+*/
+- (id)cachedObjectForKey:(NSString *)key
+             offlineMode:(BOOL)offlineMode
+          staleGraceTime:(NSTimeInterval)staleGraceTime
+                 isStale:(BOOL *)isStale;
+
+/** Возвращает разобранный объект ответа по ключу записи, учитывая попадание в
+статистике указанного метода API. Отсутствие объекта промахом не считается - промах
+учитывается при последующем обращении к данным записи.
+
+@param key ключ записи (см. VKCacheKey)
+@param methodName наименование метода API, либо nil
+@param offlineMode оффлайн режим запроса кэша
+@param staleGraceTime время (в секундах) после истечения срока жизни данных, в течение
+которого они ещё могут быть использованы
+@param isStale указатель, по которому будет записано истёк ли срок жизни возвращаемого
+объекта. Может быть NULL.
+@return разобранный объект (неизменяемый)
+*/
+- (id)cachedObjectForKey:(NSString *)key
+              methodName:(NSString *)methodName
+             offlineMode:(BOOL)offlineMode
+          staleGraceTime:(NSTimeInterval)staleGraceTime
+                 isStale:(BOOL *)isStale;
+
+/** Сохраняет разобранный объект ответа. Объект сохраняется, только если данные
+записи с этим ключом не изменились с момента их получения, и удаляется вместе с
+ними.
+
+@param object разобранный объект. Объект должен быть неизменяемым - он передаётся
+всем последующим получателям без копирования.
+@param data данные записи, из которых разобран объект: тот же экземпляр, что был
+передан addCachedData:forKey:methodName:tags:liveTime: или получен из кэша. Данные
+сравниваются по указателю, поэтому для NSMutableData, копию которых сохраняет кэш,
+объект сохранён не будет - передайте в оба метода одну неизменяемую копию.
+@param key ключ записи (см. VKCacheKey)
+*/
+- (void)setCachedObject:(id)object
+         parsedFromData:(NSData *)data
+                 forKey:(NSString *)key;
+
+/**
+@name Прогрев
+*/
+/** Загружает в кэш в оперативной памяти записи с указанными ключами.
+Загрузка выполняется асинхронно в фоне с низким приоритетом и не влияет на
+статистику обращений к записям. Записи, которые уже находятся в памяти, ожидают
+записи на диск или давно устарели, пропускаются. Загружается не более
+memoryCacheSize байт.
+
+@param keys массив ключей записей (см. VKCacheKey)
+*/
+- (void)warmUpEntriesForKeys:(NSArray *)keys;
+
+/** Загружает в кэш в оперативной памяти записи, к которым обращались последними
+
+@param count максимальное кол-во загружаемых записей
+*/
+- (void)warmUpRecentlyUsedEntries:(NSUInteger)count;
+
+/** Загружает в кэш в оперативной памяти последние использованные записи указанных
+методов API (см. addCachedData:forKey:methodName:liveTime:)
+
+@param methodNames массив наименований методов API (users.get, friends.get etc)
+@param limit максимальное кол-во загружаемых записей
+*/
+- (void)warmUpEntriesForMethods:(NSArray *)methodNames
+                          limit:(NSUInteger)limit;
+
+/** Загружает в кэш в оперативной памяти "горячий" набор записей, сохранённый в
+предыдущих сеансах работы (см. hotSetKeys). Повторные вызовы игнорируются.
+*/
+- (void)warmUpHotSet;
+
+/**
+@name Пакеты кэша
+*/
+/** Сохраняет снимок кэша в файл пакета (см. VKCachePack). Записи ждущие записи
+на диск предварительно записываются, давно устаревшие записи (см.
+staleRetentionTime) в пакет не попадают. Вызов синхронный - его не следует
+выполнять в главном потоке.
+
+@param path путь к файлу пакета
+@return YES, если пакет сохранён
+*/
+- (BOOL)exportPackToFile:(NSString *)path;
+
+/** Добавляет записи кэша в строящийся пакет (используется для сохранения
+нескольких кэшей в один пакет, см. VKStorage exportCachePackToFile:)
+
+@param writer построитель пакета
+@param sectionName наименование раздела пакета, в который добавляются записи
+@return кол-во добавленных записей
+*/
+- (NSUInteger)exportEntriesToPackWriter:(VKCachePackWriter *)writer
+                                section:(NSString *)sectionName;
+
+/** Импортирует записи раздела kVKCachePackDefaultSectionName пакета (либо
+единственного раздела, если пакет состоит из одного раздела). См.
+importPackFromFile:section:.
+
+@param path путь к файлу пакета
+@return кол-во импортированных записей
+*/
+- (NSUInteger)importPackFromFile:(NSString *)path;
+
+/** Импортирует записи раздела пакета.
+
+Пакет из одного раздела копируется в директорию кэша целиком, из раздела
+пакета с несколькими разделами строится отдельный пакет. Ранее импортированный
+пакет замещается, записи, данные которых находились лишь в нём, удаляются.
+Записи кэша, созданные позже одноимённых записей пакета, сохраняются. Вызов
+синхронный - его не следует выполнять в главном потоке.
+
+@param path путь к файлу пакета
+@param sectionName наименование раздела пакета
+@return кол-во импортированных записей
+*/
+- (NSUInteger)importPackFromFile:(NSString *)path
+                         section:(NSString *)sectionName;
+
 @end
\ No newline at end of file
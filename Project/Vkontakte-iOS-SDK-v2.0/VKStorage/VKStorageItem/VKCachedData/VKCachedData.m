@@ -24,45 +24,365 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
 // THE SOFTWARE.
 //
+#import <TargetConditionals.h>
+#if TARGET_OS_IPHONE
+#import <UIKit/UIKit.h>
+#endif
+#import <unistd.h>
 #import "VKCachedData.h"
-#import "NSString+MD5.h"
+#import "VKLRUCache.h"
+#import "VKCachedDataRecord.h"
+#import "VKCachedDataFileStore.h"
+#import "VKCachedDataSegmentStore.h"
+#import "VKCachedDataWriter.h"
+#import "VKCacheIndex.h"
+#import "VKCacheKey.h"
+#import "VKCacheDirectoryLock.h"
+#import "VKCachePack.h"
 
 
+// методы поиска и записи данных вызываются на каждый запрос, поэтому не
+// журналируются; в остальных методах журнал ведётся лишь в отладочной сборке
+#ifdef DEBUG
 #define INFO_LOG() NSLog(@"%s", __FUNCTION__)
+#else
+#define INFO_LOG()
+#endif
+
+
+/** Запись кэша в оперативной памяти: данные записи, либо разобранный из них объект
+*/
+@interface VKCachedDataMemoryEntry : NSObject
+
+@property (nonatomic, strong) NSData *data;
+@property (nonatomic, strong) id object;
+@property (nonatomic, assign) VKCachedDataLiveTime liveTime;
+@property (nonatomic, assign) NSUInteger creationTimestamp;
+
+@end
+
+@implementation VKCachedDataMemoryEntry
+@end
+
+
+@interface VKCachedData () <VKCachedDataWriterDelegate, VKCacheIndexDelegate>
+@end
+
+
+// тип хранилища записей, используемый при инициализации методом initWithCacheDirectory:
+static VKCachedDataStoreType VKCachedDataDefaultStoreType = VKCachedDataStoreTypeFiles;
+
+// многопроцессный режим, используемый при инициализации методами initWithCacheDirectory:
+// и initWithCacheDirectory:storeType:
+static BOOL VKCachedDataDefaultMultiProcess = NO;
+
+// ключ, под которым очередь _maintenanceQueue хранит указатель на свой кэш (см.
+// dispatch_queue_set_specific) - по нему определяется, выполняется ли код на ней
+static char kVKCachedDataMaintenanceQueueKey;
+
+// обращается к каждой странице данных, отображённых в память, - страницы
+// загружаются с диска сейчас, а не при первом обращении к данным
+static void VKCachedDataTouchPages(NSData *data)
+{
+    const volatile uint8_t *bytes = [data bytes];
+    NSUInteger length = [data length];
+    NSUInteger pageSize = (NSUInteger) getpagesize();
+
+    for (NSUInteger offset = 0; offset < length; offset += pageSize)
+        (void) bytes[offset];
+}
 
 
 @implementation VKCachedData
 {
     NSString *_cacheDirectoryPath;
+    id <VKCachedDataStore> _store;
+    VKCachedDataWriter *_writer;
 
     dispatch_queue_t _backgroundQueue;
+
+    VKLRUCache *_memoryCache;
+    VKLRUCache *_objectCache;
+    VKCacheIndex *_index;
+
+//    блокировка директории, общая для всех процессов (только в многопроцессном режиме)
+    VKCacheDirectoryLock *_lock;
+
+//    импортированный пакет, данные записей которого читаются прямо из него;
+//    доступ синхронизируется по self
+    VKCachePack *_pack;
+
+//    последовательная очередь фоновых работ по обслуживанию кэша (вытеснение,
+//    очистка от записей с истёкшим сроком жизни)
+    dispatch_queue_t _maintenanceQueue;
+    dispatch_source_t _expirySweepTimer;
+
+//    "горячий" набор: ключи записей текущего сеанса в порядке первого обращения
+//    к ним и набор, сохранённый в предыдущих сеансах; доступ синхронизируется по self
+    NSMutableOrderedSet *_sessionHotSetKeys;
+    NSArray *_hotSetKeys;
+    NSUInteger _savedHotSetCount;
+    BOOL _isHotSetWarmedUp;
 }
 
 #pragma mark Visible VKCachedData methods
+#pragma mark - class methods
+
++ (VKCachedDataStoreType)defaultStoreType
+{
+    return VKCachedDataDefaultStoreType;
+}
+
++ (void)setDefaultStoreType:(VKCachedDataStoreType)storeType
+{
+    VKCachedDataDefaultStoreType = storeType;
+}
+
++ (BOOL)defaultMultiProcess
+{
+    return VKCachedDataDefaultMultiProcess;
+}
+
++ (void)setDefaultMultiProcess:(BOOL)multiProcess
+{
+    VKCachedDataDefaultMultiProcess = multiProcess;
+}
+
 #pragma mark - init methods
 
 - (instancetype)initWithCacheDirectory:(NSString *)path
 {
     INFO_LOG();
 
+    return [self initWithCacheDirectory:path
+                              storeType:[VKCachedData defaultStoreType]];
+}
+
+- (instancetype)initWithCacheDirectory:(NSString *)path
+                             storeType:(VKCachedDataStoreType)storeType
+{
+    INFO_LOG();
+
+    return [self initWithCacheDirectory:path
+                              storeType:storeType
+                           multiProcess:[VKCachedData defaultMultiProcess]];
+}
+
+- (instancetype)initWithCacheDirectory:(NSString *)path
+                             storeType:(VKCachedDataStoreType)storeType
+                          multiProcess:(BOOL)multiProcess
+{
+    INFO_LOG();
+
     self = [super init];
 
     if (self) {
         [self createDirectoryIfNotExists:path];
         _backgroundQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0);
+        _memoryCache = [[VKLRUCache alloc]
+                                    initWithTotalCostLimit:kVKCachedDataDefaultMemoryCacheSize];
+        _objectCache = [[VKLRUCache alloc]
+                                    initWithTotalCostLimit:kVKCachedDataDefaultObjectCacheSize];
 
         _cacheDirectoryPath = [path copy];
+
+//        положение записей в сегментах журнала известно лишь процессу, который
+//        их записал, поэтому несколько процессов работают только с файлами записей
+        _isMultiProcess = multiProcess;
+        _storeType = (multiProcess ? VKCachedDataStoreTypeFiles : storeType);
+
+        if (multiProcess)
+            _lock = [[VKCacheDirectoryLock alloc]
+                                           initWithPath:[_cacheDirectoryPath stringByAppendingString:kVKCacheDirectoryLockFileName]];
+
+        if (VKCachedDataStoreTypeSegments == _storeType)
+            _store = [[VKCachedDataSegmentStore alloc] initWithDirectory:_cacheDirectoryPath];
+        else
+            _store = [[VKCachedDataFileStore alloc] initWithDirectory:_cacheDirectoryPath];
+
+        _statistics = [[VKCacheStatistics alloc] init];
+
+        _writer = [[VKCachedDataWriter alloc] initWithStore:_store];
+        _writer.delegate = self;
+        _writer.statistics = _statistics;
+        _writer.lock = _lock;
+
+        _pack = [VKCachePack packWithContentsOfFile:[self packFilePath]];
+
+        _maxCacheSize = 0;
+        _evictionPolicy = VKCachedDataEvictionPolicyLRU;
+        _maintenanceQueue = dispatch_queue_create("com.vk.cacheddata.maintenance", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_maintenanceQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+        dispatch_queue_set_specific(_maintenanceQueue, &kVKCachedDataMaintenanceQueueKey, (__bridge void *) self, NULL);
+
+//        индекс отсутствует (первый запуск, либо файл индекса повреждён) -
+//        восстанавливаем по заголовкам записей
+        _index = [[VKCacheIndex alloc]
+                                initWithContentsOfFile:[_cacheDirectoryPath stringByAppendingString:kVKCacheIndexFileName]
+                                                  lock:_lock];
+        _index.delegate = self;
+
+        if (!_index.isLoaded) {
+//            индекс мог быть восстановлен другим процессом, пока блокировка
+//            была свободна
+            [_lock lock];
+
+            if ([_index isChangedOnDisk])
+                [_index synchronize];
+            else
+                [self rebuildIndex];
+
+            [_index saveIfNeeded];
+            [_lock unlock];
+        } else {
+//            записи, сохранённые после последнего сохранения индекса, добавляются
+//            в индекс в фоне - до первой порции операций отложенной записи
+            __weak VKCachedData *weakSelf = self;
+
+            [_writer performBlockBetweenBatches:^
+            {
+                VKCachedData *strongSelf = weakSelf;
+
+                if (nil == strongSelf)
+                    return;
+
+                if (nil != strongSelf->_lock)
+                    [strongSelf->_index synchronize];
+
+                [strongSelf reconcileStoreWithIndex];
+                [strongSelf->_index saveIfNeeded];
+            }];
+        }
+
+        _hotSetKeys = [self loadHotSetKeys];
+        _sessionHotSetKeys = [[NSMutableOrderedSet alloc] init];
+
+        _expirySweepBatchSize = kVKCachedDataDefaultExpirySweepBatchSize;
+        _staleRetentionTime = kVKCachedDataDefaultStaleRetentionTime;
+        _compression = VKCachedDataCompressionLZ4;
+        _compressionThreshold = kVKCachedDataDefaultCompressionThreshold;
+        self.expirySweepInterval = kVKCachedDataDefaultExpirySweepInterval;
+
+#if TARGET_OS_IPHONE
+//        при нехватке памяти кэш в оперативной памяти будет восстановлен с диска
+        [[NSNotificationCenter defaultCenter]
+                               addObserver:self
+                                  selector:@selector(didReceiveMemoryWarning:)
+                                      name:UIApplicationDidReceiveMemoryWarningNotification
+                                    object:nil];
+
+//        несохранённые изменения индекса сохраняем при уходе приложения в фон
+        [[NSNotificationCenter defaultCenter]
+                               addObserver:self
+                                  selector:@selector(applicationDidEnterBackground:)
+                                      name:UIApplicationDidEnterBackgroundNotification
+                                    object:nil];
+#endif
     }
 
     return self;
 }
 
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+
+    if (nil != _expirySweepTimer)
+        dispatch_source_cancel(_expirySweepTimer);
+}
+
+#pragma mark - Getters & Setters
+
+- (NSUInteger)memoryCacheSize
+{
+    return _memoryCache.totalCostLimit;
+}
+
+- (void)setMemoryCacheSize:(NSUInteger)memoryCacheSize
+{
+    _memoryCache.totalCostLimit = memoryCacheSize;
+}
+
+- (NSUInteger)objectCacheSize
+{
+    return _objectCache.totalCostLimit;
+}
+
+- (void)setObjectCacheSize:(NSUInteger)objectCacheSize
+{
+    _objectCache.totalCostLimit = objectCacheSize;
+}
+
+- (void)setMaxCacheSize:(NSUInteger)maxCacheSize
+{
+    _maxCacheSize = maxCacheSize;
+
+//    при уменьшении допустимого размера лишние записи вытесняются сразу
+    [self scheduleEviction];
+}
+
+- (void)setExpirySweepInterval:(NSTimeInterval)expirySweepInterval
+{
+    _expirySweepInterval = expirySweepInterval;
+
+    if (nil != _expirySweepTimer) {
+        dispatch_source_cancel(_expirySweepTimer);
+        _expirySweepTimer = nil;
+    }
+
+    if (expirySweepInterval <= 0)
+        return;
+
+//    очистка не привязана к точному времени - даём системе свободу объединить
+//    её с другими пробуждениями
+    uint64_t interval = (uint64_t) (expirySweepInterval * NSEC_PER_SEC);
+    __weak VKCachedData *weakSelf = self;
+
+    _expirySweepTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _maintenanceQueue);
+    dispatch_source_set_timer(_expirySweepTimer,
+                              dispatch_time(DISPATCH_TIME_NOW, (int64_t) interval),
+                              interval,
+                              interval / 10);
+    dispatch_source_set_event_handler(_expirySweepTimer, ^
+    {
+        VKCachedData *strongSelf = weakSelf;
+
+        [strongSelf sweepExpiredCachedDataWithLimit:strongSelf.expirySweepBatchSize];
+    });
+    dispatch_resume(_expirySweepTimer);
+}
+
+- (NSUInteger)count
+{
+    return _index.count;
+}
+
+- (NSUInteger)size
+{
+    return _index.totalSize;
+}
+
+- (NSUInteger)logicalSize
+{
+    return _index.totalLogicalSize;
+}
+
+- (NSUInteger)referencedSize
+{
+    return _index.totalReferencedSize;
+}
+
+- (NSArray *)hotSetKeys
+{
+    @synchronized (self) {
+        return _hotSetKeys;
+    }
+}
+
 #pragma mark - cache manipulation
 
 - (void)addCachedData:(NSData *)cache forURL:(NSURL *)url
 {
-    INFO_LOG();
-
     [self addCachedData:cache
                  forURL:url
                liveTime:VKCachedDataLiveTimeOneHour];
@@ -72,61 +392,151 @@
                forURL:(NSURL *)url
              liveTime:(VKCachedDataLiveTime)cacheLiveTime
 {
-    INFO_LOG();
+    [self addCachedData:cache
+                 forKey:[VKCacheKey keyForURL:url]
+               liveTime:cacheLiveTime];
+}
+
+- (void)addCachedData:(NSData *)cache
+               forKey:(NSString *)key
+             liveTime:(VKCachedDataLiveTime)cacheLiveTime
+{
+    [self addCachedData:cache
+                 forKey:key
+             methodName:nil
+               liveTime:cacheLiveTime];
+}
+
+- (void)addCachedData:(NSData *)cache
+               forKey:(NSString *)key
+           methodName:(NSString *)methodName
+             liveTime:(VKCachedDataLiveTime)cacheLiveTime
+{
+    [self addCachedData:cache
+                 forKey:key
+             methodName:methodName
+                   tags:nil
+               liveTime:cacheLiveTime];
+}
 
+- (void)addCachedData:(NSData *)cache
+               forKey:(NSString *)key
+           methodName:(NSString *)methodName
+                 tags:(NSArray *)tags
+             liveTime:(VKCachedDataLiveTime)cacheLiveTime
+{
 //    нет надобности сохранять в кэше запрос с таким временем жизни
     if(VKCachedDataLiveTimeNever == cacheLiveTime)
         return;
 
+//    пустые данные не кэшируем, но и устаревшие оставлять нельзя
+    if (nil == cache) {
+        [self removeCachedDataForKey:key];
+        return;
+    }
+
 //    сохраняем данные запроса в кэше
-    NSString *encodedCachedURL = [[url absoluteString] md5];
-    NSString *filePath = [_cacheDirectoryPath stringByAppendingFormat:@"%@",
-                                                                      encodedCachedURL];
     NSUInteger creationTimestamp = ((NSUInteger) [[NSDate date]
                                                           timeIntervalSince1970]);
 
-    NSDictionary *options = @{@"liveTime"          : @(cacheLiveTime),
-                              @"data"              : (cache == nil ? [NSNull null] : cache),
-                              @"creationTimestamp" : @(creationTimestamp)};
+//    единственная копия данных (для неизменяемых NSData копирования не происходит)
+    NSData *payload = [cache copy];
 
-    dispatch_async(_backgroundQueue, ^
-    {
-        [options writeToFile:filePath
-                  atomically:YES];
-    });
+//    кэш в оперативной памяти обновляется синхронно, поэтому повторный запрос
+//    сразу после добавления не зависит от завершения записи на диск
+    [_objectCache removeObjectForKey:key];
+    [self storeMemoryEntryWithData:payload
+                            forKey:key
+                          liveTime:cacheLiveTime
+                 creationTimestamp:creationTimestamp];
+
+//    небольшие записи не сжимаем - выигрыш меньше затрат на сжатие и распаковку
+    VKCachedDataCompression compression = ([payload length] < _compressionThreshold ?
+            VKCachedDataCompressionNone : _compression);
+
+//    запись на диск откладывается: повторные записи того же ключа объединяются,
+//    запись в индексе появится после того, как данные окажутся на диске
+    [_writer writeRecordWithPayload:payload
+                           liveTime:cacheLiveTime
+                  creationTimestamp:creationTimestamp
+                        compression:compression
+                         methodHash:[VKCacheKey hashForMethod:methodName]
+                          tagHashes:[self hashesForTags:tags]
+                             forKey:key];
 }
 
 - (void)removeCachedDataForURL:(NSURL *)url
 {
-    INFO_LOG();
+    [self removeCachedDataForKey:[VKCacheKey keyForURL:url]];
+}
+
+- (NSUInteger)removeCachedDataForKey:(NSString *)key
+{
+    NSUInteger freedSize = 0;
 
-    NSString *encodedCachedURL = [[url absoluteString] md5];
-    NSString *filePath = [_cacheDirectoryPath stringByAppendingFormat:@"%@",
-                                                                      encodedCachedURL];
+    [self removeEntryForKey:key
+                  freedSize:&freedSize];
 
-    dispatch_async(_backgroundQueue, ^
-    {
-        [[NSFileManager defaultManager] removeItemAtPath:filePath
-                                                   error:nil];
-    });
+    return freedSize;
+}
+
+- (NSUInteger)invalidateCachedDataForTags:(NSArray *)tags
+{
+    NSMutableSet *keys = [NSMutableSet set];
+
+//    записи находятся по тегам через индекс, а ещё не записанные на диск - через
+//    очередь отложенной записи
+    for (NSNumber *tagHash in [self hashesForTags:tags]) {
+        [keys addObjectsFromArray:[_index keysForTagHash:[tagHash unsignedIntValue]]];
+        [keys addObjectsFromArray:[_writer pendingKeysForTagHash:[tagHash unsignedIntValue]]];
+    }
+
+    NSUInteger invalidatedCount = 0;
+
+    for (NSString *key in keys) {
+        VKCachedDataWriteOperation *pendingOperation = [_writer pendingOperationForKey:key];
+        VKCacheIndexEntry *removedEntry = [self removeEntryForKey:key
+                                                        freedSize:NULL];
+
+        if (nil == removedEntry && nil == pendingOperation.payload)
+            continue;
+
+        uint32_t methodHash = (nil != removedEntry ? removedEntry.methodHash : pendingOperation.methodHash);
+
+        [_statistics recordEvent:VKCacheStatisticsEventInvalidation
+                      methodName:[_statistics methodNameForHash:methodHash]];
+
+        invalidatedCount++;
+    }
+
+    return invalidatedCount;
 }
 
 - (void)clearCachedData
 {
     INFO_LOG();
 
-    dispatch_async(_backgroundQueue, ^{
+    [_writer removeAllRecords];
 
-        [[NSFileManager defaultManager]
-                        removeItemAtPath:_cacheDirectoryPath
-                                   error:nil];
+    [_memoryCache removeAllObjects];
+    [_objectCache removeAllObjects];
+    [_index removeAllEntries];
 
-        [[NSFileManager defaultManager]
-                        createDirectoryAtPath:_cacheDirectoryPath
-                  withIntermediateDirectories:YES
-                                   attributes:nil
-                                        error:nil];
+    @synchronized (self) {
+        _hotSetKeys = @[];
+        [_sessionHotSetKeys removeAllObjects];
+        _savedHotSetCount = 0;
+        _pack = nil;
+    }
 
+    dispatch_async(_backgroundQueue, ^{
+
+        [[NSFileManager defaultManager] removeItemAtPath:[self hotSetFilePath]
+                                                   error:nil];
+        [[NSFileManager defaultManager] removeItemAtPath:[self packFilePath]
+                                                   error:nil];
+
+        [self flush];
     });
 }
 
@@ -134,53 +544,1132 @@
 {
     INFO_LOG();
 
+    [_writer removeAllRecords];
+
+    [_memoryCache removeAllObjects];
+    [_objectCache removeAllObjects];
+    [_index removeAllEntries];
+
+    @synchronized (self) {
+        _pack = nil;
+    }
+
     dispatch_async(_backgroundQueue, ^{
 
+        [_writer flush];
+
+//        файл блокировки должен остаться на месте: другие процессы продолжают
+//        работать с директорией, удерживая открытым именно его
+        if (nil != _lock) {
+            [self removeCachedDataDirectoryContents];
+            return;
+        }
+
         [[NSFileManager defaultManager] removeItemAtPath:_cacheDirectoryPath
                                                    error:nil];
 
     });
 }
 
-- (NSData *)cachedDataForURL:(NSURL *)url
+- (void)flush
+{
+    INFO_LOG();
+
+    [_writer flush];
+    [_index flush];
+    [self saveHotSet];
+}
+
+#pragma mark - eviction
+
+- (NSUInteger)evictCachedDataToSize:(NSUInteger)size
+{
+    INFO_LOG();
+
+    NSUInteger currentSize = _index.totalSize;
+    NSUInteger freedSize = 0;
+
+    if (currentSize <= size)
+        return 0;
+
+    for (VKCacheIndexEntry *entry in [self evictionCandidates]) {
+        if (currentSize - freedSize <= size)
+            break;
+
+        freedSize += [self evictEntryForKey:entry.key];
+    }
+
+    return freedSize;
+}
+
+- (NSArray *)evictionCandidates
+{
+    INFO_LOG();
+
+    return [_index entriesSortedForEvictionPolicy:_evictionPolicy];
+}
+
+- (NSUInteger)evictCachedDataForKeys:(NSArray *)keys
+{
+    INFO_LOG();
+
+    NSUInteger freedSize = 0;
+
+    for (NSString *key in keys)
+        freedSize += [self evictEntryForKey:key];
+
+    return freedSize;
+}
+
+- (NSUInteger)removeExpiredCachedDataWithLimit:(NSUInteger)limit
 {
     INFO_LOG();
 
+//    синхронный вызов на собственной очереди привёл бы к взаимной блокировке
+    if ((__bridge void *) self == dispatch_get_specific(&kVKCachedDataMaintenanceQueueKey))
+        return [self sweepExpiredCachedDataWithLimit:limit];
+
+    __block NSUInteger freedSize;
+
+    dispatch_sync(_maintenanceQueue, ^
+    {
+        freedSize = [self sweepExpiredCachedDataWithLimit:limit];
+    });
+
+    return freedSize;
+}
+
+#pragma mark - reading cached data
+
+- (NSData *)cachedDataForURL:(NSURL *)url
+{
     return [self cachedDataForURL:url
                       offlineMode:NO];
 }
 
 - (NSData *)cachedDataForURL:(NSURL *)url offlineMode:(BOOL)offlineMode
 {
-    INFO_LOG();
+    return [self cachedDataForURL:url
+                      offlineMode:offlineMode
+                   staleGraceTime:0
+                          isStale:NULL];
+}
+
+- (NSData *)cachedDataForURL:(NSURL *)url
+                 offlineMode:(BOOL)offlineMode
+              staleGraceTime:(NSTimeInterval)staleGraceTime
+                     isStale:(BOOL *)isStale
+{
+    return [self cachedDataForKey:[VKCacheKey keyForURL:url]
+                      offlineMode:offlineMode
+                   staleGraceTime:staleGraceTime
+                          isStale:isStale];
+}
 
-    NSString *encodedCachedURL = [[url absoluteString] md5];
-    NSString *filePath = [_cacheDirectoryPath stringByAppendingFormat:@"%@",
-                                                                      encodedCachedURL];
+- (NSData *)cachedDataForKey:(NSString *)key
+                 offlineMode:(BOOL)offlineMode
+              staleGraceTime:(NSTimeInterval)staleGraceTime
+                     isStale:(BOOL *)isStale
+{
+    return [self cachedDataForKey:key
+                       methodName:nil
+                      offlineMode:offlineMode
+                   staleGraceTime:staleGraceTime
+                          isStale:isStale];
+}
 
-    if (![[NSFileManager defaultManager] fileExistsAtPath:filePath])
-        return nil;
+- (NSData *)cachedDataForKey:(NSString *)key
+                  methodName:(NSString *)methodName
+                 offlineMode:(BOOL)offlineMode
+              staleGraceTime:(NSTimeInterval)staleGraceTime
+                     isStale:(BOOL *)isStale
+{
+    uint64_t startTimestamp = VKCacheStatisticsTimestamp();
+    NSData *cachedData = nil;
+    VKCacheIndexEntry *indexEntry = nil;
+    NSUInteger liveTime;
+    NSUInteger creationTimestamp;
+
+    [self synchronizeIndexIfChangedOnDisk];
+
+//    сначала проверяем кэш в оперативной памяти, промах и истечение срока жизни
+//    записи на диске определяются по индексу, без обращения к диску
+    VKCachedDataMemoryEntry *memoryEntry = [_memoryCache objectForKey:key];
+
+//    данные, ещё не записанные на диск, берутся из очереди отложенной записи
+    VKCachedDataWriteOperation *pendingOperation = (nil == memoryEntry ? [_writer pendingOperationForKey:key] : nil);
 
-//    загружаем файл, получаем свойства
-    NSDictionary *cachedFile = [NSDictionary dictionaryWithContentsOfFile:filePath];
+    if (nil != memoryEntry) {
+        cachedData = memoryEntry.data;
+        liveTime = memoryEntry.liveTime;
+        creationTimestamp = memoryEntry.creationTimestamp;
+    } else if (nil != pendingOperation) {
+//        запись ожидает удаления
+        if (nil == pendingOperation.payload) {
+            [self recordLookupEvent:VKCacheStatisticsEventMiss
+                     sinceTimestamp:startTimestamp
+                         methodName:methodName];
+            return nil;
+        }
 
-    VKCachedDataLiveTime liveTime = (VKCachedDataLiveTime) [cachedFile[@"liveTime"] integerValue];
-    NSData *cachedData = cachedFile[@"data"];
-    NSUInteger creationTimestamp = [cachedFile[@"creationTimestamp"] unsignedIntegerValue];
+        cachedData = pendingOperation.payload;
+        liveTime = pendingOperation.liveTime;
+        creationTimestamp = pendingOperation.creationTimestamp;
+    } else {
+        indexEntry = [_index entryForKey:key];
 
-//    определяем наши действия в соответствии с указанным временем жизни кэша запроса
-    NSUInteger currentTimestamp = ((NSUInteger) [[NSDate date]
-                                                         timeIntervalSince1970]);
-    if (!offlineMode && (creationTimestamp + liveTime) < currentTimestamp) {
-        [self removeCachedDataForURL:url];
+        if (nil == indexEntry) {
+            [self recordLookupEvent:VKCacheStatisticsEventMiss
+                     sinceTimestamp:startTimestamp
+                         methodName:methodName];
+            return nil;
+        }
+
+//        метод записи известен по индексу, даже если он не указан явно
+        if (nil == methodName)
+            methodName = [_statistics methodNameForHash:indexEntry.methodHash];
+
+        liveTime = indexEntry.liveTime;
+        creationTimestamp = indexEntry.creationTimestamp;
+    }
+
+    NSUInteger currentTimestamp = [self currentTimestamp];
+    BOOL expired = NO;
+
+    if (![self isUsableEntryWithLiveTime:liveTime
+                       creationTimestamp:creationTimestamp
+                             offlineMode:offlineMode
+                          staleGraceTime:staleGraceTime
+                                 expired:&expired]) {
+        [self removeCachedDataForKey:key];
+
+        [_statistics recordEvent:VKCacheStatisticsEventExpiration
+                      methodName:methodName];
+        [self recordLookupEvent:VKCacheStatisticsEventMiss
+                 sinceTimestamp:startTimestamp
+                     methodName:methodName];
         return nil;
     }
 
-//    кэш действителен
+    if (nil == cachedData) {
+//        отображаем файл записи в память: несжатые данные не копируются, сжатые
+//        распаковываются и остаются в кэше в оперативной памяти
+        uint64_t readStartTimestamp = VKCacheStatisticsTimestamp();
+        VKCachedDataRecord *record = [self recordForEntry:indexEntry];
+
+        if (nil == record) {
+//            файл повреждён или отсутствует - индекс устарел
+            [self removeCachedDataForKey:key];
+
+            [self recordLookupEvent:VKCacheStatisticsEventMiss
+                     sinceTimestamp:startTimestamp
+                         methodName:methodName];
+            return nil;
+        }
+
+        cachedData = record.payload;
+
+        [_statistics recordLatencySinceTimestamp:readStartTimestamp
+                                       operation:VKCacheStatisticsOperationRead
+                                      methodName:methodName];
+        [_statistics recordBytesRead:record.storedLength
+                          methodName:methodName];
+
+        [self storeMemoryEntryWithData:cachedData
+                                forKey:key
+                              liveTime:(VKCachedDataLiveTime) liveTime
+                     creationTimestamp:creationTimestamp];
+    }
+
+    if (NULL != isStale)
+        *isStale = expired;
+
+//    кэш может быть использован, отмечаем обращение для политики вытеснения
+    [_index touchEntryForKey:key
+                 atTimestamp:currentTimestamp];
+    [self recordHotSetKey:key];
+
+    [self recordLookupEvent:(expired ? VKCacheStatisticsEventStaleHit : VKCacheStatisticsEventHit)
+             sinceTimestamp:startTimestamp
+                 methodName:methodName];
+
     return cachedData;
 }
 
-#pragma mark - private methods
+#pragma mark - parsed objects
+
+- (id)cachedObjectForKey:(NSString *)key
+             offlineMode:(BOOL)offlineMode
+          staleGraceTime:(NSTimeInterval)staleGraceTime
+                 isStale:(BOOL *)isStale
+{
+    return [self cachedObjectForKey:key
+                         methodName:nil
+                        offlineMode:offlineMode
+                     staleGraceTime:staleGraceTime
+                            isStale:isStale];
+}
+
+- (id)cachedObjectForKey:(NSString *)key
+              methodName:(NSString *)methodName
+             offlineMode:(BOOL)offlineMode
+          staleGraceTime:(NSTimeInterval)staleGraceTime
+                 isStale:(BOOL *)isStale
+{
+    uint64_t startTimestamp = VKCacheStatisticsTimestamp();
+
+    [self synchronizeIndexIfChangedOnDisk];
+
+    VKCachedDataMemoryEntry *objectEntry = [_objectCache objectForKey:key];
+
+    if (nil == objectEntry)
+        return nil;
+
+    BOOL expired = NO;
+
+    if (![self isUsableEntryWithLiveTime:objectEntry.liveTime
+                       creationTimestamp:objectEntry.creationTimestamp
+                             offlineMode:offlineMode
+                          staleGraceTime:staleGraceTime
+                                 expired:&expired]) {
+        [self removeCachedDataForKey:key];
+
+//        промах будет учтён при обращении к данным записи
+        [_statistics recordEvent:VKCacheStatisticsEventExpiration
+                      methodName:methodName];
+        return nil;
+    }
+
+    if (NULL != isStale)
+        *isStale = expired;
+
+    [_index touchEntryForKey:key
+                 atTimestamp:[self currentTimestamp]];
+    [self recordHotSetKey:key];
+
+    [self recordLookupEvent:(expired ? VKCacheStatisticsEventStaleHit : VKCacheStatisticsEventHit)
+             sinceTimestamp:startTimestamp
+                 methodName:methodName];
+
+    return objectEntry.object;
+}
+
+- (void)setCachedObject:(id)object
+         parsedFromData:(NSData *)data
+                 forKey:(NSString *)key
+{
+    if (nil == object || nil == data || nil == key)
+        return;
+
+    NSUInteger liveTime;
+    NSUInteger creationTimestamp;
+
+//    объект привязывается к той версии данных, из которой он разобран: если данные
+//    успели обновиться, то объект не сохраняется
+    VKCachedDataMemoryEntry *memoryEntry = [_memoryCache objectForKey:key];
+    VKCachedDataWriteOperation *pendingOperation = (nil == memoryEntry ? [_writer pendingOperationForKey:key] : nil);
+
+    if (nil != memoryEntry) {
+        if (memoryEntry.data != data)
+            return;
+
+        liveTime = memoryEntry.liveTime;
+        creationTimestamp = memoryEntry.creationTimestamp;
+    } else if (nil != pendingOperation) {
+        if (pendingOperation.payload != data)
+            return;
+
+        liveTime = pendingOperation.liveTime;
+        creationTimestamp = pendingOperation.creationTimestamp;
+    } else {
+        VKCacheIndexEntry *indexEntry = [_index entryForKey:key];
+
+        if (nil == indexEntry || indexEntry.logicalSize != [data length])
+            return;
+
+        liveTime = indexEntry.liveTime;
+        creationTimestamp = indexEntry.creationTimestamp;
+    }
+
+    VKCachedDataMemoryEntry *objectEntry = [[VKCachedDataMemoryEntry alloc] init];
+    objectEntry.object = object;
+    objectEntry.liveTime = (VKCachedDataLiveTime) liveTime;
+    objectEntry.creationTimestamp = creationTimestamp;
+
+//    размер разобранного объекта оценивается размером данных, из которых он получен
+    [_objectCache setObject:objectEntry
+                     forKey:key
+                       cost:[data length]];
+}
+
+#pragma mark - warm up
+
+- (void)warmUpEntriesForKeys:(NSArray *)keys
+{
+    INFO_LOG();
+
+    NSArray *warmUpKeys = [keys copy];
+
+    dispatch_async(_maintenanceQueue, ^
+    {
+        NSMutableArray *entries = [NSMutableArray arrayWithCapacity:[warmUpKeys count]];
+
+        for (NSString *key in warmUpKeys) {
+            VKCacheIndexEntry *entry = [_index entryForKey:key];
+
+            if (nil != entry)
+                [entries addObject:entry];
+        }
+
+        [self loadEntriesIntoMemory:entries];
+    });
+}
+
+- (void)warmUpRecentlyUsedEntries:(NSUInteger)count
+{
+    INFO_LOG();
+
+    dispatch_async(_maintenanceQueue, ^
+    {
+        NSArray *entries = [self recentlyUsedEntries];
+
+        [self loadEntriesIntoMemory:[entries subarrayWithRange:NSMakeRange(0, MIN(count, [entries count]))]];
+    });
+}
+
+- (void)warmUpEntriesForMethods:(NSArray *)methodNames
+                          limit:(NSUInteger)limit
+{
+    INFO_LOG();
+
+    NSMutableSet *methodHashes = [NSMutableSet setWithCapacity:[methodNames count]];
+
+    for (NSString *methodName in methodNames)
+        [methodHashes addObject:@([VKCacheKey hashForMethod:methodName])];
+
+    dispatch_async(_maintenanceQueue, ^
+    {
+        NSMutableArray *entries = [NSMutableArray array];
+
+        for (VKCacheIndexEntry *entry in [self recentlyUsedEntries]) {
+            if ([entries count] >= limit)
+                break;
+
+            if ([methodHashes containsObject:@(entry.methodHash)])
+                [entries addObject:entry];
+        }
+
+        [self loadEntriesIntoMemory:entries];
+    });
+}
+
+- (void)warmUpHotSet
+{
+    INFO_LOG();
+
+    NSArray *hotSetKeys;
+
+    @synchronized (self) {
+        if (_isHotSetWarmedUp)
+            return;
+
+        _isHotSetWarmedUp = YES;
+        hotSetKeys = _hotSetKeys;
+    }
+
+    [self warmUpEntriesForKeys:hotSetKeys];
+}
+
+#pragma mark - packs
+
+- (BOOL)exportPackToFile:(NSString *)path
+{
+    INFO_LOG();
+
+    VKCachePackWriter *packWriter = [[VKCachePackWriter alloc] initWithPath:path];
+
+    [self exportEntriesToPackWriter:packWriter
+                            section:kVKCachePackDefaultSectionName];
+
+    return [packWriter finish];
+}
+
+- (NSUInteger)exportEntriesToPackWriter:(VKCachePackWriter *)writer
+                                section:(NSString *)sectionName
+{
+    INFO_LOG();
+
+    [_writer flush];
+
+    NSUInteger currentTimestamp = [self currentTimestamp];
+    NSUInteger staleRetentionTime = (NSUInteger) _staleRetentionTime;
+    NSUInteger sweepTimestamp = (currentTimestamp > staleRetentionTime ? currentTimestamp - staleRetentionTime : 0);
+    NSUInteger exportedCount = 0;
+
+//    последние использованные записи оказываются в начале пакета
+    for (VKCacheIndexEntry *entry in [self recentlyUsedEntries]) {
+        if ([entry isExpiredAtTimestamp:sweepTimestamp])
+            continue;
+
+        VKCachedDataRecord *record = [self recordForEntry:entry];
+
+        if (nil == record)
+            continue;
+
+        VKCachedDataCompression compression = (entry.logicalSize < _compressionThreshold ?
+                VKCachedDataCompressionNone : _compression);
+
+        if ([writer addEntry:entry
+                      record:record
+                   toSection:sectionName
+                 compression:compression])
+            exportedCount++;
+    }
+
+    return exportedCount;
+}
+
+- (NSUInteger)importPackFromFile:(NSString *)path
+{
+    INFO_LOG();
+
+    NSArray *sectionNames = [VKCachePack packWithContentsOfFile:path].sectionNames;
+    NSString *sectionName = ([sectionNames containsObject:kVKCachePackDefaultSectionName] || 1 != [sectionNames count] ?
+            kVKCachePackDefaultSectionName : [sectionNames firstObject]);
+
+    return [self importPackFromFile:path
+                            section:sectionName];
+}
+
+- (NSUInteger)importPackFromFile:(NSString *)path
+                         section:(NSString *)sectionName
+{
+    INFO_LOG();
+
+    VKCachePack *sourcePack = [VKCachePack packWithContentsOfFile:path];
+    NSArray *sourceEntries = [sourcePack entriesInSection:sectionName];
+
+    if (nil == sourceEntries)
+        return 0;
+
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSString *packPath = [self packFilePath];
+    NSString *importPath = [packPath stringByAppendingString:@".import"];
+    BOOL isCopied;
+
+    [fileManager removeItemAtPath:importPath error:nil];
+
+//    пакет из одного раздела подключается как есть, из раздела пакета с
+//    несколькими разделами строится отдельный пакет
+    if (1 == [sourcePack.sectionNames count]) {
+        isCopied = [fileManager copyItemAtPath:path
+                                        toPath:importPath
+                                         error:nil];
+    } else {
+        VKCachePackWriter *packWriter = [[VKCachePackWriter alloc] initWithPath:importPath];
+
+        for (VKCacheIndexEntry *entry in sourceEntries) {
+            VKCachedDataCompression compression = (entry.logicalSize < _compressionThreshold ?
+                    VKCachedDataCompressionNone : _compression);
+
+            [packWriter addEntry:entry
+                          record:[sourcePack recordForKey:(nil != entry.contentKey ? entry.contentKey : entry.key)]
+                       toSection:kVKCachePackDefaultSectionName
+                     compression:compression];
+        }
+
+        isCopied = [packWriter finish];
+    }
+
+    if (!isCopied)
+        return 0;
+
+    [self removeEntriesStoredOnlyInPack:[self pack]];
+
+//    записи, ожидающие записи на диск, новее записей пакета
+    [_writer flush];
+    [_lock lock];
+
+    VKCachePack *pack = nil;
+
+    if (0 == rename([importPath fileSystemRepresentation], [packPath fileSystemRepresentation]))
+        pack = [VKCachePack packWithContentsOfFile:packPath];
+
+    @synchronized (self) {
+        _pack = pack;
+    }
+
+    NSUInteger importedCount = 0;
+
+    for (VKCacheIndexEntry *entry in [pack entriesInSection:[pack.sectionNames firstObject]]) {
+        NSString *key = entry.key;
+        VKCacheIndexEntry *existingEntry = [_index entryForKey:key];
+
+        if ((nil != existingEntry && existingEntry.creationTimestamp >= entry.creationTimestamp) ||
+                nil != [_writer pendingOperationForKey:key])
+            continue;
+
+        [_memoryCache removeObjectForKey:key];
+        [_objectCache removeObjectForKey:key];
+
+        NSString *releasedContentKey = [_index setEntry:entry];
+
+        if (nil != releasedContentKey)
+            [_writer removeContentForKey:releasedContentKey];
+
+        importedCount++;
+    }
+
+    [_index saveIfNeeded];
+    [_lock unlock];
+
+    [self scheduleEviction];
+
+    return importedCount;
+}
+
+#pragma mark - private methods
+
+- (NSUInteger)currentTimestamp
+{
+    return ((NSUInteger) [[NSDate date] timeIntervalSince1970]);
+}
+
+// хэши тегов записи (не более kVKCacheIndexMaxTagCount), либо nil
+- (NSArray *)hashesForTags:(NSArray *)tags
+{
+    if (0 == [tags count])
+        return nil;
+
+    NSMutableArray *tagHashes = [NSMutableArray arrayWithCapacity:kVKCacheIndexMaxTagCount];
+
+    for (NSString *tag in tags) {
+        if ([tagHashes count] >= kVKCacheIndexMaxTagCount)
+            break;
+
+        uint32_t tagHash = [VKCacheKey hashForTag:tag];
+
+        if (0 != tagHash && ![tagHashes containsObject:@(tagHash)])
+            [tagHashes addObject:@(tagHash)];
+    }
+
+    return tagHashes;
+}
+
+// данные записи хранятся под ключом содержимого, если он известен; данные
+// импортированных записей находятся в пакете
+- (VKCachedDataRecord *)recordForEntry:(VKCacheIndexEntry *)entry
+{
+    NSString *storeKey = (nil != entry.contentKey ? entry.contentKey : entry.key);
+    VKCachedDataRecord *record = [_store recordForKey:storeKey];
+
+    if (nil != record)
+        return record;
+
+    VKCachePack *pack = [self pack];
+
+//    пакет мог быть замещён другим процессом
+    if (nil != _lock && ![pack containsRecordForKey:storeKey]) {
+        pack = [VKCachePack packWithContentsOfFile:[self packFilePath]];
+
+        @synchronized (self) {
+            _pack = pack;
+        }
+    }
+
+    return [pack recordForKey:storeKey];
+}
+
+- (VKCachePack *)pack
+{
+    @synchronized (self) {
+        return _pack;
+    }
+}
+
+- (NSString *)packFilePath
+{
+    return [_cacheDirectoryPath stringByAppendingString:kVKCachePackFileName];
+}
+
+// удаляет записи, данные которых находятся лишь в пакете
+- (void)removeEntriesStoredOnlyInPack:(VKCachePack *)pack
+{
+    if (nil == pack)
+        return;
+
+    for (VKCacheIndexEntry *entry in [_index entriesSortedForEvictionPolicy:VKCachedDataEvictionPolicyLRU]) {
+        NSString *storeKey = (nil != entry.contentKey ? entry.contentKey : entry.key);
+
+        if ([pack containsRecordForKey:storeKey] && nil == [_store recordForKey:storeKey])
+            [self removeEntryForKey:entry.key
+                          freedSize:NULL];
+    }
+}
+
+// freedSize - объём освобождённого на диске места: содержимое, на которое
+// ссылаются другие записи, остаётся на месте
+- (VKCacheIndexEntry *)removeEntryForKey:(NSString *)key
+                               freedSize:(NSUInteger *)freedSize
+{
+//    удаление ставится в очередь раньше, чем удаляется запись индекса, - иначе
+//    выполняемая в этот момент запись могла бы вернуть её в индекс
+    [_writer removeRecordForKey:key];
+
+    [_memoryCache removeObjectForKey:key];
+    [_objectCache removeObjectForKey:key];
+
+    BOOL isContentReleased = NO;
+    VKCacheIndexEntry *removedEntry = [_index removeEntryForKey:key
+                                              isContentReleased:&isContentReleased];
+
+//    содержимое удаляется вместе с последней ссылающейся на него записью
+    if (isContentReleased)
+        [_writer removeContentForKey:removedEntry.contentKey];
+
+    if (NULL != freedSize)
+        *freedSize = (isContentReleased ? removedEntry.size : 0);
+
+    return removedEntry;
+}
+
+- (NSUInteger)evictEntryForKey:(NSString *)key
+{
+    NSUInteger freedSize = 0;
+    VKCacheIndexEntry *removedEntry = [self removeEntryForKey:key
+                                                    freedSize:&freedSize];
+
+    if (nil == removedEntry)
+        return 0;
+
+    [_statistics recordEvent:VKCacheStatisticsEventEviction
+                  methodName:[_statistics methodNameForHash:removedEntry.methodHash]];
+
+    return freedSize;
+}
+
+- (void)recordLookupEvent:(VKCacheStatisticsEvent)event
+           sinceTimestamp:(uint64_t)startTimestamp
+               methodName:(NSString *)methodName
+{
+    [_statistics recordEvent:event
+                  methodName:methodName];
+    [_statistics recordLatencySinceTimestamp:startTimestamp
+                                   operation:VKCacheStatisticsOperationLookup
+                                  methodName:methodName];
+}
+
+// определяем наши действия в соответствии с указанным временем жизни кэша запроса:
+// устаревшие данные возвращаются в оффлайн режиме и в пределах времени,
+// допустимого для использования устаревших данных
+- (BOOL)isUsableEntryWithLiveTime:(NSUInteger)liveTime
+                creationTimestamp:(NSUInteger)creationTimestamp
+                      offlineMode:(BOOL)offlineMode
+                   staleGraceTime:(NSTimeInterval)staleGraceTime
+                          expired:(BOOL *)expired
+{
+    NSUInteger currentTimestamp = [self currentTimestamp];
+    NSUInteger expirationTimestamp = creationTimestamp + liveTime;
+
+    *expired = (expirationTimestamp < currentTimestamp);
+
+    return (!*expired || offlineMode || (expirationTimestamp + (NSUInteger) staleGraceTime) >= currentTimestamp);
+}
+
+// записи индекса, начиная с тех, к которым обращались последними
+- (NSArray *)recentlyUsedEntries
+{
+    NSArray *entries = [_index entriesSortedForEvictionPolicy:VKCachedDataEvictionPolicyLRU];
+
+    return [[entries reverseObjectEnumerator] allObjects];
+}
+
+// вызывается только на очереди _maintenanceQueue
+- (void)loadEntriesIntoMemory:(NSArray *)entries
+{
+//    давно устаревшие записи скоро будут удалены фоновой очисткой - не загружаем их
+    NSUInteger currentTimestamp = [self currentTimestamp];
+    NSUInteger staleRetentionTime = (NSUInteger) _staleRetentionTime;
+    NSUInteger sweepTimestamp = (currentTimestamp > staleRetentionTime ? currentTimestamp - staleRetentionTime : 0);
+
+//    загрузка сверх размера кэша вытеснила бы только что загруженные записи
+    NSUInteger memoryBudget = _memoryCache.totalCostLimit;
+    NSUInteger loadedSize = 0;
+
+    for (VKCacheIndexEntry *entry in entries) {
+        NSString *key = entry.key;
+
+        if (loadedSize + entry.logicalSize > memoryBudget ||
+                [entry isExpiredAtTimestamp:sweepTimestamp] ||
+                nil != [_memoryCache objectForKey:key] ||
+                nil != [_writer pendingOperationForKey:key])
+            continue;
+
+        VKCachedDataRecord *record = [self recordForEntry:entry];
+
+        if (nil == record)
+            continue;
+
+        NSData *payload = record.payload;
+        VKCachedDataTouchPages(payload);
+
+        VKCachedDataMemoryEntry *memoryEntry = [[VKCachedDataMemoryEntry alloc] init];
+        memoryEntry.data = payload;
+        memoryEntry.liveTime = (VKCachedDataLiveTime) entry.liveTime;
+        memoryEntry.creationTimestamp = entry.creationTimestamp;
+
+//        пока запись читалась с диска, её могли обновить - более свежие данные
+//        в памяти не заменяем
+        if (![_memoryCache addObject:memoryEntry
+                              forKey:key
+                                cost:[payload length]])
+            continue;
+
+//        запись обновлена или удалена после того, как её данные попали в память
+        if (nil != [_writer pendingOperationForKey:key] || nil == [_index entryForKey:key]) {
+            [_memoryCache removeObjectForKey:key];
+            continue;
+        }
+
+        loadedSize += [payload length];
+    }
+}
+
+- (NSString *)hotSetFilePath
+{
+    return [_cacheDirectoryPath stringByAppendingString:kVKCachedDataHotSetFileName];
+}
+
+- (NSArray *)loadHotSetKeys
+{
+    NSData *data = [NSData dataWithContentsOfFile:[self hotSetFilePath]];
+    NSMutableArray *keys = [NSMutableArray array];
+
+//    файл состоит из ключей записей в бинарном виде
+    if (0 != [data length] % kVKCacheKeyLength)
+        return keys;
+
+    const uint8_t *bytes = [data bytes];
+    NSUInteger count = MIN([data length] / kVKCacheKeyLength, kVKCachedDataHotSetMaxCount);
+
+    for (NSUInteger i = 0; i < count; i++)
+        [keys addObject:VKCacheKeyWithBytes(bytes + i * kVKCacheKeyLength)];
+
+    return keys;
+}
+
+- (void)recordHotSetKey:(NSString *)key
+{
+    @synchronized (self) {
+        if ([_sessionHotSetKeys count] < kVKCachedDataHotSetMaxCount)
+            [_sessionHotSetKeys addObject:key];
+    }
+}
+
+- (void)saveHotSet
+{
+    NSMutableOrderedSet *keys;
+
+    @synchronized (self) {
+//        набор не изменился с момента последнего сохранения
+        if ([_sessionHotSetKeys count] == _savedHotSetCount)
+            return;
+
+        _savedHotSetCount = [_sessionHotSetKeys count];
+
+//        первыми идут записи текущего сеанса, оставшиеся места занимают
+//        записи предыдущих сеансов
+        keys = [_sessionHotSetKeys mutableCopy];
+        [keys addObjectsFromArray:_hotSetKeys];
+    }
+
+    NSMutableData *data = [NSMutableData dataWithCapacity:kVKCachedDataHotSetMaxCount * kVKCacheKeyLength];
+
+    for (NSString *key in keys) {
+        uint8_t bytes[kVKCacheKeyLength];
+
+        if ([data length] >= kVKCachedDataHotSetMaxCount * kVKCacheKeyLength)
+            break;
+
+        if (VKCacheKeyGetBytes(key, bytes))
+            [data appendBytes:bytes length:kVKCacheKeyLength];
+    }
+
+    [data writeToFile:[self hotSetFilePath]
+           atomically:YES];
+}
+
+- (void)scheduleEviction
+{
+    dispatch_async(_maintenanceQueue, ^
+    {
+        NSUInteger maxCacheSize = _maxCacheSize;
+
+        if (0 == maxCacheSize || _index.totalSize <= maxCacheSize)
+            return;
+
+        [self evictCachedDataToSize:(NSUInteger) (maxCacheSize * kVKCachedDataEvictionTargetRatio)];
+    });
+}
+
+// вызывается только на очереди _maintenanceQueue
+- (NSUInteger)sweepExpiredCachedDataWithLimit:(NSUInteger)limit
+{
+//    записи, срок жизни которых истёк недавно, ещё могут быть использованы как
+//    устаревшие - не трогаем их
+    NSUInteger currentTimestamp = [self currentTimestamp];
+    NSUInteger staleRetentionTime = (NSUInteger) _staleRetentionTime;
+    NSUInteger sweepTimestamp = (currentTimestamp > staleRetentionTime ? currentTimestamp - staleRetentionTime : 0);
+
+    NSArray *expiredEntries = [_index expiredEntriesAtTimestamp:sweepTimestamp
+                                                          limit:limit];
+    NSUInteger freedSize = 0;
+
+    for (VKCacheIndexEntry *entry in expiredEntries) {
+//        запись обновляется прямо сейчас - её срок жизни больше не истёк
+        if (nil != [_writer pendingOperationForKey:entry.key])
+            continue;
+
+        NSUInteger entryFreedSize = 0;
+        VKCacheIndexEntry *removedEntry = [self removeEntryForKey:entry.key
+                                                        freedSize:&entryFreedSize];
+
+        if (nil == removedEntry)
+            continue;
+
+        freedSize += entryFreedSize;
+
+        [_statistics recordEvent:VKCacheStatisticsEventExpiration
+                      methodName:[_statistics methodNameForHash:removedEntry.methodHash]];
+    }
+
+    _reclaimedSize += freedSize;
+
+    return freedSize;
+}
+
+- (void)rebuildIndex
+{
+    INFO_LOG();
+
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSSet *preservedItems = [NSSet setWithObjects:kVKCacheDirectoryLockFileName,
+                                                  kVKCachePackFileName,
+                                                  kVKCachedDataHotSetFileName,
+                                                  nil];
+
+//    файлы в корне директории - записи старого формата, либо повреждённый индекс
+    for (NSString *item in [fileManager contentsOfDirectoryAtPath:_cacheDirectoryPath error:nil]) {
+        NSString *itemPath = [_cacheDirectoryPath stringByAppendingString:item];
+        BOOL isDirectory = NO;
+
+        [fileManager fileExistsAtPath:itemPath isDirectory:&isDirectory];
+
+        if (!isDirectory && ![preservedItems containsObject:item])
+            [fileManager removeItemAtPath:itemPath error:nil];
+    }
+
+//    ссылки записей на содержимое хранились лишь в индексе и его журнале -
+//    восстанавливаются только записи старого формата, содержимое удаляется
+    [self reconcileStoreWithIndex];
+
+//    записи импортированного пакета восстанавливаются по его таблице записей
+    for (VKCacheIndexEntry *entry in [_pack entriesInSection:[_pack.sectionNames firstObject]]) {
+        if (nil == [_index entryForKey:entry.key])
+            [_index setEntry:entry];
+    }
+}
+
+// приводит хранилище в соответствие с индексом: записи старого формата, которых
+// нет в индексе, добавляются в него; содержимое, на которое не ссылается ни одна
+// запись (в том числе то, ссылку на которое заменила более новая версия записи,
+// если индекс не успел сохраниться), удаляется. Записи, сохранённые после
+// последнего сохранения индекса, восстанавливаются из его журнала ещё при
+// загрузке (см. VKCacheIndex writeJournal). Вызывается, когда хранилище не
+// изменяется (см. VKCachedDataWriter performBlockBetweenBatches:)
+- (void)reconcileStoreWithIndex
+{
+    NSMutableArray *contentKeys = [[NSMutableArray alloc] init];
+    NSMutableArray *referenceKeys = [[NSMutableArray alloc] init];
+
+    [_store enumerateRecordHeadersUsingBlock:^(NSString *key, VKCachedDataRecordHeader *header)
+    {
+        if (header->flags & kVKCachedDataRecordFlagContent) {
+            [contentKeys addObject:key];
+            return;
+        }
+
+        if (header->flags & kVKCachedDataRecordFlagReference) {
+            [referenceKeys addObject:key];
+            return;
+        }
+
+//        запись, сохранённая до дедупликации, хранит данные под своим ключом
+        if (nil != [_index entryForKey:key])
+            return;
+
+        VKCacheIndexEntry *entry = [[VKCacheIndexEntry alloc] init];
+        entry.key = key;
+        entry.size = (NSUInteger) header->length;
+        entry.logicalSize = (NSUInteger) header->logicalLength;
+        entry.creationTimestamp = (NSUInteger) header->creationTimestamp;
+        entry.liveTime = header->liveTime;
+        entry.lastAccessTimestamp = entry.creationTimestamp;
+        entry.accessCount = 1;
+
+        [_index setEntry:entry];
+    }];
+
+    for (NSString *key in referenceKeys)
+        [_store removeRecordForKey:key];
+
+    for (NSString *contentKey in contentKeys) {
+        if (NSNotFound == [_index sizeOfContentForKey:contentKey] &&
+                nil == [_writer pendingOperationForKey:contentKey])
+            [_store removeRecordForKey:contentKey];
+    }
+}
+
+#pragma mark - VKCachedDataWriterDelegate
+
+- (NSUInteger)cachedDataWriter:(VKCachedDataWriter *)writer
+           sizeOfContentForKey:(NSString *)contentKey
+{
+    return [_index sizeOfContentForKey:contentKey];
+}
+
+- (void)cachedDataWriter:(VKCachedDataWriter *)writer
+       didWriteOperation:(VKCachedDataWriteOperation *)operation
+{
+    NSString *key = operation.key;
+
+//    статистика обращений сохраняется при обновлении данных записи
+    VKCacheIndexEntry *oldEntry = [_index entryForKey:key];
+
+    VKCacheIndexEntry *entry = [[VKCacheIndexEntry alloc] init];
+    entry.key = key;
+    entry.contentKey = operation.contentKey;
+    entry.size = operation.storedLength;
+    entry.logicalSize = [operation.payload length];
+    entry.creationTimestamp = operation.creationTimestamp;
+    entry.liveTime = operation.liveTime;
+    entry.lastAccessTimestamp = entry.creationTimestamp;
+    entry.accessCount = oldEntry.accessCount + 1;
+    entry.methodHash = (0 != operation.methodHash ? operation.methodHash : oldEntry.methodHash);
+    entry.tagHashes = (nil != operation.tagHashes ? operation.tagHashes : oldEntry.tagHashes);
+
+    NSString *releasedContentKey = [_index setEntry:entry];
+
+//    данные, сохранённые до дедупликации под ключом самой записи, заменены
+//    содержимым; хранилище сейчас изменяет лишь очередь отложенной записи
+    if (nil != oldEntry && nil == oldEntry.contentKey)
+        [_store removeRecordForKey:key];
+
+//    прежние данные записи больше никому не нужны; очередь отложенной записи
+//    сейчас заблокирована, поэтому удаление ставится в очередь асинхронно
+    if (nil != releasedContentKey)
+        dispatch_async(_maintenanceQueue, ^
+        {
+            [_writer removeContentForKey:releasedContentKey];
+        });
+}
+
+- (void)cachedDataWriterDidFinishBatch:(VKCachedDataWriter *)writer
+{
+//    блокировка директории ещё удерживается - другие процессы увидят записанные
+//    данные одновременно с изменениями индекса
+    if (nil != _lock)
+        [_index synchronize];
+    else
+        [_index writeJournal];
+
+    [self scheduleEviction];
+
+    [[NSNotificationCenter defaultCenter]
+                           postNotificationName:kVKCachedDataDidChangeSizeNotification
+                                         object:self];
+}
+
+#pragma mark - VKCacheIndexDelegate
+
+- (void)cacheIndex:(VKCacheIndex *)index
+didLoadChangesForKeys:(NSSet *)keys
+{
+//    данные в оперативной памяти устарели - записи изменены другими процессами
+    for (NSString *key in keys) {
+        [_memoryCache removeObjectForKey:key];
+        [_objectCache removeObjectForKey:key];
+    }
+}
+
+// в многопроцессном режиме записи могли быть добавлены, изменены или удалены
+// другими процессами: загрузка их изменений удаляет устаревшие данные из кэша
+// в оперативной памяти (см. cacheIndex:didLoadChangesForKeys:), поэтому поколение
+// индекса проверяется до обращения к кэшу в оперативной памяти
+- (void)synchronizeIndexIfChangedOnDisk
+{
+    if (nil != _lock && [_index isChangedOnDisk])
+        [_index synchronize];
+}
+
+- (void)removeCachedDataDirectoryContents
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+
+    [_lock lock];
+
+    for (NSString *item in [fileManager contentsOfDirectoryAtPath:_cacheDirectoryPath error:nil]) {
+        if (![item isEqualToString:kVKCacheDirectoryLockFileName])
+            [fileManager removeItemAtPath:[_cacheDirectoryPath stringByAppendingString:item]
+                                    error:nil];
+    }
+
+    [_lock unlock];
+}
+
+- (void)storeMemoryEntryWithData:(NSData *)data
+                          forKey:(NSString *)key
+                        liveTime:(VKCachedDataLiveTime)liveTime
+               creationTimestamp:(NSUInteger)creationTimestamp
+{
+    if (nil == data) {
+        [_memoryCache removeObjectForKey:key];
+        return;
+    }
+
+    VKCachedDataMemoryEntry *entry = [[VKCachedDataMemoryEntry alloc] init];
+    entry.data = data;
+    entry.liveTime = liveTime;
+    entry.creationTimestamp = creationTimestamp;
+
+    [_memoryCache setObject:entry
+                     forKey:key
+                       cost:[data length]];
+}
+
+- (void)didReceiveMemoryWarning:(NSNotification *)notification
+{
+    INFO_LOG();
+
+    [_memoryCache removeAllObjects];
+    [_objectCache removeAllObjects];
+}
+
+- (void)applicationDidEnterBackground:(NSNotification *)notification
+{
+    INFO_LOG();
+
+//    ожидающие записи и индекс сохраняем, пока приложение ещё не приостановлено:
+//    фоновая задача откладывает приостановку до окончания сохранения
+    NSUInteger backgroundTask = VKCachedDataBeginBackgroundTask();
+
+    dispatch_async(_backgroundQueue, ^
+    {
+        [self flush];
+
+        VKCachedDataEndBackgroundTask(backgroundTask);
+    });
+}
 
 - (void)createDirectoryIfNotExists:(NSString *)path
 {
@@ -198,4 +1687,4 @@
     }
 }
 
-@end
\ No newline at end of file
+@end
@@ -0,0 +1,184 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import "VKCachedDataFileStore.h"
+#import "VKCacheKey.h"
+#import <fcntl.h>
+#import <unistd.h>
+
+
+@implementation VKCachedDataFileStore
+{
+    NSString *_directoryPath;
+
+//    файлы записей, не сброшенные на диск
+    NSMutableSet *_unsynchronizedPaths;
+}
+
+#pragma mark Visible VKCachedDataFileStore methods
+#pragma mark - Init methods
+
+- (instancetype)initWithDirectory:(NSString *)path
+{
+    self = [super init];
+
+    if (self) {
+        _directoryPath = [path copy];
+        _unsynchronizedPaths = [[NSMutableSet alloc] init];
+    }
+
+    return self;
+}
+
+#pragma mark - VKCachedDataStore
+
+- (BOOL)writeRecordWithHeader:(const VKCachedDataRecordHeader *)header
+                      payload:(NSData *)payload
+                       forKey:(NSString *)key
+{
+    NSString *filePath = [self filePathForKey:key];
+
+    [[NSFileManager defaultManager]
+                    createDirectoryAtPath:[filePath stringByDeletingLastPathComponent]
+              withIntermediateDirectories:YES
+                               attributes:nil
+                                    error:nil];
+
+    BOOL written = [VKCachedDataRecord writeRecordWithHeader:header
+                                                     payload:payload
+                                                      toFile:filePath];
+
+    if (written) {
+        @synchronized (self) {
+            [_unsynchronizedPaths addObject:filePath];
+        }
+    }
+
+    return written;
+}
+
+- (VKCachedDataRecord *)recordForKey:(NSString *)key
+{
+    return [VKCachedDataRecord recordWithContentsOfFile:[self filePathForKey:key]];
+}
+
+- (void)removeRecordForKey:(NSString *)key
+{
+    [[NSFileManager defaultManager] removeItemAtPath:[self filePathForKey:key]
+                                               error:nil];
+}
+
+- (void)removeAllRecords
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+
+    for (NSString *item in [self shardNames])
+        [fileManager removeItemAtPath:[_directoryPath stringByAppendingString:item]
+                                error:nil];
+}
+
+- (void)synchronize
+{
+    NSSet *paths;
+
+    @synchronized (self) {
+        paths = [_unsynchronizedPaths copy];
+        [_unsynchronizedPaths removeAllObjects];
+    }
+
+//    сбрасываем данные файлов, затем директории шардов, в которых они появились
+    NSMutableSet *shardPaths = [[NSMutableSet alloc] init];
+
+    for (NSString *path in paths) {
+        [self synchronizeFileAtPath:path];
+        [shardPaths addObject:[path stringByDeletingLastPathComponent]];
+    }
+
+    for (NSString *path in shardPaths)
+        [self synchronizeFileAtPath:path];
+}
+
+- (void)enumerateRecordHeadersUsingBlock:(void (^)(NSString *key, VKCachedDataRecordHeader *header))block
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+
+    for (NSString *item in [self shardNames]) {
+        NSString *shardPath = [_directoryPath stringByAppendingString:item];
+
+        for (NSString *key in [fileManager contentsOfDirectoryAtPath:shardPath error:nil]) {
+            NSString *recordPath = [shardPath stringByAppendingPathComponent:key];
+            VKCachedDataRecordHeader header;
+
+//            незавершённые временные файлы и повреждённые записи удаляем
+            if (kVKCacheKeyLength * 2 != [key length] || ![VKCachedDataRecord readHeader:&header ofFile:recordPath]) {
+                [fileManager removeItemAtPath:recordPath error:nil];
+                continue;
+            }
+
+            block(key, &header);
+        }
+    }
+}
+
+#pragma mark - private methods
+
+- (NSString *)filePathForKey:(NSString *)key
+{
+    return [_directoryPath stringByAppendingFormat:@"%@/%@",
+                                                   [key substringToIndex:2],
+                                                   key];
+}
+
+- (void)synchronizeFileAtPath:(NSString *)path
+{
+//    файл мог быть удалён или заменён с момента записи - это не ошибка
+    int fd = open([path fileSystemRepresentation], O_RDONLY);
+
+    if (-1 == fd)
+        return;
+
+    fsync(fd);
+    close(fd);
+}
+
+- (NSArray *)shardNames
+{
+    NSMutableArray *shardNames = [[NSMutableArray alloc] init];
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+
+    for (NSString *item in [fileManager contentsOfDirectoryAtPath:_directoryPath error:nil]) {
+        BOOL isDirectory = NO;
+
+        [fileManager fileExistsAtPath:[_directoryPath stringByAppendingString:item]
+                          isDirectory:&isDirectory];
+
+        if (isDirectory && 2 == [item length])
+            [shardNames addObject:item];
+    }
+
+    return shardNames;
+}
+
+@end
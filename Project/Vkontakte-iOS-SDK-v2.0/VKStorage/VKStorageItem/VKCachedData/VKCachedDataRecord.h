@@ -0,0 +1,219 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import <Foundation/Foundation.h>
+#import <sys/uio.h>
+
+/** Сигнатура бинарной записи кэша ("VKCD")
+*/
+static uint32_t const kVKCachedDataRecordMagic = 0x44434B56;
+
+/** Текущая версия формата бинарной записи кэша
+*/
+static uint16_t const kVKCachedDataRecordVersion = 2;
+
+/** Флаг записи-надгробия: запись не содержит данных и означает, что все предыдущие
+записи с тем же ключом удалены (используется в сегментах журнала, см.
+VKCachedDataSegmentStore)
+*/
+static uint16_t const kVKCachedDataRecordFlagTombstone = 1 << 0;
+
+/** Флаг записи, данные которой сжаты кодеком LZ4
+*/
+static uint16_t const kVKCachedDataRecordFlagCompressionLZ4 = 1 << 1;
+
+/** Флаг записи, данные которой сжаты кодеком zlib
+*/
+static uint16_t const kVKCachedDataRecordFlagCompressionZlib = 1 << 2;
+
+/** Флаг записи содержимого: запись хранится под ключом своих данных (см. VKCacheKey
+keyForContent:) и может принадлежать сразу нескольким записям кэша. Время жизни
+таких записей хранится только в индексе кэша.
+*/
+static uint16_t const kVKCachedDataRecordFlagContent = 1 << 3;
+
+/** Флаг записи-ссылки на содержимое (см. kVKCachedDataRecordFlagContent). Такие
+записи больше не создаются: ссылки на содержимое хранятся в индексе кэша и его
+журнале (см. VKCacheIndex). Оставшиеся записи-ссылки удаляются при сверке
+хранилища с индексом.
+*/
+static uint16_t const kVKCachedDataRecordFlagReference = 1 << 4;
+
+/** Перечисление возможных способов сжатия данных записей кэша.
+*/
+typedef enum
+{
+
+    VKCachedDataCompressionNone = 0,
+    VKCachedDataCompressionLZ4 = 1,
+    VKCachedDataCompressionZlib = 2,
+
+} VKCachedDataCompression;
+
+/** Заголовок бинарной записи кэша. Следом за заголовком в файле идут данные
+длиной length байт (возможно сжатые, см. флаги сжатия), контрольная сумма
+считается по ним же. Длина исходных (несжатых) данных - logicalLength.
+*/
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t liveTime;
+    uint32_t checksum;
+    uint64_t creationTimestamp;
+    uint64_t length;
+    uint64_t logicalLength;
+} VKCachedDataRecordHeader;
+
+/** Записывает все переданные части целиком (writev может записать лишь часть данных)
+
+@param fd файловый дескриптор
+@param parts части данных
+@param count кол-во частей
+@return YES, если все данные записаны
+*/
+BOOL VKWriteVectorFully(int fd, struct iovec *parts, int count);
+
+
+/** Бинарная запись кэша: заголовок фиксированной длины (время жизни, время
+создания, длина и контрольная сумма данных) и следующие за ним данные без
+какой-либо сериализации.
+
+Чтение осуществляется отображением файла в память (mmap), несжатые данные записи
+возвращаются без копирования. Сжатые данные распаковываются при чтении.
+*/
+@interface VKCachedDataRecord : NSObject
+
+/**
+@name Свойства
+*/
+/** Флаги записи (kVKCachedDataRecordFlagContent, kVKCachedDataRecordFlagReference etc)
+*/
+@property (nonatomic, readonly) uint16_t flags;
+
+/** Время жизни записи
+*/
+@property (nonatomic, readonly) NSUInteger liveTime;
+
+/** Время создания записи
+*/
+@property (nonatomic, readonly) NSUInteger creationTimestamp;
+
+/** Данные записи. Если данные хранятся несжатыми, то являются "окном" в
+отображенный в память файл, копирования не происходит.
+*/
+@property (nonatomic, readonly) NSData *payload;
+
+/** Размер данных записи на диске (после сжатия)
+*/
+@property (nonatomic, readonly) NSUInteger storedLength;
+
+/**
+@name Чтение и запись
+*/
+/** Читает запись из файла
+
+@param path путь к файлу записи
+@return экземпляр класса VKCachedDataRecord, либо nil, если файла нет, формат
+записи не совпадает или контрольная сумма данных не сошлась
+*/
++ (instancetype)recordWithContentsOfFile:(NSString *)path;
+
+/** Читает запись, находящуюся в файле по указанному смещению (файл может содержать
+несколько записей подряд). Отображается в память лишь область файла, в которой
+находится запись.
+
+@param fd файловый дескриптор открытого для чтения файла
+@param offset смещение заголовка записи в файле
+@return экземпляр класса VKCachedDataRecord, либо nil, если формат записи не совпадает,
+запись выходит за пределы файла или контрольная сумма данных не сошлась
+*/
++ (instancetype)recordWithFileDescriptor:(int)fd
+                                  offset:(off_t)offset;
+
+/** Читает только заголовок записи, не затрагивая данные
+
+@param header заголовок, который будет заполнен прочитанными значениями
+@param path путь к файлу записи
+@return YES, если заголовок прочитан и соответствует текущему формату записи
+*/
++ (BOOL)readHeader:(VKCachedDataRecordHeader *)header
+            ofFile:(NSString *)path;
+
+/** Заполняет заголовок записи для указанных данных
+
+@param header заголовок, который будет заполнен
+@param payload данные записи
+@param liveTime время жизни записи
+@param creationTimestamp время создания записи
+*/
++ (void)fillHeader:(VKCachedDataRecordHeader *)header
+       withPayload:(NSData *)payload
+          liveTime:(NSUInteger)liveTime
+ creationTimestamp:(NSUInteger)creationTimestamp;
+
+/** Сжимает данные записи и заполняет для них заголовок
+
+Если сжатие не уменьшило размер данных, то данные сохраняются несжатыми.
+
+@param header заголовок, который будет заполнен
+@param payload данные записи
+@param liveTime время жизни записи
+@param creationTimestamp время создания записи
+@param compression способ сжатия
+@return данные, которые должны быть записаны на диск следом за заголовком
+*/
++ (NSData *)fillHeader:(VKCachedDataRecordHeader *)header
+           withPayload:(NSData *)payload
+              liveTime:(NSUInteger)liveTime
+     creationTimestamp:(NSUInteger)creationTimestamp
+           compression:(VKCachedDataCompression)compression;
+
+/** Атомарно записывает запись в файл (через временный файл в той же директории)
+
+@param payload данные записи
+@param liveTime время жизни записи
+@param creationTimestamp время создания записи
+@param path путь к файлу записи
+@return YES, если запись прошла успешно
+*/
++ (BOOL)writeRecordWithPayload:(NSData *)payload
+                      liveTime:(NSUInteger)liveTime
+             creationTimestamp:(NSUInteger)creationTimestamp
+                        toFile:(NSString *)path;
+
+/** Атомарно записывает запись с подготовленным заголовком в файл
+
+@param header заголовок записи (см. fillHeader:withPayload:liveTime:creationTimestamp:compression:)
+@param payload данные, записываемые следом за заголовком
+@param path путь к файлу записи
+@return YES, если запись прошла успешно
+*/
++ (BOOL)writeRecordWithHeader:(const VKCachedDataRecordHeader *)header
+                      payload:(NSData *)payload
+                       toFile:(NSString *)path;
+
+@end
@@ -0,0 +1,342 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import "VKCachedDataRecord.h"
+#import "NSData+compression.h"
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <sys/uio.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import <errno.h>
+#import <zlib.h>
+
+
+/** Данные, находящиеся в отображенной в память области файла.
+Область освобождается (munmap) вместе с объектом.
+*/
+@interface VKMappedData : NSData
+
+- (instancetype)initWithMapping:(void *)mapping
+                  mappingLength:(size_t)mappingLength
+                         offset:(size_t)offset
+                         length:(NSUInteger)length;
+
+@end
+
+@implementation VKMappedData
+{
+    void *_mapping;
+    size_t _mappingLength;
+
+    const void *_bytes;
+    NSUInteger _length;
+}
+
+- (instancetype)initWithMapping:(void *)mapping
+                  mappingLength:(size_t)mappingLength
+                         offset:(size_t)offset
+                         length:(NSUInteger)length
+{
+    self = [super init];
+
+    if (self) {
+        _mapping = mapping;
+        _mappingLength = mappingLength;
+        _bytes = (const uint8_t *) mapping + offset;
+        _length = length;
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    if (NULL != _mapping)
+        munmap(_mapping, _mappingLength);
+}
+
+- (const void *)bytes
+{
+    return _bytes;
+}
+
+- (NSUInteger)length
+{
+    return _length;
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+//    данные неизменяемы, копировать отображенную область нет смысла
+    return self;
+}
+
+@end
+
+
+BOOL VKWriteVectorFully(int fd, struct iovec *parts, int count)
+{
+    while (count > 0) {
+        ssize_t written = writev(fd, parts, count);
+
+        if (-1 == written) {
+            if (EINTR == errno)
+                continue;
+
+            return NO;
+        }
+
+        while (count > 0 && (size_t) written >= parts->iov_len) {
+            written -= parts->iov_len;
+            parts++;
+            count--;
+        }
+
+        if (count > 0) {
+            parts->iov_base = (uint8_t *) parts->iov_base + written;
+            parts->iov_len -= written;
+        }
+    }
+
+    return YES;
+}
+
+
+@implementation VKCachedDataRecord
+
+#pragma mark Visible VKCachedDataRecord methods
+#pragma mark - Reading & writing
+
++ (instancetype)recordWithContentsOfFile:(NSString *)path
+{
+    int fd = open([path fileSystemRepresentation], O_RDONLY);
+
+    if (-1 == fd)
+        return nil;
+
+    struct stat fileInfo;
+    VKCachedDataRecord *record = nil;
+
+    if (0 == fstat(fd, &fileInfo))
+        record = [self recordWithFileDescriptor:fd
+                                         offset:0];
+
+//    после отображения файловый дескриптор больше не нужен
+    close(fd);
+
+//    файл записи содержит ровно одну запись
+    if (nil != record && (off_t) (sizeof(VKCachedDataRecordHeader) + record.storedLength) != fileInfo.st_size)
+        return nil;
+
+    return record;
+}
+
++ (instancetype)recordWithFileDescriptor:(int)fd
+                                  offset:(off_t)offset
+{
+    VKCachedDataRecordHeader header;
+    struct stat fileInfo;
+
+    if ((ssize_t) sizeof(header) != pread(fd, &header, sizeof(header), offset) ||
+            kVKCachedDataRecordMagic != header.magic ||
+            kVKCachedDataRecordVersion != header.version ||
+            0 != fstat(fd, &fileInfo) ||
+            header.length > (uint64_t) (fileInfo.st_size - offset - (off_t) sizeof(header)))
+        return nil;
+
+//    смещение отображаемой области должно быть кратно размеру страницы
+    off_t pageSize = (off_t) sysconf(_SC_PAGESIZE);
+    off_t mappingOffset = offset - offset % pageSize;
+    size_t headerOffset = (size_t) (offset - mappingOffset);
+    size_t mappingLength = headerOffset + sizeof(header) + (size_t) header.length;
+
+    void *mapping = mmap(NULL, mappingLength, PROT_READ, MAP_PRIVATE, fd, mappingOffset);
+
+    if (MAP_FAILED == mapping)
+        return nil;
+
+    const uint8_t *payloadBytes = (const uint8_t *) mapping + headerOffset + sizeof(header);
+
+    if (header.checksum != (uint32_t) crc32(0, payloadBytes, (uInt) header.length)) {
+        munmap(mapping, mappingLength);
+        return nil;
+    }
+
+    NSData *payload = [[VKMappedData alloc]
+                                     initWithMapping:mapping
+                                       mappingLength:mappingLength
+                                              offset:headerOffset + sizeof(header)
+                                              length:(NSUInteger) header.length];
+
+//    распакованные данные не зависят от отображенной области, она освобождается
+//    вместе с объектом сжатых данных
+    if (header.flags & kVKCachedDataRecordFlagCompressionLZ4)
+        payload = [payload LZ4DecompressedDataWithLength:(NSUInteger) header.logicalLength];
+    else if (header.flags & kVKCachedDataRecordFlagCompressionZlib)
+        payload = [payload zlibDecompressedDataWithLength:(NSUInteger) header.logicalLength];
+    else if (header.logicalLength != header.length)
+        payload = nil;
+
+    if (nil == payload)
+        return nil;
+
+    VKCachedDataRecord *record = [[VKCachedDataRecord alloc] init];
+    record->_flags = header.flags;
+    record->_liveTime = header.liveTime;
+    record->_creationTimestamp = (NSUInteger) header.creationTimestamp;
+    record->_payload = payload;
+    record->_storedLength = (NSUInteger) header.length;
+
+    return record;
+}
+
++ (BOOL)readHeader:(VKCachedDataRecordHeader *)header
+            ofFile:(NSString *)path
+{
+    int fd = open([path fileSystemRepresentation], O_RDONLY);
+
+    if (-1 == fd)
+        return NO;
+
+    ssize_t readLength = pread(fd, header, sizeof(*header), 0);
+    close(fd);
+
+    return ((ssize_t) sizeof(*header) == readLength &&
+            kVKCachedDataRecordMagic == header->magic &&
+            kVKCachedDataRecordVersion == header->version);
+}
+
++ (void)fillHeader:(VKCachedDataRecordHeader *)header
+       withPayload:(NSData *)payload
+          liveTime:(NSUInteger)liveTime
+ creationTimestamp:(NSUInteger)creationTimestamp
+{
+    memset(header, 0, sizeof(*header));
+
+    header->magic = kVKCachedDataRecordMagic;
+    header->version = kVKCachedDataRecordVersion;
+    header->liveTime = (uint32_t) liveTime;
+    header->creationTimestamp = creationTimestamp;
+    header->length = [payload length];
+    header->logicalLength = [payload length];
+    header->checksum = (uint32_t) crc32(0, [payload bytes], (uInt) [payload length]);
+}
+
++ (NSData *)fillHeader:(VKCachedDataRecordHeader *)header
+           withPayload:(NSData *)payload
+              liveTime:(NSUInteger)liveTime
+     creationTimestamp:(NSUInteger)creationTimestamp
+           compression:(VKCachedDataCompression)compression
+{
+    NSData *storedPayload = nil;
+    uint16_t flags = 0;
+
+    switch (compression) {
+        case VKCachedDataCompressionLZ4:
+            storedPayload = [payload LZ4CompressedData];
+            flags = kVKCachedDataRecordFlagCompressionLZ4;
+            break;
+
+        case VKCachedDataCompressionZlib:
+            storedPayload = [payload zlibCompressedData];
+            flags = kVKCachedDataRecordFlagCompressionZlib;
+            break;
+
+        default:
+            break;
+    }
+
+//    несжимаемые данные (например, уже сжатые изображения) хранятся как есть
+    if (nil == storedPayload || [storedPayload length] >= [payload length]) {
+        storedPayload = payload;
+        flags = 0;
+    }
+
+    [self fillHeader:header
+         withPayload:storedPayload
+            liveTime:liveTime
+   creationTimestamp:creationTimestamp];
+
+    header->flags = flags;
+    header->logicalLength = [payload length];
+
+    return storedPayload;
+}
+
++ (BOOL)writeRecordWithPayload:(NSData *)payload
+                      liveTime:(NSUInteger)liveTime
+             creationTimestamp:(NSUInteger)creationTimestamp
+                        toFile:(NSString *)path
+{
+    VKCachedDataRecordHeader header;
+
+    [self fillHeader:&header
+         withPayload:payload
+            liveTime:liveTime
+   creationTimestamp:creationTimestamp];
+
+    return [self writeRecordWithHeader:&header
+                               payload:payload
+                                toFile:path];
+}
+
++ (BOOL)writeRecordWithHeader:(const VKCachedDataRecordHeader *)header
+                      payload:(NSData *)payload
+                       toFile:(NSString *)path
+{
+//    запись производится во временный файл, который затем переименовывается,
+//    чтобы читатели никогда не увидели частично записанную запись
+    NSString *temporaryPath = [path stringByAppendingString:@".XXXXXX"];
+    char *temporaryFileName = strdup([temporaryPath fileSystemRepresentation]);
+    int fd = mkstemp(temporaryFileName);
+
+    if (-1 == fd) {
+        free(temporaryFileName);
+        return NO;
+    }
+
+    struct iovec parts[2];
+    parts[0].iov_base = (void *) header;
+    parts[0].iov_len = sizeof(*header);
+    parts[1].iov_base = (void *) [payload bytes];
+    parts[1].iov_len = [payload length];
+
+    BOOL success = VKWriteVectorFully(fd, parts, 2);
+
+    close(fd);
+
+    if (success)
+        success = (0 == rename(temporaryFileName, [path fileSystemRepresentation]));
+
+    if (!success)
+        unlink(temporaryFileName);
+
+    free(temporaryFileName);
+
+    return success;
+}
+
+@end
@@ -0,0 +1,88 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import <Foundation/Foundation.h>
+#import "VKCachedDataStore.h"
+
+/** Наименование поддиректории кэша, в которой находятся сегменты журнала
+*/
+static NSString *const kVKCachedDataSegmentStoreDirectoryName = @"segments";
+
+/** Размер (в байтах), по достижении которого текущий сегмент журнала закрывается
+и начинается новый
+*/
+static off_t const kVKCachedDataSegmentMaxSize = 4 * 1024 * 1024;
+
+/** Доля "мёртвых" (перезаписанных и удалённых) данных в закрытых сегментах, по
+достижении которой запускается уплотнение журнала
+*/
+static double const kVKCachedDataSegmentCompactionRatio = 0.5;
+
+/** Журнальное хранилище записей кэша.
+
+Записи не хранятся в отдельных файлах, а дописываются в конец текущего сегмента
+журнала (файл размером до kVKCachedDataSegmentMaxSize), поэтому запись данных -
+это последовательная запись в уже открытый файл без создания файлов и
+переименований. Каждая запись в сегменте предваряется её ключом. Удаление записи
+дописывает в журнал запись-надгробие (kVKCachedDataRecordFlagTombstone).
+
+Положение каждой действующей записи (сегмент и смещение) хранится в оперативной
+памяти и восстанавливается при инициализации последовательным чтением заголовков
+записей сегментов.
+
+Когда доля перезаписанных и удалённых данных в закрытых сегментах превышает
+kVKCachedDataSegmentCompactionRatio, в фоне с низким приоритетом производится
+уплотнение: действующие записи самого старого сегмента переносятся в текущий
+сегмент, после чего старый сегмент удаляется. Уплотнение производится по одному
+сегменту за раз и не блокирует работу с хранилищем надолго.
+
+Удаление всех записей сводится к удалению нескольких файлов сегментов.
+*/
+@interface VKCachedDataSegmentStore : NSObject <VKCachedDataStore>
+
+/**
+@name Свойства
+*/
+/** Суммарный размер (в байтах) всех сегментов журнала
+*/
+@property (nonatomic, readonly) NSUInteger totalSize;
+
+/** Суммарный размер (в байтах) перезаписанных и удалённых данных в сегментах журнала
+*/
+@property (nonatomic, readonly) NSUInteger deadSize;
+
+/** Кол-во сегментов журнала
+*/
+@property (nonatomic, readonly) NSUInteger segmentsCount;
+
+/**
+@name Уплотнение
+*/
+/** Уплотняет журнал: удаляет все закрытые сегменты, перенося их действующие
+записи в текущий сегмент. Вызов синхронный.
+*/
+- (void)compact;
+
+@end
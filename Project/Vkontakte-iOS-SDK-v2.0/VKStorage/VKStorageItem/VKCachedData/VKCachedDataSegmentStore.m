@@ -0,0 +1,618 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import "VKCachedDataSegmentStore.h"
+#import "VKCacheKey.h"
+#import <sys/stat.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+
+/** Расширение файлов сегментов журнала
+*/
+static NSString *const kVKCachedDataSegmentFileExtension = @"segment";
+
+
+/** Сегмент журнала
+*/
+@interface VKCachedDataSegment : NSObject
+
+@property (nonatomic, copy) NSString *path;
+@property (nonatomic, assign) int fd;
+
+// суммарная длина всех записей сегмента и длина действующих записей
+@property (nonatomic, assign) off_t size;
+@property (nonatomic, assign) off_t liveSize;
+
+// в сегмент дописаны данные, не сброшенные на диск
+@property (nonatomic, assign) BOOL needsSynchronize;
+
+@end
+
+@implementation VKCachedDataSegment
+@end
+
+
+/** Положение действующей записи в журнале
+*/
+@interface VKCachedDataSegmentLocation : NSObject
+
+@property (nonatomic, strong) VKCachedDataSegment *segment;
+
+// смещение начала записи (ключа) в сегменте и полная длина записи:
+// ключ, заголовок и данные
+@property (nonatomic, assign) off_t offset;
+@property (nonatomic, assign) off_t length;
+
+@property (nonatomic, assign) VKCachedDataRecordHeader header;
+
+@end
+
+@implementation VKCachedDataSegmentLocation
+@end
+
+
+@implementation VKCachedDataSegmentStore
+{
+    NSString *_directoryPath;
+
+//    всё состояние хранилища изменяется только на этой очереди
+    dispatch_queue_t _queue;
+    dispatch_queue_t _compactionQueue;
+    BOOL _isCompactionScheduled;
+
+    NSMutableDictionary *_locations;
+    NSMutableArray *_segments;
+    VKCachedDataSegment *_activeSegment;
+    NSUInteger _lastSegmentID;
+}
+
+#pragma mark Visible VKCachedDataSegmentStore methods
+#pragma mark - Init methods
+
+- (instancetype)initWithDirectory:(NSString *)path
+{
+    self = [super init];
+
+    if (self) {
+        _directoryPath = [path stringByAppendingPathComponent:kVKCachedDataSegmentStoreDirectoryName];
+
+        _queue = dispatch_queue_create("com.vk.cacheddata.segmentstore", DISPATCH_QUEUE_SERIAL);
+        _compactionQueue = dispatch_queue_create("com.vk.cacheddata.segmentstore.compaction", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_compactionQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+
+        _locations = [[NSMutableDictionary alloc] init];
+        _segments = [[NSMutableArray alloc] init];
+        _lastSegmentID = 0;
+
+        [[NSFileManager defaultManager]
+                        createDirectoryAtPath:_directoryPath
+                  withIntermediateDirectories:YES
+                                   attributes:nil
+                                        error:nil];
+
+        [self loadSegments];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    for (VKCachedDataSegment *segment in _segments)
+        close(segment.fd);
+}
+
+#pragma mark - Getters
+
+- (NSUInteger)totalSize
+{
+    __block off_t totalSize = 0;
+
+    dispatch_sync(_queue, ^
+    {
+        for (VKCachedDataSegment *segment in _segments)
+            totalSize += segment.size;
+    });
+
+    return (NSUInteger) totalSize;
+}
+
+- (NSUInteger)deadSize
+{
+    __block off_t deadSize = 0;
+
+    dispatch_sync(_queue, ^
+    {
+        for (VKCachedDataSegment *segment in _segments)
+            deadSize += segment.size - segment.liveSize;
+    });
+
+    return (NSUInteger) deadSize;
+}
+
+- (NSUInteger)segmentsCount
+{
+    __block NSUInteger segmentsCount;
+
+    dispatch_sync(_queue, ^
+    {
+        segmentsCount = [_segments count];
+    });
+
+    return segmentsCount;
+}
+
+#pragma mark - VKCachedDataStore
+
+- (BOOL)writeRecordWithHeader:(const VKCachedDataRecordHeader *)header
+                      payload:(NSData *)payload
+                       forKey:(NSString *)key
+{
+    __block BOOL success = NO;
+
+    dispatch_sync(_queue, ^
+    {
+        uint8_t keyBytes[kVKCacheKeyLength];
+
+        if (!VKCacheKeyGetBytes(key, keyBytes))
+            return;
+
+        VKCachedDataRecordHeader recordHeader = *header;
+        struct iovec parts[3];
+        parts[0].iov_base = keyBytes;
+        parts[0].iov_len = sizeof(keyBytes);
+        parts[1].iov_base = &recordHeader;
+        parts[1].iov_len = sizeof(recordHeader);
+        parts[2].iov_base = (void *) [payload bytes];
+        parts[2].iov_len = [payload length];
+
+        VKCachedDataSegmentLocation *location = [self appendRecordParts:parts
+                                                                  count:3
+                                                                 header:recordHeader];
+
+        if (nil == location)
+            return;
+
+        [self setLocation:location
+                   forKey:key];
+
+        [self scheduleCompactionIfNeeded];
+
+        success = YES;
+    });
+
+    return success;
+}
+
+- (VKCachedDataRecord *)recordForKey:(NSString *)key
+{
+    __block int fd = -1;
+    __block off_t offset = 0;
+
+    dispatch_sync(_queue, ^
+    {
+        VKCachedDataSegmentLocation *location = _locations[key];
+
+        if (nil == location)
+            return;
+
+//        дескриптор дублируется, чтобы уплотнение могло удалить сегмент, не
+//        дожидаясь окончания чтения
+        fd = dup(location.segment.fd);
+        offset = location.offset + kVKCacheKeyLength;
+    });
+
+    if (-1 == fd)
+        return nil;
+
+    VKCachedDataRecord *record = [VKCachedDataRecord recordWithFileDescriptor:fd
+                                                                       offset:offset];
+    close(fd);
+
+    return record;
+}
+
+- (void)removeRecordForKey:(NSString *)key
+{
+    dispatch_sync(_queue, ^
+    {
+        uint8_t keyBytes[kVKCacheKeyLength];
+
+        if (nil == _locations[key] || !VKCacheKeyGetBytes(key, keyBytes))
+            return;
+
+//        надгробие не даст восстановить удалённую запись при следующей загрузке
+        VKCachedDataRecordHeader header;
+
+        [VKCachedDataRecord fillHeader:&header
+                           withPayload:nil
+                              liveTime:0
+                     creationTimestamp:0];
+        header.flags = kVKCachedDataRecordFlagTombstone;
+
+        struct iovec parts[2];
+        parts[0].iov_base = keyBytes;
+        parts[0].iov_len = sizeof(keyBytes);
+        parts[1].iov_base = &header;
+        parts[1].iov_len = sizeof(header);
+
+        [self appendRecordParts:parts
+                          count:2
+                         header:header];
+
+        [self setLocation:nil
+                   forKey:key];
+
+        [self scheduleCompactionIfNeeded];
+    });
+}
+
+- (void)removeAllRecords
+{
+    dispatch_sync(_queue, ^
+    {
+        for (VKCachedDataSegment *segment in _segments)
+            close(segment.fd);
+
+        [_segments removeAllObjects];
+        [_locations removeAllObjects];
+        _activeSegment = nil;
+
+        [[NSFileManager defaultManager] removeItemAtPath:_directoryPath
+                                                   error:nil];
+
+        [[NSFileManager defaultManager]
+                        createDirectoryAtPath:_directoryPath
+                  withIntermediateDirectories:YES
+                                   attributes:nil
+                                        error:nil];
+    });
+}
+
+- (void)synchronize
+{
+    NSMutableArray *descriptors = [[NSMutableArray alloc] init];
+
+//    fsync выполняется вне очереди хранилища, чтобы не блокировать чтение -
+//    копия дескриптора остаётся действительной, даже если сегмент будет удалён
+    dispatch_sync(_queue, ^
+    {
+        for (VKCachedDataSegment *segment in _segments) {
+            if (!segment.needsSynchronize)
+                continue;
+
+            int fd = dup(segment.fd);
+
+            if (-1 == fd)
+                continue;
+
+            [descriptors addObject:@(fd)];
+            segment.needsSynchronize = NO;
+        }
+    });
+
+    for (NSNumber *descriptor in descriptors) {
+        fsync([descriptor intValue]);
+        close([descriptor intValue]);
+    }
+}
+
+- (void)enumerateRecordHeadersUsingBlock:(void (^)(NSString *key, VKCachedDataRecordHeader *header))block
+{
+    __block NSDictionary *locations;
+
+    dispatch_sync(_queue, ^
+    {
+        locations = [_locations copy];
+    });
+
+    [locations enumerateKeysAndObjectsUsingBlock:^(NSString *key,
+                                                   VKCachedDataSegmentLocation *location,
+                                                   BOOL *stop)
+    {
+        VKCachedDataRecordHeader header = location.header;
+
+        block(key, &header);
+    }];
+}
+
+#pragma mark - Compaction
+
+- (void)compact
+{
+    dispatch_sync(_queue, ^
+    {
+//        уплотняются только сегменты, закрытые на момент вызова - сегменты,
+//        созданные во время уплотнения, содержат лишь перенесённые записи
+        NSMutableArray *sealedSegments = [_segments mutableCopy];
+
+        if (nil != _activeSegment)
+            [sealedSegments removeObject:_activeSegment];
+
+        while ([_segments count] > 0 && [sealedSegments containsObject:_segments[0]]) {
+            [sealedSegments removeObject:_segments[0]];
+            [self compactOldestSegment];
+        }
+    });
+}
+
+#pragma mark - private methods
+
+// все приватные методы вызываются только на очереди _queue (либо при инициализации)
+
+- (void)loadSegments
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSArray *fileNames = [[fileManager contentsOfDirectoryAtPath:_directoryPath error:nil]
+                                       sortedArrayUsingSelector:@selector(compare:)];
+
+    for (NSString *fileName in fileNames) {
+        NSString *filePath = [_directoryPath stringByAppendingPathComponent:fileName];
+
+        if (![kVKCachedDataSegmentFileExtension isEqualToString:[fileName pathExtension]]) {
+            [fileManager removeItemAtPath:filePath error:nil];
+            continue;
+        }
+
+        int fd = open([filePath fileSystemRepresentation], O_RDWR);
+        struct stat fileInfo;
+
+        if (-1 == fd)
+            continue;
+
+        if (0 != fstat(fd, &fileInfo)) {
+            close(fd);
+            continue;
+        }
+
+        VKCachedDataSegment *segment = [[VKCachedDataSegment alloc] init];
+        segment.path = filePath;
+        segment.fd = fd;
+        segment.size = fileInfo.st_size;
+        segment.liveSize = 0;
+
+        [_segments addObject:segment];
+        _lastSegmentID = MAX(_lastSegmentID, (NSUInteger) [[fileName stringByDeletingPathExtension] integerValue]);
+
+        [self loadRecordsOfSegment:segment];
+    }
+
+//    дописывание продолжается в последний сегмент
+    _activeSegment = [_segments lastObject];
+}
+
+- (void)loadRecordsOfSegment:(VKCachedDataSegment *)segment
+{
+    off_t offset = 0;
+    off_t recordHeaderLength = kVKCacheKeyLength + sizeof(VKCachedDataRecordHeader);
+
+    while (offset < segment.size) {
+        uint8_t keyBytes[kVKCacheKeyLength];
+        VKCachedDataRecordHeader header;
+
+        BOOL valid = (offset + recordHeaderLength <= segment.size &&
+                (ssize_t) sizeof(keyBytes) == pread(segment.fd, keyBytes, sizeof(keyBytes), offset) &&
+                (ssize_t) sizeof(header) == pread(segment.fd, &header, sizeof(header), offset + kVKCacheKeyLength) &&
+                kVKCachedDataRecordMagic == header.magic &&
+                kVKCachedDataRecordVersion == header.version &&
+                header.length <= (uint64_t) (segment.size - offset - recordHeaderLength));
+
+        if (!valid) {
+//            запись прервана (например, приложение было завершено во время
+//            записи) - отбрасываем хвост сегмента
+            ftruncate(segment.fd, offset);
+            segment.size = offset;
+
+            break;
+        }
+
+        VKCachedDataSegmentLocation *location = [[VKCachedDataSegmentLocation alloc] init];
+        location.segment = segment;
+        location.offset = offset;
+        location.length = recordHeaderLength + (off_t) header.length;
+        location.header = header;
+
+        [self setLocation:((header.flags & kVKCachedDataRecordFlagTombstone) ? nil : location)
+                   forKey:VKCacheKeyWithBytes(keyBytes)];
+
+        offset += location.length;
+    }
+}
+
+- (VKCachedDataSegment *)activeSegmentForWriting
+{
+    if (nil != _activeSegment && _activeSegment.size < kVKCachedDataSegmentMaxSize)
+        return _activeSegment;
+
+    _lastSegmentID++;
+
+//    имена сегментов одной длины - лексикографический порядок совпадает с порядком создания
+    NSString *fileName = [NSString stringWithFormat:@"%010lu.%@",
+                                                    (unsigned long) _lastSegmentID,
+                                                    kVKCachedDataSegmentFileExtension];
+    NSString *filePath = [_directoryPath stringByAppendingPathComponent:fileName];
+    int fd = open([filePath fileSystemRepresentation], O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (-1 == fd)
+        return nil;
+
+    VKCachedDataSegment *segment = [[VKCachedDataSegment alloc] init];
+    segment.path = filePath;
+    segment.fd = fd;
+    segment.size = 0;
+    segment.liveSize = 0;
+
+    [_segments addObject:segment];
+    _activeSegment = segment;
+
+    return segment;
+}
+
+- (VKCachedDataSegmentLocation *)appendRecordParts:(struct iovec *)parts
+                                             count:(int)count
+                                            header:(VKCachedDataRecordHeader)header
+{
+    VKCachedDataSegment *segment = [self activeSegmentForWriting];
+
+    if (nil == segment)
+        return nil;
+
+    off_t length = 0;
+
+    for (int i = 0; i < count; i++)
+        length += parts[i].iov_len;
+
+    if (-1 == lseek(segment.fd, segment.size, SEEK_SET) || !VKWriteVectorFully(segment.fd, parts, count)) {
+//        частично записанную запись отбрасываем
+        ftruncate(segment.fd, segment.size);
+        return nil;
+    }
+
+    VKCachedDataSegmentLocation *location = [[VKCachedDataSegmentLocation alloc] init];
+    location.segment = segment;
+    location.offset = segment.size;
+    location.length = length;
+    location.header = header;
+
+    segment.size += length;
+    segment.needsSynchronize = YES;
+
+    return location;
+}
+
+- (void)setLocation:(VKCachedDataSegmentLocation *)location
+             forKey:(NSString *)key
+{
+//    предыдущая версия записи становится "мёртвой"
+    VKCachedDataSegmentLocation *oldLocation = _locations[key];
+
+    if (nil != oldLocation)
+        oldLocation.segment.liveSize -= oldLocation.length;
+
+    if (nil == location) {
+        [_locations removeObjectForKey:key];
+        return;
+    }
+
+    _locations[key] = location;
+    location.segment.liveSize += location.length;
+}
+
+- (BOOL)needsCompaction
+{
+    off_t sealedSize = 0;
+    off_t sealedDeadSize = 0;
+
+    for (VKCachedDataSegment *segment in _segments) {
+        if (segment == _activeSegment)
+            continue;
+
+        sealedSize += segment.size;
+        sealedDeadSize += segment.size - segment.liveSize;
+    }
+
+    return (sealedSize > 0 && sealedDeadSize >= sealedSize * kVKCachedDataSegmentCompactionRatio);
+}
+
+- (void)scheduleCompactionIfNeeded
+{
+    if (_isCompactionScheduled || ![self needsCompaction])
+        return;
+
+    _isCompactionScheduled = YES;
+
+//    уплотняем по одному сегменту, освобождая очередь хранилища между шагами
+    dispatch_async(_compactionQueue, ^
+    {
+        __block BOOL needsCompaction = YES;
+
+        while (needsCompaction) {
+            dispatch_sync(_queue, ^
+            {
+                [self compactOldestSegment];
+
+                needsCompaction = [self needsCompaction];
+
+                if (!needsCompaction)
+                    _isCompactionScheduled = NO;
+            });
+        }
+    });
+}
+
+- (void)compactOldestSegment
+{
+    VKCachedDataSegment *oldestSegment = ([_segments count] > 0 ? _segments[0] : nil);
+
+//    текущий сегмент не уплотняется
+    if (nil == oldestSegment || oldestSegment == _activeSegment)
+        return;
+
+    NSMutableArray *liveKeys = [[NSMutableArray alloc] init];
+
+    [_locations enumerateKeysAndObjectsUsingBlock:^(NSString *key,
+                                                    VKCachedDataSegmentLocation *location,
+                                                    BOOL *stop)
+    {
+        if (location.segment == oldestSegment)
+            [liveKeys addObject:key];
+    }];
+
+//    самый старый сегмент - надгробия в нём больше ничего не скрывают и
+//    переносятся лишь действующие записи
+    for (NSString *key in liveKeys) {
+        VKCachedDataSegmentLocation *location = _locations[key];
+        NSMutableData *recordData = [[NSMutableData alloc] initWithLength:(NSUInteger) location.length];
+        VKCachedDataSegmentLocation *newLocation = nil;
+
+        if (location.length == pread(oldestSegment.fd, [recordData mutableBytes], (size_t) location.length, location.offset)) {
+            struct iovec part;
+            part.iov_base = [recordData mutableBytes];
+            part.iov_len = (size_t) location.length;
+
+            newLocation = [self appendRecordParts:&part
+                                            count:1
+                                           header:location.header];
+        }
+
+//        не перенесённая запись теряется - кэш узнает об этом при её чтении
+        [self setLocation:newLocation
+                   forKey:key];
+    }
+
+//    перенесённые записи должны оказаться на диске раньше, чем исчезнет сегмент
+    if (_activeSegment.needsSynchronize) {
+        fsync(_activeSegment.fd);
+        _activeSegment.needsSynchronize = NO;
+    }
+
+    close(oldestSegment.fd);
+    unlink([oldestSegment.path fileSystemRepresentation]);
+
+    [_segments removeObjectAtIndex:0];
+}
+
+@end
@@ -0,0 +1,87 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import <Foundation/Foundation.h>
+#import "VKCachedDataRecord.h"
+
+/** Протокол хранилища записей кэша на диске.
+
+Хранилище отвечает лишь за размещение записей (VKCachedDataRecord) на диске.
+Метаданные записей, сроки жизни и вытеснение находятся в ведении VKCachedData
+и индекса кэша (VKCacheIndex). Все методы могут вызываться из любого потока.
+*/
+@protocol VKCachedDataStore <NSObject>
+
+@required
+/** Инициализация хранилища
+
+@param path директория кэша, в которой хранилище размещает свои файлы
+@return объект хранилища
+*/
+- (instancetype)initWithDirectory:(NSString *)path;
+
+/** Сохраняет запись
+
+@param header заголовок записи (см. VKCachedDataRecord
+fillHeader:withPayload:liveTime:creationTimestamp:compression:)
+@param payload данные, записываемые следом за заголовком (возможно сжатые)
+@param key ключ записи
+@return YES, если запись сохранена
+*/
+- (BOOL)writeRecordWithHeader:(const VKCachedDataRecordHeader *)header
+                      payload:(NSData *)payload
+                       forKey:(NSString *)key;
+
+/** Читает запись
+
+@param key ключ записи
+@return запись, либо nil, если записи нет или она повреждена
+*/
+- (VKCachedDataRecord *)recordForKey:(NSString *)key;
+
+/** Удаляет запись
+
+@param key ключ записи
+*/
+- (void)removeRecordForKey:(NSString *)key;
+
+/** Удаляет все записи хранилища
+*/
+- (void)removeAllRecords;
+
+/** Сбрасывает на диск все записанные с момента предыдущего вызова данные (fsync).
+Записи и удаления не дожидаются сброса на диск, поэтому метод следует вызывать
+один раз после порции операций.
+*/
+- (void)synchronize;
+
+/** Перебирает заголовки всех записей хранилища (используется для восстановления
+индекса кэша). Повреждённые записи при этом удаляются.
+
+@param block блок, вызываемый для каждой записи
+*/
+- (void)enumerateRecordHeadersUsingBlock:(void (^)(NSString *key, VKCachedDataRecordHeader *header))block;
+
+@end
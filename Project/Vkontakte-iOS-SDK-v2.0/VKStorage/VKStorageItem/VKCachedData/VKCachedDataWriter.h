@@ -0,0 +1,269 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import <Foundation/Foundation.h>
+#import "VKCachedDataStore.h"
+
+/** Задержка (в секундах) между постановкой операции в очередь и её выполнением
+по умолчанию. Повторные записи одного ключа в течение этого времени объединяются.
+*/
+static NSTimeInterval const kVKCachedDataWriterDefaultWriteDelay = 0.5;
+
+/** Кол-во ожидающих операций, при котором они выполняются без задержки
+*/
+static NSUInteger const kVKCachedDataWriterMaxPendingCount = 64;
+
+@class VKCachedDataWriter;
+@class VKCachedDataWriteOperation;
+@class VKCacheStatistics;
+
+
+/** Начинает фоновую задачу приложения (UIApplication
+beginBackgroundTaskWithExpirationHandler:), в течение которой система не
+приостанавливает приложение, ушедшее в фон. Задача завершается вызовом
+VKCachedDataEndBackgroundTask, либо по истечении отведённого системой времени.
+
+@return идентификатор фоновой задачи
+*/
+NSUInteger VKCachedDataBeginBackgroundTask(void);
+
+/** Завершает фоновую задачу приложения. Повторное завершение задачи допустимо.
+
+@param backgroundTask идентификатор задачи (см. VKCachedDataBeginBackgroundTask)
+*/
+void VKCachedDataEndBackgroundTask(NSUInteger backgroundTask);
+
+
+/** Протокол делегата отложенной записи
+*/
+@protocol VKCachedDataWriterDelegate <NSObject>
+
+@required
+/** Размер содержимого, уже находящегося в хранилище. Вызывается на очереди записи
+перед сохранением данных и перед удалением содержимого.
+
+@param writer объект отложенной записи
+@param contentKey ключ содержимого (см. VKCacheKey keyForContent:)
+@return размер содержимого на диске, либо NSNotFound, если на содержимое не
+ссылается ни одна запись кэша
+*/
+- (NSUInteger)cachedDataWriter:(VKCachedDataWriter *)writer
+           sizeOfContentForKey:(NSString *)contentKey;
+
+/** Данные записи сохранены в хранилище (ключ содержимого и размер данных на диске
+указаны в операции)
+
+Метод не вызывается, если после сохранения записи для её ключа уже поставлена
+в очередь новая операция. Вызывается на очереди записи, при этом очередь операций
+заблокирована - метод не должен обращаться к объекту отложенной записи.
+
+@param writer объект отложенной записи
+@param operation выполненная операция
+*/
+- (void)cachedDataWriter:(VKCachedDataWriter *)writer
+       didWriteOperation:(VKCachedDataWriteOperation *)operation;
+
+/** Очередная порция операций выполнена и сброшена на диск
+
+@param writer объект отложенной записи
+*/
+- (void)cachedDataWriterDidFinishBatch:(VKCachedDataWriter *)writer;
+
+@end
+
+
+/** Ожидающая выполнения операция с записью кэша
+*/
+@interface VKCachedDataWriteOperation : NSObject
+
+/** Ключ записи
+*/
+@property (nonatomic, copy) NSString *key;
+
+/** Данные записи, либо nil, если запись удаляется
+*/
+@property (nonatomic, strong) NSData *payload;
+
+/** Время жизни записи
+*/
+@property (nonatomic, assign) NSUInteger liveTime;
+
+/** Время создания записи
+*/
+@property (nonatomic, assign) NSUInteger creationTimestamp;
+
+/** Способ сжатия данных записи
+*/
+@property (nonatomic, assign) VKCachedDataCompression compression;
+
+/** Хэш наименования метода API, ответ которого хранится в записи, либо 0
+*/
+@property (nonatomic, assign) uint32_t methodHash;
+
+/** Хэши тегов записи (см. VKCacheKey hashForTag:) - массив объектов типа NSNumber,
+либо nil
+*/
+@property (nonatomic, copy) NSArray *tagHashes;
+
+/** Ключ содержимого, под которым данные записи хранятся в хранилище (см. VKCacheKey
+keyForContent:). Для операции сохранения заполняется при её выполнении. Операция
+удаления с указанным ключом содержимого удаляет содержимое, если на него больше не
+ссылается ни одна запись кэша.
+*/
+@property (nonatomic, copy) NSString *contentKey;
+
+/** Размер данных записи на диске (после сжатия). Заполняется при выполнении
+операции сохранения.
+*/
+@property (nonatomic, assign) NSUInteger storedLength;
+
+@end
+
+
+/** Отложенная запись в хранилище записей кэша.
+
+Операции записи и удаления не выполняются сразу, а накапливаются в течение
+writeDelay секунд и выполняются порцией на отдельной последовательной очереди
+с низким приоритетом:
+- повторные операции с одним ключом объединяются - выполняется лишь последняя
+из них, поэтому порядок операций с одним ключом всегда сохраняется;
+- сжатие данных производится на очереди записи;
+- данные хранятся под ключом содержимого (см. VKCacheKey keyForContent:): если
+такое содержимое уже есть в хранилище, то данные повторно не записываются, а
+ссылка записи на содержимое хранится лишь в индексе кэша;
+- после каждой порции данные сбрасываются на диск одним вызовом synchronize
+хранилища.
+
+Все методы могут вызываться из любого потока.
+*/
+@interface VKCachedDataWriter : NSObject
+
+/**
+@name Свойства
+*/
+/** Делегат отложенной записи
+*/
+@property (nonatomic, weak) id <VKCachedDataWriterDelegate> delegate;
+
+/** Статистика, в которой учитываются объём и время записи. Может быть nil.
+*/
+@property (nonatomic, strong) VKCacheStatistics *statistics;
+
+/** Задержка (в секундах) перед выполнением операций. По умолчанию равна
+kVKCachedDataWriterDefaultWriteDelay.
+*/
+@property (nonatomic, assign, readwrite) NSTimeInterval writeDelay;
+
+/** Межпроцессная блокировка директории кэша (см. VKCacheDirectoryLock). Если
+задана, то каждая порция операций выполняется целиком под блокировкой, а делегат
+уведомляется об окончании порции до её снятия. По умолчанию nil.
+*/
+@property (nonatomic, strong) id <NSLocking> lock;
+
+/** Кол-во ожидающих выполнения операций
+*/
+@property (nonatomic, readonly) NSUInteger pendingCount;
+
+/**
+@name Методы инициализации
+*/
+/** Инициализация объекта отложенной записи
+
+@param store хранилище, в которое производится запись
+@return объект отложенной записи
+*/
+- (instancetype)initWithStore:(id <VKCachedDataStore>)store;
+
+/**
+@name Операции
+*/
+/** Ставит в очередь сохранение записи
+
+@param payload данные записи
+@param liveTime время жизни записи
+@param creationTimestamp время создания записи
+@param compression способ сжатия данных записи
+@param methodHash хэш наименования метода API (см. VKCacheKey hashForMethod:),
+либо 0, если метод неизвестен
+@param tagHashes хэши тегов записи (см. VKCacheKey hashForTag:), либо nil
+@param key ключ записи
+*/
+- (void)writeRecordWithPayload:(NSData *)payload
+                      liveTime:(NSUInteger)liveTime
+             creationTimestamp:(NSUInteger)creationTimestamp
+                   compression:(VKCachedDataCompression)compression
+                    methodHash:(uint32_t)methodHash
+                     tagHashes:(NSArray *)tagHashes
+                        forKey:(NSString *)key;
+
+/** Ставит в очередь удаление записи
+
+@param key ключ записи
+*/
+- (void)removeRecordForKey:(NSString *)key;
+
+/** Ставит в очередь удаление содержимого. Содержимое будет удалено, только если
+к моменту выполнения операции на него не ссылается ни одна запись кэша (см.
+VKCachedDataWriterDelegate cachedDataWriter:sizeOfContentForKey:).
+
+@param contentKey ключ содержимого
+*/
+- (void)removeContentForKey:(NSString *)contentKey;
+
+/** Отменяет все ожидающие операции и ставит в очередь удаление всех записей
+хранилища
+*/
+- (void)removeAllRecords;
+
+/** Последняя ожидающая (либо выполняемая в данный момент) операция с записью
+
+@param key ключ записи
+@return экземпляр класса VKCachedDataWriteOperation, либо nil, если операций
+с этой записью нет
+*/
+- (VKCachedDataWriteOperation *)pendingOperationForKey:(NSString *)key;
+
+/** Ключи записей, сохранение которых с указанным тегом ожидает выполнения (либо
+выполняется в данный момент). Таких записей ещё нет в индексе кэша.
+
+@param tagHash хэш тега (см. VKCacheKey hashForTag:)
+@return массив ключей записей (NSString)
+*/
+- (NSArray *)pendingKeysForTagHash:(uint32_t)tagHash;
+
+/** Немедленно выполняет все ожидающие операции и сбрасывает данные на диск.
+Вызов синхронный.
+*/
+- (void)flush;
+
+/** Выполняет блок на очереди записи между порциями операций под блокировкой lock.
+Пока блок выполняется, хранилище не изменяется ни текущим объектом, ни (при
+заданной блокировке) другими процессами. Вызов асинхронный.
+
+@param block блок, обращающийся к хранилищу
+*/
+- (void)performBlockBetweenBatches:(void (^)(void))block;
+
+@end
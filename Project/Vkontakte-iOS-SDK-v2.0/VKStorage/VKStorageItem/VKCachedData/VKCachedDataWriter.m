@@ -0,0 +1,431 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import <TargetConditionals.h>
+#if TARGET_OS_IPHONE
+#import <UIKit/UIKit.h>
+#endif
+#import "VKCachedDataWriter.h"
+#import "VKCacheStatistics.h"
+#import "VKCacheKey.h"
+
+
+#if TARGET_OS_IPHONE
+// незавершённые фоновые задачи; задача может быть завершена как по окончании
+// работы, так и по истечении отведённого времени - но лишь один раз
+static NSMutableIndexSet *VKCachedDataActiveBackgroundTasks(void)
+{
+    static NSMutableIndexSet *activeBackgroundTasks;
+    static dispatch_once_t onceToken;
+
+    dispatch_once(&onceToken, ^
+    {
+        activeBackgroundTasks = [[NSMutableIndexSet alloc] init];
+    });
+
+    return activeBackgroundTasks;
+}
+#endif
+
+NSUInteger VKCachedDataBeginBackgroundTask(void)
+{
+#if TARGET_OS_IPHONE
+    UIApplication *application = [UIApplication sharedApplication];
+    __block UIBackgroundTaskIdentifier backgroundTask = UIBackgroundTaskInvalid;
+
+    @synchronized (VKCachedDataActiveBackgroundTasks()) {
+        backgroundTask = [application beginBackgroundTaskWithExpirationHandler:^
+        {
+            VKCachedDataEndBackgroundTask(backgroundTask);
+        }];
+
+        if (UIBackgroundTaskInvalid != backgroundTask)
+            [VKCachedDataActiveBackgroundTasks() addIndex:backgroundTask];
+    }
+
+    return backgroundTask;
+#else
+    return 0;
+#endif
+}
+
+void VKCachedDataEndBackgroundTask(NSUInteger backgroundTask)
+{
+#if TARGET_OS_IPHONE
+    @synchronized (VKCachedDataActiveBackgroundTasks()) {
+        if (![VKCachedDataActiveBackgroundTasks() containsIndex:backgroundTask])
+            return;
+
+        [VKCachedDataActiveBackgroundTasks() removeIndex:backgroundTask];
+    }
+
+    [[UIApplication sharedApplication] endBackgroundTask:backgroundTask];
+#endif
+}
+
+
+@implementation VKCachedDataWriteOperation
+@end
+
+
+@implementation VKCachedDataWriter
+{
+    id <VKCachedDataStore> _store;
+
+//    очередь операций изменяется только на _stateQueue, операции выполняются
+//    на _writeQueue
+    dispatch_queue_t _stateQueue;
+    dispatch_queue_t _writeQueue;
+
+    NSMutableDictionary *_pendingOperations;
+    NSMutableArray *_pendingKeys;
+    BOOL _isRemoveAllPending;
+    BOOL _isDrainScheduled;
+
+//    операции выполняемой в данный момент порции
+    NSMutableDictionary *_inFlightOperations;
+}
+
+#pragma mark Visible VKCachedDataWriter methods
+#pragma mark - Init methods
+
+- (instancetype)initWithStore:(id <VKCachedDataStore>)store
+{
+    self = [super init];
+
+    if (self) {
+        _store = store;
+        _writeDelay = kVKCachedDataWriterDefaultWriteDelay;
+
+        _stateQueue = dispatch_queue_create("com.vk.cacheddata.writer.state", DISPATCH_QUEUE_SERIAL);
+        _writeQueue = dispatch_queue_create("com.vk.cacheddata.writer", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_writeQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+
+        _pendingOperations = [[NSMutableDictionary alloc] init];
+        _pendingKeys = [[NSMutableArray alloc] init];
+        _inFlightOperations = [[NSMutableDictionary alloc] init];
+    }
+
+    return self;
+}
+
+#pragma mark - Getters
+
+- (NSUInteger)pendingCount
+{
+    __block NSUInteger pendingCount;
+
+    dispatch_sync(_stateQueue, ^
+    {
+        pendingCount = [_pendingKeys count];
+    });
+
+    return pendingCount;
+}
+
+#pragma mark - Operations
+
+- (void)writeRecordWithPayload:(NSData *)payload
+                      liveTime:(NSUInteger)liveTime
+             creationTimestamp:(NSUInteger)creationTimestamp
+                   compression:(VKCachedDataCompression)compression
+                    methodHash:(uint32_t)methodHash
+                     tagHashes:(NSArray *)tagHashes
+                        forKey:(NSString *)key
+{
+    if (nil == payload || nil == key)
+        return;
+
+    VKCachedDataWriteOperation *operation = [[VKCachedDataWriteOperation alloc] init];
+    operation.key = key;
+    operation.payload = payload;
+    operation.liveTime = liveTime;
+    operation.creationTimestamp = creationTimestamp;
+    operation.compression = compression;
+    operation.methodHash = methodHash;
+    operation.tagHashes = tagHashes;
+
+    [self enqueueOperation:operation];
+}
+
+- (void)removeRecordForKey:(NSString *)key
+{
+    if (nil == key)
+        return;
+
+    VKCachedDataWriteOperation *operation = [[VKCachedDataWriteOperation alloc] init];
+    operation.key = key;
+
+    [self enqueueOperation:operation];
+}
+
+- (void)removeContentForKey:(NSString *)contentKey
+{
+    if (nil == contentKey)
+        return;
+
+    VKCachedDataWriteOperation *operation = [[VKCachedDataWriteOperation alloc] init];
+    operation.key = contentKey;
+    operation.contentKey = contentKey;
+
+    [self enqueueOperation:operation];
+}
+
+- (void)removeAllRecords
+{
+    dispatch_sync(_stateQueue, ^
+    {
+        [_pendingOperations removeAllObjects];
+        [_pendingKeys removeAllObjects];
+        [_inFlightOperations removeAllObjects];
+        _isRemoveAllPending = YES;
+
+        [self scheduleDrain];
+    });
+}
+
+- (VKCachedDataWriteOperation *)pendingOperationForKey:(NSString *)key
+{
+    if (nil == key)
+        return nil;
+
+    __block VKCachedDataWriteOperation *operation;
+
+    dispatch_sync(_stateQueue, ^
+    {
+        operation = _pendingOperations[key];
+
+        if (nil == operation)
+            operation = _inFlightOperations[key];
+    });
+
+    return operation;
+}
+
+- (NSArray *)pendingKeysForTagHash:(uint32_t)tagHash
+{
+    NSNumber *hash = @(tagHash);
+    __block NSMutableSet *keys;
+
+    dispatch_sync(_stateQueue, ^
+    {
+        keys = [[NSMutableSet alloc] init];
+
+        for (NSDictionary *operations in @[_pendingOperations, _inFlightOperations]) {
+            for (VKCachedDataWriteOperation *operation in [operations objectEnumerator]) {
+                if (nil != operation.payload && [operation.tagHashes containsObject:hash])
+                    [keys addObject:operation.key];
+            }
+        }
+    });
+
+    return [keys allObjects];
+}
+
+- (void)flush
+{
+    dispatch_sync(_writeQueue, ^
+    {
+        [self drain];
+    });
+}
+
+- (void)performBlockBetweenBatches:(void (^)(void))block
+{
+    id <NSLocking> lock = _lock;
+
+    dispatch_async(_writeQueue, ^
+    {
+        [lock lock];
+        block();
+        [lock unlock];
+    });
+}
+
+#pragma mark - Private methods
+
+- (void)enqueueOperation:(VKCachedDataWriteOperation *)operation
+{
+    dispatch_sync(_stateQueue, ^
+    {
+//        предыдущая операция с тем же ключом ещё не выполнена - она больше
+//        не нужна, достаточно выполнить последнюю
+        if (nil == _pendingOperations[operation.key])
+            [_pendingKeys addObject:operation.key];
+
+        _pendingOperations[operation.key] = operation;
+
+        [self scheduleDrain];
+    });
+}
+
+// вызывается только из _stateQueue
+- (void)scheduleDrain
+{
+    if ([_pendingKeys count] >= kVKCachedDataWriterMaxPendingCount) {
+        dispatch_async(_writeQueue, ^
+        {
+            [self drain];
+        });
+
+        return;
+    }
+
+    if (_isDrainScheduled)
+        return;
+
+    _isDrainScheduled = YES;
+
+    dispatch_time_t drainTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t) (_writeDelay * NSEC_PER_SEC));
+
+    dispatch_after(drainTime, _writeQueue, ^
+    {
+        [self drain];
+    });
+}
+
+// вызывается только из _writeQueue
+- (void)drain
+{
+    __block NSArray *operations;
+    __block BOOL removeAll;
+
+    dispatch_sync(_stateQueue, ^
+    {
+        operations = [_pendingOperations objectsForKeys:_pendingKeys
+                                         notFoundMarker:[NSNull null]];
+        removeAll = _isRemoveAllPending;
+
+        [_inFlightOperations addEntriesFromDictionary:_pendingOperations];
+        [_pendingOperations removeAllObjects];
+        [_pendingKeys removeAllObjects];
+
+        _isRemoveAllPending = NO;
+        _isDrainScheduled = NO;
+    });
+
+    if (!removeAll && 0 == [operations count])
+        return;
+
+    id <VKCachedDataWriterDelegate> delegate = _delegate;
+    VKCacheStatistics *statistics = _statistics;
+    id <NSLocking> lock = _lock;
+
+//    начатая порция операций выполняется целиком, даже если приложение уходит в фон
+    NSUInteger backgroundTask = VKCachedDataBeginBackgroundTask();
+
+    [lock lock];
+
+    if (removeAll)
+        [_store removeAllRecords];
+
+    for (VKCachedDataWriteOperation *operation in operations) {
+        BOOL written = NO;
+
+        if (nil != operation.payload) {
+            written = [self writeContentOfOperation:operation
+                                           delegate:delegate
+                                         statistics:statistics];
+        } else if (nil != operation.contentKey) {
+//            на содержимое могли сослаться уже после того, как его удаление
+//            было поставлено в очередь
+            if (NSNotFound == [delegate cachedDataWriter:self
+                                     sizeOfContentForKey:operation.contentKey])
+                [_store removeRecordForKey:operation.contentKey];
+        } else {
+            [_store removeRecordForKey:operation.key];
+        }
+
+        dispatch_sync(_stateQueue, ^
+        {
+//            операция могла быть отменена удалением всех записей
+            if (_inFlightOperations[operation.key] != operation)
+                return;
+
+            [_inFlightOperations removeObjectForKey:operation.key];
+
+//            если для ключа уже есть новая операция, то сохранённая запись
+//            проживёт недолго - сообщать о ней не нужно
+            if (written && nil == _pendingOperations[operation.key] && !_isRemoveAllPending)
+                [delegate cachedDataWriter:self
+                         didWriteOperation:operation];
+        });
+    }
+
+//    одна синхронизация с диском на всю порцию операций
+    [_store synchronize];
+
+    [delegate cachedDataWriterDidFinishBatch:self];
+
+    [lock unlock];
+
+    VKCachedDataEndBackgroundTask(backgroundTask);
+}
+
+// вызывается только из _writeQueue
+- (BOOL)writeContentOfOperation:(VKCachedDataWriteOperation *)operation
+                       delegate:(id <VKCachedDataWriterDelegate>)delegate
+                     statistics:(VKCacheStatistics *)statistics
+{
+    uint64_t startTimestamp = VKCacheStatisticsTimestamp();
+    NSString *methodName = [statistics methodNameForHash:operation.methodHash];
+    NSString *contentKey = [VKCacheKey keyForContent:operation.payload];
+    NSUInteger storedLength = [delegate cachedDataWriter:self
+                                     sizeOfContentForKey:contentKey];
+
+//    такое содержимое уже хранится - достаточно сослаться на него
+    if (NSNotFound != storedLength) {
+        [statistics recordBytesDeduplicated:storedLength
+                                 methodName:methodName];
+    } else {
+        VKCachedDataRecordHeader header;
+        NSData *storedPayload = [VKCachedDataRecord fillHeader:&header
+                                                   withPayload:operation.payload
+                                                      liveTime:0
+                                             creationTimestamp:operation.creationTimestamp
+                                                   compression:operation.compression];
+        header.flags |= kVKCachedDataRecordFlagContent;
+
+        if (![_store writeRecordWithHeader:&header
+                                   payload:storedPayload
+                                    forKey:contentKey])
+            return NO;
+
+        storedLength = [storedPayload length];
+
+        [statistics recordLatencySinceTimestamp:startTimestamp
+                                      operation:VKCacheStatisticsOperationWrite
+                                     methodName:methodName];
+        [statistics recordBytesWritten:storedLength
+                            methodName:methodName];
+    }
+
+    operation.contentKey = contentKey;
+    operation.storedLength = storedLength;
+
+    return YES;
+}
+
+@end
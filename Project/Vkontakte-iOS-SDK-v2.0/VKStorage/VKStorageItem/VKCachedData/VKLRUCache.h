@@ -0,0 +1,107 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import <Foundation/Foundation.h>
+
+/** Ограниченный по суммарной стоимости (как правило - размеру в байтах) кэш в
+оперативной памяти, вытесняющий давно не использовавшиеся объекты (LRU).
+
+В отличие от NSCache порядок вытеснения строго определен: при превышении лимита
+удаляются объекты, к которым дольше всего не было обращений.
+
+Все методы потокобезопасны.
+*/
+@interface VKLRUCache : NSObject
+
+/**
+@name Свойства
+*/
+/** Максимальная суммарная стоимость объектов находящихся в кэше
+*/
+@property (nonatomic, assign, readwrite) NSUInteger totalCostLimit;
+
+/** Текущая суммарная стоимость объектов находящихся в кэше
+*/
+@property (nonatomic, readonly) NSUInteger totalCost;
+
+/** Кол-во объектов находящихся в кэше
+*/
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+@name Методы инициализации
+*/
+/** Инициализация кэша с указанным ограничением суммарной стоимости
+
+@param totalCostLimit максимальная суммарная стоимость объектов в кэше
+@return экземпляр класса VKLRUCache
+*/
+- (instancetype)initWithTotalCostLimit:(NSUInteger)totalCostLimit;
+
+/**
+@name Методы манипуляции с кэшем
+*/
+/** Возвращает объект по ключу, либо nil, если объекта нет.
+Объект становится самым "свежим" в очереди вытеснения.
+
+@param key ключ объекта
+@return объект ассоциированный с ключом
+*/
+- (id)objectForKey:(id)key;
+
+/** Добавляет объект в кэш. Если стоимость объекта превышает лимит кэша, то
+объект добавлен не будет (а ранее хранимый по этому ключу - удалится).
+
+@param object добавляемый объект
+@param key ключ объекта
+@param cost стоимость объекта (размер в байтах)
+*/
+- (void)setObject:(id)object
+           forKey:(id)key
+             cost:(NSUInteger)cost;
+
+/** Добавляет объект в кэш, только если по этому ключу объекта ещё нет.
+Проверка и добавление выполняются атомарно.
+
+@param object добавляемый объект
+@param key ключ объекта
+@param cost стоимость объекта (размер в байтах)
+@return YES, если объект добавлен
+*/
+- (BOOL)addObject:(id)object
+           forKey:(id)key
+             cost:(NSUInteger)cost;
+
+/** Удаляет объект по ключу
+
+@param key ключ объекта
+*/
+- (void)removeObjectForKey:(id)key;
+
+/** Удаляет все объекты
+*/
+- (void)removeAllObjects;
+
+@end
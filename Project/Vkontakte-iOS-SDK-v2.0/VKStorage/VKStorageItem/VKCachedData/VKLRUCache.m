@@ -0,0 +1,312 @@
+//
+// Created by AndrewShmig on 10/16/13.
+//
+// Copyright (c) 2013 Andrew Shmig
+// 
+// Permission is hereby granted, free of charge, to any person 
+// obtaining a copy of this software and associated documentation 
+// files (the "Software"), to deal in the Software without 
+// restriction, including without limitation the rights to use, 
+// copy, modify, merge, publish, distribute, sublicense, and/or 
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following 
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+// FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN 
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+// THE SOFTWARE.
+#import "VKLRUCache.h"
+
+
+/** Элемент двусвязного списка, определяющего порядок вытеснения
+*/
+@interface VKLRUCacheNode : NSObject
+
+@property (nonatomic, strong) id key;
+@property (nonatomic, strong) id object;
+@property (nonatomic, assign) NSUInteger cost;
+
+@property (nonatomic, strong) VKLRUCacheNode *next;
+@property (nonatomic, unsafe_unretained) VKLRUCacheNode *prev;
+
+@end
+
+@implementation VKLRUCacheNode
+@end
+
+
+@implementation VKLRUCache
+{
+    NSMutableDictionary *_nodes;
+
+//    голова списка - самый "свежий" объект, хвост - кандидат на вытеснение
+    VKLRUCacheNode *_head;
+    VKLRUCacheNode *_tail;
+
+    NSUInteger _totalCost;
+
+    dispatch_queue_t _lockQueue;
+}
+
+#pragma mark Visible VKLRUCache methods
+#pragma mark - Init methods
+
+- (instancetype)initWithTotalCostLimit:(NSUInteger)totalCostLimit
+{
+    self = [super init];
+
+    if (self) {
+        _nodes = [[NSMutableDictionary alloc] init];
+        _totalCostLimit = totalCostLimit;
+        _totalCost = 0;
+        _lockQueue = dispatch_queue_create("com.vk.lrucache", DISPATCH_QUEUE_SERIAL);
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+//    разрываем сильные ссылки в списке явно, чтобы не вызвать рекурсивное
+//    освобождение длинной цепочки узлов
+    while (nil != _head) {
+        VKLRUCacheNode *next = _head.next;
+        _head.next = nil;
+        _head = next;
+    }
+}
+
+#pragma mark - Getters & Setters
+
+- (NSUInteger)totalCost
+{
+    __block NSUInteger totalCost;
+
+    dispatch_sync(_lockQueue, ^
+    {
+        totalCost = _totalCost;
+    });
+
+    return totalCost;
+}
+
+- (NSUInteger)count
+{
+    __block NSUInteger count;
+
+    dispatch_sync(_lockQueue, ^
+    {
+        count = [_nodes count];
+    });
+
+    return count;
+}
+
+- (NSUInteger)totalCostLimit
+{
+    __block NSUInteger totalCostLimit;
+
+    dispatch_sync(_lockQueue, ^
+    {
+        totalCostLimit = _totalCostLimit;
+    });
+
+    return totalCostLimit;
+}
+
+- (void)setTotalCostLimit:(NSUInteger)totalCostLimit
+{
+    dispatch_sync(_lockQueue, ^
+    {
+        _totalCostLimit = totalCostLimit;
+        [self trimToCostLimit];
+    });
+}
+
+#pragma mark - Cache manipulation
+
+- (id)objectForKey:(id)key
+{
+    if (nil == key)
+        return nil;
+
+    __block id object = nil;
+
+    dispatch_sync(_lockQueue, ^
+    {
+        VKLRUCacheNode *node = _nodes[key];
+
+        if (nil == node)
+            return;
+
+        [self moveNodeToHead:node];
+        object = node.object;
+    });
+
+    return object;
+}
+
+- (void)setObject:(id)object
+           forKey:(id)key
+             cost:(NSUInteger)cost
+{
+    if (nil == key)
+        return;
+
+    if (nil == object) {
+        [self removeObjectForKey:key];
+        return;
+    }
+
+    dispatch_sync(_lockQueue, ^
+    {
+        VKLRUCacheNode *node = _nodes[key];
+
+        if (nil != node)
+            [self removeNode:node];
+
+//        объект, который не помещается в кэш целиком, не храним вовсе
+        if (cost > _totalCostLimit)
+            return;
+
+        node = [[VKLRUCacheNode alloc] init];
+        node.key = key;
+        node.object = object;
+        node.cost = cost;
+
+        _nodes[key] = node;
+        _totalCost += cost;
+        [self insertNodeAtHead:node];
+
+        [self trimToCostLimit];
+    });
+}
+
+- (BOOL)addObject:(id)object
+           forKey:(id)key
+             cost:(NSUInteger)cost
+{
+    if (nil == key || nil == object)
+        return NO;
+
+    __block BOOL added = NO;
+
+    dispatch_sync(_lockQueue, ^
+    {
+        if (nil != _nodes[key] || cost > _totalCostLimit)
+            return;
+
+        VKLRUCacheNode *node = [[VKLRUCacheNode alloc] init];
+        node.key = key;
+        node.object = object;
+        node.cost = cost;
+
+        _nodes[key] = node;
+        _totalCost += cost;
+        [self insertNodeAtHead:node];
+
+        [self trimToCostLimit];
+
+        added = YES;
+    });
+
+    return added;
+}
+
+- (void)removeObjectForKey:(id)key
+{
+    if (nil == key)
+        return;
+
+    dispatch_sync(_lockQueue, ^
+    {
+        VKLRUCacheNode *node = _nodes[key];
+
+        if (nil != node)
+            [self removeNode:node];
+    });
+}
+
+- (void)removeAllObjects
+{
+    dispatch_sync(_lockQueue, ^
+    {
+        while (nil != _head) {
+            VKLRUCacheNode *next = _head.next;
+            _head.next = nil;
+            _head = next;
+        }
+
+        _tail = nil;
+        _totalCost = 0;
+        [_nodes removeAllObjects];
+    });
+}
+
+#pragma mark - Private methods
+// все методы ниже должны вызываться только из _lockQueue
+
+- (void)trimToCostLimit
+{
+    while (_totalCost > _totalCostLimit && nil != _tail)
+        [self removeNode:_tail];
+}
+
+- (void)insertNodeAtHead:(VKLRUCacheNode *)node
+{
+    node.prev = nil;
+    node.next = _head;
+
+    if (nil != _head)
+        _head.prev = node;
+
+    _head = node;
+
+    if (nil == _tail)
+        _tail = node;
+}
+
+- (void)unlinkNode:(VKLRUCacheNode *)node
+{
+    if (nil != node.prev)
+        node.prev.next = node.next;
+    else
+        _head = node.next;
+
+    if (nil != node.next)
+        node.next.prev = node.prev;
+    else
+        _tail = node.prev;
+
+    node.prev = nil;
+    node.next = nil;
+}
+
+- (void)moveNodeToHead:(VKLRUCacheNode *)node
+{
+    if (_head == node)
+        return;
+
+    [self unlinkNode:node];
+    [self insertNodeAtHead:node];
+}
+
+- (void)removeNode:(VKLRUCacheNode *)node
+{
+//    удерживаем узел до конца метода - после unlink на него может не остаться ссылок
+    VKLRUCacheNode *removedNode = node;
+
+    [self unlinkNode:removedNode];
+    [_nodes removeObjectForKey:removedNode.key];
+    _totalCost -= removedNode.cost;
+}
+
+@end
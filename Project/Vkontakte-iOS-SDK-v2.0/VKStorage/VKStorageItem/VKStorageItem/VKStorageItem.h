@@ -56,4 +56,13 @@
 - (instancetype)initWithAccessToken:(VKAccessToken *)token
                     mainCacheStoragePath:(NSString *)path;
 
+/**
+@name Прогрев кэша
+*/
+/** Асинхронно загружает в оперативную память записи кэша, к которым чаще всего
+обращались в начале предыдущих сеансов работы ("горячий" набор, см. VKCachedData
+warmUpHotSet). Вызывается автоматически при активации пользователя.
+*/
+- (void)warmUpCachedData;
+
 @end
\ No newline at end of file
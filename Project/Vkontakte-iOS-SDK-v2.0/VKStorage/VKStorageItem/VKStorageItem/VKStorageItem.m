@@ -57,4 +57,13 @@
     return nil;
 }
 
+#pragma mark - Cache warm up
+
+- (void)warmUpCachedData
+{
+    INFO_LOG();
+
+    [_cachedData warmUpHotSet];
+}
+
 @end
\ No newline at end of file
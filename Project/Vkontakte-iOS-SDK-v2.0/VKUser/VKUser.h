@@ -26,6 +26,10 @@
 //
 #import <Foundation/Foundation.h>
 #import "VKCachedData.h"
+#import "VKCacheTagRules.h"
+#import "VKCachePolicy.h"
+#import "VKRequestBatcher.h"
+#import "VKRequestRetryPolicy.h"
 
 
 @class VKAccessToken;
@@ -99,6 +103,48 @@
 */
 @property (nonatomic, assign, readwrite) BOOL offlineMode;
 
+/** Таблица политик кэширования методов API: время жизни кэша, время использования
+устаревших данных, хранение в общем кэше и приоритет запросов. Применяется ко всем
+создаваемым запросам, изменения таблицы во время работы приложения учитываются
+последующими запросами. Кэшируемость ответов изменяющих методов определяется
+только таблицей (см. VKCachePolicyTable mutatingMethodPolicy). По умолчанию -
+[VKCachePolicyTable defaultTable].
+*/
+@property (nonatomic, strong, readwrite) VKCachePolicyTable *cachePolicyTable;
+
+/** Таблица правил тегов кэша. По ней ответы запросов помечаются тегами (см.
+VKRequest cacheTags), а запросы к изменяющим методам API (wall.post, friends.add
+etc) после успешного выполнения удаляют из кэша затронутые ими ответы (см.
+VKRequest invalidatedCacheTags). Запросы к изменяющим методам не идемпотентны
+и потому не кэшируются (см. VKRequest idempotent).
+По умолчанию - [VKCacheTagRules defaultRules].
+*/
+@property (nonatomic, strong, readwrite) VKCacheTagRules *cacheTagRules;
+
+/** Политика повторения запросов при временных сбоях (см. VKRequest retryPolicy),
+либо nil - запросы не повторяются. Запросы к изменяющим методам API повторяются
+лишь в том случае, если сервер их точно не выполнял. По умолчанию -
+[VKRequestRetryPolicy defaultPolicy].
+*/
+@property (nonatomic, strong, readwrite) VKRequestRetryPolicy *retryPolicy;
+
+/** Планировщик пакетного выполнения запросов, либо nil (по умолчанию). Если
+планировщик задан, то запросы, выполненные в течение его batchInterval, отправляются
+на сервер одним запросом к методу execute (до 25 вызовов), а каждый запрос
+получает свой ответ через делегата:
+
+    [VKUser currentUser].requestBatcher = [[VKRequestBatcher alloc] init];
+
+    // три вызова - один запрос к серверу
+    [[VKUser currentUser] info];
+    [[VKUser currentUser] wallGetWithCustomOptions:@{@"count": @"10"}];
+    [[VKUser currentUser] photosGetTagsWithCustomOptions:@{@"photo_id": @"1"}];
+
+Ответы, найденные в кэше, возвращаются без обращения к серверу и в пакет не
+попадают.
+*/
+@property (nonatomic, strong, readwrite) VKRequestBatcher *requestBatcher;
+
 /**
 @name Методы класса
 */
@@ -48,6 +48,12 @@
         _storageItem = storageItem;
         _startAllRequestsImmediately = YES;
         _offlineMode = NO;
+        _cachePolicyTable = [VKCachePolicyTable defaultTable];
+        _cacheTagRules = [VKCacheTagRules defaultRules];
+        _retryPolicy = [VKRequestRetryPolicy defaultPolicy];
+
+//        данные, нужные сразу после запуска, загружаем в память заранее
+        [_storageItem warmUpCachedData];
     }
 
     return self;
@@ -829,6 +835,26 @@ static VKUser *_currentUser;
     req.signature = NSStringFromSelector(selector);
     req.offlineMode = self.offlineMode;
     req.delegate = self.delegate;
+    req.batcher = self.requestBatcher;
+    req.retryPolicy = self.retryPolicy;
+
+//    время жизни кэша, хранение в общем кэше и приоритет определяются методом
+    [[self.cachePolicyTable policyForMethod:methodName] applyToRequest:req];
+
+//    владельцем данных, если он не указан в параметрах, считается текущий пользователь
+    NSUInteger userID = self.accessToken.userID;
+    req.cacheTags = [self.cacheTagRules tagsForMethod:methodName
+                                              options:options
+                                               userID:userID];
+    req.invalidatedCacheTags = [self.cacheTagRules invalidatedTagsForMethod:methodName
+                                                                    options:options
+                                                                     userID:userID];
+
+//    запрос к изменяющему методу нельзя повторить, если неизвестно, выполнил ли
+//    его сервер; правила тегов лишь дополняют список изменяющих методов
+//    (см. VKRequest isMutatingMethod:), кэшируемость определяет таблица политик
+    if ([self.cacheTagRules isMutatingMethod:methodName])
+        req.idempotent = NO;
 
     if (self.startAllRequestsImmediately)
         [req start];